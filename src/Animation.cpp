@@ -0,0 +1,922 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+static const char kMagic[4] = { 'A', 'N', 'I', 'M' };
+static const uint32_t kVersion = 1;
+
+struct AnimationClipHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numJoints;
+	uint32_t numFrames;
+	float frameRate;
+};
+
+// local matrices are built as 12 arrays of padded joints, element (row, column) in array row * 4 + column
+static const int kLocalMatrixStreams = 12;
+
+static int PadJoints(int joints)
+{
+	return (joints + 7) & ~7;
+}
+
+template <typename T>
+static void Write(std::ofstream& file, const T& value)
+{
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool Read(std::ifstream& file, T& value)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+static void WriteArray(std::ofstream& file, const std::vector<T>& values)
+{
+	file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+static bool ReadArray(std::ifstream& file, std::vector<T>& values)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)));
+}
+
+JointMatrix MakeJointMatrix(const glm::mat4& m)
+{
+	JointMatrix result;
+	for (int r = 0; r < 3; r++)
+	{
+		result.rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	}
+	return result;
+}
+
+JointMatrix MakeJointMatrix(const glm::quat& rotation, const glm::vec3& translation)
+{
+	glm::mat3 m = glm::mat3_cast(rotation);
+	JointMatrix result;
+	for (int r = 0; r < 3; r++)
+	{
+		result.rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], translation[r]);
+	}
+	return result;
+}
+
+glm::mat4 ToMat4(const JointMatrix& m)
+{
+	return glm::transpose(glm::mat4(m.rows[0], m.rows[1], m.rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
+
+JointMatrix MultiplyJointMatrices(const JointMatrix& a, const JointMatrix& b)
+{
+	JointMatrix result;
+	for (int r = 0; r < 3; r++)
+	{
+		const glm::vec4& row = a.rows[r];
+		result.rows[r] = row.x * b.rows[0] + row.y * b.rows[1] + row.z * b.rows[2] + glm::vec4(0.0f, 0.0f, 0.0f, row.w);
+	}
+	return result;
+}
+
+JointMatrix InverseJointMatrix(const JointMatrix& m)
+{
+	// rigid transforms only: the inverse rotation is the transpose
+	glm::vec3 t(m.rows[0].w, m.rows[1].w, m.rows[2].w);
+	JointMatrix result;
+	for (int r = 0; r < 3; r++)
+	{
+		glm::vec3 column(m.rows[0][r], m.rows[1][r], m.rows[2][r]);
+		result.rows[r] = glm::vec4(column, -glm::dot(column, t));
+	}
+	return result;
+}
+
+void Pose::Resize(int joints)
+{
+	numJoints = joints;
+	paddedJoints = PadJoints(joints);
+	data.assign(NumStreams * paddedJoints, 0.0f);
+	std::fill_n(Stream(RotationW), paddedJoints, 1.0f);
+}
+
+void Pose::SetJoint(int joint, const glm::quat& rotation, const glm::vec3& translation)
+{
+	Stream(RotationX)[joint] = rotation.x;
+	Stream(RotationY)[joint] = rotation.y;
+	Stream(RotationZ)[joint] = rotation.z;
+	Stream(RotationW)[joint] = rotation.w;
+	Stream(TranslationX)[joint] = translation.x;
+	Stream(TranslationY)[joint] = translation.y;
+	Stream(TranslationZ)[joint] = translation.z;
+}
+
+glm::quat Pose::GetRotation(int joint) const
+{
+	return glm::quat(Stream(RotationW)[joint], Stream(RotationX)[joint], Stream(RotationY)[joint], Stream(RotationZ)[joint]);
+}
+
+glm::vec3 Pose::GetTranslation(int joint) const
+{
+	return glm::vec3(Stream(TranslationX)[joint], Stream(TranslationY)[joint], Stream(TranslationZ)[joint]);
+}
+
+int Skeleton::AddJoint(int parent, const glm::quat& bindRotation, const glm::vec3& bindTranslation)
+{
+	int joint = GetNumJoints();
+	if (joint >= kMaxJoints || parent >= joint)
+		return -1;
+
+	m_parents.push_back(parent < 0 ? -1 : parent);
+	m_bindRotations.push_back(glm::normalize(bindRotation));
+	m_bindTranslations.push_back(bindTranslation);
+	return joint;
+}
+
+void Skeleton::Finalize()
+{
+	int numJoints = GetNumJoints();
+	m_bindPose.Resize(numJoints);
+
+	std::vector<JointMatrix> model(numJoints);
+	m_inverseBind.resize(numJoints);
+	for (int i = 0; i < numJoints; i++)
+	{
+		m_bindPose.SetJoint(i, m_bindRotations[i], m_bindTranslations[i]);
+
+		JointMatrix local = MakeJointMatrix(m_bindRotations[i], m_bindTranslations[i]);
+		model[i] = m_parents[i] < 0 ? local : MultiplyJointMatrices(model[m_parents[i]], local);
+		m_inverseBind[i] = InverseJointMatrix(model[i]);
+	}
+}
+
+static int16_t QuantizeSnorm16(float v)
+{
+	return static_cast<int16_t>(roundf(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f));
+}
+
+void AnimationClip::Build(const std::vector<Pose>& frames, float frameRate)
+{
+	m_numFrames = (int)frames.size();
+	m_numJoints = frames.empty() ? 0 : frames[0].numJoints;
+	m_paddedJoints = PadJoints(m_numJoints);
+	m_frameRate = frameRate;
+
+	const int n = m_paddedJoints;
+
+	// each joint's translation range over the clip, so a joint that barely moves keeps its precision
+	m_translationMin.assign(3 * n, 0.0f);
+	m_translationScale.assign(3 * n, 0.0f);
+	for (int c = 0; c < 3; c++)
+	{
+		for (int j = 0; j < m_numJoints; j++)
+		{
+			float lo = FLT_MAX;
+			float hi = -FLT_MAX;
+			for (const Pose& frame : frames)
+			{
+				float value = frame.Stream(Pose::TranslationX + c)[j];
+				lo = std::min(lo, value);
+				hi = std::max(hi, value);
+			}
+			m_translationMin[c * n + j] = lo;
+			m_translationScale[c * n + j] = (hi - lo) / 65535.0f;
+		}
+	}
+
+	m_rotations.assign((size_t)m_numFrames * 4 * n, 0);
+	m_translations.assign((size_t)m_numFrames * 3 * n, 0);
+	for (int f = 0; f < m_numFrames; f++)
+	{
+		const Pose& frame = frames[f];
+		int16_t* rotations = &m_rotations[(size_t)f * 4 * n];
+		uint16_t* translations = &m_translations[(size_t)f * 3 * n];
+
+		// padding joints stay identity
+		std::fill_n(rotations + 3 * n, n, (int16_t)32767);
+
+		for (int j = 0; j < m_numJoints; j++)
+		{
+			glm::quat q = glm::normalize(frame.GetRotation(j));
+			rotations[0 * n + j] = QuantizeSnorm16(q.x);
+			rotations[1 * n + j] = QuantizeSnorm16(q.y);
+			rotations[2 * n + j] = QuantizeSnorm16(q.z);
+			rotations[3 * n + j] = QuantizeSnorm16(q.w);
+
+			for (int c = 0; c < 3; c++)
+			{
+				float scale = m_translationScale[c * n + j];
+				float key = scale > 0.0f ? (frame.Stream(Pose::TranslationX + c)[j] - m_translationMin[c * n + j]) / scale : 0.0f;
+				translations[c * n + j] = static_cast<uint16_t>(std::min(std::max(key + 0.5f, 0.0f), 65535.0f));
+			}
+		}
+	}
+}
+
+size_t AnimationClip::GetSizeBytes() const
+{
+	return m_rotations.size() * sizeof(int16_t) + m_translations.size() * sizeof(uint16_t) +
+		(m_translationMin.size() + m_translationScale.size()) * sizeof(float);
+}
+
+size_t AnimationClip::GetUncompressedSizeBytes() const
+{
+	return (size_t)m_numFrames * m_numJoints * Pose::NumStreams * sizeof(float);
+}
+
+bool AnimationClip::Save(const char* path) const
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << " for writing\n";
+		return false;
+	}
+
+	AnimationClipHeader header;
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.numJoints = static_cast<uint32_t>(m_numJoints);
+	header.numFrames = static_cast<uint32_t>(m_numFrames);
+	header.frameRate = m_frameRate;
+	Write(file, header);
+
+	WriteArray(file, m_translationMin);
+	WriteArray(file, m_translationScale);
+	WriteArray(file, m_rotations);
+	WriteArray(file, m_translations);
+
+	if (!file)
+	{
+		std::cerr << "Failed to write " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool AnimationClip::Load(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << "\n";
+		return false;
+	}
+
+	AnimationClipHeader header;
+	if (!Read(file, header) || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+		header.numJoints > (uint32_t)kMaxJoints || header.numFrames == 0 || header.frameRate <= 0.0f)
+	{
+		std::cerr << "Not an animation clip: " << path << "\n";
+		return false;
+	}
+
+	// the key arrays' size follows from the header, check it against the file before allocating them
+	const uint64_t padded = (uint64_t)PadJoints((int)header.numJoints);
+	const uint64_t expectedBytes = 6 * padded * sizeof(float) + (uint64_t)header.numFrames * padded * (4 * sizeof(int16_t) + 3 * sizeof(uint16_t));
+	std::streamoff dataStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	std::streamoff dataEnd = file.tellg();
+	file.seekg(dataStart);
+	if (dataStart < 0 || dataEnd < dataStart || (uint64_t)(dataEnd - dataStart) != expectedBytes)
+	{
+		std::cerr << "Not an animation clip: " << path << "\n";
+		return false;
+	}
+
+	m_numJoints = (int)header.numJoints;
+	m_paddedJoints = PadJoints(m_numJoints);
+	m_numFrames = (int)header.numFrames;
+	m_frameRate = header.frameRate;
+
+	const size_t n = m_paddedJoints;
+	m_translationMin.resize(3 * n);
+	m_translationScale.resize(3 * n);
+	m_rotations.resize(m_numFrames * 4 * n);
+	m_translations.resize(m_numFrames * 3 * n);
+
+	if (!ReadArray(file, m_translationMin) || !ReadArray(file, m_translationScale) || !ReadArray(file, m_rotations) || !ReadArray(file, m_translations))
+	{
+		std::cerr << "Truncated animation clip: " << path << "\n";
+		m_numJoints = m_paddedJoints = m_numFrames = 0;
+		return false;
+	}
+	return true;
+}
+
+// the two keys a sample time falls between, and how far along
+struct SampleKeys
+{
+	const int16_t* rotations0;
+	const int16_t* rotations1;
+	const uint16_t* translations0;
+	const uint16_t* translations1;
+	const float* translationMin;
+	const float* translationScale;
+	float alpha;
+	int paddedJoints;
+};
+
+static SampleKeys FindKeys(const AnimationClip& clip, float time)
+{
+	int numFrames = clip.GetNumFrames();
+	float frameTime = fmodf(time * clip.GetFrameRate(), (float)numFrames);
+	if (frameTime < 0.0f)
+		frameTime += numFrames;
+
+	int frame0 = std::min((int)frameTime, numFrames - 1);
+	int frame1 = frame0 + 1 < numFrames ? frame0 + 1 : 0;
+
+	SampleKeys keys;
+	keys.rotations0 = clip.GetRotationKeys(frame0);
+	keys.rotations1 = clip.GetRotationKeys(frame1);
+	keys.translations0 = clip.GetTranslationKeys(frame0);
+	keys.translations1 = clip.GetTranslationKeys(frame1);
+	keys.translationMin = clip.GetTranslationMin();
+	keys.translationScale = clip.GetTranslationScale();
+	keys.alpha = std::min(std::max(frameTime - frame0, 0.0f), 1.0f);
+	keys.paddedJoints = clip.GetPaddedJoints();
+	return keys;
+}
+
+// sampling: nlerp between the two rotation keys and lerp between the translation keys. the rotation keys are
+// used as integers, normalizing afterwards takes care of the snorm scale
+
+static void SampleScalar(const SampleKeys& k, Pose& out)
+{
+	const int n = k.paddedJoints;
+	for (int j = 0; j < n; j++)
+	{
+		float q0[4], q1[4];
+		float dot = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = k.rotations0[c * n + j];
+			q1[c] = k.rotations1[c * n + j];
+			dot += q0[c] * q1[c];
+		}
+
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float q[4];
+		float lengthSq = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			q[c] = q0[c] + (q1[c] * sign - q0[c]) * k.alpha;
+			lengthSq += q[c] * q[c];
+		}
+
+		float invLength = 1.0f / sqrtf(lengthSq);
+		for (int c = 0; c < 4; c++)
+		{
+			out.Stream(Pose::RotationX + c)[j] = q[c] * invLength;
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			float t0 = k.translations0[c * n + j];
+			float t1 = k.translations1[c * n + j];
+			out.Stream(Pose::TranslationX + c)[j] = k.translationMin[c * n + j] + k.translationScale[c * n + j] * (t0 + (t1 - t0) * k.alpha);
+		}
+	}
+}
+
+static void BlendScalar(const Pose& a, const Pose& b, float weight, Pose& out)
+{
+	const int n = a.paddedJoints;
+	for (int j = 0; j < n; j++)
+	{
+		float dot = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			dot += a.Stream(Pose::RotationX + c)[j] * b.Stream(Pose::RotationX + c)[j];
+		}
+
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		float q[4];
+		float lengthSq = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			float q0 = a.Stream(Pose::RotationX + c)[j];
+			q[c] = q0 + (b.Stream(Pose::RotationX + c)[j] * sign - q0) * weight;
+			lengthSq += q[c] * q[c];
+		}
+
+		float invLength = 1.0f / sqrtf(lengthSq);
+		for (int c = 0; c < 4; c++)
+		{
+			out.Stream(Pose::RotationX + c)[j] = q[c] * invLength;
+		}
+
+		for (int c = Pose::TranslationX; c <= Pose::TranslationZ; c++)
+		{
+			float t0 = a.Stream(c)[j];
+			out.Stream(c)[j] = t0 + (b.Stream(c)[j] - t0) * weight;
+		}
+	}
+}
+
+static void LocalMatricesScalar(const Pose& pose, float* local)
+{
+	const int n = pose.paddedJoints;
+	for (int j = 0; j < n; j++)
+	{
+		float x = pose.Stream(Pose::RotationX)[j];
+		float y = pose.Stream(Pose::RotationY)[j];
+		float z = pose.Stream(Pose::RotationZ)[j];
+		float w = pose.Stream(Pose::RotationW)[j];
+
+		local[0 * n + j] = 1.0f - 2.0f * (y * y + z * z);
+		local[1 * n + j] = 2.0f * (x * y - w * z);
+		local[2 * n + j] = 2.0f * (x * z + w * y);
+		local[3 * n + j] = pose.Stream(Pose::TranslationX)[j];
+		local[4 * n + j] = 2.0f * (x * y + w * z);
+		local[5 * n + j] = 1.0f - 2.0f * (x * x + z * z);
+		local[6 * n + j] = 2.0f * (y * z - w * x);
+		local[7 * n + j] = pose.Stream(Pose::TranslationY)[j];
+		local[8 * n + j] = 2.0f * (x * z - w * y);
+		local[9 * n + j] = 2.0f * (y * z + w * x);
+		local[10 * n + j] = 1.0f - 2.0f * (x * x + y * y);
+		local[11 * n + j] = pose.Stream(Pose::TranslationZ)[j];
+	}
+}
+
+static JointMatrix GetLocalMatrix(const float* local, int n, int joint)
+{
+	JointMatrix m;
+	for (int r = 0; r < 3; r++)
+	{
+		m.rows[r] = glm::vec4(local[(r * 4 + 0) * n + joint], local[(r * 4 + 1) * n + joint],
+			local[(r * 4 + 2) * n + joint], local[(r * 4 + 3) * n + joint]);
+	}
+	return m;
+}
+
+static void HierarchyScalar(const Skeleton& skeleton, const float* local, int n, const JointMatrix& world, JointMatrix* outJoints, JointMatrix* outPalette)
+{
+	const int* parents = skeleton.GetParents();
+	const JointMatrix* inverseBind = skeleton.GetInverseBind();
+	for (int j = 0; j < skeleton.GetNumJoints(); j++)
+	{
+		const JointMatrix& parent = parents[j] < 0 ? world : outJoints[parents[j]];
+		outJoints[j] = MultiplyJointMatrices(parent, GetLocalMatrix(local, n, j));
+		outPalette[j] = MultiplyJointMatrices(outJoints[j], inverseBind[j]);
+	}
+}
+
+#if defined(CPU_X86)
+
+// q = normalize(q0 + (q1 * sign(dot) - q0) * alpha) for 4 joints, one register per component
+static inline void NlerpSse(const __m128 q0[4], const __m128 q1[4], __m128 alpha, __m128 out[4])
+{
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q0[0], q1[0]), _mm_mul_ps(q0[1], q1[1])),
+		_mm_add_ps(_mm_mul_ps(q0[2], q1[2]), _mm_mul_ps(q0[3], q1[3])));
+	// the sign bit of every lane where the keys are in opposite hemispheres
+	__m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+
+	__m128 lengthSq = _mm_setzero_ps();
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 target = _mm_xor_ps(q1[c], flip);
+		out[c] = _mm_add_ps(q0[c], _mm_mul_ps(_mm_sub_ps(target, q0[c]), alpha));
+		lengthSq = _mm_add_ps(lengthSq, _mm_mul_ps(out[c], out[c]));
+	}
+
+	// rsqrt is 12 bits, one Newton step brings it to about 22
+	__m128 r = _mm_rsqrt_ps(lengthSq);
+	r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(lengthSq, r), r)));
+	for (int c = 0; c < 4; c++)
+	{
+		out[c] = _mm_mul_ps(out[c], r);
+	}
+}
+
+static inline __m128 LoadSnorm16Sse(const int16_t* p)
+{
+	__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+static inline __m128 LoadUnorm16Sse(const uint16_t* p)
+{
+	__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+static void SampleSse(const SampleKeys& k, Pose& out)
+{
+	const int n = k.paddedJoints;
+	const __m128 alpha = _mm_set1_ps(k.alpha);
+	for (int j = 0; j < n; j += 4)
+	{
+		__m128 q0[4], q1[4], q[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = LoadSnorm16Sse(&k.rotations0[c * n + j]);
+			q1[c] = LoadSnorm16Sse(&k.rotations1[c * n + j]);
+		}
+		NlerpSse(q0, q1, alpha, q);
+		for (int c = 0; c < 4; c++)
+		{
+			_mm_storeu_ps(&out.Stream(Pose::RotationX + c)[j], q[c]);
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 t0 = LoadUnorm16Sse(&k.translations0[c * n + j]);
+			__m128 t1 = LoadUnorm16Sse(&k.translations1[c * n + j]);
+			__m128 key = _mm_add_ps(t0, _mm_mul_ps(_mm_sub_ps(t1, t0), alpha));
+			__m128 t = _mm_add_ps(_mm_loadu_ps(&k.translationMin[c * n + j]), _mm_mul_ps(_mm_loadu_ps(&k.translationScale[c * n + j]), key));
+			_mm_storeu_ps(&out.Stream(Pose::TranslationX + c)[j], t);
+		}
+	}
+}
+
+static void BlendSse(const Pose& a, const Pose& b, float weight, Pose& out)
+{
+	const int n = a.paddedJoints;
+	const __m128 alpha = _mm_set1_ps(weight);
+	for (int j = 0; j < n; j += 4)
+	{
+		__m128 q0[4], q1[4], q[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = _mm_loadu_ps(&a.Stream(Pose::RotationX + c)[j]);
+			q1[c] = _mm_loadu_ps(&b.Stream(Pose::RotationX + c)[j]);
+		}
+		NlerpSse(q0, q1, alpha, q);
+		for (int c = 0; c < 4; c++)
+		{
+			_mm_storeu_ps(&out.Stream(Pose::RotationX + c)[j], q[c]);
+		}
+
+		for (int c = Pose::TranslationX; c <= Pose::TranslationZ; c++)
+		{
+			__m128 t0 = _mm_loadu_ps(&a.Stream(c)[j]);
+			__m128 t1 = _mm_loadu_ps(&b.Stream(c)[j]);
+			_mm_storeu_ps(&out.Stream(c)[j], _mm_add_ps(t0, _mm_mul_ps(_mm_sub_ps(t1, t0), alpha)));
+		}
+	}
+}
+
+static void LocalMatricesSse(const Pose& pose, float* local)
+{
+	const int n = pose.paddedJoints;
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	for (int j = 0; j < n; j += 4)
+	{
+		__m128 x = _mm_loadu_ps(&pose.Stream(Pose::RotationX)[j]);
+		__m128 y = _mm_loadu_ps(&pose.Stream(Pose::RotationY)[j]);
+		__m128 z = _mm_loadu_ps(&pose.Stream(Pose::RotationZ)[j]);
+		__m128 w = _mm_loadu_ps(&pose.Stream(Pose::RotationW)[j]);
+
+		__m128 x2 = _mm_mul_ps(x, two);
+		__m128 y2 = _mm_mul_ps(y, two);
+		__m128 z2 = _mm_mul_ps(z, two);
+		__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		_mm_storeu_ps(&local[0 * n + j], _mm_sub_ps(one, _mm_add_ps(yy, zz)));
+		_mm_storeu_ps(&local[1 * n + j], _mm_sub_ps(xy, wz));
+		_mm_storeu_ps(&local[2 * n + j], _mm_add_ps(xz, wy));
+		_mm_storeu_ps(&local[3 * n + j], _mm_loadu_ps(&pose.Stream(Pose::TranslationX)[j]));
+		_mm_storeu_ps(&local[4 * n + j], _mm_add_ps(xy, wz));
+		_mm_storeu_ps(&local[5 * n + j], _mm_sub_ps(one, _mm_add_ps(xx, zz)));
+		_mm_storeu_ps(&local[6 * n + j], _mm_sub_ps(yz, wx));
+		_mm_storeu_ps(&local[7 * n + j], _mm_loadu_ps(&pose.Stream(Pose::TranslationY)[j]));
+		_mm_storeu_ps(&local[8 * n + j], _mm_sub_ps(xz, wy));
+		_mm_storeu_ps(&local[9 * n + j], _mm_add_ps(yz, wx));
+		_mm_storeu_ps(&local[10 * n + j], _mm_sub_ps(one, _mm_add_ps(xx, yy)));
+		_mm_storeu_ps(&local[11 * n + j], _mm_loadu_ps(&pose.Stream(Pose::TranslationZ)[j]));
+	}
+}
+
+// a * b for 3x4 rows in registers: each output row is a weighted sum of b's rows, plus a's translation
+static inline void MultiplyRowsSse(const __m128 a[3], const __m128 b[3], __m128 out[3])
+{
+	const __m128 unitW = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	for (int r = 0; r < 3; r++)
+	{
+		__m128 sum = _mm_mul_ps(_mm_shuffle_ps(a[r], a[r], _MM_SHUFFLE(0, 0, 0, 0)), b[0]);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(a[r], a[r], _MM_SHUFFLE(1, 1, 1, 1)), b[1]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(a[r], a[r], _MM_SHUFFLE(2, 2, 2, 2)), b[2]));
+		out[r] = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(a[r], a[r], _MM_SHUFFLE(3, 3, 3, 3)), unitW));
+	}
+}
+
+// the hierarchy is a chain of dependent multiplies, so this goes across the 4 columns of a row rather than
+// across joints. the AVX2 level uses it as well
+static void HierarchySse(const Skeleton& skeleton, const float* local, int n, const JointMatrix& world, JointMatrix* outJoints, JointMatrix* outPalette)
+{
+	const int* parents = skeleton.GetParents();
+	const JointMatrix* inverseBind = skeleton.GetInverseBind();
+	for (int j = 0; j < skeleton.GetNumJoints(); j++)
+	{
+		const JointMatrix& parentMatrix = parents[j] < 0 ? world : outJoints[parents[j]];
+		__m128 parent[3], localRows[3], joint[3], bind[3], palette[3];
+		for (int r = 0; r < 3; r++)
+		{
+			parent[r] = _mm_loadu_ps(&parentMatrix.rows[r].x);
+			localRows[r] = _mm_set_ps(local[(r * 4 + 3) * n + j], local[(r * 4 + 2) * n + j], local[(r * 4 + 1) * n + j], local[(r * 4 + 0) * n + j]);
+			bind[r] = _mm_loadu_ps(&inverseBind[j].rows[r].x);
+		}
+
+		MultiplyRowsSse(parent, localRows, joint);
+		MultiplyRowsSse(joint, bind, palette);
+		for (int r = 0; r < 3; r++)
+		{
+			_mm_storeu_ps(&outJoints[j].rows[r].x, joint[r]);
+			_mm_storeu_ps(&outPalette[j].rows[r].x, palette[r]);
+		}
+	}
+}
+
+CPU_TARGET_AVX2 static inline void NlerpAvx2(const __m256 q0[4], const __m256 q1[4], __m256 alpha, __m256 out[4])
+{
+	__m256 dot = _mm256_mul_ps(q0[0], q1[0]);
+	dot = _mm256_fmadd_ps(q0[1], q1[1], dot);
+	dot = _mm256_fmadd_ps(q0[2], q1[2], dot);
+	dot = _mm256_fmadd_ps(q0[3], q1[3], dot);
+	__m256 flip = _mm256_and_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(-0.0f));
+
+	__m256 lengthSq = _mm256_setzero_ps();
+	for (int c = 0; c < 4; c++)
+	{
+		__m256 target = _mm256_xor_ps(q1[c], flip);
+		out[c] = _mm256_fmadd_ps(_mm256_sub_ps(target, q0[c]), alpha, q0[c]);
+		lengthSq = _mm256_fmadd_ps(out[c], out[c], lengthSq);
+	}
+
+	__m256 r = _mm256_rsqrt_ps(lengthSq);
+	r = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_fnmadd_ps(_mm256_mul_ps(lengthSq, r), r, _mm256_set1_ps(3.0f)));
+	for (int c = 0; c < 4; c++)
+	{
+		out[c] = _mm256_mul_ps(out[c], r);
+	}
+}
+
+CPU_TARGET_AVX2 static inline __m256 LoadSnorm16Avx2(const int16_t* p)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+CPU_TARGET_AVX2 static inline __m256 LoadUnorm16Avx2(const uint16_t* p)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+CPU_TARGET_AVX2 static void SampleAvx2(const SampleKeys& k, Pose& out)
+{
+	const int n = k.paddedJoints;
+	const __m256 alpha = _mm256_set1_ps(k.alpha);
+	for (int j = 0; j < n; j += 8)
+	{
+		__m256 q0[4], q1[4], q[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = LoadSnorm16Avx2(&k.rotations0[c * n + j]);
+			q1[c] = LoadSnorm16Avx2(&k.rotations1[c * n + j]);
+		}
+		NlerpAvx2(q0, q1, alpha, q);
+		for (int c = 0; c < 4; c++)
+		{
+			_mm256_storeu_ps(&out.Stream(Pose::RotationX + c)[j], q[c]);
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 t0 = LoadUnorm16Avx2(&k.translations0[c * n + j]);
+			__m256 t1 = LoadUnorm16Avx2(&k.translations1[c * n + j]);
+			__m256 key = _mm256_fmadd_ps(_mm256_sub_ps(t1, t0), alpha, t0);
+			__m256 t = _mm256_fmadd_ps(_mm256_loadu_ps(&k.translationScale[c * n + j]), key, _mm256_loadu_ps(&k.translationMin[c * n + j]));
+			_mm256_storeu_ps(&out.Stream(Pose::TranslationX + c)[j], t);
+		}
+	}
+}
+
+CPU_TARGET_AVX2 static void BlendAvx2(const Pose& a, const Pose& b, float weight, Pose& out)
+{
+	const int n = a.paddedJoints;
+	const __m256 alpha = _mm256_set1_ps(weight);
+	for (int j = 0; j < n; j += 8)
+	{
+		__m256 q0[4], q1[4], q[4];
+		for (int c = 0; c < 4; c++)
+		{
+			q0[c] = _mm256_loadu_ps(&a.Stream(Pose::RotationX + c)[j]);
+			q1[c] = _mm256_loadu_ps(&b.Stream(Pose::RotationX + c)[j]);
+		}
+		NlerpAvx2(q0, q1, alpha, q);
+		for (int c = 0; c < 4; c++)
+		{
+			_mm256_storeu_ps(&out.Stream(Pose::RotationX + c)[j], q[c]);
+		}
+
+		for (int c = Pose::TranslationX; c <= Pose::TranslationZ; c++)
+		{
+			__m256 t0 = _mm256_loadu_ps(&a.Stream(c)[j]);
+			__m256 t1 = _mm256_loadu_ps(&b.Stream(c)[j]);
+			_mm256_storeu_ps(&out.Stream(c)[j], _mm256_fmadd_ps(_mm256_sub_ps(t1, t0), alpha, t0));
+		}
+	}
+}
+
+CPU_TARGET_AVX2 static void LocalMatricesAvx2(const Pose& pose, float* local)
+{
+	const int n = pose.paddedJoints;
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	for (int j = 0; j < n; j += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&pose.Stream(Pose::RotationX)[j]);
+		__m256 y = _mm256_loadu_ps(&pose.Stream(Pose::RotationY)[j]);
+		__m256 z = _mm256_loadu_ps(&pose.Stream(Pose::RotationZ)[j]);
+		__m256 w = _mm256_loadu_ps(&pose.Stream(Pose::RotationW)[j]);
+
+		__m256 x2 = _mm256_mul_ps(x, two);
+		__m256 y2 = _mm256_mul_ps(y, two);
+		__m256 z2 = _mm256_mul_ps(z, two);
+		__m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+		__m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+		__m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+		_mm256_storeu_ps(&local[0 * n + j], _mm256_sub_ps(one, _mm256_add_ps(yy, zz)));
+		_mm256_storeu_ps(&local[1 * n + j], _mm256_sub_ps(xy, wz));
+		_mm256_storeu_ps(&local[2 * n + j], _mm256_add_ps(xz, wy));
+		_mm256_storeu_ps(&local[3 * n + j], _mm256_loadu_ps(&pose.Stream(Pose::TranslationX)[j]));
+		_mm256_storeu_ps(&local[4 * n + j], _mm256_add_ps(xy, wz));
+		_mm256_storeu_ps(&local[5 * n + j], _mm256_sub_ps(one, _mm256_add_ps(xx, zz)));
+		_mm256_storeu_ps(&local[6 * n + j], _mm256_sub_ps(yz, wx));
+		_mm256_storeu_ps(&local[7 * n + j], _mm256_loadu_ps(&pose.Stream(Pose::TranslationY)[j]));
+		_mm256_storeu_ps(&local[8 * n + j], _mm256_sub_ps(xz, wy));
+		_mm256_storeu_ps(&local[9 * n + j], _mm256_add_ps(yz, wx));
+		_mm256_storeu_ps(&local[10 * n + j], _mm256_sub_ps(one, _mm256_add_ps(xx, yy)));
+		_mm256_storeu_ps(&local[11 * n + j], _mm256_loadu_ps(&pose.Stream(Pose::TranslationZ)[j]));
+	}
+}
+
+#endif
+
+void SamplePose(const AnimationClip& clip, float time, Pose& outPose)
+{
+	SamplePose(GetBestSimdLevel(), clip, time, outPose);
+}
+
+void SamplePose(SimdLevel level, const AnimationClip& clip, float time, Pose& outPose)
+{
+	if (outPose.numJoints != clip.GetNumJoints())
+		outPose.Resize(clip.GetNumJoints());
+	if (clip.GetNumFrames() == 0)
+		return;
+
+	SampleKeys keys = FindKeys(clip, time);
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2: SampleAvx2(keys, outPose); break;
+	case SimdLevel::Sse: SampleSse(keys, outPose); break;
+#endif
+	default: SampleScalar(keys, outPose); break;
+	}
+}
+
+void BlendPoses(const Pose& a, const Pose& b, float weight, Pose& outPose)
+{
+	BlendPoses(GetBestSimdLevel(), a, b, weight, outPose);
+}
+
+void BlendPoses(SimdLevel level, const Pose& a, const Pose& b, float weight, Pose& outPose)
+{
+	if (outPose.numJoints != a.numJoints)
+		outPose.Resize(a.numJoints);
+
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2: BlendAvx2(a, b, weight, outPose); break;
+	case SimdLevel::Sse: BlendSse(a, b, weight, outPose); break;
+#endif
+	default: BlendScalar(a, b, weight, outPose); break;
+	}
+}
+
+void ComputeSkinningPalette(const Skeleton& skeleton, const Pose& pose, const JointMatrix& world, JointMatrix* outJoints, JointMatrix* outPalette)
+{
+	ComputeSkinningPalette(GetBestSimdLevel(), skeleton, pose, world, outJoints, outPalette);
+}
+
+void ComputeSkinningPalette(SimdLevel level, const Skeleton& skeleton, const Pose& pose, const JointMatrix& world,
+	JointMatrix* outJoints, JointMatrix* outPalette)
+{
+	// on the stack, the largest skeleton's local matrices are 12 KB
+	float local[kLocalMatrixStreams * kMaxJoints];
+	const int n = pose.paddedJoints;
+
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2:
+		LocalMatricesAvx2(pose, local);
+		HierarchySse(skeleton, local, n, world, outJoints, outPalette);
+		break;
+	case SimdLevel::Sse:
+		LocalMatricesSse(pose, local);
+		HierarchySse(skeleton, local, n, world, outJoints, outPalette);
+		break;
+#endif
+	default:
+		LocalMatricesScalar(pose, local);
+		HierarchyScalar(skeleton, local, n, world, outJoints, outPalette);
+		break;
+	}
+}
+
+float ValidateAnimationKernels(int numJoints, unsigned int seed)
+{
+	// its own generator, so the result doesn't depend on rand's state and doesn't move it
+	std::mt19937 generator(seed);
+	auto random = [&generator](float range) { return ((float)generator() / (float)std::mt19937::max() * 2.0f - 1.0f) * range; };
+	auto randomPose = [&random](int joints) {
+		Pose pose;
+		pose.Resize(joints);
+		for (int j = 0; j < joints; j++)
+		{
+			glm::quat q = glm::normalize(glm::quat(random(1.0f), random(1.0f), random(1.0f), random(1.0f)));
+			pose.SetJoint(j, q, glm::vec3(random(1.0f), random(1.0f), random(1.0f)));
+		}
+		return pose;
+	};
+
+	Skeleton skeleton;
+	for (int j = 0; j < numJoints; j++)
+	{
+		int parent = j == 0 ? -1 : (int)(generator() % j);
+		skeleton.AddJoint(parent, glm::normalize(glm::quat(1.0f, random(0.3f), random(0.3f), random(0.3f))), glm::vec3(random(1.0f), random(1.0f), random(1.0f)));
+	}
+	skeleton.Finalize();
+
+	std::vector<Pose> frames;
+	for (int f = 0; f < 8; f++)
+	{
+		frames.push_back(randomPose(numJoints));
+	}
+	AnimationClip clip;
+	clip.Build(frames, 30.0f);
+
+	Pose other = randomPose(numJoints);
+	JointMatrix world = MakeJointMatrix(glm::normalize(glm::quat(0.9f, 0.1f, 0.3f, 0.0f)), glm::vec3(10.0f, 0.0f, -5.0f));
+	const float time = 0.123f;
+	const float weight = 0.3f;
+
+	Pose referenceSample, referenceBlend;
+	std::vector<JointMatrix> referenceJoints(numJoints), referencePalette(numJoints);
+	SamplePose(SimdLevel::Scalar, clip, time, referenceSample);
+	BlendPoses(SimdLevel::Scalar, referenceSample, other, weight, referenceBlend);
+	ComputeSkinningPalette(SimdLevel::Scalar, skeleton, referenceBlend, world, referenceJoints.data(), referencePalette.data());
+
+	// rsqrt and fma round differently, so an exact match isn't expected
+	float maxError = 0.0f;
+	const SimdLevel levels[] = { SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		Pose sample, blend;
+		std::vector<JointMatrix> joints(numJoints), palette(numJoints);
+		SamplePose(level, clip, time, sample);
+		BlendPoses(level, sample, other, weight, blend);
+		ComputeSkinningPalette(level, skeleton, blend, world, joints.data(), palette.data());
+
+		for (size_t i = 0; i < sample.data.size(); i++)
+		{
+			maxError = std::max(maxError, fabsf(sample.data[i] - referenceSample.data[i]));
+			maxError = std::max(maxError, fabsf(blend.data[i] - referenceBlend.data[i]));
+		}
+		for (int j = 0; j < numJoints; j++)
+		{
+			for (int r = 0; r < 3; r++)
+			{
+				maxError = std::max(maxError, glm::length(palette[j].rows[r] - referencePalette[j].rows[r]));
+			}
+		}
+	}
+
+	return maxError;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+// skeletal animation data and the kernels that turn it into skinning matrices.
+// skeletons are flat arrays with every parent before its children, so one forward pass resolves the hierarchy.
+// a pose keeps each component of the joints' local transforms in its own array, padded to a multiple of 8
+// joints, and sampling, blending and building local matrices run 4 or 8 joints at a time with SSE/AVX2
+// kernels (scalar elsewhere). clips hold quantized keys at a fixed rate for every joint, so a sample time
+// picks the same two frames for all of them.
+// the end result is the skinning palette: world * model space * inverse bind per joint, as the three rows of
+// an affine matrix, the layout the skinned vertex shader reads
+
+#include "CpuFeatures.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// joint indices are stored as bytes in skinned vertices
+static const int kMaxJoints = 256;
+
+// a 3x4 affine transform as its rows, p' = (dot(rows[0], p), dot(rows[1], p), dot(rows[2], p)) with p.w = 1
+struct JointMatrix
+{
+	glm::vec4 rows[3];
+};
+
+JointMatrix MakeJointMatrix(const glm::mat4& m);
+JointMatrix MakeJointMatrix(const glm::quat& rotation, const glm::vec3& translation);
+glm::mat4 ToMat4(const JointMatrix& m);
+// a * b, b applied first
+JointMatrix MultiplyJointMatrices(const JointMatrix& a, const JointMatrix& b);
+JointMatrix InverseJointMatrix(const JointMatrix& m);
+
+// every joint's rotation (unit quaternion) and translation relative to its parent. no scale
+struct Pose
+{
+	enum Stream
+	{
+		RotationX, RotationY, RotationZ, RotationW,
+		TranslationX, TranslationY, TranslationZ,
+		NumStreams
+	};
+
+	int numJoints = 0;
+	int paddedJoints = 0;
+	std::vector<float> data; // NumStreams arrays of paddedJoints, padding joints are identity
+
+	void Resize(int joints);
+	float* Stream(int stream) { return &data[stream * paddedJoints]; }
+	const float* Stream(int stream) const { return &data[stream * paddedJoints]; }
+
+	void SetJoint(int joint, const glm::quat& rotation, const glm::vec3& translation);
+	glm::quat GetRotation(int joint) const;
+	glm::vec3 GetTranslation(int joint) const;
+};
+
+class Skeleton
+{
+public:
+	// parent is -1 for a root, otherwise an earlier joint. returns the new joint's index, -1 once full
+	int AddJoint(int parent, const glm::quat& bindRotation, const glm::vec3& bindTranslation);
+	// builds the bind pose and inverse bind matrices, after the last AddJoint
+	void Finalize();
+
+	int GetNumJoints() const { return (int)m_parents.size(); }
+	int GetParent(int joint) const { return m_parents[joint]; }
+	const int* GetParents() const { return m_parents.data(); }
+	const JointMatrix* GetInverseBind() const { return m_inverseBind.data(); }
+	const Pose& GetBindPose() const { return m_bindPose; }
+
+private:
+	std::vector<int> m_parents;
+	std::vector<glm::quat> m_bindRotations;
+	std::vector<glm::vec3> m_bindTranslations;
+	std::vector<JointMatrix> m_inverseBind;
+	Pose m_bindPose;
+
+};
+
+// rotations are 4 x snorm16 and translations 3 x unorm16 over each joint's range in the clip, 14 bytes per
+// joint per frame instead of 28. keys are laid out like a pose, one array per component per frame
+class AnimationClip
+{
+public:
+	// frames are poses 1 / frameRate apart. the clip loops, the last frame blends back into the first
+	void Build(const std::vector<Pose>& frames, float frameRate);
+
+	// "ANIM" binary, version 1
+	bool Save(const char* path) const;
+	bool Load(const char* path);
+
+	int GetNumJoints() const { return m_numJoints; }
+	int GetPaddedJoints() const { return m_paddedJoints; }
+	int GetNumFrames() const { return m_numFrames; }
+	float GetFrameRate() const { return m_frameRate; }
+	float GetDuration() const { return m_frameRate > 0.0f ? m_numFrames / m_frameRate : 0.0f; }
+	// key data, and what it would take as float poses
+	size_t GetSizeBytes() const;
+	size_t GetUncompressedSizeBytes() const;
+
+	// 4 arrays of GetPaddedJoints(), x y z w
+	const int16_t* GetRotationKeys(int frame) const { return &m_rotations[(size_t)frame * 4 * m_paddedJoints]; }
+	// 3 arrays of GetPaddedJoints(), translation = min + key * scale per joint and axis
+	const uint16_t* GetTranslationKeys(int frame) const { return &m_translations[(size_t)frame * 3 * m_paddedJoints]; }
+	const float* GetTranslationMin() const { return m_translationMin.data(); }
+	const float* GetTranslationScale() const { return m_translationScale.data(); }
+
+private:
+	int m_numJoints = 0;
+	int m_paddedJoints = 0;
+	int m_numFrames = 0;
+	float m_frameRate = 30.0f;
+
+	std::vector<int16_t> m_rotations;
+	std::vector<uint16_t> m_translations;
+	std::vector<float> m_translationMin;   // 3 arrays of m_paddedJoints
+	std::vector<float> m_translationScale; // same
+
+};
+
+// GetBestSimdLevel's kernel unless one is given. time is in seconds and wraps around the clip.
+// outPose is resized to the clip's joints
+void SamplePose(const AnimationClip& clip, float time, Pose& outPose);
+void SamplePose(SimdLevel level, const AnimationClip& clip, float time, Pose& outPose);
+
+// nlerp from a to b by weight (0 = a), taking the short way round. a and b need the same joint count
+void BlendPoses(const Pose& a, const Pose& b, float weight, Pose& outPose);
+void BlendPoses(SimdLevel level, const Pose& a, const Pose& b, float weight, Pose& outPose);
+
+// local matrices for the whole pose, then the hierarchy pass in joint order. outJoints gets every joint's
+// transform in world space and outPalette world * model * inverse bind, both GetNumJoints() long
+void ComputeSkinningPalette(const Skeleton& skeleton, const Pose& pose, const JointMatrix& world, JointMatrix* outJoints, JointMatrix* outPalette);
+void ComputeSkinningPalette(SimdLevel level, const Skeleton& skeleton, const Pose& pose, const JointMatrix& world,
+	JointMatrix* outJoints, JointMatrix* outPalette);
+
+// runs every supported kernel over random poses and clips and returns the largest difference from the scalar one.
+// the same seed gives the same poses on every platform
+float ValidateAnimationKernels(int numJoints = 67, unsigned int seed = 1234);
@@ -0,0 +1,355 @@
+#include "AnimationBenchmark.h"
+
+#include "Animation.h"
+#include "AnimationSystem.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "SkinnedMeshRenderer.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// a spine out of the root and four limbs hanging off it, 64 joints
+static const int kSpineJoints = 15;
+static const int kLimbJoints = 12;
+static const int kLimbs = 4;
+// the kernels only reorder float math, the palettes are within a few ulps of the scalar ones
+static const float kMaxKernelError = 1e-3f;
+// half the width of the box drawn along each bone
+static const float kBoneRadius = 0.025f;
+
+struct SkinnedResult
+{
+	unsigned int drawCalls;
+	unsigned int uploads;
+	double updateMs;
+	double submitMs;
+	double frameMs;
+};
+
+static Skeleton BuildSkeleton()
+{
+	Skeleton skeleton;
+	int root = skeleton.AddJoint(-1, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	int parent = root;
+	int limbParents[kLimbs];
+	for (int i = 0; i < kSpineJoints; i++)
+	{
+		parent = skeleton.AddJoint(parent, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.05f, 0.0f));
+		if (i == 2)
+			limbParents[0] = limbParents[1] = parent; // legs
+		if (i == 9)
+			limbParents[2] = limbParents[3] = parent; // arms
+	}
+
+	const glm::vec3 directions[kLimbs] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+	const float sides[kLimbs] = { -0.1f, 0.1f, -0.2f, 0.2f };
+	for (int limb = 0; limb < kLimbs; limb++)
+	{
+		parent = skeleton.AddJoint(limbParents[limb], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(sides[limb], 0.0f, 0.0f));
+		for (int i = 1; i < kLimbJoints; i++)
+		{
+			parent = skeleton.AddJoint(parent, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), directions[limb] * 0.07f);
+		}
+	}
+
+	skeleton.Finalize();
+	return skeleton;
+}
+
+// every joint swings around its own axis, out of phase with its neighbours. the root bobs
+static AnimationClip BuildClip(const Skeleton& skeleton, float duration, float amplitude, float frameRate)
+{
+	int numFrames = (int)(duration * frameRate);
+	int numJoints = skeleton.GetNumJoints();
+	const Pose& bindPose = skeleton.GetBindPose();
+
+	std::vector<Pose> frames(numFrames);
+	for (int f = 0; f < numFrames; f++)
+	{
+		float phase = 6.2831853f * f / numFrames;
+		Pose& pose = frames[f];
+		pose.Resize(numJoints);
+		for (int j = 0; j < numJoints; j++)
+		{
+			glm::vec3 axis = glm::normalize(glm::vec3(1.0f, 0.3f * (j % 3), 0.2f * (j % 5) - 0.4f));
+			float angle = amplitude * sinf(phase + j * 0.4f);
+			glm::vec3 translation = bindPose.GetTranslation(j);
+			if (j == 0)
+				translation.y += 0.05f * amplitude * sinf(2.0f * phase);
+			pose.SetJoint(j, bindPose.GetRotation(j) * glm::angleAxis(angle, axis), translation);
+		}
+	}
+
+	AnimationClip clip;
+	clip.Build(frames, frameRate);
+	return clip;
+}
+
+// a box along every bone, from the parent joint's bind position to the joint's. the parent end follows the parent,
+// the other end is split evenly between the two so every vertex there blends two palette matrices
+static int BuildSkinnedMesh(const Skeleton& skeleton, Mesh& mesh)
+{
+	int numJoints = skeleton.GetNumJoints();
+	std::vector<glm::vec3> bindPositions(numJoints);
+	for (int j = 0; j < numJoints; j++)
+	{
+		bindPositions[j] = glm::vec3(glm::inverse(ToMat4(skeleton.GetInverseBind()[j]))[3]);
+	}
+
+	// corner k is at the joint end if bit 0 is set, on the +side if bit 1 is and on the +up if bit 2 is
+	const int faces[6][4] = { { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 4, 5, 1 }, { 2, 6, 7, 3 }, { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };
+
+	std::vector<MeshVertex> vertices;
+	std::vector<VertexSkin> skins;
+	std::vector<unsigned int> indices;
+	for (int j = 0; j < numJoints; j++)
+	{
+		int parent = skeleton.GetParent(j);
+		if (parent < 0)
+			continue;
+
+		glm::vec3 start = bindPositions[parent];
+		glm::vec3 axis = bindPositions[j] - start;
+		float length = glm::length(axis);
+		if (length < 1e-4f)
+			continue;
+		axis /= length;
+		glm::vec3 side = glm::normalize(glm::cross(axis, fabsf(axis.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+		glm::vec3 up = glm::cross(side, axis);
+
+		glm::vec3 corners[8];
+		for (int k = 0; k < 8; k++)
+		{
+			corners[k] = start + axis * ((k & 1) ? length : 0.0f) + side * ((k & 2) ? kBoneRadius : -kBoneRadius) + up * ((k & 4) ? kBoneRadius : -kBoneRadius);
+		}
+
+		glm::vec3 center = start + axis * (length * 0.5f);
+		for (const int* face : faces)
+		{
+			glm::vec3 faceCenter = (corners[face[0]] + corners[face[1]] + corners[face[2]] + corners[face[3]]) * 0.25f;
+			glm::vec3 normal = glm::normalize(faceCenter - center);
+			// counter clockwise seen from outside
+			bool flip = glm::dot(glm::cross(corners[face[1]] - corners[face[0]], corners[face[2]] - corners[face[0]]), normal) < 0.0f;
+
+			unsigned int first = (unsigned int)vertices.size();
+			for (int c = 0; c < 4; c++)
+			{
+				int k = face[c];
+				vertices.push_back({ corners[k], normal, glm::vec2((float)(c == 1 || c == 2), (float)(c >= 2)) });
+
+				VertexSkin skin = { { (uint8_t)parent, (uint8_t)j, 0, 0 }, { 1.0f, 0.0f, 0.0f, 0.0f } };
+				if (k & 1)
+					skin.weights[0] = skin.weights[1] = 0.5f;
+				skins.push_back(skin);
+			}
+
+			const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int i = 0; i < 6; i++)
+			{
+				indices.push_back(first + quad[flip ? 5 - i : i]);
+			}
+		}
+	}
+
+	mesh.LoadFromGeometry(vertices, indices, MakeVertexFormat(PositionEncoding::Float32, NormalEncoding::Float32, TexCoordEncoding::Float32, true), &skins);
+	return (int)indices.size() / 3;
+}
+
+static double RunPass(AnimationSystem& animation, int frames)
+{
+	const float dt = 1.0f / 60.0f;
+	double updateMs = 0.0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		animation.Update(dt);
+		updateMs += animation.GetStats().updateMs;
+	}
+	return updateMs / frames;
+}
+
+// animation update, then every character through SkinnedMeshRenderer, timed to the end of the frame
+static SkinnedResult RunSkinnedPass(SDL_Window* window, AnimationSystem& animation, SkinnedMeshRenderer& renderer, const Mesh& mesh, int frames)
+{
+	SkinnedResult result = {};
+	const float dt = 1.0f / 60.0f;
+
+	// the first few frames include driver warm up, leave them out
+	const int warmupFrames = 10;
+	for (int frame = 0; frame < warmupFrames + frames; frame++)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		animation.Update(dt);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (int i = 0; i < animation.GetNumCharacters(); i++)
+		{
+			renderer.Submit(&mesh, nullptr, animation.GetPalette(i), animation.GetNumJoints(i));
+		}
+		renderer.Render();
+
+		SDL_GL_SwapWindow(window);
+		glFinish();
+
+		auto endTime = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames)
+		{
+			result.drawCalls = renderer.GetStats().drawCalls;
+			result.uploads = renderer.GetStats().uploads;
+			result.updateMs += animation.GetStats().updateMs;
+			result.submitMs += renderer.GetStats().submitMs;
+			result.frameMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+		}
+
+		SDL_PumpEvents();
+	}
+
+	result.updateMs /= frames;
+	result.submitMs /= frames;
+	result.frameMs /= frames;
+	return result;
+}
+
+static void PrintTiming(const char* name, int count, double updateMs)
+{
+	printf("%-20s %10.3f   %10.3f   %s\n", name, updateMs, updateMs * 1000.0 / count, updateMs < 1000.0 / 60.0 ? "yes" : "no");
+}
+
+// the same work as AnimationSystem::Update, one character at a time with each stage timed on its own
+static void PrintStageTimings(const Skeleton& skeleton, const AnimationClip* clips, int count, int frames)
+{
+	SimdLevel level = GetBestSimdLevel();
+	Pose sampleA, sampleB, blended;
+	std::vector<JointMatrix> joints(skeleton.GetNumJoints());
+	std::vector<JointMatrix> palette(skeleton.GetNumJoints());
+	JointMatrix world = MakeJointMatrix(glm::mat4(1.0f));
+
+	double sampleMs = 0.0;
+	double blendMs = 0.0;
+	double paletteMs = 0.0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		float time = frame / 60.0f;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			SamplePose(level, clips[i % 3], time + i * 0.01f, sampleA);
+			SamplePose(level, clips[(i + 1) % 3], time + i * 0.01f, sampleB);
+		}
+		auto sampled = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			BlendPoses(level, sampleA, sampleB, 0.5f, blended);
+		}
+		auto blendedTime = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			ComputeSkinningPalette(level, skeleton, blended, world, joints.data(), palette.data());
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		sampleMs += std::chrono::duration<double, std::milli>(sampled - start).count();
+		blendMs += std::chrono::duration<double, std::milli>(blendedTime - sampled).count();
+		paletteMs += std::chrono::duration<double, std::milli>(end - blendedTime).count();
+	}
+
+	printf("%s stages, 1 thread: sample x2 %.3f ms, blend %.3f ms, palette %.3f ms\n", GetSimdLevelName(level),
+		sampleMs / frames, blendMs / frames, paletteMs / frames);
+}
+
+bool RunAnimationBenchmark(SDL_Window* window, int count, int frames)
+{
+	Skeleton skeleton = BuildSkeleton();
+	AnimationClip clips[3] = {
+		BuildClip(skeleton, 2.0f, 0.1f, 30.0f),  // idle
+		BuildClip(skeleton, 1.0f, 0.5f, 30.0f),  // walk
+		BuildClip(skeleton, 0.6f, 0.9f, 30.0f)   // run
+	};
+
+	AnimationSystem animation;
+	for (int i = 0; i < count; i++)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((i % 32) * 2.0f, 0.0f, (i / 32) * 2.0f));
+		int character = animation.AddCharacter(&skeleton, transform);
+		animation.SetClips(character, &clips[i % 3], &clips[(i + 1) % 3], (i % 7) / 7.0f);
+		animation.SetTime(character, i * 0.137f);
+		animation.SetSpeed(character, 0.8f + (i % 5) * 0.1f);
+	}
+
+	size_t compressed = 0;
+	size_t uncompressed = 0;
+	for (const AnimationClip& clip : clips)
+	{
+		compressed += clip.GetSizeBytes();
+		uncompressed += clip.GetUncompressedSizeBytes();
+	}
+
+	float kernelError = ValidateAnimationKernels();
+	bool kernelsMatch = kernelError <= kMaxKernelError;
+	printf("\n%d characters, %d joints, %d frames\n", count, skeleton.GetNumJoints(), frames);
+	printf("kernels vs scalar: max error %g, %s (tolerance %g)\n", kernelError, kernelsMatch ? "pass" : "FAIL", kMaxKernelError);
+	printf("clips: %.1f KB quantized, %.1f KB as float poses\n", compressed / 1024.0, uncompressed / 1024.0);
+	printf("kernel                update (ms)  per character (us)  60 Hz\n");
+
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		animation.SetSimdLevel(level);
+		PrintTiming(GetSimdLevelName(level), count, RunPass(animation, frames));
+	}
+
+	JobSystem jobSystem;
+	jobSystem.Init();
+	animation.SetSimdLevel(GetBestSimdLevel());
+	animation.SetJobSystem(&jobSystem);
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s, %u threads", GetSimdLevelName(GetBestSimdLevel()), jobSystem.GetNumThreads());
+	PrintTiming(name, count, RunPass(animation, frames));
+
+	// the same update, drawn. the characters stand 32 to a row 2 apart, seen from above one corner
+	Mesh mesh;
+	int meshTriangles = BuildSkinnedMesh(skeleton, mesh);
+
+	int width, height;
+	SDL_GL_GetDrawableSize(window, &width, &height);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glClearColor(0.4f, 0.5f, 0.6f, 1.0f);
+
+	int rows = (count + 31) / 32;
+	glm::vec3 fieldCenter((std::min(count, 32) - 1) * 1.0f, 1.0f, (rows - 1) * 1.0f);
+	float fieldSize = 2.0f * std::max(std::min(count, 32), rows);
+	glm::vec3 cameraPosition = fieldCenter + glm::vec3(-0.6f, 0.4f, -0.6f) * fieldSize;
+	glm::mat4 view = glm::lookAt(cameraPosition, fieldCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 0.1f, fieldSize * 3.0f);
+
+	SkinnedMeshRenderer renderer;
+	renderer.Init();
+	renderer.SetCamera(view, projection);
+	SkinnedResult skinned = RunSkinnedPass(window, animation, renderer, mesh, frames);
+	renderer.Dispose();
+
+	animation.SetJobSystem(nullptr);
+	jobSystem.Dispose();
+
+	printf("\nskinned draw, %d x %d triangles\n", count, meshTriangles);
+	printf("draw calls   uploads   update (ms)   submit (ms)   frame (ms)\n");
+	printf("%10u   %7u   %11.3f   %11.3f   %10.3f\n", skinned.drawCalls, skinned.uploads, skinned.updateMs, skinned.submitMs, skinned.frameMs);
+
+	PrintStageTimings(skeleton, clips, count, frames);
+	return kernelsMatch;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <SDL.h>
+
+// animates count characters on a procedural 64 joint skeleton, each cross fading two of three looping clips,
+// and times AnimationSystem::Update per 60 Hz frame for each SIMD level on one thread, then with the job system
+// on every hardware thread. the threaded update is then drawn with SkinnedMeshRenderer, a box per bone, and timed
+// to the end of the frame. also splits one thread's time into sampling, blending and the palette. returns false
+// if a SIMD kernel strays from the scalar one. needs a current GL context
+bool RunAnimationBenchmark(SDL_Window* window, int count, int frames = 120);
@@ -0,0 +1,107 @@
+#include "AnimationSystem.h"
+
+#include "JobSystem.h"
+
+#include <chrono>
+
+// a 64 joint character takes a few microseconds, so jobs get a batch of them
+static const size_t kCharactersPerJob = 16;
+
+int AnimationSystem::AddCharacter(const Skeleton* skeleton, const glm::mat4& transform)
+{
+	Character character;
+	character.skeleton = skeleton;
+	character.clips[0] = nullptr;
+	character.clips[1] = nullptr;
+	character.weight = 0.0f;
+	character.time = 0.0f;
+	character.speed = 1.0f;
+	character.transform = MakeJointMatrix(transform);
+	character.firstJoint = m_palettes.size();
+	character.pose = skeleton->GetBindPose();
+
+	// until the first Update the palette is the bind pose
+	size_t numJoints = skeleton->GetNumJoints();
+	m_jointTransforms.resize(m_jointTransforms.size() + numJoints);
+	m_palettes.resize(m_palettes.size() + numJoints);
+	ComputeSkinningPalette(m_simdLevel, *skeleton, character.pose, character.transform,
+		&m_jointTransforms[character.firstJoint], &m_palettes[character.firstJoint]);
+
+	m_characters.push_back(std::move(character));
+	return (int)m_characters.size() - 1;
+}
+
+void AnimationSystem::Clear()
+{
+	m_characters.clear();
+	m_jointTransforms.clear();
+	m_palettes.clear();
+}
+
+void AnimationSystem::SetTransform(int character, const glm::mat4& transform)
+{
+	m_characters[character].transform = MakeJointMatrix(transform);
+}
+
+void AnimationSystem::SetClips(int character, const AnimationClip* a, const AnimationClip* b, float weight)
+{
+	Character& c = m_characters[character];
+	c.clips[0] = a;
+	c.clips[1] = b;
+	c.weight = weight;
+}
+
+void AnimationSystem::SetTime(int character, float time)
+{
+	m_characters[character].time = time;
+}
+
+void AnimationSystem::SetSpeed(int character, float speed)
+{
+	m_characters[character].speed = speed;
+}
+
+void AnimationSystem::UpdateCharacter(Character& character, SimdLevel level)
+{
+	const AnimationClip* a = character.clips[0];
+	const AnimationClip* b = character.clips[1];
+
+	// no clip keeps whatever pose it had, the bind pose to start with. the blend reads each joint before
+	// writing it, so it can go straight back into the pose
+	if (a != nullptr)
+	{
+		SamplePose(level, *a, character.time, character.pose);
+		if (b != nullptr && character.weight > 0.0f)
+		{
+			SamplePose(level, *b, character.time, character.blendPose);
+			BlendPoses(level, character.pose, character.blendPose, character.weight, character.pose);
+		}
+	}
+
+	ComputeSkinningPalette(level, *character.skeleton, character.pose, character.transform,
+		&m_jointTransforms[character.firstJoint], &m_palettes[character.firstJoint]);
+}
+
+void AnimationSystem::Update(float dt)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	SimdLevel level = m_simdLevel;
+	auto updateRange = [this, level, dt](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			Character& character = m_characters[i];
+			character.time += dt * character.speed;
+			UpdateCharacter(character, level);
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_characters.size(), kCharactersPerJob, updateRange);
+	else
+		updateRange(0, m_characters.size());
+
+	m_stats.characters = (unsigned int)m_characters.size();
+	m_stats.joints = (unsigned int)m_palettes.size();
+	m_stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// plays animation clips on a set of characters. every Update samples each character's clips, cross fades
+// them and computes its skinning palette, split across the job system's threads by character. the palettes
+// of all characters live in one flat array, in the order the characters were added, ready for
+// SkinnedMeshRenderer
+
+#include "Animation.h"
+#include "CpuFeatures.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+struct AnimationStats
+{
+	unsigned int characters;
+	unsigned int joints; // over all characters
+	double updateMs;
+};
+
+class AnimationSystem
+{
+public:
+	AnimationSystem() = default;
+	~AnimationSystem() {}
+
+	// characters are split across the job system's threads when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	// defaults to GetBestSimdLevel, settable for benchmarking
+	void SetSimdLevel(SimdLevel level) { m_simdLevel = level; }
+
+	// the skeleton, and any clips set later, have to outlive the character. returns its index
+	int AddCharacter(const Skeleton* skeleton, const glm::mat4& transform);
+	void Clear();
+
+	void SetTransform(int character, const glm::mat4& transform);
+	// plays a, cross faded towards b by weight (0 = only a). b may be null. clips need the skeleton's joints
+	void SetClips(int character, const AnimationClip* a, const AnimationClip* b, float weight);
+	// both clips' playback position in seconds, and how fast it advances
+	void SetTime(int character, float time);
+	void SetSpeed(int character, float speed);
+
+	void Update(float dt);
+
+	int GetNumCharacters() const { return (int)m_characters.size(); }
+	int GetNumJoints(int character) const { return m_characters[character].skeleton->GetNumJoints(); }
+	// world * model * inverse bind per joint, from the last Update
+	const JointMatrix* GetPalette(int character) const { return &m_palettes[m_characters[character].firstJoint]; }
+	// each joint's world transform, for attaching things to them
+	const JointMatrix* GetJointTransforms(int character) const { return &m_jointTransforms[m_characters[character].firstJoint]; }
+	const std::vector<JointMatrix>& GetPalettes() const { return m_palettes; }
+
+	const AnimationStats& GetStats() const { return m_stats; }
+
+private:
+	struct Character
+	{
+		const Skeleton* skeleton;
+		const AnimationClip* clips[2];
+		float weight;
+		float time;
+		float speed;
+		JointMatrix transform;
+		size_t firstJoint;
+		Pose pose;
+		Pose blendPose; // clip b's sample before the cross fade
+	};
+
+	void UpdateCharacter(Character& character, SimdLevel level);
+
+	std::vector<Character> m_characters;
+	std::vector<JointMatrix> m_jointTransforms;
+	std::vector<JointMatrix> m_palettes;
+
+	JobSystem* m_jobSystem = nullptr;
+	SimdLevel m_simdLevel = GetBestSimdLevel();
+
+	AnimationStats m_stats = { 0, 0, 0.0 };
+
+};
@@ -0,0 +1,102 @@
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(CPU_X86)
+static void Cpuid(int leaf, int subleaf, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+	int values[4];
+	__cpuidex(values, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+	{
+		registers[i] = (unsigned int)values[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// which register state the OS saves on context switches, XCR0
+static unsigned long long ReadXcr0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+static CpuFeatures DetectCpuFeatures()
+{
+	CpuFeatures features = {};
+
+#if defined(CPU_X86)
+	unsigned int registers[4];
+	Cpuid(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+
+	Cpuid(1, 0, registers);
+	features.sse2 = (registers[3] & (1u << 26)) != 0;
+	features.sse41 = (registers[2] & (1u << 19)) != 0;
+	features.fma = (registers[2] & (1u << 12)) != 0;
+
+	// the cpu supporting AVX isn't enough, the OS has to save the ymm registers too
+	bool osxsave = (registers[2] & (1u << 27)) != 0;
+	bool ymmSaved = osxsave && (ReadXcr0() & 0x6) == 0x6;
+	features.avx = ymmSaved && (registers[2] & (1u << 28)) != 0;
+	features.fma = features.fma && features.avx;
+
+	if (maxLeaf >= 7)
+	{
+		Cpuid(7, 0, registers);
+		features.avx2 = features.avx && (registers[1] & (1u << 5)) != 0;
+	}
+#endif
+
+	return features;
+}
+
+const CpuFeatures& GetCpuFeatures()
+{
+	static const CpuFeatures features = DetectCpuFeatures();
+	return features;
+}
+
+bool IsSimdLevelSupported(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar: return true;
+	case SimdLevel::Sse: return GetCpuFeatures().sse2;
+	case SimdLevel::Avx2: return GetCpuFeatures().avx2 && GetCpuFeatures().fma;
+	}
+	return false;
+}
+
+SimdLevel GetBestSimdLevel()
+{
+	static const SimdLevel best = IsSimdLevelSupported(SimdLevel::Avx2) ? SimdLevel::Avx2
+		: IsSimdLevelSupported(SimdLevel::Sse) ? SimdLevel::Sse : SimdLevel::Scalar;
+	return best;
+}
+
+const char* GetSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar: return "scalar";
+	case SimdLevel::Sse: return "sse";
+	case SimdLevel::Avx2: return "avx2";
+	}
+	return "unknown";
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// which SIMD instruction sets this CPU (and OS, for the AVX register state) supports, for picking kernels at runtime
+
+// x86 builds get the SSE/AVX kernels, anything else only the scalar ones
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+// functions using AVX2 intrinsics need this on gcc/clang when the file isn't built with -mavx2. msvc allows the
+// intrinsics anywhere, so it's empty there
+#if defined(CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define CPU_TARGET_AVX2
+#endif
+
+struct CpuFeatures
+{
+	bool sse2;
+	bool sse41;
+	bool avx;
+	bool avx2;
+	bool fma;
+};
+
+// detected once, on first call
+const CpuFeatures& GetCpuFeatures();
+
+// kernel variants the SIMD code paths come in. Sse means SSE2, Avx2 includes FMA
+enum class SimdLevel
+{
+	Scalar,
+	Sse,
+	Avx2
+};
+
+bool IsSimdLevelSupported(SimdLevel level);
+SimdLevel GetBestSimdLevel();
+const char* GetSimdLevelName(SimdLevel level);
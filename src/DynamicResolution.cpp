@@ -0,0 +1,286 @@
+#include "DynamicResolution.h"
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// GPU time is averaged over this fraction of each new measurement, so one odd frame doesn't move the scale much
+static const double kSmoothing = 0.25;
+// over the target, the scale drops straight to what should fit with this much to spare...
+static const double kDropHeadroom = 0.9;
+// ...but by no more than this per frame
+static const float kMaxDropStep = 0.85f;
+// it only goes back up after this many frames in a row under kRaiseThreshold of the target, a little at a time
+static const int kRaiseFrames = 30;
+static const double kRaiseThreshold = 0.75;
+static const float kMaxRaiseStep = 1.05f;
+
+DynamicResolution::~DynamicResolution()
+{
+	Dispose();
+}
+
+void DynamicResolution::Init(int outputWidth, int outputHeight, float minScale, float maxScale, float targetMs)
+{
+	m_outputWidth = outputWidth;
+	m_outputHeight = outputHeight;
+	m_maxScale = std::max(maxScale, 0.1f);
+	m_minScale = std::min(std::max(minScale, 0.1f), m_maxScale);
+	m_targetMs = targetMs;
+	m_scale = m_maxScale;
+	m_smoothedGpuMs = 0.0;
+	m_framesUnderBudget = 0;
+	m_settleFrames = 0;
+
+	m_targetWidth = std::max(1, static_cast<int>(std::ceil(m_outputWidth * m_maxScale)));
+	m_targetHeight = std::max(1, static_cast<int>(std::ceil(m_outputHeight * m_maxScale)));
+
+	glGenTextures(1, &m_colorTexture);
+	glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_targetWidth, m_targetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the renderer depth tests its opaque pass, so the target needs its own depth buffer
+	glGenRenderbuffers(1, &m_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_targetWidth, m_targetHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		printf("Dynamic resolution framebuffer is incomplete\n");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenQueries(kQueryFrames, m_timerQueries);
+	for (int i = 0; i < kQueryFrames; i++)
+	{
+		m_queryIssued[i] = false;
+	}
+	m_queryFrame = 0;
+
+	CreateSharpenProgram();
+
+	printf("Dynamic resolution: %dx%d output, scale %.2f to %.2f, target %.1f ms\n", m_outputWidth, m_outputHeight, m_minScale, m_maxScale, m_targetMs);
+}
+
+void DynamicResolution::Dispose()
+{
+	if (m_framebuffer == 0)
+		return;
+
+	glDeleteQueries(kQueryFrames, m_timerQueries);
+	glDeleteFramebuffers(1, &m_framebuffer);
+	glDeleteTextures(1, &m_colorTexture);
+	glDeleteRenderbuffers(1, &m_depthBuffer);
+	glDeleteVertexArrays(1, &m_sharpenVao);
+	glDeleteProgram(m_sharpenProgram);
+	m_framebuffer = 0;
+}
+
+void DynamicResolution::BeginFrame()
+{
+	m_frameStart = std::chrono::steady_clock::now();
+
+	ReadTimerQueries();
+
+	// even sizes, so a 2:1 upscale lands on whole pixels
+	m_renderWidth = std::min(m_targetWidth, std::max(2, static_cast<int>(m_outputWidth * m_scale) & ~1));
+	m_renderHeight = std::min(m_targetHeight, std::max(2, static_cast<int>(m_outputHeight * m_scale) & ~1));
+
+	glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_queryFrame]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, m_renderWidth, m_renderHeight);
+
+	// what's outside the last frame's corner is stale, clear this one's so a smaller frame never shows it
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, m_renderWidth, m_renderHeight);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void DynamicResolution::EndFrame()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_outputWidth, m_outputHeight);
+
+	if (m_filter == UpscaleFilter::Blit)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+		glBlitFramebuffer(0, 0, m_renderWidth, m_renderHeight, 0, 0, m_outputWidth, m_outputHeight, GL_COLOR_BUFFER_BIT,
+			m_renderWidth == m_outputWidth && m_renderHeight == m_outputHeight ? GL_NEAREST : GL_LINEAR);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+	else
+	{
+		GLboolean blendWasEnabled = glIsEnabled(GL_BLEND);
+		glDisable(GL_BLEND);
+
+		glUseProgram(m_sharpenProgram);
+		glUniform2f(glGetUniformLocation(m_sharpenProgram, "u_uvScale"),
+			(float)m_renderWidth / m_targetWidth, (float)m_renderHeight / m_targetHeight);
+		glUniform2f(glGetUniformLocation(m_sharpenProgram, "u_texelSize"), 1.0f / m_targetWidth, 1.0f / m_targetHeight);
+		glUniform1f(glGetUniformLocation(m_sharpenProgram, "u_sharpness"), m_sharpness);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+		glBindVertexArray(m_sharpenVao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (blendWasEnabled)
+			glEnable(GL_BLEND);
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	m_queryIssued[m_queryFrame] = true;
+	m_queryFrame = (m_queryFrame + 1) % kQueryFrames;
+
+	m_stats.scale = m_scale;
+	m_stats.renderWidth = m_renderWidth;
+	m_stats.renderHeight = m_renderHeight;
+	m_stats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count();
+}
+
+void DynamicResolution::ReadTimerQueries()
+{
+	// the query about to be reused is kQueryFrames - 1 frames old. if the GPU still hasn't finished that frame
+	// it's far behind, which the next result that does come back will show anyway
+	GLuint query = m_timerQueries[m_queryFrame];
+	if (!m_queryIssued[m_queryFrame])
+		return;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	GLuint64 elapsedNs = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+	m_queryIssued[m_queryFrame] = false;
+
+	double gpuMs = elapsedNs / 1000000.0;
+	m_stats.gpuMs = gpuMs;
+	UpdateScale(gpuMs);
+}
+
+void DynamicResolution::UpdateScale(double gpuMs)
+{
+	// frames already in flight when the scale last changed were drawn at the old one
+	if (m_settleFrames > 0)
+	{
+		m_settleFrames--;
+		return;
+	}
+
+	float oldScale = m_scale;
+	m_smoothedGpuMs = m_smoothedGpuMs > 0.0 ? m_smoothedGpuMs + (gpuMs - m_smoothedGpuMs) * kSmoothing : gpuMs;
+
+	// GPU time is mostly fill, which goes with the pixel count, the square of the scale. CPU time doesn't
+	// change with resolution, so it's reported but doesn't steer anything
+	if (m_smoothedGpuMs > m_targetMs)
+	{
+		float step = static_cast<float>(std::sqrt(m_targetMs * kDropHeadroom / m_smoothedGpuMs));
+		m_scale = std::max(m_minScale, m_scale * std::max(step, kMaxDropStep));
+		m_framesUnderBudget = 0;
+	}
+	else if (m_smoothedGpuMs < m_targetMs * kRaiseThreshold)
+	{
+		if (++m_framesUnderBudget >= kRaiseFrames && m_scale < m_maxScale)
+		{
+			float step = static_cast<float>(std::sqrt(m_targetMs * kRaiseThreshold / std::max(m_smoothedGpuMs, 0.01)));
+			m_scale = std::min(m_maxScale, m_scale * std::min(step, kMaxRaiseStep));
+			m_framesUnderBudget = 0;
+		}
+	}
+	else
+	{
+		m_framesUnderBudget = 0;
+	}
+
+	// the average is moved along with the scale, otherwise it would lag behind and keep dropping it
+	if (m_scale != oldScale)
+	{
+		float ratio = m_scale / oldScale;
+		m_smoothedGpuMs *= ratio * ratio;
+		m_settleFrames = kQueryFrames - 1;
+	}
+}
+
+void DynamicResolution::CreateSharpenProgram()
+{
+	const GLchar* vertexSource = R"(
+		#version 330 core
+
+		out vec2 v_texcoord;
+
+		void main()
+		{
+			vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+			gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+			v_texcoord = corner;
+		}
+	)";
+
+	// bilinear upscale plus a 4 tap unsharp mask at the source's resolution, kept inside the rendered corner
+	const GLchar* fragmentSource = R"(
+		#version 330 core
+		out vec4 out_color;
+
+		in vec2 v_texcoord;
+
+		uniform sampler2D u_source;
+		uniform vec2 u_uvScale;   // the rendered corner of the target
+		uniform vec2 u_texelSize;
+		uniform float u_sharpness;
+
+		vec3 Sample(vec2 uv)
+		{
+			return texture(u_source, clamp(uv, u_texelSize * 0.5, u_uvScale - u_texelSize * 0.5)).rgb;
+		}
+
+		void main()
+		{
+			vec2 uv = v_texcoord * u_uvScale;
+			vec3 centre = Sample(uv);
+			vec3 neighbours = Sample(uv + vec2(u_texelSize.x, 0.0)) + Sample(uv - vec2(u_texelSize.x, 0.0))
+				+ Sample(uv + vec2(0.0, u_texelSize.y)) + Sample(uv - vec2(0.0, u_texelSize.y));
+			vec3 sharpened = centre + (centre * 4.0 - neighbours) * u_sharpness;
+			out_color = vec4(clamp(sharpened, 0.0, 1.0), 1.0);
+		}
+	)";
+
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+	m_sharpenProgram = glCreateProgram();
+	glAttachShader(m_sharpenProgram, vertexShader);
+	glAttachShader(m_sharpenProgram, fragmentShader);
+	glLinkProgram(m_sharpenProgram);
+
+	int success;
+	char info_log[512];
+	glGetProgramiv(m_sharpenProgram, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(m_sharpenProgram, 512, NULL, info_log);
+		printf("Failed to link shader:\n%s\n", info_log);
+	}
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glUseProgram(m_sharpenProgram);
+	glUniform1i(glGetUniformLocation(m_sharpenProgram, "u_source"), 0);
+
+	glGenVertexArrays(1, &m_sharpenVao);
+}
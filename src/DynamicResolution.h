@@ -0,0 +1,90 @@
+#pragma once
+
+// renders the frame into an offscreen target at a fraction of the window's resolution and scales it up into
+// the backbuffer. the fraction follows the GPU time of earlier frames, measured with timer queries, so a frame
+// that runs over the target drops resolution within a few frames and it creeps back up once there's headroom.
+// the target is allocated once at the largest scale and smaller scales only draw into a corner of it, so
+// changing scale never reallocates anything
+
+#include <glad/glad.h>
+
+#include <chrono>
+
+enum class UpscaleFilter
+{
+	Blit,   // glBlitFramebuffer with linear filtering
+	Sharpen // a fullscreen pass that sharpens while it scales, to win back some of the lost detail
+};
+
+struct DynamicResolutionStats
+{
+	float scale;
+	int renderWidth;
+	int renderHeight;
+	double gpuMs; // last measured, a few frames old
+	double cpuMs; // BeginFrame to EndFrame on the render thread, not including the swap
+};
+
+class DynamicResolution
+{
+public:
+	DynamicResolution() = default;
+	~DynamicResolution();
+
+	// the output is the window's drawable size. scales are per axis, so 0.5 is a quarter of the pixels.
+	// targetMs is the GPU time per frame to stay under, a little below the refresh interval
+	void Init(int outputWidth, int outputHeight, float minScale = 0.5f, float maxScale = 1.0f, float targetMs = 15.0f);
+	void Dispose();
+
+	void SetUpscaleFilter(UpscaleFilter filter) { m_filter = filter; }
+	// 0 is a plain bilinear upscale, 1 is strong
+	void SetSharpness(float sharpness) { m_sharpness = sharpness; }
+
+	// picks this frame's scale from the timings that have come back, binds the offscreen target and sets the
+	// viewport to the scaled size. everything drawn until EndFrame goes into it
+	void BeginFrame();
+	// scales the frame up into the default framebuffer, ready to swap
+	void EndFrame();
+
+	float GetScale() const { return m_scale; }
+	const DynamicResolutionStats& GetStats() const { return m_stats; }
+
+private:
+	void ReadTimerQueries();
+	void UpdateScale(double gpuMs);
+	void CreateSharpenProgram();
+
+	int m_outputWidth = 0;
+	int m_outputHeight = 0;
+	int m_targetWidth = 0;  // allocated size, at m_maxScale
+	int m_targetHeight = 0;
+	int m_renderWidth = 0;  // this frame's
+	int m_renderHeight = 0;
+
+	float m_minScale = 0.5f;
+	float m_maxScale = 1.0f;
+	float m_scale = 1.0f;
+	double m_targetMs = 15.0;
+	double m_smoothedGpuMs = 0.0;
+	int m_framesUnderBudget = 0;
+	int m_settleFrames = 0; // results still to ignore after a change
+
+	UpscaleFilter m_filter = UpscaleFilter::Sharpen;
+	float m_sharpness = 0.25f;
+
+	GLuint m_framebuffer = 0;
+	GLuint m_colorTexture = 0;
+	GLuint m_depthBuffer = 0;
+	GLuint m_sharpenProgram = 0;
+	GLuint m_sharpenVao = 0; // empty, the triangle comes from gl_VertexID
+
+	// one GL_TIME_ELAPSED query per frame in flight, read back when it's about to be reused
+	static const int kQueryFrames = 4;
+	GLuint m_timerQueries[kQueryFrames] = {};
+	bool m_queryIssued[kQueryFrames] = {};
+	int m_queryFrame = 0;
+
+	std::chrono::steady_clock::time_point m_frameStart;
+	DynamicResolutionStats m_stats = { 1.0f, 0, 0, 0.0, 0.0 };
+
+};
@@ -3,7 +3,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 Entity3D::Entity3D()
-    : m_worldPosition(glm::vec3(0.0f, 0.0f, 0.0f)), m_scale(glm::vec3(1.0f, 1.0f, 1.0f)), m_rotation(glm::vec3(0.0f, 0.0f, 0.0f))
+    : m_worldPosition(glm::vec3(0.0f, 0.0f, 0.0f)), m_scale(glm::vec3(1.0f, 1.0f, 1.0f)), m_rotation(glm::vec3(0.0f, 0.0f, 0.0f)), m_transform(1.0f)
 {
 
 }
@@ -12,13 +12,14 @@ void Entity3D::UpdateTransform()
 {
     glm::mat4 transform = glm::mat4(1.0f); // identity
 
-    transform = glm::scale(transform, m_scale);
+    // applied right to left: scale, then rotate, then move into place
+    transform = glm::translate(transform, m_worldPosition);
 
     transform = glm::rotate(transform, m_rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
     transform = glm::rotate(transform, m_rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
     transform = glm::rotate(transform, m_rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
 
-    transform = glm::translate(transform, m_worldPosition);
+    transform = glm::scale(transform, m_scale);
 
-    //m_transform = transform;
-}
\ No newline at end of file
+    m_transform = transform;
+}
@@ -10,9 +10,21 @@ public:
 
     void UpdateTransform();
 
+    void SetPosition(const glm::vec3& position) { m_worldPosition = position; }
+    void SetScale(const glm::vec3& scale) { m_scale = scale; }
+    void SetRotation(const glm::vec3& rotation) { m_rotation = rotation; }
+
+    const glm::vec3& GetPosition() const { return m_worldPosition; }
+    const glm::vec3& GetScale() const { return m_scale; }
+    const glm::vec3& GetRotation() const { return m_rotation; }
+
+    // world matrix as of the last UpdateTransform
+    const glm::mat4& GetTransform() const { return m_transform; }
+
 protected:
     glm::vec3 m_worldPosition;
     glm::vec3 m_scale;
     glm::vec3 m_rotation;
+    glm::mat4 m_transform;
 
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+// bitmap font rasterized into a single atlas page at load time. LoadBuiltin uses an 8x8 ASCII font compiled
+// into the game, with per glyph advances trimmed to the set pixels so it reads as proportional.
+// LoadFromImage takes a pre-baked grid of equally sized cells (e.g. 16 x 6 starting at ' ')
+
+#include "Texture.h"
+
+#include <glm/glm.hpp>
+
+struct Glyph
+{
+	glm::vec4 uvRect;   // u0, v0, u1, v1
+	glm::vec2 size;     // pixels
+	float advance;      // pixels to the next glyph's origin
+	bool visible;       // false for blanks like ' ', no quad is emitted
+};
+
+class Font
+{
+public:
+	static const int kFirstChar = 32;
+	static const int kNumChars = 95; // ' ' to '~'
+
+	Font() = default;
+	~Font() {}
+
+	bool LoadBuiltin();
+	bool LoadFromImage(const char* path, int columns, int rows, int firstChar = kFirstChar);
+
+	// characters outside the font fall back to '?'
+	const Glyph& GetGlyph(unsigned char c) const;
+	float GetLineHeight() const { return m_lineHeight; }
+	Texture* GetTexture() { return &m_texture; }
+
+private:
+	Texture m_texture;
+	Glyph m_glyphs[kNumChars] = {};
+	float m_lineHeight = 0.0f;
+
+};
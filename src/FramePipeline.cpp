@@ -0,0 +1,129 @@
+#include "FramePipeline.h"
+
+#include <cassert>
+#include <chrono>
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+FramePipeline::~FramePipeline()
+{
+	Stop();
+}
+
+void FramePipeline::Start(SDL_Window* window, SDL_GLContext context, int latency, const RenderFunction& render)
+{
+	assert(!m_thread.joinable() && "FramePipeline already started");
+
+	m_window = window;
+	m_context = context;
+	m_render = render;
+	m_quit = false;
+	m_building = nullptr;
+	m_nextFrame = 0;
+	m_stats = { 0, 0.0, 0.0 };
+
+	// one packet being drawn plus latency packets the simulation can be ahead by
+	m_packets.clear();
+	m_packets.resize(latency > 0 ? latency + 1 : 1);
+	m_free.clear();
+	m_ready.clear();
+	for (RenderPacket& packet : m_packets)
+	{
+		m_free.push_back(&packet);
+	}
+
+	// a context can only be current on one thread at a time
+	SDL_GL_MakeCurrent(m_window, nullptr);
+	m_thread = std::thread(&FramePipeline::RenderThread, this);
+}
+
+void FramePipeline::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+
+	SDL_GL_MakeCurrent(m_window, m_context);
+}
+
+RenderPacket& FramePipeline::BeginFrame()
+{
+	assert(m_building == nullptr && "BeginFrame called twice");
+
+	auto startTime = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_condition.wait(lock, [this] { return !m_free.empty(); });
+	m_stats.simulationWaitMs += ElapsedMs(startTime);
+
+	m_building = m_free.front();
+	m_free.pop_front();
+	lock.unlock();
+
+	m_building->Clear();
+	m_building->frame = m_nextFrame++;
+	return *m_building;
+}
+
+void FramePipeline::EndFrame()
+{
+	assert(m_building != nullptr && "EndFrame without BeginFrame");
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ready.push_back(m_building);
+	}
+	m_building = nullptr;
+	m_condition.notify_all();
+}
+
+FramePipelineStats FramePipeline::TakeStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	FramePipelineStats stats = m_stats;
+	m_stats = { 0, 0.0, 0.0 };
+	return stats;
+}
+
+void FramePipeline::RenderThread()
+{
+	SDL_GL_MakeCurrent(m_window, m_context);
+
+	while (true)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		RenderPacket* packet = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return !m_ready.empty() || m_quit; });
+			if (m_ready.empty())
+				break;
+
+			packet = m_ready.front();
+			m_ready.pop_front();
+			m_stats.renderWaitMs += ElapsedMs(startTime);
+		}
+
+		// the packet is only read here, the simulation won't get it back until it's released below
+		m_render(*packet);
+		SDL_GL_SwapWindow(m_window);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.push_back(packet);
+			m_stats.framesDrawn++;
+		}
+		m_condition.notify_all();
+	}
+
+	SDL_GL_MakeCurrent(m_window, nullptr);
+}
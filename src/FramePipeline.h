@@ -0,0 +1,74 @@
+#pragma once
+
+// runs rendering on its own thread, one frame behind the simulation.
+// the simulation fills a RenderPacket between BeginFrame and EndFrame, the render thread draws finished packets
+// in order and swaps. with latency 1 there are two packets: frame N+1 is built while frame N is drawn, so a frame
+// costs max(update, render) instead of update + render. more latency adds packets (and input lag) so a spike on
+// one side can be absorbed by the other, 0 waits for each frame to be drawn before building the next.
+// the GL context belongs to the render thread between Start and Stop, so anything that touches GL (texture
+// streaming, resource loading) has to happen on the render side or outside that window
+
+#include "RenderPacket.h"
+
+#include <SDL.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct FramePipelineStats
+{
+	unsigned int framesDrawn;
+	double simulationWaitMs; // BeginFrame blocked on the render thread
+	double renderWaitMs;     // render thread idle, waiting for a packet
+};
+
+class FramePipeline
+{
+public:
+	typedef std::function<void(const RenderPacket&)> RenderFunction;
+
+	FramePipeline() = default;
+	~FramePipeline();
+
+	// takes the context off the calling thread and hands it to a new render thread, which calls render then
+	// swaps the window for every packet
+	void Start(SDL_Window* window, SDL_GLContext context, int latency, const RenderFunction& render);
+
+	// draws whatever is still queued, joins the render thread and makes the context current here again
+	void Stop();
+
+	// a free packet for the next frame, blocks while the render thread is latency frames behind
+	RenderPacket& BeginFrame();
+	// hands the packet from BeginFrame over to the render thread
+	void EndFrame();
+
+	int GetLatency() const { return (int)m_packets.size() - 1; }
+
+	// totals since the last call
+	FramePipelineStats TakeStats();
+
+private:
+	void RenderThread();
+
+	SDL_Window* m_window = nullptr;
+	SDL_GLContext m_context = nullptr;
+	RenderFunction m_render;
+
+	std::vector<RenderPacket> m_packets;
+	std::deque<RenderPacket*> m_free;
+	std::deque<RenderPacket*> m_ready;
+	RenderPacket* m_building = nullptr;
+	unsigned int m_nextFrame = 0;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_quit = false;
+
+	FramePipelineStats m_stats = { 0, 0.0, 0.0 };
+
+};
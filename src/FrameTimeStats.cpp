@@ -0,0 +1,41 @@
+#include "FrameTimeStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static double Percentile(const std::vector<double>& sorted, double percentile)
+{
+	size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+	return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+}
+
+FrameTimeSummary SummarizeFrameTimes(std::vector<double>& frameMs)
+{
+	FrameTimeSummary summary = { frameMs.size(), 0.0, 0.0, 0.0, 0.0 };
+	if (frameMs.empty())
+		return summary;
+
+	std::sort(frameMs.begin(), frameMs.end());
+
+	double total = 0.0;
+	for (double ms : frameMs)
+		total += ms;
+
+	summary.meanMs = total / frameMs.size();
+	summary.p95Ms = Percentile(frameMs, 95.0);
+	summary.p99Ms = Percentile(frameMs, 99.0);
+	summary.maxMs = frameMs.back();
+	return summary;
+}
+
+void PrintFrameTimeHeader()
+{
+	printf("run          frames   mean (ms)   p95 (ms)   p99 (ms)   max (ms)\n");
+}
+
+void PrintFrameTimeSummary(const char* label, const FrameTimeSummary& summary)
+{
+	printf("%-10s   %6u   %9.3f   %8.3f   %8.3f   %8.3f\n", label, static_cast<unsigned int>(summary.frames),
+		summary.meanMs, summary.p95Ms, summary.p99Ms, summary.maxMs);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// summary statistics of a run's frame times, for comparing replays of the same input log
+
+#include <cstddef>
+#include <vector>
+
+struct FrameTimeSummary
+{
+	size_t frames;
+	double meanMs;
+	double p95Ms;
+	double p99Ms;
+	double maxMs;
+};
+
+// percentiles are nearest rank. sorts frameMs
+FrameTimeSummary SummarizeFrameTimes(std::vector<double>& frameMs);
+
+void PrintFrameTimeHeader();
+void PrintFrameTimeSummary(const char* label, const FrameTimeSummary& summary);
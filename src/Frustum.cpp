@@ -0,0 +1,47 @@
+#include "Frustum.h"
+
+void Frustum::Update(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	m_planes[0] = row3 + row0;
+	m_planes[1] = row3 - row0;
+	m_planes[2] = row3 + row1;
+	m_planes[3] = row3 - row1;
+	m_planes[4] = row3 + row2;
+	m_planes[5] = row3 - row2;
+
+	for (glm::vec4& plane : m_planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+bool Frustum::IntersectsAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	for (const glm::vec4& plane : m_planes)
+	{
+		// the corner furthest along the plane normal, if that's outside the whole box is
+		glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+			plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+			plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : m_planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// view frustum as 6 planes pulled out of a view-projection matrix, for culling bounds against
+class Frustum
+{
+public:
+	Frustum() = default;
+	explicit Frustum(const glm::mat4& viewProjection) { Update(viewProjection); }
+
+	void Update(const glm::mat4& viewProjection);
+
+	// conservative: can return true for boxes just outside a corner
+	bool IntersectsAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+private:
+	// xyz = normal pointing inwards, w = distance. left, right, bottom, top, near, far
+	glm::vec4 m_planes[6];
+
+};
@@ -1,9 +1,33 @@
 #include "Game.h"
 
 #include "Renderer.h"
+#include "ResourceManager.h"
+#include "DynamicResolution.h"
+#include "Font.h"
+#include "FramePipeline.h"
+#include "FrameTimeStats.h"
 #include "Input.h"
+#include "JobSystem.h"
+#include "ParticleSystem.h"
+#include "TextRenderer.h"
 #include <iostream>
 #include "Texture.h"
+#include "TextureStreamer.h"
+#include "Mesh.h"
+#include "AnimationBenchmark.h"
+#include "MeshBenchmark.h"
+#include "SpriteLayerBenchmark.h"
+#include "TilemapBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+
+// recorded and replayed sessions run the simulation in ticks of this length
+static const float kTickSeconds = 1.0f / 60.0f;
+// a longer stall than this many ticks is dropped rather than caught up
+static const int kMaxTicksPerFrame = 8;
 
 bool Game::Init(int width, int height, bool fullscreen, const char* title)
 {
@@ -44,6 +68,7 @@ bool Game::Init(int width, int height, bool fullscreen, const char* title)
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24); // the renderer's opaque pass depth tests sprites
 
 	m_context = SDL_GL_CreateContext(m_window);
 	if (!m_context)
@@ -67,29 +92,171 @@ bool Game::Init(int width, int height, bool fullscreen, const char* title)
 	SetupGL();
 
 	// Init systems
+	// one thread per core, the main thread included
+	m_jobSystem = new JobSystem();
+	m_jobSystem->Init();
+
 	m_renderer = new Renderer();
 	m_renderer->Init();
 	m_renderer->SetProjection(m_viewportWidth, m_viewportHeight);
+	m_renderer->SetPixelsPerUnit(static_cast<float>(m_windowWidth) / m_viewportWidth);
+	m_renderer->SetJobSystem(m_jobSystem);
+
+	m_textureStreamer = new TextureStreamer();
+	m_textureStreamer->Init();
+
+	// streamed loads go through the streamer's worker and upload queue
+	m_resourceManager = new ResourceManager();
+	m_resourceManager->SetTextureStreamer(m_textureStreamer);
 
 	m_input = new Input();
 
+	m_particleSystem = new ParticleSystem();
+	m_particleSystem->SetJobSystem(m_jobSystem);
+
+	m_font = new Font();
+	m_font->LoadBuiltin();
+	m_textRenderer = new TextRenderer();
+	m_textRenderer->SetRenderer(m_renderer);
+
+	// the drawable size, which is the window's unless the OS scales it
+	int drawableWidth, drawableHeight;
+	SDL_GL_GetDrawableSize(m_window, &drawableWidth, &drawableHeight);
+	m_dynamicResolution = new DynamicResolution();
+	m_dynamicResolution->Init(drawableWidth, drawableHeight, m_minResolutionScale, m_maxResolutionScale, m_resolutionTargetMs);
+
+	return true;
+}
+
+bool Game::InitHeadless()
+{
+	if (SDL_Init(SDL_INIT_TIMER) < 0)
+	{
+		std::cerr << "An error occurred while initializing SDL2:" << SDL_GetError() << ".\n";
+		return false;
+	}
+
+	m_headless = true;
+	m_window = nullptr;
+	m_context = nullptr;
+	m_renderer = nullptr;
+	m_textureStreamer = nullptr;
+	m_resourceManager = nullptr;
+	m_font = nullptr;
+	m_textRenderer = nullptr;
+	m_dynamicResolution = nullptr;
+
+	m_jobSystem = new JobSystem();
+	m_jobSystem->Init();
+
+	m_input = new Input();
+
+	m_particleSystem = new ParticleSystem();
+	m_particleSystem->SetJobSystem(m_jobSystem);
+
 	return true;
 }
 
 void Game::Run()
 {
+	if (!m_recordPath.empty())
+	{
+		m_tickSeconds = kTickSeconds;
+		m_inputLog.SetTickSeconds(kTickSeconds);
+		m_input->StartRecording(&m_inputLog);
+	}
+
+	RunSession();
+
+	if (!m_recordPath.empty())
+	{
+		m_input->Stop();
+		if (m_inputLog.Save(m_recordPath.c_str()))
+			printf("Recorded %u frames to %s\n", static_cast<unsigned int>(m_inputLog.GetNumFrames()), m_recordPath.c_str());
+	}
+
+	Cleanup();
+}
+
+void Game::RunReplay(const InputLog& log, int runs)
+{
+	m_tickSeconds = log.GetTickSeconds();
+
+	printf("\nreplaying %u frames %d times%s\n", static_cast<unsigned int>(log.GetNumFrames()), runs, m_headless ? ", headless" : "");
+	PrintFrameTimeHeader();
+
+	std::vector<double> allFrameTimes;
+	std::vector<double> runMeans;
+	for (int run = 0; run < runs; run++)
+	{
+		m_input->StartReplay(&log);
+		RunSession();
+		m_input->Stop();
+
+		allFrameTimes.insert(allFrameTimes.end(), m_frameTimes.begin(), m_frameTimes.end());
+		FrameTimeSummary summary = SummarizeFrameTimes(m_frameTimes);
+		runMeans.push_back(summary.meanMs);
+
+		char label[16];
+		snprintf(label, sizeof(label), "%d", run + 1);
+		PrintFrameTimeSummary(label, summary);
+	}
+	PrintFrameTimeSummary("all", SummarizeFrameTimes(allFrameTimes));
+
+	// how much the mean moves between runs of the same input, a difference between builds smaller than a
+	// couple of these is noise
+	if (runs > 1)
+	{
+		double meanOfMeans = 0.0;
+		for (double mean : runMeans)
+			meanOfMeans += mean;
+		meanOfMeans /= runs;
+
+		double variance = 0.0;
+		for (double mean : runMeans)
+			variance += (mean - meanOfMeans) * (mean - meanOfMeans);
+		printf("run to run standard deviation of the mean: %.3f ms\n", std::sqrt(variance / (runs - 1)));
+	}
+
+	Cleanup();
+}
+
+void Game::RunSession()
+{
+	// replays have to start from the same state every time
+	srand(1);
 	Create();
 
-	Uint32 last_time = 0;
+	m_tickAccumulator = 0.0f;
+	m_frameTimes.clear();
+	bool fixedTimestep = !m_recordPath.empty() || m_input->IsReplaying();
+
+	// Create loads resources, so the render thread only takes the context after it
+	if (m_frameLatency > 0 && !m_headless)
+	{
+		m_pipeline = new FramePipeline();
+		m_pipeline->Start(m_window, m_context, m_frameLatency, [this](const RenderPacket& packet) { RenderFrame(packet); });
+	}
+
+	Uint32 last_time = SDL_GetTicks();
 
-	int fps = 0;
 	int fps_count = 0;
 	float fps_interval = 0.0f;
 
+	// replays time whole iterations of the loop, start to start
+	auto frameStart = std::chrono::steady_clock::now();
+	bool firstFrame = true;
+
 	// main loop
 	bool running = true;
 	while (running)
 	{
+		auto now = std::chrono::steady_clock::now();
+		if (m_input->IsReplaying() && !firstFrame)
+			m_frameTimes.push_back(std::chrono::duration<double, std::milli>(now - frameStart).count());
+		frameStart = now;
+		firstFrame = false;
+
 		running = m_input->HandleEvents();
 		HandleInput();
 		m_input->Update();
@@ -104,28 +271,155 @@ void Game::Run()
 		fps_interval += dt;
 		if (fps_interval > 1.0f)
 		{
-			fps = fps_count;
+			if (m_pipeline != nullptr)
+			{
+				// time each side spent waiting on the other, a balanced pipeline keeps both low
+				FramePipelineStats pipelineStats = m_pipeline->TakeStats();
+				printf("FPS: %d, simulation waited %.2f ms/frame, render waited %.2f ms/frame\n", fps_count,
+					pipelineStats.simulationWaitMs / fps_count, pipelineStats.framesDrawn > 0 ? pipelineStats.renderWaitMs / pipelineStats.framesDrawn : 0.0);
+			}
+
+			m_fps = fps_count;
+			m_frameMs = fps_interval * 1000.0f / fps_count;
 			fps_count = 0;
 			fps_interval = 0.0f;
 		}
 
-		// update
-		Update(dt);
+		// update. recorded and replayed sessions run whole ticks and the log keeps how many, so a replay
+		// simulates exactly what was recorded however long its own frames take
+		if (fixedTimestep)
+		{
+			m_tickAccumulator += dt;
+			int ticks = static_cast<int>(m_tickAccumulator / m_tickSeconds);
+			m_tickAccumulator -= ticks * m_tickSeconds;
+			ticks = m_input->SyncTicks(std::min(ticks, kMaxTicksPerFrame));
+
+			for (int tick = 0; tick < ticks; tick++)
+			{
+				Update(m_tickSeconds);
+				m_particleSystem->Update(m_tickSeconds);
+			}
+		}
+		else
+		{
+			Update(dt);
+			m_particleSystem->Update(dt);
+		}
 
-		// render
-		//glClear(GL_COLOR_BUFFER_BIT);
+		if (m_headless)
+		{
+			// nothing to draw with, but the recording side of the frame is still work worth measuring
+			m_packet.Clear();
+			m_particleSystem->Record(m_packet);
+			continue;
+		}
+
+		// record
 		Render();
-		m_renderer->RenderObjects();
-		m_renderer->RenderDebugLines();
+		RenderPacket& packet = m_pipeline != nullptr ? m_pipeline->BeginFrame() : m_packet;
+		if (m_pipeline == nullptr)
+			m_packet.Clear(); // BeginFrame hands out cleared packets
+		m_renderer->RecordFrame(packet);
+		m_particleSystem->Record(packet);
+		m_textRenderer->EndFrame();
 
-		// swap buffers
-		SDL_GL_SwapWindow(m_window);
+		// render
+		if (m_pipeline != nullptr)
+		{
+			m_pipeline->EndFrame();
+		}
+		else
+		{
+			RenderFrame(packet);
+			SDL_GL_SwapWindow(m_window);
+		}
+	}
+
+	if (m_pipeline != nullptr)
+	{
+		m_pipeline->Stop();
+		delete m_pipeline;
+		m_pipeline = nullptr;
 	}
 
 	Destroy();
+}
+
+void Game::RenderFrame(const RenderPacket& packet)
+{
+	m_textureStreamer->Update();
+
+	// the projection stays in viewport units, only the pixels they cover change with the scale
+	m_dynamicResolution->BeginFrame();
+	m_renderer->SetPixelsPerUnit(m_dynamicResolution->GetScale() * m_windowWidth / m_viewportWidth);
+
+	//glClear(GL_COLOR_BUFFER_BIT);
+	m_renderer->DrawFrame(packet);
+
+	m_dynamicResolution->EndFrame();
+
+	// mesh triangles per frame, averaged over the last second. the draw stats are only touched from here
+	m_statsFrames++;
+	if (SDL_GetTicks() - m_statsStart > 1000)
+	{
+		const MeshDrawStats& meshStats = Mesh::GetDrawStats();
+		if (meshStats.draws > 0)
+		{
+			printf("Mesh triangles/frame: %" PRIu64 " with LOD, %" PRIu64 " without (%" PRIu64 " draws)\n",
+				meshStats.trianglesSubmitted / m_statsFrames, meshStats.trianglesWithoutLod / m_statsFrames, meshStats.draws / m_statsFrames);
+		}
+		Mesh::ResetDrawStats();
+
+		const DynamicResolutionStats& resolutionStats = m_dynamicResolution->GetStats();
+		printf("Resolution: %dx%d (%.0f%%), GPU %.2f ms, render CPU %.2f ms\n", resolutionStats.renderWidth, resolutionStats.renderHeight,
+			resolutionStats.scale * 100.0f, resolutionStats.gpuMs, resolutionStats.cpuMs);
+
+		// samples written per screen pixel, what the fill rate is spent on
+		const FillStats& fillStats = m_renderer->GetFillStats();
+		if (fillStats.screenPixels > 0)
+		{
+			printf("Fill: %.2fx screen, %.2fx opaque, %.2fx translucent\n",
+				(double)(fillStats.opaqueSamples + fillStats.translucentSamples) / fillStats.screenPixels,
+				(double)fillStats.opaqueSamples / fillStats.screenPixels, (double)fillStats.translucentSamples / fillStats.screenPixels);
+		}
+
+		m_statsStart = SDL_GetTicks();
+		m_statsFrames = 0;
+	}
+}
+
+void Game::RunMeshBenchmark(const char* meshPath, int instanceCount, int lightCount)
+{
+	::RunMeshBenchmark(m_window, meshPath, instanceCount, lightCount);
 	Cleanup();
 }
 
+bool Game::RunAnimationBenchmark(int count)
+{
+	bool ok = ::RunAnimationBenchmark(m_window, count);
+	Cleanup();
+	return ok;
+}
+
+void Game::RunTilemapBenchmark(const char* tilesetPath, int mapSize)
+{
+	::RunTilemapBenchmark(m_window, *m_renderer, glm::vec2((float)m_viewportWidth, (float)m_viewportHeight), tilesetPath, mapSize);
+	Cleanup();
+}
+
+void Game::RunSpriteLayerBenchmark(int count)
+{
+	::RunSpriteLayerBenchmark(m_window, *m_renderer, glm::vec2((float)m_viewportWidth, (float)m_viewportHeight), count);
+	Cleanup();
+}
+
+void Game::SetDynamicResolution(float minScale, float maxScale, float targetMs)
+{
+	m_minResolutionScale = minScale;
+	m_maxResolutionScale = maxScale;
+	m_resolutionTargetMs = targetMs;
+}
+
 void Game::SetupGL()
 {
 	glEnable(GL_BLEND);
@@ -148,6 +442,10 @@ void Game::Create()
 
 void Game::HandleInput()
 {
+	// F2 swaps the frame for the overdraw heat map
+	if (m_renderer != nullptr && m_input->IsKeyPressed(SDL_SCANCODE_F2))
+		m_renderer->SetOverdrawView(!m_renderer->GetOverdrawView());
+
 	//m_player->HandleInput(m_input);
 }
 
@@ -187,23 +485,55 @@ void Game::Render()
 	//}
 	//m_player->Render();
 
+	m_textRenderer->DrawFormat(*m_font, glm::vec2(4.0f), 1.0f, "FPS %d (%.2f ms)", m_fps, m_frameMs);
 }
 
 void Game::Destroy()
 {
-
+	// emitters belong to the scene
+	m_particleSystem->Clear();
 }
 
 void Game::Cleanup()
 {
 	delete m_renderer;
 	m_renderer = nullptr;
+
+	delete m_dynamicResolution;
+	m_dynamicResolution = nullptr;
+
+	// streamed textures go back to the streamer, so before it's gone
+	if (m_resourceManager != nullptr)
+		m_resourceManager->UnloadResources();
+	delete m_resourceManager;
+	m_resourceManager = nullptr;
+
+	if (m_textureStreamer != nullptr)
+		m_textureStreamer->Dispose();
+	delete m_textureStreamer;
+	m_textureStreamer = nullptr;
 	
 	delete m_input;
 	m_input = nullptr;
 
-	SDL_GL_DeleteContext(m_context);
-	SDL_DestroyWindow(m_window);
+	delete m_particleSystem;
+	m_particleSystem = nullptr;
+
+	delete m_textRenderer;
+	m_textRenderer = nullptr;
+
+	delete m_font;
+	m_font = nullptr;
+
+	m_jobSystem->Dispose();
+	delete m_jobSystem;
+	m_jobSystem = nullptr;
+
+	if (!m_headless)
+	{
+		SDL_GL_DeleteContext(m_context);
+		SDL_DestroyWindow(m_window);
+	}
 
 	SDL_Quit();
 }
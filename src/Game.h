@@ -4,18 +4,46 @@
 #include <glad/glad.h>
 #include <SDL_opengl.h>
 
+#include "InputLog.h"
+#include "RenderPacket.h"
+
 #include <memory>
+#include <string>
 #include <vector>
 
+class DynamicResolution;
+class Font;
+class FramePipeline;
 class Renderer;
+class ResourceManager;
 class Input;
+class JobSystem;
+class ParticleSystem;
+class TextRenderer;
+class TextureStreamer;
 
 class Game
 {
 public:
 	Game() {}
 	bool Init(int width, int height, bool fullscreen, const char* title);
+	// simulation only, no window or GL. for RunReplay
+	bool InitHeadless();
 	void Run();
+	// replays log runs times instead of Run and prints frame time statistics for each run and all of them
+	void RunReplay(const InputLog& log, int runs);
+	void RunMeshBenchmark(const char* meshPath, int instanceCount, int lightCount); // instead of Run, see MeshBenchmark.h
+	bool RunAnimationBenchmark(int count); // instead of Run, see AnimationBenchmark.h
+	void RunTilemapBenchmark(const char* tilesetPath, int mapSize); // instead of Run, see TilemapBenchmark.h
+	void RunSpriteLayerBenchmark(int count); // instead of Run, see SpriteLayerBenchmark.h
+
+	// frames the simulation runs ahead of rendering, 0 = update and draw in turn on the main thread. before Run
+	void SetFrameLatency(int latency) { m_frameLatency = latency; }
+	// Run records its input to path and saves it on exit. before Run
+	void SetInputRecording(const char* path) { m_recordPath = path; }
+	// Run's render resolution, as a fraction of the window's, moves between minScale and maxScale to keep the
+	// GPU time per frame under targetMs. before Init
+	void SetDynamicResolution(float minScale, float maxScale, float targetMs);
 
 private:
 	void SetupGL();
@@ -29,12 +57,43 @@ private:
 	int m_viewportHeight;
 	Renderer* m_renderer;
 	Input* m_input;
+	TextureStreamer* m_textureStreamer;
+	ResourceManager* m_resourceManager;
+	JobSystem* m_jobSystem;
+	ParticleSystem* m_particleSystem;
+	Font* m_font;
+	TextRenderer* m_textRenderer;
+	DynamicResolution* m_dynamicResolution = nullptr;
+	float m_minResolutionScale = 0.5f;
+	float m_maxResolutionScale = 1.0f;
+	float m_resolutionTargetMs = 15.0f;
+	FramePipeline* m_pipeline = nullptr;
+	int m_frameLatency = 1;
+	RenderPacket m_packet; // when not pipelined
+	bool m_headless = false;
+
+	// recording and replaying
+	std::string m_recordPath;
+	InputLog m_inputLog;
+	float m_tickSeconds = 1.0f / 60.0f;
+	float m_tickAccumulator = 0.0f;
+	std::vector<double> m_frameTimes; // ms, while replaying
+
+	// shown by Render
+	int m_fps = 0;
+	float m_frameMs = 0.0f;
+
+	// render side stats
+	Uint32 m_statsStart = 0;
+	int m_statsFrames = 0;
 
 private:
+	void RunSession(); // Create, the main loop, Destroy
 	void HandleInput();
 	void Update(float dt);
 	void Create(); // scene related
 	void Render(); // scene related
+	void RenderFrame(const RenderPacket& packet); // render thread when pipelined
 	void Destroy(); // scene related
 
 };
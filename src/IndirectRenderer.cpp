@@ -0,0 +1,306 @@
+#include "IndirectRenderer.h"
+
+#include "LightClusters.h"
+#include "MeshArena.h"
+#include "MeshRenderer.h"
+#include "Renderable.h"
+#include "Texture.h"
+#include "VertexFormat.h"
+
+#include <SDL.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// not in the 3.3 glad loader
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+static const GLuint kDrawIdAttribute = 3;
+static const size_t kRowsPerInstance = 3;
+static const size_t kInitialInstanceCapacity = 1024;
+static const size_t kInitialCommandCapacity = 256;
+static const GLint kInstanceTextureUnit = 1;
+
+static const char* kIndirectVertexSource = R"(
+	layout (location = 0) in vec3 a_position;
+	layout (location = 1) in vec3 a_normal;
+	layout (location = 2) in vec2 a_texcoord;
+	layout (location = 3) in uint a_drawId;
+
+	out vec3 v_normal;
+	out vec2 v_texcoord;
+	out vec3 v_worldPosition;
+
+	uniform mat4 u_viewProjection;
+	uniform samplerBuffer u_instanceData;
+
+	void main()
+	{
+		int row = int(a_drawId) * 3;
+		mat4 model = transpose(mat4(texelFetch(u_instanceData, row + 0), texelFetch(u_instanceData, row + 1),
+			texelFetch(u_instanceData, row + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+
+		vec4 worldPosition = model * vec4(DecodePosition(a_position), 1.0);
+		gl_Position = u_viewProjection * worldPosition;
+		v_worldPosition = worldPosition.xyz;
+		v_normal = mat3(model) * DecodeNormal(a_normal);
+		v_texcoord = a_texcoord;
+	}
+)";
+
+void IndirectRenderer::Init(MeshArena* arena)
+{
+	m_arena = arena;
+	LoadIndirectFunctions();
+
+	m_program = CreateMeshShaderProgram(GetFullVertexFormat(), kIndirectVertexSource);
+	glUseProgram(m_program);
+	glUniform1i(glGetUniformLocation(m_program, "u_instanceData"), kInstanceTextureUnit);
+	// the arena is float vertices, nothing to dequantize
+	glUniform3f(glGetUniformLocation(m_program, "u_positionOffset"), 0.0f, 0.0f, 0.0f);
+	glUniform3f(glGetUniformLocation(m_program, "u_positionScale"), 1.0f, 1.0f, 1.0f);
+
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenTextures(1, &m_instanceTexture);
+	glGenBuffers(1, &m_drawIdBuffer);
+	glGenBuffers(1, &m_commandBuffer);
+	Reserve(kInitialInstanceCapacity, kInitialCommandCapacity);
+
+	printf("IndirectRenderer: %s\n", SupportsIndirect() ? "glMultiDrawElementsIndirect" : "no multi-draw indirect, drawing per command");
+}
+
+void IndirectRenderer::Dispose()
+{
+	glDeleteProgram(m_program);
+	glDeleteTextures(1, &m_instanceTexture);
+	glDeleteBuffers(1, &m_instanceBuffer);
+	glDeleteBuffers(1, &m_drawIdBuffer);
+	glDeleteBuffers(1, &m_commandBuffer);
+	m_instanceCapacity = 0;
+	m_commandCapacity = 0;
+}
+
+void IndirectRenderer::LoadIndirectFunctions()
+{
+	// baseInstance is what gives each command its own draw ids, so both extensions are needed
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool core = major > 4 || (major == 4 && minor >= 3);
+	bool extensions = SDL_GL_ExtensionSupported("GL_ARB_multi_draw_indirect") == SDL_TRUE
+		&& SDL_GL_ExtensionSupported("GL_ARB_base_instance") == SDL_TRUE;
+
+	if (core || extensions)
+		m_multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)SDL_GL_GetProcAddress("glMultiDrawElementsIndirect");
+}
+
+void IndirectRenderer::Reserve(size_t instances, size_t commands)
+{
+	if (instances > m_instanceCapacity)
+	{
+		m_instanceCapacity = std::max(m_instanceCapacity, kInitialInstanceCapacity);
+		while (m_instanceCapacity < instances)
+			m_instanceCapacity *= 2;
+
+		glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, m_instanceCapacity * kRowsPerInstance * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glActiveTexture(GL_TEXTURE0 + kInstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_instanceTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instanceBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glActiveTexture(GL_TEXTURE0);
+
+		// never changes, instance i of a command reads id baseInstance + i
+		std::vector<GLuint> ids(m_instanceCapacity);
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			ids[i] = (GLuint)i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	if (commands > m_commandCapacity && SupportsIndirect())
+	{
+		m_commandCapacity = std::max(m_commandCapacity, kInitialCommandCapacity);
+		while (m_commandCapacity < commands)
+			m_commandCapacity *= 2;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
+
+void IndirectRenderer::SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float fovY, float viewportHeight)
+{
+	m_viewProjection = projection * view;
+	m_cameraPosition = cameraPosition;
+	m_fovY = fovY;
+	m_viewportHeight = viewportHeight;
+}
+
+void IndirectRenderer::Submit(iRenderable* renderable)
+{
+	if (renderable->GetMesh() == nullptr)
+		return;
+
+	int meshId = m_arena->FindMesh(renderable->GetMesh());
+	if (meshId < 0)
+		return;
+
+	renderable->UpdateLod(m_cameraPosition, m_fovY, m_viewportHeight);
+	m_items.push_back({ renderable->GetTexture(), meshId, renderable->GetLod(), renderable });
+}
+
+void IndirectRenderer::Render()
+{
+	auto startTime = std::chrono::steady_clock::now();
+	m_stats.drawCalls = 0;
+	m_stats.commands = 0;
+	m_stats.triangles = 0;
+	m_stats.instances = (unsigned int)m_items.size();
+	m_stats.indirect = SupportsIndirect();
+
+	if (m_items.empty())
+	{
+		m_stats.submitMs = 0.0;
+		return;
+	}
+
+	// texture is the only state that changes between multi-draws, so it's the outer key
+	std::sort(m_items.begin(), m_items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.texture != b.texture) return a.texture < b.texture;
+		if (a.meshId != b.meshId) return a.meshId < b.meshId;
+		return a.lod < b.lod;
+	});
+
+	m_instanceData.resize(m_items.size() * kRowsPerInstance);
+	m_commands.clear();
+	m_buckets.clear();
+
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		const DrawItem& item = m_items[i];
+
+		glm::mat4 rows = glm::transpose(item.renderable->GetTransform());
+		m_instanceData[i * kRowsPerInstance + 0] = rows[0];
+		m_instanceData[i * kRowsPerInstance + 1] = rows[1];
+		m_instanceData[i * kRowsPerInstance + 2] = rows[2];
+
+		bool newBucket = m_buckets.empty() || m_buckets.back().first != item.texture;
+		if (newBucket)
+			m_buckets.push_back({ item.texture, m_commands.size() });
+
+		const DrawItem* previous = i > 0 ? &m_items[i - 1] : nullptr;
+		if (!newBucket && previous->meshId == item.meshId && previous->lod == item.lod)
+		{
+			m_commands.back().instanceCount++;
+			continue;
+		}
+
+		const ArenaMesh& mesh = m_arena->GetMesh(item.meshId);
+		const ArenaLod& lod = mesh.lods[std::min(item.lod, (int)mesh.lods.size() - 1)];
+		m_commands.push_back({ lod.indexCount, 1, lod.firstIndex, mesh.baseVertex, (GLuint)i });
+	}
+
+	Reserve(m_items.size(), m_commands.size());
+
+	// orphan last frame's data instead of waiting for the GPU to finish with it
+	glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_instanceCapacity * kRowsPerInstance * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, m_instanceData.size() * sizeof(glm::vec4), m_instanceData.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glUseProgram(m_program);
+	glUniformMatrix4fv(glGetUniformLocation(m_program, "u_viewProjection"), 1, false, glm::value_ptr(m_viewProjection));
+
+	if (m_lightClusters != nullptr)
+		m_lightClusters->Bind(m_program);
+	else
+		glUniform1i(glGetUniformLocation(m_program, "u_useClusters"), 0);
+
+	glActiveTexture(GL_TEXTURE0 + kInstanceTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_instanceTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindVertexArray(m_arena->GetVertexArray());
+	SetDrawIdOffset(0);
+
+	if (SupportsIndirect())
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_commands.size() * sizeof(DrawElementsIndirectCommand), m_commands.data());
+
+		for (size_t b = 0; b < m_buckets.size(); b++)
+		{
+			size_t first = m_buckets[b].second;
+			size_t last = b + 1 < m_buckets.size() ? m_buckets[b + 1].second : m_commands.size();
+
+			BindTexture(m_buckets[b].first);
+			m_multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(first * sizeof(DrawElementsIndirectCommand)),
+				(GLsizei)(last - first), sizeof(DrawElementsIndirectCommand));
+			m_stats.drawCalls++;
+		}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else
+	{
+		for (size_t b = 0; b < m_buckets.size(); b++)
+		{
+			size_t first = m_buckets[b].second;
+			size_t last = b + 1 < m_buckets.size() ? m_buckets[b + 1].second : m_commands.size();
+
+			BindTexture(m_buckets[b].first);
+			for (size_t c = first; c < last; c++)
+			{
+				// no baseInstance in 3.3, so the draw id attribute is re-pointed instead
+				const DrawElementsIndirectCommand& command = m_commands[c];
+				SetDrawIdOffset(command.baseInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+					(const void*)(command.firstIndex * sizeof(unsigned int)), command.instanceCount, command.baseVertex);
+				m_stats.drawCalls++;
+			}
+		}
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0 + kInstanceTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	m_stats.commands = (unsigned int)m_commands.size();
+	for (const DrawElementsIndirectCommand& command : m_commands)
+	{
+		m_stats.triangles += (uint64_t)(command.count / 3) * command.instanceCount;
+	}
+	m_items.clear();
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.submitMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void IndirectRenderer::SetDrawIdOffset(GLuint baseInstance)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_drawIdBuffer);
+	glEnableVertexAttribArray(kDrawIdAttribute);
+	glVertexAttribIPointer(kDrawIdAttribute, 1, GL_UNSIGNED_INT, sizeof(GLuint), (const void*)(baseInstance * sizeof(GLuint)));
+	glVertexAttribDivisor(kDrawIdAttribute, 1);
+}
+
+void IndirectRenderer::BindTexture(Texture* texture)
+{
+	glUniform1i(glGetUniformLocation(m_program, "u_useTexture"), texture != nullptr);
+	if (texture != nullptr)
+		texture->Bind();
+}
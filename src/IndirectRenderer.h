@@ -0,0 +1,104 @@
+#pragma once
+
+// draws 3D renderables whose meshes live in a MeshArena with glMultiDrawElementsIndirect: every mesh/lod
+// in the frame becomes one indirect command, and each texture bucket is a single multi-draw call.
+// world matrices go into a texture buffer indexed by a per-instance draw id (baseInstance + gl_InstanceID),
+// since a 3.3 context has no SSBOs or gl_DrawID. without ARB_multi_draw_indirect the same commands are
+// issued one glDrawElementsInstancedBaseVertex at a time
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class iRenderable;
+class LightClusters;
+class MeshArena;
+class Texture;
+
+// same layout as GL's DrawElementsIndirectCommand
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+struct IndirectRenderStats
+{
+	unsigned int drawCalls;
+	unsigned int commands;
+	unsigned int instances;
+	uint64_t triangles;
+	double submitMs; // CPU time spent issuing the frame, not GPU time
+	bool indirect;   // false when falling back to one draw per command
+};
+
+class IndirectRenderer
+{
+public:
+	IndirectRenderer() = default;
+	~IndirectRenderer() {}
+
+	void Init(MeshArena* arena);
+	void Dispose();
+
+	// point lights binned for the same camera are added on top of the directional light. the clusters
+	// have to be built and uploaded before rendering
+	void SetLightClusters(const LightClusters* clusters) { m_lightClusters = clusters; }
+
+	void SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float fovY, float viewportHeight);
+
+	// picks the lod and queues the renderable, its mesh has to be in the arena
+	void Submit(iRenderable* renderable);
+
+	void Render();
+
+	bool SupportsIndirect() const { return m_multiDrawElementsIndirect != nullptr; }
+	const IndirectRenderStats& GetStats() const { return m_stats; }
+
+private:
+	typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+	struct DrawItem
+	{
+		Texture* texture;
+		int meshId;
+		int lod;
+		const iRenderable* renderable;
+	};
+
+	void LoadIndirectFunctions();
+	void Reserve(size_t instances, size_t commands);
+	void SetDrawIdOffset(GLuint baseInstance);
+	void BindTexture(Texture* texture);
+
+	MeshArena* m_arena = nullptr;
+	const LightClusters* m_lightClusters = nullptr;
+	MultiDrawElementsIndirectProc m_multiDrawElementsIndirect = nullptr;
+
+	GLuint m_program = 0;
+
+	GLuint m_instanceBuffer = 0;  // 3 rows of the world matrix per instance
+	GLuint m_instanceTexture = 0; // GL_TEXTURE_BUFFER view of m_instanceBuffer
+	GLuint m_drawIdBuffer = 0;    // 0..capacity-1, one per instance
+	GLuint m_commandBuffer = 0;
+	size_t m_instanceCapacity = 0;
+	size_t m_commandCapacity = 0;
+
+	std::vector<DrawItem> m_items;
+	std::vector<glm::vec4> m_instanceData;
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	std::vector<std::pair<Texture*, size_t>> m_buckets; // texture and first command, in command order
+
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+	float m_fovY = 1.0f;
+	float m_viewportHeight = 1.0f;
+
+	IndirectRenderStats m_stats = { 0, 0, 0, 0, 0.0, false };
+
+};
@@ -1,6 +1,10 @@
 #include "Input.h"
 
+#include "InputLog.h"
+
 Input::Input()
+	: m_mouseAbsPos(0.0f)
+	, m_mouseRelPos(0.0f)
 {
 	// find the number of keys
 	SDL_GetKeyboardState(&m_numKeys);
@@ -23,10 +27,15 @@ Input::~Input()
 
 bool Input::HandleEvents()
 {
+	if (m_replayLog != nullptr)
+		return ReplayFrame();
+
 	// handle input events
 	while (SDL_PollEvent(&m_event) != 0) {
 		switch(m_event.type) {
 		case SDL_QUIT:
+			if (m_recordLog != nullptr)
+				RecordFrame(true);
 			return false;
 		case SDL_KEYDOWN:
 			m_keyboardState[m_event.key.keysym.scancode] = true;
@@ -46,9 +55,94 @@ bool Input::HandleEvents()
 	m_mouseRelPos = glm::vec2(static_cast<float>(relX), static_cast<float>(relY));
 	//m_mouseRelPos = (m_mouseRelPos / glm::vec2(800.0f, 600.0f));//*vVirtualSize;
 
+	if (m_recordLog != nullptr)
+		RecordFrame(false);
+
 	return true;
 }
 
+void Input::StartRecording(InputLog* log)
+{
+	Stop();
+	m_recordLog = log;
+	m_recordLog->Clear();
+}
+
+void Input::StartReplay(const InputLog* log)
+{
+	Stop();
+	m_replayLog = log;
+	m_logFrame = 0;
+
+	for (int i = 0; i < m_numKeys; i++) {
+		m_keyboardState[i] = false;
+		m_lastKeyboardState[i] = false;
+	}
+	m_mouseAbsPos = glm::vec2(0.0f);
+	m_mouseRelPos = glm::vec2(0.0f);
+}
+
+void Input::Stop()
+{
+	m_recordLog = nullptr;
+	m_replayLog = nullptr;
+}
+
+int Input::SyncTicks(int ticks)
+{
+	if (m_replayLog != nullptr)
+		return m_logFrame > 0 ? m_replayLog->GetFrame(m_logFrame - 1).ticks : 0;
+
+	if (m_recordLog != nullptr && m_recordLog->GetNumFrames() > 0)
+		m_recordLog->GetFrame(m_recordLog->GetNumFrames() - 1).ticks = static_cast<uint8_t>(ticks);
+
+	return ticks;
+}
+
+void Input::RecordFrame(bool quit)
+{
+	// the last state still holds the previous frame's keys until Update, so the difference is this frame's changes
+	m_keyChanges.clear();
+	for (int i = 0; i < m_numKeys; i++) {
+		if (m_keyboardState[i] != m_lastKeyboardState[i])
+			m_keyChanges.push_back(static_cast<uint16_t>(i) | (m_keyboardState[i] ? InputLog::kKeyDownBit : 0));
+	}
+
+	InputFrame& frame = m_recordLog->AddFrame(m_keyChanges.data(), m_keyChanges.size());
+	frame.quit = quit;
+	frame.mouseX = static_cast<int16_t>(m_mouseAbsPos.x);
+	frame.mouseY = static_cast<int16_t>(m_mouseAbsPos.y);
+	frame.mouseRelX = static_cast<int16_t>(m_mouseRelPos.x);
+	frame.mouseRelY = static_cast<int16_t>(m_mouseRelPos.y);
+}
+
+bool Input::ReplayFrame()
+{
+	// a windowed replay still has to service the window or the OS decides it has hung. the events are dropped,
+	// the log is the input. headless replays have no event queue
+	if (SDL_WasInit(SDL_INIT_VIDEO) != 0)
+	{
+		SDL_PumpEvents();
+		SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+	}
+
+	if (m_logFrame >= m_replayLog->GetNumFrames())
+		return false;
+
+	const InputFrame& frame = m_replayLog->GetFrame(m_logFrame++);
+	const uint16_t* keyChanges = m_replayLog->GetKeyChanges(frame);
+	for (int i = 0; i < frame.keyChangeCount; i++) {
+		int scancode = keyChanges[i] & ~InputLog::kKeyDownBit;
+		if (scancode < m_numKeys)
+			m_keyboardState[scancode] = (keyChanges[i] & InputLog::kKeyDownBit) != 0;
+	}
+
+	m_mouseAbsPos = glm::vec2(frame.mouseX, frame.mouseY);
+	m_mouseRelPos = glm::vec2(frame.mouseRelX, frame.mouseRelY);
+
+	return !frame.quit;
+}
+
 void Input::Update()
 {
 	// update last state
@@ -3,6 +3,11 @@
 #include <SDL.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <vector>
+
+class InputLog;
+
 class Input
 {
 public:
@@ -12,6 +17,18 @@ public:
 	bool HandleEvents();
 	void Update();
 
+	// every HandleEvents appends the frame's key changes and mouse state to log
+	void StartRecording(InputLog* log);
+	// HandleEvents reads the next frame from log instead of SDL, and returns false once it runs out.
+	// resets the key and mouse state, so a log can be replayed again from the start
+	void StartReplay(const InputLog* log);
+	void Stop();
+	bool IsReplaying() const { return m_replayLog != nullptr; }
+
+	// fixed timestep ticks the simulation runs this frame, after HandleEvents. the given count is stored
+	// while recording and replaced by the recorded one while replaying
+	int SyncTicks(int ticks);
+
 	bool IsKeyPressed(Uint8 key) const;
 	bool IsKeyHeld(Uint8 key) const;
 	glm::vec2 GetMouseAbsPos() const;
@@ -27,4 +44,12 @@ private:
 	glm::vec2 m_mouseAbsPos;
 	glm::vec2 m_mouseRelPos;
 
+	void RecordFrame(bool quit);
+	bool ReplayFrame();
+
+	InputLog* m_recordLog = nullptr;
+	const InputLog* m_replayLog = nullptr;
+	size_t m_logFrame = 0; // frame HandleEvents last recorded or replayed
+	std::vector<uint16_t> m_keyChanges;
+
 };
@@ -0,0 +1,165 @@
+#include "InputLog.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char kMagic[4] = { 'I', 'N', 'P', 'L' };
+static const uint32_t kVersion = 1;
+
+enum InputFrameFlags : uint8_t
+{
+	FrameQuit = 1 << 0,
+	FrameMouseMoved = 1 << 1,
+	FrameMouseRelative = 1 << 2
+};
+
+struct InputLogHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numFrames;
+	float tickSeconds;
+};
+
+template <typename T>
+static void Write(std::ofstream& file, const T& value)
+{
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool Read(std::ifstream& file, T& value)
+{
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+void InputLog::Clear()
+{
+	m_frames.clear();
+	m_keyChanges.clear();
+}
+
+InputFrame& InputLog::AddFrame(const uint16_t* keyChanges, size_t keyChangeCount)
+{
+	InputFrame frame = {};
+	frame.firstKeyChange = static_cast<uint32_t>(m_keyChanges.size());
+	frame.keyChangeCount = static_cast<uint16_t>(keyChangeCount);
+	m_keyChanges.insert(m_keyChanges.end(), keyChanges, keyChanges + keyChangeCount);
+
+	m_frames.push_back(frame);
+	return m_frames.back();
+}
+
+bool InputLog::Save(const char* path) const
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << " for writing\n";
+		return false;
+	}
+
+	InputLogHeader header;
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.numFrames = static_cast<uint32_t>(m_frames.size());
+	header.tickSeconds = m_tickSeconds;
+	Write(file, header);
+
+	int16_t mouseX = 0;
+	int16_t mouseY = 0;
+	for (const InputFrame& frame : m_frames)
+	{
+		uint8_t flags = 0;
+		if (frame.quit)
+			flags |= FrameQuit;
+		if (frame.mouseX != mouseX || frame.mouseY != mouseY)
+			flags |= FrameMouseMoved;
+		if (frame.mouseRelX != 0 || frame.mouseRelY != 0)
+			flags |= FrameMouseRelative;
+
+		Write(file, flags);
+		Write(file, frame.ticks);
+		Write(file, frame.keyChangeCount);
+		if (flags & FrameMouseMoved)
+		{
+			Write(file, frame.mouseX);
+			Write(file, frame.mouseY);
+		}
+		if (flags & FrameMouseRelative)
+		{
+			Write(file, frame.mouseRelX);
+			Write(file, frame.mouseRelY);
+		}
+		file.write(reinterpret_cast<const char*>(GetKeyChanges(frame)), frame.keyChangeCount * sizeof(uint16_t));
+
+		mouseX = frame.mouseX;
+		mouseY = frame.mouseY;
+	}
+
+	if (!file)
+	{
+		std::cerr << "Failed to write " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool InputLog::Load(const char* path)
+{
+	Clear();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << path << "\n";
+		return false;
+	}
+
+	InputLogHeader header;
+	if (!Read(file, header) || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion)
+	{
+		std::cerr << "Not an input log: " << path << "\n";
+		return false;
+	}
+	m_tickSeconds = header.tickSeconds;
+
+	m_frames.reserve(header.numFrames);
+	int16_t mouseX = 0;
+	int16_t mouseY = 0;
+	std::vector<uint16_t> keyChanges;
+	for (uint32_t i = 0; i < header.numFrames; i++)
+	{
+		uint8_t flags, ticks;
+		uint16_t keyChangeCount;
+		int16_t mouseRelX = 0;
+		int16_t mouseRelY = 0;
+		bool ok = Read(file, flags) && Read(file, ticks) && Read(file, keyChangeCount);
+		if (ok && (flags & FrameMouseMoved))
+			ok = Read(file, mouseX) && Read(file, mouseY);
+		if (ok && (flags & FrameMouseRelative))
+			ok = Read(file, mouseRelX) && Read(file, mouseRelY);
+
+		keyChanges.resize(keyChangeCount);
+		if (ok && keyChangeCount > 0)
+			ok = static_cast<bool>(file.read(reinterpret_cast<char*>(keyChanges.data()), keyChangeCount * sizeof(uint16_t)));
+
+		if (!ok)
+		{
+			std::cerr << "Truncated input log " << path << " at frame " << i << "\n";
+			Clear();
+			return false;
+		}
+
+		InputFrame& frame = AddFrame(keyChanges.data(), keyChanges.size());
+		frame.quit = (flags & FrameQuit) != 0;
+		frame.ticks = ticks;
+		frame.mouseX = mouseX;
+		frame.mouseY = mouseY;
+		frame.mouseRelX = mouseRelX;
+		frame.mouseRelY = mouseRelY;
+	}
+
+	return true;
+}
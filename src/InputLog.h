@@ -0,0 +1,53 @@
+#pragma once
+
+// per frame input captured by Input while recording, and fed back through it when replaying.
+// a frame holds the key changes since the previous frame, the mouse state and how many fixed timestep ticks
+// the simulation ran, so a replay advances exactly like the recorded session did whatever its frame rate.
+// on disk every frame is a flags byte, the tick count and the number of key changes, followed by the mouse
+// position only when it moved and the relative motion only when there was some
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct InputFrame
+{
+	bool quit;
+	uint8_t ticks;
+	int16_t mouseX;
+	int16_t mouseY;
+	int16_t mouseRelX;
+	int16_t mouseRelY;
+	uint32_t firstKeyChange; // into InputLog's key changes
+	uint16_t keyChangeCount;
+};
+
+class InputLog
+{
+public:
+	// scancode in the low bits, set when the key went down
+	static const uint16_t kKeyDownBit = 0x8000;
+
+	InputLog() = default;
+
+	void Clear();
+	void SetTickSeconds(float tickSeconds) { m_tickSeconds = tickSeconds; }
+	float GetTickSeconds() const { return m_tickSeconds; }
+
+	// keyChanges are scancodes, or'd with kKeyDownBit for presses
+	InputFrame& AddFrame(const uint16_t* keyChanges, size_t keyChangeCount);
+
+	size_t GetNumFrames() const { return m_frames.size(); }
+	InputFrame& GetFrame(size_t index) { return m_frames[index]; }
+	const InputFrame& GetFrame(size_t index) const { return m_frames[index]; }
+	const uint16_t* GetKeyChanges(const InputFrame& frame) const { return m_keyChanges.data() + frame.firstKeyChange; }
+
+	bool Save(const char* path) const;
+	bool Load(const char* path);
+
+private:
+	std::vector<InputFrame> m_frames;
+	std::vector<uint16_t> m_keyChanges;
+	float m_tickSeconds = 1.0f / 60.0f;
+
+};
@@ -0,0 +1,118 @@
+#include "JobBenchmark.h"
+
+#include "Entity3D.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+struct BenchmarkEntity
+{
+	Entity3D entity;
+	glm::vec3 velocity;
+	glm::vec3 spin;
+	float radius;
+};
+
+// entities per job, small enough that 16 threads all get a few ranges at 10k entities
+static const size_t kEntitiesPerJob = 512;
+
+static double RunPass(unsigned int numThreads, std::vector<BenchmarkEntity>& entities, const Frustum& frustum, int frames, unsigned int& outVisible)
+{
+	JobSystem jobSystem;
+	jobSystem.Init(numThreads);
+
+	const float dt = 1.0f / 60.0f;
+	std::atomic<unsigned int> visible(0);
+
+	auto updateRange = [&entities, &frustum, &visible, dt](size_t begin, size_t end) {
+		unsigned int rangeVisible = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			BenchmarkEntity& e = entities[i];
+
+			glm::vec3 position = e.entity.GetPosition() + e.velocity * dt;
+			// bounce inside the box so the visible set keeps changing but stays bounded
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (fabsf(position[axis]) > 500.0f)
+					e.velocity[axis] = -e.velocity[axis];
+			}
+
+			e.entity.SetPosition(position);
+			e.entity.SetRotation(e.entity.GetRotation() + e.spin * dt);
+			e.entity.UpdateTransform();
+
+			if (frustum.IntersectsSphere(glm::vec3(e.entity.GetTransform()[3]), e.radius))
+				rangeVisible++;
+		}
+		visible += rangeVisible;
+	};
+
+	// warm up the threads and caches
+	jobSystem.ParallelFor(entities.size(), kEntitiesPerJob, updateRange);
+
+	auto startTime = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		visible = 0;
+		jobSystem.ParallelFor(entities.size(), kEntitiesPerJob, updateRange);
+	}
+	auto endTime = std::chrono::steady_clock::now();
+
+	jobSystem.Dispose();
+
+	outVisible = visible;
+	return std::chrono::duration<double, std::milli>(endTime - startTime).count() / frames;
+}
+
+void RunJobBenchmark(int entityCount, int frames)
+{
+	srand(1234);
+	auto random = [](float range) { return (rand() / (float)RAND_MAX * 2.0f - 1.0f) * range; };
+
+	std::vector<BenchmarkEntity> entities(entityCount);
+	for (BenchmarkEntity& e : entities)
+	{
+		e.entity.SetPosition(glm::vec3(random(500.0f), random(500.0f), random(500.0f)));
+		e.entity.SetScale(glm::vec3(1.0f + random(0.5f)));
+		e.velocity = glm::vec3(random(20.0f), random(20.0f), random(20.0f));
+		e.spin = glm::vec3(random(2.0f), random(2.0f), random(2.0f));
+		e.radius = 2.0f;
+	}
+
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -700.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, 2000.0f);
+	Frustum frustum(projection * view);
+
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int n = 1; n < maxThreads; n *= 2)
+	{
+		threadCounts.push_back(n);
+	}
+	threadCounts.push_back(maxThreads);
+
+	printf("\n%d entities, %d frames, %u hardware threads\n", entityCount, frames, maxThreads);
+	printf("threads   update (ms)   speedup   visible\n");
+
+	double singleThreadMs = 0.0;
+	for (unsigned int numThreads : threadCounts)
+	{
+		unsigned int visible = 0;
+		double ms = RunPass(numThreads, entities, frustum, frames, visible);
+		if (numThreads == 1)
+			singleThreadMs = ms;
+
+		printf("%7u   %11.3f   %6.2fx   %7u\n", numThreads, ms, singleThreadMs / ms, visible);
+	}
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// synthetic entity update (move, spin, rebuild the world matrix, frustum test) run through JobSystem::ParallelFor
+// with 1, 2, 4 ... up to every hardware thread, printing frame time and speedup over one thread. no GL needed
+void RunJobBenchmark(int entityCount, int frames = 100);
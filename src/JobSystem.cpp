@@ -0,0 +1,184 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// how many times an idle worker looks for work before going to sleep
+static const int kIdleSpins = 64;
+
+static thread_local int t_threadIndex = -1;
+
+JobSystem::~JobSystem()
+{
+	Dispose();
+}
+
+void JobSystem::Init(unsigned int numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	m_numThreads = numThreads;
+	m_queues.reset(new WorkQueue[m_numThreads]);
+	m_queuedJobs = 0;
+	m_quit = false;
+
+	t_threadIndex = 0;
+	for (unsigned int i = 1; i < m_numThreads; i++)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerThread, this, i);
+	}
+}
+
+void JobSystem::Dispose()
+{
+	if (m_workers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+	m_numThreads = 1;
+}
+
+int JobSystem::GetThreadIndex()
+{
+	return t_threadIndex;
+}
+
+void JobSystem::Run(const Job& job)
+{
+	Run(&job, 1);
+}
+
+void JobSystem::Run(const Job* jobs, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (jobs[i].counter != nullptr)
+			jobs[i].counter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (m_numThreads <= 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			Execute(jobs[i]);
+		}
+		return;
+	}
+
+	WorkQueue& queue = m_queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.insert(queue.jobs.end(), jobs, jobs + count);
+	}
+	m_queuedJobs.fetch_add((int)count);
+
+	// taking the lock orders this against a worker that has just checked m_queuedJobs and is about to wait
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	if (count == 1)
+		m_wake.notify_one();
+	else
+		m_wake.notify_all();
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	unsigned int index = GetQueueIndex();
+	while (counter.value.load(std::memory_order_acquire) > 0)
+	{
+		Job job;
+		if (PopOrSteal(index, job))
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerThread(unsigned int index)
+{
+	t_threadIndex = (int)index;
+
+	int idleSpins = 0;
+	while (!m_quit)
+	{
+		Job job;
+		if (PopOrSteal(index, job))
+		{
+			Execute(job);
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < kIdleSpins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_queuedJobs.load() > 0 || m_quit; });
+		idleSpins = 0;
+	}
+}
+
+bool JobSystem::PopOrSteal(unsigned int index, Job& outJob)
+{
+	if (m_queuedJobs.load(std::memory_order_relaxed) <= 0)
+		return false;
+
+	// newest of our own first, it's the most likely to still be in cache
+	{
+		WorkQueue& queue = m_queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			outJob = queue.jobs.back();
+			queue.jobs.pop_back();
+			m_queuedJobs.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// then the oldest from someone else, which tends to be the biggest piece of work left
+	for (unsigned int i = 1; i < m_numThreads; i++)
+	{
+		WorkQueue& queue = m_queues[(index + i) % m_numThreads];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			outJob = queue.jobs.front();
+			queue.jobs.pop_front();
+			m_queuedJobs.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+	job.function(job.data, job.begin, job.end);
+
+	if (job.counter != nullptr)
+		job.counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+unsigned int JobSystem::GetQueueIndex() const
+{
+	// threads outside the pool share the first queue, it's locked like any other
+	int index = t_threadIndex;
+	return index >= 0 && (unsigned int)index < m_numThreads ? (unsigned int)index : 0;
+}
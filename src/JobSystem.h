@@ -0,0 +1,129 @@
+#pragma once
+
+// fixed pool of worker threads running small jobs.
+// every thread (workers and the one that called Init) has its own deque: jobs are pushed and popped at the
+// back by the owner and stolen from the front by idle threads, so a thread mostly works through its own jobs
+// in LIFO order and only touches another queue when it runs dry.
+// a job can decrement a JobCounter when it finishes. Wait(counter) blocks until it reaches zero, running
+// other jobs in the meantime, so jobs can wait on their own children without deadlocking the pool
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobCounter
+{
+	std::atomic<int> value{ 0 };
+};
+
+// processes items [begin, end). data is whatever the caller needs, it has to outlive the job
+typedef void (*JobFunction)(void* data, size_t begin, size_t end);
+
+struct Job
+{
+	JobFunction function;
+	void* data;
+	size_t begin;
+	size_t end;
+	JobCounter* counter; // optional, decremented once the job has run
+};
+
+class JobSystem
+{
+public:
+	JobSystem() = default;
+	~JobSystem();
+
+	// numThreads includes the calling thread, 0 = one per hardware thread. 1 runs everything inline
+	void Init(unsigned int numThreads = 0);
+	void Dispose();
+
+	// the counter is incremented here, so it's safe to Wait on it straight after
+	void Run(const Job& job);
+	void Run(const Job* jobs, size_t count);
+
+	// helps out with queued jobs until counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// splits [0, count) into ranges of about grainSize and calls function(begin, end) on each, in parallel.
+	// returns once every range has run
+	template <typename Function>
+	void ParallelFor(size_t count, size_t grainSize, const Function& function);
+
+	unsigned int GetNumThreads() const { return m_numThreads; }
+
+	// 0 for the thread that called Init, 1..n-1 for workers, -1 for anything else
+	static int GetThreadIndex();
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void WorkerThread(unsigned int index);
+	bool PopOrSteal(unsigned int index, Job& outJob);
+	void Execute(const Job& job);
+	unsigned int GetQueueIndex() const;
+
+	template <typename Function>
+	static void RunRange(void* data, size_t begin, size_t end)
+	{
+		(*static_cast<const Function*>(data))(begin, end);
+	}
+
+	unsigned int m_numThreads = 1;
+	std::vector<std::thread> m_workers;
+	std::unique_ptr<WorkQueue[]> m_queues;
+
+	// sleeping workers
+	std::atomic<int> m_queuedJobs{ 0 };
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<bool> m_quit{ false };
+
+};
+
+template <typename Function>
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const Function& function)
+{
+	if (count == 0)
+		return;
+
+	if (grainSize == 0)
+		grainSize = 1;
+
+	// no point queueing anything for a single range
+	if (m_numThreads <= 1 || count <= grainSize)
+	{
+		function((size_t)0, count);
+		return;
+	}
+
+	// a few ranges per thread so uneven ranges balance out through stealing
+	size_t maxRanges = (size_t)m_numThreads * 4;
+	size_t numRanges = (count + grainSize - 1) / grainSize;
+	if (numRanges > maxRanges)
+		numRanges = maxRanges;
+
+	// Run copies the jobs into the queues, so the scratch can be reused straight away by nested calls
+	static thread_local std::vector<Job> jobs;
+	jobs.clear();
+
+	JobCounter counter;
+	for (size_t i = 0; i < numRanges; i++)
+	{
+		size_t begin = count * i / numRanges;
+		size_t end = count * (i + 1) / numRanges;
+		jobs.push_back({ &RunRange<Function>, const_cast<Function*>(&function), begin, end, &counter });
+	}
+
+	Run(jobs.data(), jobs.size());
+	Wait(counter);
+}
@@ -0,0 +1,102 @@
+#include "LightClusterBenchmark.h"
+
+#include "JobSystem.h"
+#include "LightClusters.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static double RunPass(LightClusters& clusters, const std::vector<PointLight>& lights, const glm::mat4& view, int frames)
+{
+	double binMs = 0.0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		clusters.Build(lights.data(), lights.size(), view);
+		binMs += clusters.GetStats().binMs;
+	}
+	return binMs / frames;
+}
+
+static void PrintResult(const char* label, const LightClusters& clusters, double binMs, bool matchesScalar)
+{
+	const LightClusterStats& stats = clusters.GetStats();
+
+	unsigned int litClusters = 0;
+	for (int z = 0; z < LightClusters::kClustersZ; z++)
+	{
+		for (int y = 0; y < LightClusters::kClustersY; y++)
+		{
+			for (int x = 0; x < LightClusters::kClustersX; x++)
+			{
+				if (clusters.GetClusterLightCount(x, y, z) > 0)
+					litClusters++;
+			}
+		}
+	}
+
+	printf("%-16s   %8.3f   %7u   %11u   %14.1f   %11u   %7u   %s\n", label, binMs, stats.visibleLights, stats.assignments,
+		litClusters > 0 ? stats.assignments / (double)litClusters : 0.0, stats.maxLightsPerCluster, stats.droppedAssignments,
+		matchesScalar ? "yes" : "NO");
+}
+
+void RunLightClusterBenchmark(int lightCount, int frames)
+{
+	auto random = [](float range) { return rand() / (float)RAND_MAX * range; };
+	srand(1234);
+
+	// a 400x400 level with lights up to 20 high, a few big ones among many small
+	const float levelSize = 400.0f;
+	std::vector<PointLight> lights(lightCount);
+	for (PointLight& light : lights)
+	{
+		light.position = glm::vec3(random(levelSize) - levelSize * 0.5f, random(20.0f), random(levelSize) - levelSize * 0.5f);
+		light.radius = rand() % 16 == 0 ? 15.0f + random(15.0f) : 2.0f + random(6.0f);
+		light.color = glm::vec3(0.2f + random(0.8f), 0.2f + random(0.8f), 0.2f + random(0.8f));
+		light.intensity = 1.0f;
+	}
+
+	// above one edge looking down across it
+	glm::vec3 eye(0.0f, 60.0f, levelSize * 0.5f + 20.0f);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	LightClusters clusters;
+	clusters.SetProjection(glm::radians(60.0f), 0.5f, levelSize, 1280, 720);
+
+	printf("\n%d lights, %dx%dx%d clusters, %d frames\n", lightCount, LightClusters::kClustersX, LightClusters::kClustersY,
+		LightClusters::kClustersZ, frames);
+	printf("kernel             bin (ms)   visible   assignments   lights/cluster   max/cluster   dropped   matches scalar\n");
+
+	// every kernel should bin exactly the same lights into the same clusters
+	std::vector<uint32_t> scalarIndices;
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		clusters.SetSimdLevel(level);
+		double binMs = RunPass(clusters, lights, view, frames);
+		if (level == SimdLevel::Scalar)
+			scalarIndices = clusters.GetLightIndices();
+
+		PrintResult(GetSimdLevelName(level), clusters, binMs, clusters.GetLightIndices() == scalarIndices);
+	}
+
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	JobSystem jobSystem;
+	jobSystem.Init(numThreads);
+	clusters.SetJobSystem(&jobSystem);
+	clusters.SetSimdLevel(GetBestSimdLevel());
+
+	double threadedMs = RunPass(clusters, lights, view, frames);
+	char label[32];
+	snprintf(label, sizeof(label), "%s, %u threads", GetSimdLevelName(GetBestSimdLevel()), numThreads);
+	PrintResult(label, clusters, threadedMs, clusters.GetLightIndices() == scalarIndices);
+
+	jobSystem.Dispose();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// lightCount point lights scattered over a large flat level seen from one end. bins them into the clusters
+// with each SIMD level on one thread, then with the job system on every hardware thread, checks the SIMD
+// light lists against the scalar ones and prints binning time, assignments and the average and worst lights
+// per cluster a fragment would loop over. CPU only, no GL needed
+void RunLightClusterBenchmark(int lightCount, int frames = 200);
@@ -0,0 +1,412 @@
+#include "LightClusters.h"
+
+#include "JobSystem.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+const char* kClusteredLightingGLSL = R"(
+	uniform samplerBuffer u_lightData;
+	uniform usamplerBuffer u_clusterGrid;
+	uniform usamplerBuffer u_lightIndices;
+	uniform int u_useClusters;
+	uniform mat4 u_view;
+	uniform vec2 u_viewportSize;
+	uniform ivec3 u_clusterCount;
+	uniform vec2 u_clusterDepth; // slice = log(depth) * x + y
+
+	vec3 ClusteredLighting(vec3 worldPosition, vec3 normal)
+	{
+		if (u_useClusters == 0)
+			return vec3(0.0);
+
+		float depth = -(u_view * vec4(worldPosition, 1.0)).z;
+		ivec3 cluster;
+		cluster.xy = ivec2(gl_FragCoord.xy / u_viewportSize * vec2(u_clusterCount.xy));
+		cluster.z = int(log(max(depth, 1e-4)) * u_clusterDepth.x + u_clusterDepth.y);
+		cluster = clamp(cluster, ivec3(0), u_clusterCount - 1);
+
+		uvec2 range = texelFetch(u_clusterGrid, (cluster.z * u_clusterCount.y + cluster.y) * u_clusterCount.x + cluster.x).xy;
+		vec3 result = vec3(0.0);
+		for (uint i = 0u; i < range.y; i++)
+		{
+			int light = int(texelFetch(u_lightIndices, int(range.x + i)).x) * 2;
+			vec4 positionRadius = texelFetch(u_lightData, light);
+			vec3 color = texelFetch(u_lightData, light + 1).rgb;
+
+			vec3 toLight = positionRadius.xyz - worldPosition;
+			float distance = length(toLight);
+			float falloff = clamp(1.0 - distance / positionRadius.w, 0.0, 1.0);
+			result += color * (falloff * falloff * max(dot(normal, toLight / max(distance, 1e-4)), 0.0));
+		}
+		return result;
+	}
+)";
+
+// bit k set when the sphere touches cluster k of the kClustersX in a row. distance from the centre to
+// each box is the per axis excess past either face, 0 inside
+
+static uint32_t TestRowScalar(const float* const* boundsMin, const float* const* boundsMax, const glm::vec4& sphere)
+{
+	uint32_t mask = 0;
+	for (int k = 0; k < LightClusters::kClustersX; k++)
+	{
+		float distanceSquared = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float d = std::max(std::max(boundsMin[axis][k] - sphere[axis], sphere[axis] - boundsMax[axis][k]), 0.0f);
+			distanceSquared += d * d;
+		}
+		if (distanceSquared <= sphere.w * sphere.w)
+			mask |= 1u << k;
+	}
+	return mask;
+}
+
+#if defined(CPU_X86)
+
+static uint32_t TestRowSse(const float* const* boundsMin, const float* const* boundsMax, const glm::vec4& sphere)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 radiusSquared = _mm_set1_ps(sphere.w * sphere.w);
+
+	uint32_t mask = 0;
+	for (int k = 0; k < LightClusters::kClustersX; k += 4)
+	{
+		__m128 distanceSquared = zero;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 center = _mm_set1_ps(sphere[axis]);
+			__m128 below = _mm_sub_ps(_mm_loadu_ps(boundsMin[axis] + k), center);
+			__m128 above = _mm_sub_ps(center, _mm_loadu_ps(boundsMax[axis] + k));
+			__m128 d = _mm_max_ps(_mm_max_ps(below, above), zero);
+			distanceSquared = _mm_add_ps(distanceSquared, _mm_mul_ps(d, d));
+		}
+		mask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared)) << k;
+	}
+	return mask;
+}
+
+// plain multiply and add rather than FMA, so it agrees with the other kernels on lights grazing a cluster
+CPU_TARGET_AVX2 static uint32_t TestRowAvx2(const float* const* boundsMin, const float* const* boundsMax, const glm::vec4& sphere)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 radiusSquared = _mm256_set1_ps(sphere.w * sphere.w);
+
+	uint32_t mask = 0;
+	for (int k = 0; k < LightClusters::kClustersX; k += 8)
+	{
+		__m256 distanceSquared = zero;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m256 center = _mm256_set1_ps(sphere[axis]);
+			__m256 below = _mm256_sub_ps(_mm256_loadu_ps(boundsMin[axis] + k), center);
+			__m256 above = _mm256_sub_ps(center, _mm256_loadu_ps(boundsMax[axis] + k));
+			__m256 d = _mm256_max_ps(_mm256_max_ps(below, above), zero);
+			distanceSquared = _mm256_add_ps(distanceSquared, _mm256_mul_ps(d, d));
+		}
+		mask |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(distanceSquared, radiusSquared, _CMP_LE_OQ)) << k;
+	}
+	return mask;
+}
+
+#endif
+
+static_assert(LightClusters::kClustersX % 8 == 0, "the row kernels test 8 clusters at a time");
+
+static uint32_t TestRow(SimdLevel level, const float* const* boundsMin, const float* const* boundsMax, const glm::vec4& sphere)
+{
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2: return TestRowAvx2(boundsMin, boundsMax, sphere);
+	case SimdLevel::Sse: return TestRowSse(boundsMin, boundsMax, sphere);
+#endif
+	default: return TestRowScalar(boundsMin, boundsMax, sphere);
+	}
+}
+
+static bool SphereTouchesBox(const glm::vec4& sphere, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	float dx = std::max(std::max(boxMin.x - sphere.x, sphere.x - boxMax.x), 0.0f);
+	float dy = std::max(std::max(boxMin.y - sphere.y, sphere.y - boxMax.y), 0.0f);
+	float dz = std::max(std::max(boxMin.z - sphere.z, sphere.z - boxMax.z), 0.0f);
+	return dx * dx + dy * dy + dz * dz <= sphere.w * sphere.w;
+}
+
+// grows the buffer if needed and replaces its contents
+static void UploadBuffer(GLuint buffer, size_t& capacity, const void* data, size_t bytes)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	if (bytes > capacity)
+	{
+		capacity = std::max(bytes, capacity * 2);
+		glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	}
+	if (bytes > 0)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Init()
+{
+	static const GLenum kFormats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	static const size_t kInitialCapacity = 64 * 1024;
+
+	glGenBuffers(3, m_buffers);
+	glGenTextures(3, m_textures);
+	for (int i = 0; i < 3; i++)
+	{
+		m_capacities[i] = kInitialCapacity;
+		glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, m_capacities[i], NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, kFormats[i], m_buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// nothing binned yet, every cluster empty
+	m_grid.assign(kNumClusters * 2, 0);
+	Upload();
+}
+
+void LightClusters::Dispose()
+{
+	glDeleteTextures(3, m_textures);
+	glDeleteBuffers(3, m_buffers);
+	for (int i = 0; i < 3; i++)
+	{
+		m_textures[i] = 0;
+		m_buffers[i] = 0;
+		m_capacities[i] = 0;
+	}
+}
+
+void LightClusters::SetProjection(float fovY, float nearPlane, float farPlane, int viewportWidth, int viewportHeight)
+{
+	m_nearPlane = nearPlane;
+	m_farPlane = farPlane;
+	m_viewportSize = glm::vec2((float)viewportWidth, (float)viewportHeight);
+
+	float logRatio = std::log(farPlane / nearPlane);
+	m_sliceScale = kClustersZ / logRatio;
+	m_sliceBias = -kClustersZ * std::log(nearPlane) / logRatio;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		m_boundsMin[axis].resize(kNumClusters);
+		m_boundsMax[axis].resize(kNumClusters);
+	}
+	m_rowMin.resize(kClustersZ * kClustersY);
+	m_rowMax.resize(kClustersZ * kClustersY);
+
+	float tanHalfY = std::tan(fovY * 0.5f);
+	float tanHalfX = tanHalfY * m_viewportSize.x / m_viewportSize.y;
+
+	for (int z = 0; z < kClustersZ; z++)
+	{
+		// exponential slices, each one the same ratio deeper than the last
+		float depths[2] = {
+			nearPlane * std::pow(farPlane / nearPlane, (float)z / kClustersZ),
+			nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / kClustersZ)
+		};
+
+		for (int y = 0; y < kClustersY; y++)
+		{
+			float ndcY[2] = { -1.0f + 2.0f * y / kClustersY, -1.0f + 2.0f * (y + 1) / kClustersY };
+			glm::vec3 rowMin(FLT_MAX), rowMax(-FLT_MAX);
+
+			for (int x = 0; x < kClustersX; x++)
+			{
+				float ndcX[2] = { -1.0f + 2.0f * x / kClustersX, -1.0f + 2.0f * (x + 1) / kClustersX };
+
+				// the box around the 8 corners of the cluster's frustum piece, looking down -z
+				glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+				for (int corner = 0; corner < 8; corner++)
+				{
+					float depth = depths[corner >> 2];
+					glm::vec3 p(ndcX[corner & 1] * tanHalfX * depth, ndcY[(corner >> 1) & 1] * tanHalfY * depth, -depth);
+					boxMin = glm::min(boxMin, p);
+					boxMax = glm::max(boxMax, p);
+				}
+
+				int index = GetClusterIndex(x, y, z);
+				for (int axis = 0; axis < 3; axis++)
+				{
+					m_boundsMin[axis][index] = boxMin[axis];
+					m_boundsMax[axis][index] = boxMax[axis];
+				}
+				rowMin = glm::min(rowMin, boxMin);
+				rowMax = glm::max(rowMax, boxMax);
+			}
+
+			m_rowMin[z * kClustersY + y] = rowMin;
+			m_rowMax[z * kClustersY + y] = rowMax;
+		}
+	}
+}
+
+int LightClusters::GetSlice(float depth) const
+{
+	if (depth <= m_nearPlane)
+		return 0;
+	int slice = (int)(std::log(depth) * m_sliceScale + m_sliceBias);
+	return std::min(std::max(slice, 0), kClustersZ - 1);
+}
+
+void LightClusters::Build(const PointLight* lights, size_t count, const glm::mat4& view)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	m_view = view;
+	m_stats.lights = (unsigned int)count;
+
+	// lights entirely in front of the near plane or past the far plane never touch a cluster
+	m_viewLights.clear();
+	m_lightSlices.clear();
+	m_lightData.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		const PointLight& light = lights[i];
+		glm::vec3 viewPosition = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		float depth = -viewPosition.z;
+		if (depth + light.radius < m_nearPlane || depth - light.radius > m_farPlane)
+			continue;
+
+		m_viewLights.push_back(glm::vec4(viewPosition, light.radius));
+		m_lightSlices.push_back(GetSlice(depth - light.radius));
+		m_lightSlices.push_back(GetSlice(depth + light.radius));
+		m_lightData.push_back(glm::vec4(light.position, light.radius));
+		m_lightData.push_back(glm::vec4(light.color * light.intensity, 0.0f));
+	}
+	m_stats.visibleLights = (unsigned int)m_viewLights.size();
+
+	// bucket the lights by slice so each slice only looks at the lights reaching it
+	m_sliceStarts.assign(kClustersZ + 1, 0);
+	for (size_t i = 0; i < m_viewLights.size(); i++)
+	{
+		for (int z = m_lightSlices[i * 2]; z <= m_lightSlices[i * 2 + 1]; z++)
+			m_sliceStarts[z + 1]++;
+	}
+	for (int z = 0; z < kClustersZ; z++)
+		m_sliceStarts[z + 1] += m_sliceStarts[z];
+	m_sliceLights.resize(m_sliceStarts[kClustersZ]);
+	m_sliceFill.assign(m_sliceStarts.begin(), m_sliceStarts.end() - 1);
+	for (size_t i = 0; i < m_viewLights.size(); i++)
+	{
+		for (int z = m_lightSlices[i * 2]; z <= m_lightSlices[i * 2 + 1]; z++)
+			m_sliceLights[m_sliceFill[z]++] = (uint32_t)i;
+	}
+
+	m_clusterCounts.assign(kNumClusters, 0);
+	m_clusterLights.resize((size_t)kNumClusters * kMaxLightsPerCluster);
+	m_droppedPerSlice.assign(kClustersZ, 0);
+
+	// every slice only writes its own clusters, so they can be binned in parallel
+	if (m_jobSystem != nullptr)
+	{
+		m_jobSystem->ParallelFor(kClustersZ, 1, [this](size_t begin, size_t end) {
+			for (size_t z = begin; z < end; z++)
+				BinSlice((int)z);
+		});
+	}
+	else
+	{
+		for (int z = 0; z < kClustersZ; z++)
+			BinSlice(z);
+	}
+
+	// pack the fixed size lists into one index list
+	m_grid.resize(kNumClusters * 2);
+	m_indices.clear();
+	m_stats.maxLightsPerCluster = 0;
+	for (int cluster = 0; cluster < kNumClusters; cluster++)
+	{
+		uint32_t lightCount = m_clusterCounts[cluster];
+		const uint32_t* clusterLights = &m_clusterLights[(size_t)cluster * kMaxLightsPerCluster];
+		m_grid[cluster * 2 + 0] = (uint32_t)m_indices.size();
+		m_grid[cluster * 2 + 1] = lightCount;
+		m_indices.insert(m_indices.end(), clusterLights, clusterLights + lightCount);
+		m_stats.maxLightsPerCluster = std::max(m_stats.maxLightsPerCluster, lightCount);
+	}
+	m_stats.assignments = (unsigned int)m_indices.size();
+
+	m_stats.droppedAssignments = 0;
+	for (uint32_t dropped : m_droppedPerSlice)
+		m_stats.droppedAssignments += dropped;
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.binMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void LightClusters::BinSlice(int z)
+{
+	uint32_t dropped = 0;
+
+	for (uint32_t entry = m_sliceStarts[z]; entry < m_sliceStarts[z + 1]; entry++)
+	{
+		uint32_t i = m_sliceLights[entry];
+		const glm::vec4& sphere = m_viewLights[i];
+		for (int y = 0; y < kClustersY; y++)
+		{
+			int row = z * kClustersY + y;
+			if (!SphereTouchesBox(sphere, m_rowMin[row], m_rowMax[row]))
+				continue;
+
+			int first = GetClusterIndex(0, y, z);
+			const float* boundsMin[3] = { &m_boundsMin[0][first], &m_boundsMin[1][first], &m_boundsMin[2][first] };
+			const float* boundsMax[3] = { &m_boundsMax[0][first], &m_boundsMax[1][first], &m_boundsMax[2][first] };
+
+			uint32_t mask = TestRow(m_simdLevel, boundsMin, boundsMax, sphere);
+			while (mask != 0)
+			{
+				int x = 0;
+				while ((mask & (1u << x)) == 0)
+					x++;
+				mask &= mask - 1;
+
+				int cluster = first + x;
+				uint32_t& lightCount = m_clusterCounts[cluster];
+				if (lightCount < (uint32_t)kMaxLightsPerCluster)
+					m_clusterLights[(size_t)cluster * kMaxLightsPerCluster + lightCount++] = i;
+				else
+					dropped++;
+			}
+		}
+	}
+
+	m_droppedPerSlice[z] = dropped;
+}
+
+void LightClusters::Upload()
+{
+	UploadBuffer(m_buffers[0], m_capacities[0], m_lightData.data(), m_lightData.size() * sizeof(glm::vec4));
+	UploadBuffer(m_buffers[1], m_capacities[1], m_grid.data(), m_grid.size() * sizeof(uint32_t));
+	UploadBuffer(m_buffers[2], m_capacities[2], m_indices.data(), m_indices.size() * sizeof(uint32_t));
+}
+
+void LightClusters::Bind(GLuint program) const
+{
+	static const int kUnits[3] = { kLightDataTextureUnit, kClusterGridTextureUnit, kLightIndexTextureUnit };
+	for (int i = 0; i < 3; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + kUnits[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(glGetUniformLocation(program, "u_useClusters"), 1);
+	glUniformMatrix4fv(glGetUniformLocation(program, "u_view"), 1, false, glm::value_ptr(m_view));
+	glUniform2f(glGetUniformLocation(program, "u_viewportSize"), m_viewportSize.x, m_viewportSize.y);
+	glUniform3i(glGetUniformLocation(program, "u_clusterCount"), kClustersX, kClustersY, kClustersZ);
+	glUniform2f(glGetUniformLocation(program, "u_clusterDepth"), m_sliceScale, m_sliceBias);
+}
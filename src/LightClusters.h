@@ -0,0 +1,125 @@
+#pragma once
+
+// clustered forward lighting. the view frustum is split into a kClustersX x kClustersY x kClustersZ grid
+// (screen tiles times exponential depth slices) and every frame each point light is tested against the
+// clusters it might touch on the CPU, 8 or 4 clusters at a time with AVX2/SSE. the result is a per cluster
+// range into one light index list, uploaded with the light data as texture buffers, so the mesh fragment
+// shader (see kClusteredLightingGLSL) only loops over the lights that can reach its cluster.
+// lights that don't fit in a cluster (more than kMaxLightsPerCluster) are dropped and counted in the stats
+
+#include "CpuFeatures.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct PointLight
+{
+	glm::vec3 position;
+	float radius; // no light past this
+	glm::vec3 color;
+	float intensity;
+};
+
+struct LightClusterStats
+{
+	unsigned int lights;
+	unsigned int visibleLights;     // overlapping the frustum's depth range, the ones uploaded
+	unsigned int assignments;       // light/cluster pairs
+	unsigned int maxLightsPerCluster;
+	unsigned int droppedAssignments;
+	double binMs;
+};
+
+// declares ClusteredLighting(worldPosition, normal), the sum of the point lights' diffuse light.
+// goes after the #version line, needs the uniforms LightClusters::Bind sets
+extern const char* kClusteredLightingGLSL;
+
+class LightClusters
+{
+public:
+	static const int kClustersX = 16;
+	static const int kClustersY = 9;
+	static const int kClustersZ = 24;
+	static const int kNumClusters = kClustersX * kClustersY * kClustersZ;
+	static const int kMaxLightsPerCluster = 256;
+
+	// texture units Bind uses, 0 is the material and 1 IndirectRenderer's instance data
+	static const int kLightDataTextureUnit = 2;
+	static const int kClusterGridTextureUnit = 3;
+	static const int kLightIndexTextureUnit = 4;
+
+	LightClusters() = default;
+	~LightClusters() {}
+
+	void Init(); // needs the GL context
+	void Dispose();
+
+	// binning is split across the job system's threads (a slice of depth per job) when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	// defaults to GetBestSimdLevel, settable for benchmarking
+	void SetSimdLevel(SimdLevel level) { m_simdLevel = level; }
+
+	// rebuilds the cluster bounds, only needed when the projection changes
+	void SetProjection(float fovY, float nearPlane, float farPlane, int viewportWidth, int viewportHeight);
+
+	// CPU only, bins the lights for this camera
+	void Build(const PointLight* lights, size_t count, const glm::mat4& view);
+	// copies the last Build to the GPU
+	void Upload();
+	// binds the buffers to their units and sets the uniforms kClusteredLightingGLSL needs on program (bound)
+	void Bind(GLuint program) const;
+
+	// light count of one cluster in the last Build, y = 0 is the bottom row
+	unsigned int GetClusterLightCount(int x, int y, int z) const { return m_grid[GetClusterIndex(x, y, z) * 2 + 1]; }
+	const std::vector<uint32_t>& GetLightIndices() const { return m_indices; }
+	const LightClusterStats& GetStats() const { return m_stats; }
+
+private:
+	static int GetClusterIndex(int x, int y, int z) { return (z * kClustersY + y) * kClustersX + x; }
+	int GetSlice(float depth) const;
+	void BinSlice(int z);
+
+	JobSystem* m_jobSystem = nullptr;
+	SimdLevel m_simdLevel = GetBestSimdLevel();
+
+	float m_nearPlane = 0.1f;
+	float m_farPlane = 100.0f;
+	float m_sliceScale = 1.0f; // slice = log(depth) * scale + bias
+	float m_sliceBias = 0.0f;
+	glm::vec2 m_viewportSize = glm::vec2(1.0f);
+	glm::mat4 m_view = glm::mat4(1.0f);
+
+	// view space cluster bounds, structure of arrays so a row of kClustersX can be tested at once
+	std::vector<float> m_boundsMin[3];
+	std::vector<float> m_boundsMax[3];
+	std::vector<glm::vec3> m_rowMin; // per (z, y) row, for skipping whole rows
+	std::vector<glm::vec3> m_rowMax;
+
+	// Build scratch
+	std::vector<glm::vec4> m_viewLights;   // view space position, radius. visible lights only
+	std::vector<int> m_lightSlices;        // first and last slice per visible light
+	std::vector<uint32_t> m_sliceStarts;   // per slice range of m_sliceLights, plus the end
+	std::vector<uint32_t> m_sliceFill;
+	std::vector<uint32_t> m_sliceLights;   // visible light indices grouped by slice
+	std::vector<uint32_t> m_clusterCounts;
+	std::vector<uint32_t> m_clusterLights; // kMaxLightsPerCluster per cluster
+	std::vector<uint32_t> m_droppedPerSlice;
+
+	// what's uploaded
+	std::vector<glm::vec4> m_lightData; // position + radius, colour * intensity, per visible light
+	std::vector<uint32_t> m_grid;       // first index, count per cluster
+	std::vector<uint32_t> m_indices;
+
+	GLuint m_buffers[3] = { 0, 0, 0 };  // light data, grid, indices
+	GLuint m_textures[3] = { 0, 0, 0 };
+	size_t m_capacities[3] = { 0, 0, 0 }; // bytes
+
+	LightClusterStats m_stats = { 0, 0, 0, 0, 0, 0.0 };
+
+};
@@ -3,24 +3,181 @@
 #include <cstdio> // printf
 #include <iostream> // cerr
 #include <cassert> // assert
+#include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+#include <cfloat>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+#include "ObjParser.h" // must come before the tinyobj implementation include
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+// define to load with tinyobj::LoadObj instead of the parallel parser, for comparing load times
+//#define MESH_USE_TINYOBJ
+
+// lod chain: each level aims for half the triangles of the last, until the simplifier reaches kLodMaxError
+static const int kMaxLods = 5;
+static const float kLodReduction = 0.5f;
+static const float kLodMaxError = 0.02f; // relative to the bounds diagonal
+static const int kMinLodTriangles = 64;
+
+// a level is used while its error is under kLodPixelError on screen, dropping detail needs kLodHysteresis of headroom
+static const float kLodPixelError = 1.0f;
+static const float kLodHysteresis = 0.75f;
+
+// define to keep the optimized mesh in <obj>.cache next to the obj and load that while the obj, its mtl files and the
+// settings above are unchanged. off by default since it writes into the data directory
+//#define MESH_USE_CACHE
+
+// obj faces index position/normal/texcoord separately, a gl vertex is one unique combination
+struct ObjVertexKey
+{
+    int vertex;
+    int normal;
+    int texcoord;
+
+    bool operator==(const ObjVertexKey& other) const
+    {
+        return vertex == other.vertex && normal == other.normal && texcoord == other.texcoord;
+    }
+};
+
+struct ObjVertexKeyHash
+{
+    size_t operator()(const ObjVertexKey& key) const
+    {
+        size_t h = static_cast<size_t>(key.vertex) * 73856093u;
+        h ^= static_cast<size_t>(key.normal) * 19349663u;
+        h ^= static_cast<size_t>(key.texcoord) * 83492791u;
+        return h;
+    }
+};
+
+// one triangle of one shape, so they can be reordered by material
+struct ObjTriangle
+{
+    int materialId;
+    int shape;
+    unsigned int face;
+};
+
 Mesh::~Mesh()
 {
     glDeleteVertexArrays(1, &m_vertexArrayId);
     glDeleteBuffers(1, &m_vertexBufferId);
+    glDeleteBuffers(1, &m_indexBufferId);
+}
+
+bool Mesh::LoadFromFile(const char *filepath, const VertexFormat& format, bool keepGeometry)
+{
+    m_vertexFormat = format;
+
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned int> indices;
+
+#ifdef MESH_USE_CACHE
+    std::string cachePath = std::string(filepath) + ".cache";
+    if (!ReadCache(cachePath.c_str(), filepath, vertices, indices))
+    {
+        if (!LoadObj(filepath, vertices, indices))
+            return false;
+
+        Optimize(vertices, indices);
+        BuildLods(vertices, indices);
+        WriteCache(cachePath.c_str(), filepath, vertices, indices);
+    }
+#else
+    if (!LoadObj(filepath, vertices, indices))
+        return false;
+
+    Optimize(vertices, indices);
+    BuildLods(vertices, indices);
+#endif
+
+    m_numTriangles = m_lods[0].numTriangles;
+    printf("# of triangles = %d\n", m_numTriangles);
+    printf("# of unique vertices = %d\n", (int)vertices.size());
+    printf("# of submeshes = %d\n", (int)m_submeshes.size());
+    for (size_t i = 1; i < m_lods.size(); i++)
+    {
+        printf("LOD %d: %d triangles, error %.4f\n", (int)i, m_lods[i].numTriangles, m_lods[i].error);
+    }
+
+    m_boundsMin = glm::vec3(FLT_MAX);
+    m_boundsMax = glm::vec3(-FLT_MAX);
+    for (const MeshVertex& vertex : vertices)
+    {
+        m_boundsMin = glm::min(m_boundsMin, vertex.position);
+        m_boundsMax = glm::max(m_boundsMax, vertex.position);
+    }
+
+    BuildBatches();
+    Upload(vertices, indices);
+
+    if (keepGeometry)
+    {
+        m_vertices = vertices;
+        m_indices = indices;
+    }
+
+    return true;
+}
+
+void Mesh::LoadFromGeometry(const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices,
+    const VertexFormat& format, const std::vector<VertexSkin>* skins)
+{
+    m_vertexFormat = format;
+
+    Submesh submesh;
+    submesh.materialId = -1;
+    submesh.indexOffset = 0;
+    submesh.indexCount = (unsigned int)indices.size();
+    m_submeshes.assign(1, submesh);
+
+    MeshLod lod;
+    lod.error = 0.0f;
+    lod.numTriangles = (int)indices.size() / 3;
+    lod.submeshes = m_submeshes;
+    m_lods.assign(1, lod);
+    m_numTriangles = lod.numTriangles;
+
+    m_boundsMin = glm::vec3(FLT_MAX);
+    m_boundsMax = glm::vec3(-FLT_MAX);
+    for (const MeshVertex& vertex : vertices)
+    {
+        m_boundsMin = glm::min(m_boundsMin, vertex.position);
+        m_boundsMax = glm::max(m_boundsMax, vertex.position);
+    }
+
+    BuildBatches();
+    Upload(vertices, indices, format.skinned ? skins : nullptr);
 }
 
-bool Mesh::LoadFromFile(const char *filepath)
+bool Mesh::LoadObj(const char* filepath, std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices)
 {
     tinyobj::attrib_t inattrib;
     std::vector<tinyobj::shape_t> inshapes;
+    std::vector<tinyobj::material_t> inmaterials;
 
     std::string err;
 
-    bool ret = tinyobj::LoadObj(&inattrib, &inshapes, nullptr, &err, filepath);
+    auto startTime = std::chrono::steady_clock::now();
+#ifdef MESH_USE_TINYOBJ
+    std::string basedir(filepath);
+    basedir = basedir.substr(0, basedir.find_last_of("/\\") + 1);
+    bool ret = tinyobj::LoadObj(&inattrib, &inshapes, &inmaterials, &err, filepath, basedir.c_str());
+#else
+    bool ret = ParseObj(filepath, &inattrib, &inshapes, &inmaterials, &err);
+#endif
+    auto endTime = std::chrono::steady_clock::now();
 
     if (!ret)
     {
@@ -28,156 +185,659 @@ bool Mesh::LoadFromFile(const char *filepath)
         return false;
     }
 
+    if (!err.empty())
+    {
+        std::cerr << err;
+    }
+
+    printf("Parsed %s in %.1f ms\n", filepath, std::chrono::duration<double, std::milli>(endTime - startTime).count());
+
     printf("# of vertices = %d\n", (int)(inattrib.vertices.size()) / 3);
     printf("# of normals = %d\n", (int)(inattrib.normals.size()) / 3);
     printf("# of texcoords = %d\n", (int)(inattrib.texcoords.size()) / 2);
+    printf("# of shapes = %d\n", (int)inshapes.size());
+    printf("# of materials = %d\n", (int)inmaterials.size());
 
-    // inshapes is a collection of meshes in the OBJ. we only care about loading a single mesh so just index 0
-    assert(inshapes.size() == 1);
-    tinyobj::shape_t shape = inshapes[0];
+    m_materials.clear();
+    for (const tinyobj::material_t& inmaterial : inmaterials)
+    {
+        MeshMaterial material;
+        material.name = inmaterial.name;
+        material.diffuseColor = glm::vec3(inmaterial.diffuse[0], inmaterial.diffuse[1], inmaterial.diffuse[2]);
+        material.diffuseTexture = inmaterial.diffuse_texname;
+        m_materials.push_back(material);
+    }
 
-    std::vector<float> buffer; // pos(3float), normal(3float), texcoords(2float)
-    for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++)
+    // sort every triangle by material, keeping shape order within a material
+    std::vector<ObjTriangle> triangles;
+    for (size_t s = 0; s < inshapes.size(); s++)
     {
-        tinyobj::index_t idx0 = shape.mesh.indices[3 * f + 0];
-        tinyobj::index_t idx1 = shape.mesh.indices[3 * f + 1];
-        tinyobj::index_t idx2 = shape.mesh.indices[3 * f + 2];
+        const tinyobj::mesh_t& mesh = inshapes[s].mesh;
+        for (size_t f = 0; f < mesh.indices.size() / 3; f++)
+        {
+            int materialId = f < mesh.material_ids.size() ? mesh.material_ids[f] : -1;
+            if (materialId < 0 || materialId >= (int)m_materials.size())
+                materialId = -1;
+            triangles.push_back({ materialId, (int)s, (unsigned int)f });
+        }
+    }
+    std::stable_sort(triangles.begin(), triangles.end(), [](const ObjTriangle& a, const ObjTriangle& b) {
+        return a.materialId < b.materialId;
+    });
 
-        float tc[3][2];
-        if (inattrib.texcoords.size() > 0)
+    // faces without normals get a smooth one, area weighted over every face sharing the position.
+    // keeps those vertices shareable so the cache optimizer and simplifier have something to work with
+    std::vector<glm::vec3> smoothNormals;
+    for (const ObjTriangle& triangle : triangles)
+    {
+        const tinyobj::mesh_t& mesh = inshapes[triangle.shape].mesh;
+        const tinyobj::index_t* idx = &mesh.indices[3 * triangle.face];
+        if (inattrib.normals.size() > 0 && idx[0].normal_index >= 0 && idx[1].normal_index >= 0 && idx[2].normal_index >= 0)
+            continue;
+
+        if (smoothNormals.empty())
+            smoothNormals.resize(inattrib.vertices.size() / 3, glm::vec3(0.0f));
+
+        glm::vec3 p[3];
+        for (int k = 0; k < 3; k++)
         {
-            if ((idx0.texcoord_index < 0) || (idx1.texcoord_index < 0) || (idx2.texcoord_index < 0))
+            assert(idx[k].vertex_index >= 0);
+            p[k] = glm::vec3(inattrib.vertices[3 * idx[k].vertex_index + 0], inattrib.vertices[3 * idx[k].vertex_index + 1], inattrib.vertices[3 * idx[k].vertex_index + 2]);
+        }
+        glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (int k = 0; k < 3; k++)
+        {
+            smoothNormals[idx[k].vertex_index] += n;
+        }
+    }
+
+    std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> vertexMap;
+    vertexMap.reserve(inattrib.vertices.size() / 3);
+    indices.reserve(triangles.size() * 3);
+
+    m_submeshes.clear();
+    for (const ObjTriangle& triangle : triangles)
+    {
+        // new submesh whenever the shape or material changes
+        if (m_submeshes.empty() || m_submeshes.back().materialId != triangle.materialId || m_submeshes.back().shapeName != inshapes[triangle.shape].name)
+        {
+            Submesh submesh;
+            submesh.shapeName = inshapes[triangle.shape].name;
+            submesh.materialId = triangle.materialId;
+            submesh.indexOffset = (unsigned int)indices.size();
+            submesh.indexCount = 0;
+            m_submeshes.push_back(submesh);
+        }
+
+        const tinyobj::mesh_t& mesh = inshapes[triangle.shape].mesh;
+        tinyobj::index_t idx[3] = {
+            mesh.indices[3 * triangle.face + 0],
+            mesh.indices[3 * triangle.face + 1],
+            mesh.indices[3 * triangle.face + 2]
+        };
+
+        bool hasNormals = inattrib.normals.size() > 0 && idx[0].normal_index >= 0 && idx[1].normal_index >= 0 && idx[2].normal_index >= 0;
+
+        for (int k = 0; k < 3; k++)
+        {
+            ObjVertexKey key = { idx[k].vertex_index, hasNormals ? idx[k].normal_index : -1, idx[k].texcoord_index };
+
+            auto it = vertexMap.find(key);
+            if (it != vertexMap.end())
             {
-                // face does not contain valid uv index.
-                tc[0][0] = 0.0f;
-                tc[0][1] = 0.0f;
-                tc[1][0] = 0.0f;
-                tc[1][1] = 0.0f;
-                tc[2][0] = 0.0f;
-                tc[2][1] = 0.0f;
-            } else {
-                assert(inattrib.texcoords.size() >
-                    size_t(2 * idx0.texcoord_index + 1));
-                assert(inattrib.texcoords.size() >
-                    size_t(2 * idx1.texcoord_index + 1));
-                assert(inattrib.texcoords.size() >
-                    size_t(2 * idx2.texcoord_index + 1));
+                indices.push_back(it->second);
+                continue;
+            }
+
+            MeshVertex vertex;
+
+            // vertices
+            assert(idx[k].vertex_index >= 0);
+            vertex.position = glm::vec3(inattrib.vertices[3 * idx[k].vertex_index + 0], inattrib.vertices[3 * idx[k].vertex_index + 1], inattrib.vertices[3 * idx[k].vertex_index + 2]);
+
+            // normals
+            if (hasNormals)
+            {
+                assert(size_t(3 * idx[k].normal_index + 2) < inattrib.normals.size());
+                vertex.normal = glm::vec3(inattrib.normals[3 * idx[k].normal_index + 0], inattrib.normals[3 * idx[k].normal_index + 1], inattrib.normals[3 * idx[k].normal_index + 2]);
+            }
+            else
+            {
+                glm::vec3 n = smoothNormals[idx[k].vertex_index];
+                float length = glm::length(n);
+                vertex.normal = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+
+            // texcoords
+            if (inattrib.texcoords.size() > 0 && idx[k].texcoord_index >= 0)
+            {
+                assert(inattrib.texcoords.size() > size_t(2 * idx[k].texcoord_index + 1));
 
                 // Flip Y coord.
-                tc[0][0] = inattrib.texcoords[2 * idx0.texcoord_index];
-                tc[0][1] = 1.0f - inattrib.texcoords[2 * idx0.texcoord_index + 1];
-                tc[1][0] = inattrib.texcoords[2 * idx1.texcoord_index];
-                tc[1][1] = 1.0f - inattrib.texcoords[2 * idx1.texcoord_index + 1];
-                tc[2][0] = inattrib.texcoords[2 * idx2.texcoord_index];
-                tc[2][1] = 1.0f - inattrib.texcoords[2 * idx2.texcoord_index + 1];
+                vertex.texCoord = glm::vec2(inattrib.texcoords[2 * idx[k].texcoord_index], 1.0f - inattrib.texcoords[2 * idx[k].texcoord_index + 1]);
             }
+            else
+            {
+                // face does not contain valid uv index.
+                vertex.texCoord = glm::vec2(0.0f);
+            }
+
+            unsigned int index = (unsigned int)vertices.size();
+            vertices.push_back(vertex);
+            vertexMap.emplace(key, index);
+            indices.push_back(index);
         }
-        else
+
+        m_submeshes.back().indexCount += 3;
+    }
+
+    return true;
+}
+
+void Mesh::Optimize(std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    VertexCacheStats before = AnalyzeVertexCache(indices.data(), indices.size());
+
+    // reordering stays inside each submesh so the material sort and batch ranges still hold
+    for (const Submesh& submesh : m_submeshes)
+    {
+        OptimizeVertexCache(&indices[submesh.indexOffset], submesh.indexCount);
+        OptimizeOverdraw(&indices[submesh.indexOffset], submesh.indexCount, vertices);
+    }
+    OptimizeVertexFetch(vertices, indices);
+
+    VertexCacheStats after = AnalyzeVertexCache(indices.data(), indices.size());
+    auto endTime = std::chrono::steady_clock::now();
+
+    printf("Optimized mesh in %.1f ms\n", std::chrono::duration<double, std::milli>(endTime - startTime).count());
+    printf("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (fifo %u)\n", before.acmr, after.acmr, before.atvr, after.atvr, kVertexCacheSize);
+}
+
+void Mesh::BuildLods(const std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    m_lods.clear();
+    m_lods.resize(1);
+    m_lods[0].error = 0.0f;
+    m_lods[0].numTriangles = (int)indices.size() / 3;
+    m_lods[0].submeshes = m_submeshes;
+
+    // every submesh measures its error against the whole mesh, the scale SelectLod compares it at
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (const MeshVertex& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    float diagonal = glm::length(boundsMax - boundsMin);
+
+    // each level simplifies the previous one, appended to the same index buffer in the same submesh order
+    std::vector<unsigned int> simplified;
+    while ((int)m_lods.size() < kMaxLods)
+    {
+        const MeshLod& previous = m_lods.back();
+        if (previous.numTriangles < kMinLodTriangles)
+            break;
+
+        MeshLod lod;
+        lod.numTriangles = 0;
+        float stepError = 0.0f;
+
+        for (const Submesh& source : previous.submeshes)
         {
-            tc[0][0] = 0.0f;
-            tc[0][1] = 0.0f;
-            tc[1][0] = 0.0f;
-            tc[1][1] = 0.0f;
-            tc[2][0] = 0.0f;
-            tc[2][1] = 0.0f;
+            size_t target = (size_t)(source.indexCount * kLodReduction) / 3 * 3;
+            float error = SimplifyMesh(vertices, &indices[source.indexOffset], source.indexCount, target, kLodMaxError, diagonal, simplified);
+
+            Submesh submesh = source;
+            submesh.indexOffset = (unsigned int)indices.size();
+            submesh.indexCount = (unsigned int)simplified.size();
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            OptimizeVertexCache(&indices[submesh.indexOffset], submesh.indexCount);
+
+            stepError = std::max(stepError, error);
+            lod.numTriangles += submesh.indexCount / 3;
+            lod.submeshes.push_back(submesh);
         }
 
-        float v[3][3];
-        for (int k = 0; k < 3; k++)
+        // errors add up along the chain since each level is built from the last
+        lod.error = previous.error + stepError;
+
+        // simplifier hit the error limit, another level wouldn't save anything
+        if (lod.numTriangles > previous.numTriangles * 0.9f)
         {
-            int f0 = idx0.vertex_index;
-            int f1 = idx1.vertex_index;
-            int f2 = idx2.vertex_index;
-            assert(f0 >= 0);
-            assert(f1 >= 0);
-            assert(f2 >= 0);    
-            v[0][k] = inattrib.vertices[3 * f0 + k];
-            v[1][k] = inattrib.vertices[3 * f1 + k];
-            v[2][k] = inattrib.vertices[3 * f2 + k];
+            indices.resize(lod.submeshes.front().indexOffset);
+            break;
         }
 
-        float n[3][3];
+        m_lods.push_back(lod);
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    printf("Built %d LODs in %.1f ms\n", (int)m_lods.size() - 1, std::chrono::duration<double, std::milli>(endTime - startTime).count());
+}
+
+int Mesh::SelectLod(float screenSize, int currentLod) const
+{
+    int lod = std::max(0, std::min(currentLod, (int)m_lods.size() - 1));
+
+    // errors are relative to the bounds diagonal, so error * screenSize is the error in pixels
+    while (lod > 0 && m_lods[lod].error * screenSize > kLodPixelError)
+        lod--;
+
+    // only drop detail once the coarser level is comfortably under the limit, so objects near the threshold don't flicker
+    while (lod + 1 < (int)m_lods.size() && m_lods[lod + 1].error * screenSize < kLodPixelError * kLodHysteresis)
+        lod++;
+
+    return lod;
+}
+
+// cache layout: header, sources, vertices, indices, lods (error, submesh count, submeshes), materials. strings are a
+// uint32 length then the chars. the header holds the settings the mesh was built with and the sources are the obj and
+// the mtl files it names with their size and modification time, so changing any of them invalidates it
+static const uint32_t kMeshCacheMagic = 0x4853454D; // "MESH"
+static const uint32_t kMeshCacheVersion = 4;
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t maxLods;
+    uint32_t minLodTriangles;
+    float lodReduction;
+    float lodMaxError;
+    uint32_t vertexCacheSize;
+    uint32_t sourceCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t materialCount;
+};
+
+struct MeshCacheSource
+{
+    std::string path;
+    uint64_t size;
+    int64_t time;
+};
+
+static MeshCacheHeader MakeCacheHeader()
+{
+    MeshCacheHeader header = {};
+    header.magic = kMeshCacheMagic;
+    header.version = kMeshCacheVersion;
+    header.vertexSize = sizeof(MeshVertex);
+    header.maxLods = kMaxLods;
+    header.minLodTriangles = kMinLodTriangles;
+    header.lodReduction = kLodReduction;
+    header.lodMaxError = kLodMaxError;
+    header.vertexCacheSize = kVertexCacheSize;
+    return header;
+}
+
+static bool IsSameSettings(const MeshCacheHeader& a, const MeshCacheHeader& b)
+{
+    return a.magic == b.magic && a.version == b.version && a.vertexSize == b.vertexSize && a.maxLods == b.maxLods &&
+        a.minLodTriangles == b.minLodTriangles && a.lodReduction == b.lodReduction && a.lodMaxError == b.lodMaxError &&
+        a.vertexCacheSize == b.vertexCacheSize;
+}
+
+static bool GetSourceStamp(const char* path, uint64_t& outSize, int64_t& outTime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+
+    outSize = static_cast<uint64_t>(st.st_size);
+    outTime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+// the obj, then every library on its mtllib lines relative to it. a missing mtl is stamped 0 so adding it later
+// invalidates the cache too
+static bool GetCacheSources(const char* objPath, std::vector<MeshCacheSource>& outSources)
+{
+    outSources.resize(1);
+    outSources[0].path = objPath;
+    if (!GetSourceStamp(objPath, outSources[0].size, outSources[0].time))
+        return false;
+
+    std::string baseDir(objPath);
+    baseDir = baseDir.substr(0, baseDir.find_last_of("/\\") + 1);
+
+    std::ifstream file(objPath);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, 6, "mtllib") != 0 || line.size() < 7 || !isspace((unsigned char)line[6]))
+            continue;
+
+        size_t start = 7;
+        while (start < line.size())
         {
-            if (inattrib.normals.size() > 0)
+            start = line.find_first_not_of(" \t\r", start);
+            if (start == std::string::npos)
+                break;
+            size_t end = std::min(line.find_first_of(" \t\r", start), line.size());
+
+            MeshCacheSource source;
+            source.path = baseDir + line.substr(start, end - start);
+            if (!GetSourceStamp(source.path.c_str(), source.size, source.time))
             {
-                int nf0 = idx0.normal_index;
-                int nf1 = idx1.normal_index;
-                int nf2 = idx2.normal_index;  
-                if ((nf0 < 0) || (nf1 < 0) || (nf2 < 0))
-                {
-                    // normal index is missing from this face.
-                    //invalid_normal_index = true;
-                    assert(false);
-                }
-                else
-                {
-                    for (int k = 0; k < 3; k++)
-                    {
-                        assert(size_t(3 * nf0 + k) < inattrib.normals.size());
-                        assert(size_t(3 * nf1 + k) < inattrib.normals.size());
-                        assert(size_t(3 * nf2 + k) < inattrib.normals.size());
-                        n[0][k] = inattrib.normals[3 * nf0 + k];
-                        n[1][k] = inattrib.normals[3 * nf1 + k];
-                        n[2][k] = inattrib.normals[3 * nf2 + k];
-                    }
-                }
+                source.size = 0;
+                source.time = 0;
             }
+            outSources.push_back(source);
+            start = end;
         }
+    }
+    return true;
+}
 
-        for (int k = 0; k < 3; k++)
-        {
-            // vertices
-            buffer.push_back(v[k][0]);
-            buffer.push_back(v[k][1]);
-            buffer.push_back(v[k][2]);
+static void WriteString(std::ofstream& file, const std::string& str)
+{
+    uint32_t length = static_cast<uint32_t>(str.size());
+    file.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+    file.write(str.data(), length);
+}
 
-            // normals
-            buffer.push_back(n[k][0]);
-            buffer.push_back(n[k][1]);
-            buffer.push_back(n[k][2]);
+static bool ReadString(std::ifstream& file, std::string& outStr)
+{
+    uint32_t length = 0;
+    if (!file.read(reinterpret_cast<char*>(&length), sizeof(uint32_t)))
+        return false;
 
-            // texcoords
-            buffer.push_back(tc[k][0]);
-            buffer.push_back(tc[k][1]);
+    outStr.resize(length);
+    return length == 0 || file.read(&outStr[0], length);
+}
+
+static void WriteSubmeshes(std::ofstream& file, const std::vector<Submesh>& submeshes)
+{
+    uint32_t count = static_cast<uint32_t>(submeshes.size());
+    file.write(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
+
+    for (const Submesh& submesh : submeshes)
+    {
+        WriteString(file, submesh.shapeName);
+        file.write(reinterpret_cast<const char*>(&submesh.materialId), sizeof(int));
+        file.write(reinterpret_cast<const char*>(&submesh.indexOffset), sizeof(unsigned int));
+        file.write(reinterpret_cast<const char*>(&submesh.indexCount), sizeof(unsigned int));
+    }
+}
+
+static bool ReadSubmeshes(std::ifstream& file, std::vector<Submesh>& outSubmeshes)
+{
+    uint32_t count = 0;
+    if (!file.read(reinterpret_cast<char*>(&count), sizeof(uint32_t)))
+        return false;
+
+    outSubmeshes.resize(count);
+    for (Submesh& submesh : outSubmeshes)
+    {
+        ReadString(file, submesh.shapeName);
+        file.read(reinterpret_cast<char*>(&submesh.materialId), sizeof(int));
+        file.read(reinterpret_cast<char*>(&submesh.indexOffset), sizeof(unsigned int));
+        file.read(reinterpret_cast<char*>(&submesh.indexCount), sizeof(unsigned int));
+    }
+    return file.good();
+}
+
+bool Mesh::ReadCache(const char* cachePath, const char* sourcePath, std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    MeshCacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(MeshCacheHeader)) || !IsSameSettings(header, MakeCacheHeader()) || header.sourceCount == 0)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.sourceCount; i++)
+    {
+        MeshCacheSource cached;
+        ReadString(file, cached.path);
+        file.read(reinterpret_cast<char*>(&cached.size), sizeof(uint64_t));
+        file.read(reinterpret_cast<char*>(&cached.time), sizeof(int64_t));
+
+        // a missing mtl stays stamped 0
+        uint64_t size = 0;
+        int64_t time = 0;
+        bool exists = GetSourceStamp(cached.path.c_str(), size, time);
+        if (!file || (i == 0 && (cached.path != sourcePath || !exists)) || size != cached.size || time != cached.time)
+            return false;
+    }
+
+    vertices.resize(header.vertexCount);
+    indices.resize(header.indexCount);
+    file.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(MeshVertex));
+    file.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(unsigned int));
+
+    m_lods.resize(header.lodCount);
+    for (MeshLod& lod : m_lods)
+    {
+        file.read(reinterpret_cast<char*>(&lod.error), sizeof(float));
+        ReadSubmeshes(file, lod.submeshes);
+
+        lod.numTriangles = 0;
+        for (const Submesh& submesh : lod.submeshes)
+        {
+            lod.numTriangles += submesh.indexCount / 3;
         }
     }
 
-    m_numTriangles = buffer.size() / (3 + 3 + 2) / 3; // 3:vtx, 3:normal, 2:texcoord
-    printf("# of triangles = %d\n", m_numTriangles);
+    m_materials.resize(header.materialCount);
+    for (MeshMaterial& material : m_materials)
+    {
+        ReadString(file, material.name);
+        file.read(reinterpret_cast<char*>(&material.diffuseColor), sizeof(glm::vec3));
+        ReadString(file, material.diffuseTexture);
+    }
+
+    if (!file || m_lods.empty())
+    {
+        std::cerr << "Mesh cache is truncated, rebuilding: " << cachePath << "\n";
+        vertices.clear();
+        indices.clear();
+        m_lods.clear();
+        m_materials.clear();
+        return false;
+    }
+
+    m_submeshes = m_lods[0].submeshes;
+
+    printf("Loaded %s from cache\n", sourcePath);
+    return true;
+}
+
+void Mesh::WriteCache(const char* cachePath, const char* sourcePath, const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices) const
+{
+    std::vector<MeshCacheSource> sources;
+    if (!GetCacheSources(sourcePath, sources))
+        return;
+
+    std::ofstream file(cachePath, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open " << cachePath << " for writing\n";
+        return;
+    }
+
+    MeshCacheHeader header = MakeCacheHeader();
+    header.sourceCount = static_cast<uint32_t>(sources.size());
+    header.vertexCount = static_cast<uint32_t>(vertices.size());
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    header.lodCount = static_cast<uint32_t>(m_lods.size());
+    header.materialCount = static_cast<uint32_t>(m_materials.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+
+    for (const MeshCacheSource& source : sources)
+    {
+        WriteString(file, source.path);
+        file.write(reinterpret_cast<const char*>(&source.size), sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(&source.time), sizeof(int64_t));
+    }
+
+    file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(MeshVertex));
+    file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(unsigned int));
+
+    for (const MeshLod& lod : m_lods)
+    {
+        file.write(reinterpret_cast<const char*>(&lod.error), sizeof(float));
+        WriteSubmeshes(file, lod.submeshes);
+    }
+
+    for (const MeshMaterial& material : m_materials)
+    {
+        WriteString(file, material.name);
+        file.write(reinterpret_cast<const char*>(&material.diffuseColor), sizeof(glm::vec3));
+        WriteString(file, material.diffuseTexture);
+    }
+}
+
+void Mesh::Upload(const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<VertexSkin>* skins)
+{
+    std::vector<uint8_t> encoded = EncodeVertices(m_vertexFormat, vertices, m_dequantization, skins);
+
+    printf("Vertex size = %u bytes (%.1f KB)\n", m_vertexFormat.stride, encoded.size() / 1024.0f);
+    if (m_vertexFormat.stride != sizeof(MeshVertex))
+    {
+        VertexPrecisionError error = MeasurePrecisionError(m_vertexFormat, vertices, encoded, m_dequantization);
+        printf("Max error: position %g (%.5f%% of bounds), normal %.3f deg, texcoord %g\n",
+            error.maxPositionError, error.relativePositionError * 100.0f, error.maxNormalError, error.maxTexCoordError);
+    }
 
     // create the actual mesh
-    m_vertexArrayId = 0;
-    m_vertexBufferId = 0;
     glGenVertexArrays(1, &m_vertexArrayId);
 
     // bind the mesh data
     glBindVertexArray(m_vertexArrayId);
     glGenBuffers(1, &m_vertexBufferId);
     glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, encoded.size(), encoded.data(), GL_STATIC_DRAW);
 
-    GLsizei stride = (3 + 3 + 2) * sizeof(float); // temp kinda
-    // positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void *)0);
+    glGenBuffers(1, &m_indexBufferId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
-    // normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (const void *)(sizeof(float) * 3));
+    SetupVertexAttributes(m_vertexFormat);
 
-    // tex coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (const void *)(sizeof(float) * 6));
+    // unbind (the element buffer binding is part of the VAO so unbind that first)
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-    // unbind
+void Mesh::SetDequantizationUniforms(GLuint program) const
+{
+    glUniform3fv(glGetUniformLocation(program, "u_positionOffset"), 1, &m_dequantization.positionOffset.x);
+    glUniform3fv(glGetUniformLocation(program, "u_positionScale"), 1, &m_dequantization.positionScale.x);
+}
+
+void Mesh::BuildBatches()
+{
+    // submeshes are already sorted by material so this is just merging neighbours
+    for (MeshLod& lod : m_lods)
+    {
+        lod.batches.clear();
+        for (const Submesh& submesh : lod.submeshes)
+        {
+            if (!lod.batches.empty() && lod.batches.back().materialId == submesh.materialId)
+            {
+                lod.batches.back().indexCount += submesh.indexCount;
+                continue;
+            }
+
+            MaterialBatch batch;
+            batch.materialId = submesh.materialId;
+            batch.indexOffset = submesh.indexOffset;
+            batch.indexCount = submesh.indexCount;
+            lod.batches.push_back(batch);
+        }
+    }
+}
+
+MeshDrawStats Mesh::s_drawStats = { 0, 0, 0 };
+
+void Mesh::ResetDrawStats()
+{
+    s_drawStats.trianglesSubmitted = 0;
+    s_drawStats.trianglesWithoutLod = 0;
+    s_drawStats.draws = 0;
+}
+
+void Mesh::Draw(int lod) const
+{
+    const MeshLod& level = m_lods[lod];
+
+    // lods follow each other in the index buffer so a whole level is one contiguous range
+    unsigned int indexOffset = level.submeshes.empty() ? 0 : level.submeshes.front().indexOffset;
+
+    glBindVertexArray(m_vertexArrayId);
+    glDrawElements(GL_TRIANGLES, 3 * level.numTriangles, GL_UNSIGNED_INT, (const void *)(indexOffset * sizeof(unsigned int)));
     glBindVertexArray(0);
 
-    return true;
+    s_drawStats.trianglesSubmitted += level.numTriangles;
+    s_drawStats.trianglesWithoutLod += m_numTriangles;
+    s_drawStats.draws++;
+}
+
+void Mesh::DrawInstanced(GLsizei instanceCount, int lod) const
+{
+    const MeshLod& level = m_lods[lod];
+    unsigned int indexOffset = level.submeshes.empty() ? 0 : level.submeshes.front().indexOffset;
+
+    glDrawElementsInstanced(GL_TRIANGLES, 3 * level.numTriangles, GL_UNSIGNED_INT, (const void *)(indexOffset * sizeof(unsigned int)), instanceCount);
+
+    s_drawStats.trianglesSubmitted += (uint64_t)level.numTriangles * instanceCount;
+    s_drawStats.trianglesWithoutLod += (uint64_t)m_numTriangles * instanceCount;
+    s_drawStats.draws++;
 }
 
-void Mesh::Draw() const
+void Mesh::DrawBatches(const std::function<void(const MeshMaterial*)>& bindMaterial, int lod) const
 {
+    const MeshLod& level = m_lods[lod];
+
     glBindVertexArray(m_vertexArrayId);
-    glDrawArrays(GL_TRIANGLES, 0, 3 * m_numTriangles);
+    for (const MaterialBatch& batch : level.batches)
+    {
+        if (bindMaterial)
+        {
+            bindMaterial(batch.materialId >= 0 ? &m_materials[batch.materialId] : nullptr);
+        }
+        glDrawElements(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, (const void *)(batch.indexOffset * sizeof(unsigned int)));
+    }
     glBindVertexArray(0);
+
+    s_drawStats.trianglesSubmitted += level.numTriangles;
+    s_drawStats.trianglesWithoutLod += m_numTriangles;
+    s_drawStats.draws += level.batches.size();
+}
+
+void Mesh::DrawSubmeshes(const std::vector<int>& submeshIndices) const
+{
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    counts.reserve(submeshIndices.size());
+    offsets.reserve(submeshIndices.size());
+    for (int i : submeshIndices)
+    {
+        counts.push_back(m_submeshes[i].indexCount);
+        offsets.push_back((const void *)(m_submeshes[i].indexOffset * sizeof(unsigned int)));
+    }
+
+    glBindVertexArray(m_vertexArrayId);
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)counts.size());
+    glBindVertexArray(0);
+
+    for (GLsizei count : counts)
+    {
+        s_drawStats.trianglesSubmitted += count / 3;
+        s_drawStats.trianglesWithoutLod += count / 3;
+    }
+    s_drawStats.draws++;
 }
@@ -3,22 +3,149 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "VertexFormat.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
 #include <vector>
 
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+// up to 4 joints influencing a vertex, for skinned vertex formats. weights are normalized when encoding
+struct VertexSkin
+{
+    uint8_t joints[4];
+    float weights[4];
+};
+
+struct MeshMaterial
+{
+    std::string name;
+    glm::vec3 diffuseColor = glm::vec3(1.0f);
+    std::string diffuseTexture; // map_Kd, as written in the mtl
+};
+
+// a shape/material pair from the obj, as a range of the shared index buffer
+struct Submesh
+{
+    std::string shapeName;
+    int materialId; // -1 = no material
+    unsigned int indexOffset;
+    unsigned int indexCount;
+};
+
+// consecutive submeshes with the same material, drawn with a single call
+struct MaterialBatch
+{
+    int materialId;
+    unsigned int indexOffset;
+    unsigned int indexCount;
+};
+
+// one level of detail. level 0 is the full mesh, later levels are simplified index ranges over the same vertices
+struct MeshLod
+{
+    float error; // weighted RMS distance to the original faces' planes (the quadric error), relative to the mesh's bounds diagonal
+    int numTriangles;
+    std::vector<Submesh> submeshes;
+    std::vector<MaterialBatch> batches;
+};
+
+// totals since the last ResetDrawStats
+struct MeshDrawStats
+{
+    uint64_t trianglesSubmitted; // a second of instanced draws goes past 32 bits
+    uint64_t trianglesWithoutLod; // what the same draws would have cost at lod 0
+    uint64_t draws;
+};
+
 class Mesh
 {
 public:
     Mesh() = default;
     ~Mesh();
 
-    bool LoadFromFile(const char* filepath);
-    void Draw() const;
+    // keeps every shape and material in the file. all geometry shares one vertex/index buffer
+    // with the triangles sorted by material, then reordered for the vertex cache and overdraw within each submesh.
+    // a chain of simplified LODs is generated and appended to the index buffer
+    // the vertex buffer is packed in the given format, use GetCompactVertexFormat() for half the bandwidth.
+    // keepGeometry holds on to a CPU copy of the vertices/indices, for building static batches and arenas
+    bool LoadFromFile(const char* filepath, const VertexFormat& format = GetFullVertexFormat(), bool keepGeometry = false);
+
+    // uploads generated geometry as it is: a single submesh and lod, no material and no reordering.
+    // skins has one entry per vertex when the format is skinned and is ignored otherwise
+    void LoadFromGeometry(const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices,
+        const VertexFormat& format = GetFullVertexFormat(), const std::vector<VertexSkin>* skins = nullptr);
+
+    // sets u_positionOffset/u_positionScale on the bound program, for shaders using kVertexDecodeGLSL
+    void SetDequantizationUniforms(GLuint program) const;
+
+    // whole mesh in one draw, for when material state doesn't matter
+    void Draw(int lod = 0) const;
+
+    // one VAO bind, then a draw per material. bindMaterial is called before each one (may be null)
+    void DrawBatches(const std::function<void(const MeshMaterial*)>& bindMaterial, int lod = 0) const;
+
+    // for instanced drawing: bind, set up any per-instance attributes on the VAO, then DrawInstanced
+    void BindVertexArray() const { glBindVertexArray(m_vertexArrayId); }
+    void DrawInstanced(GLsizei instanceCount, int lod = 0) const;
+
+    // draws a subset of lod 0 submeshes with a single glMultiDrawElements
+    void DrawSubmeshes(const std::vector<int>& submeshIndices) const;
+
+    // screenSize is the projected bounds diagonal in pixels. keeps currentLod unless another level is clearly better
+    int SelectLod(float screenSize, int currentLod) const;
 
     int NumTriangles() const { return m_numTriangles; }
-    
+    const std::vector<Submesh>& GetSubmeshes() const { return m_submeshes; }
+    const std::vector<MaterialBatch>& GetBatches() const { return m_lods[0].batches; }
+    int GetNumLods() const { return (int)m_lods.size(); }
+    const MeshLod& GetLod(int lod) const { return m_lods[lod]; }
+    const std::vector<MeshMaterial>& GetMaterials() const { return m_materials; }
+    const VertexFormat& GetVertexFormat() const { return m_vertexFormat; }
+    const VertexDequantization& GetDequantization() const { return m_dequantization; }
+    const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+    glm::vec3 GetBoundsCenter() const { return (m_boundsMin + m_boundsMax) * 0.5f; }
+    float GetBoundingRadius() const { return glm::length(m_boundsMax - m_boundsMin) * 0.5f; }
+
+    // empty unless loaded with keepGeometry. indices cover every lod, lod 0 is the first 3 * NumTriangles()
+    const std::vector<MeshVertex>& GetVertices() const { return m_vertices; }
+    const std::vector<unsigned int>& GetIndices() const { return m_indices; }
+
+    static const MeshDrawStats& GetDrawStats() { return s_drawStats; }
+    static void ResetDrawStats();
+
 private:
-    GLuint m_vertexArrayId;
-    GLuint m_vertexBufferId;
-    int m_numTriangles;
+    bool LoadObj(const char* filepath, std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices);
+    void Optimize(std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices);
+    void BuildLods(const std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices);
+    bool ReadCache(const char* cachePath, const char* sourcePath, std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices);
+    void WriteCache(const char* cachePath, const char* sourcePath, const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices) const;
+    void Upload(const std::vector<MeshVertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<VertexSkin>* skins = nullptr);
+    void BuildBatches();
+
+    GLuint m_vertexArrayId = 0;
+    GLuint m_vertexBufferId = 0;
+    GLuint m_indexBufferId = 0;
+    int m_numTriangles = 0;
+    VertexFormat m_vertexFormat = GetFullVertexFormat();
+    VertexDequantization m_dequantization;
+    glm::vec3 m_boundsMin = glm::vec3(0.0f);
+    glm::vec3 m_boundsMax = glm::vec3(0.0f);
+
+    std::vector<Submesh> m_submeshes; // lod 0
+    std::vector<MeshLod> m_lods;
+    std::vector<MeshMaterial> m_materials;
+    std::vector<MeshVertex> m_vertices;
+    std::vector<unsigned int> m_indices;
+
+    static MeshDrawStats s_drawStats;
 
 };
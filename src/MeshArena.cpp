@@ -0,0 +1,96 @@
+#include "MeshArena.h"
+
+#include "Mesh.h"
+#include "VertexFormat.h"
+
+#include <cstdio>
+
+void MeshArena::Init(size_t maxVertices, size_t maxIndices)
+{
+	m_maxVertices = maxVertices;
+	m_maxIndices = maxIndices;
+
+	glGenVertexArrays(1, &m_vertexArrayId);
+	glBindVertexArray(m_vertexArrayId);
+
+	glGenBuffers(1, &m_vertexBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+	glBufferData(GL_ARRAY_BUFFER, m_maxVertices * sizeof(MeshVertex), NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_indexBufferId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_maxIndices * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+
+	SetupVertexAttributes(GetFullVertexFormat());
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void MeshArena::Dispose()
+{
+	glDeleteVertexArrays(1, &m_vertexArrayId);
+	glDeleteBuffers(1, &m_vertexBufferId);
+	glDeleteBuffers(1, &m_indexBufferId);
+	m_meshes.clear();
+	m_usedVertices = 0;
+	m_usedIndices = 0;
+}
+
+int MeshArena::AddMesh(const Mesh* mesh)
+{
+	int existing = FindMesh(mesh);
+	if (existing >= 0)
+		return existing;
+
+	const std::vector<MeshVertex>& vertices = mesh->GetVertices();
+	const std::vector<unsigned int>& indices = mesh->GetIndices();
+	if (vertices.empty())
+	{
+		printf("MeshArena: mesh has no CPU geometry (load it with keepGeometry)\n");
+		return -1;
+	}
+
+	if (m_usedVertices + vertices.size() > m_maxVertices || m_usedIndices + indices.size() > m_maxIndices)
+	{
+		printf("MeshArena: out of space (%zu/%zu vertices, %zu/%zu indices used)\n", m_usedVertices, m_maxVertices, m_usedIndices, m_maxIndices);
+		return -1;
+	}
+
+	// indices stay relative to the mesh, draws add baseVertex
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+	glBufferSubData(GL_ARRAY_BUFFER, m_usedVertices * sizeof(MeshVertex), vertices.size() * sizeof(MeshVertex), vertices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the element buffer binding is VAO state
+	glBindVertexArray(m_vertexArrayId);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m_usedIndices * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+	glBindVertexArray(0);
+
+	ArenaMesh entry;
+	entry.mesh = mesh;
+	entry.baseVertex = (int)m_usedVertices;
+	for (int i = 0; i < mesh->GetNumLods(); i++)
+	{
+		const MeshLod& lod = mesh->GetLod(i);
+		unsigned int firstIndex = lod.submeshes.empty() ? 0 : lod.submeshes.front().indexOffset;
+		entry.lods.push_back({ (unsigned int)m_usedIndices + firstIndex, 3 * (unsigned int)lod.numTriangles });
+	}
+
+	m_usedVertices += vertices.size();
+	m_usedIndices += indices.size();
+	m_meshes.push_back(entry);
+
+	return (int)m_meshes.size() - 1;
+}
+
+int MeshArena::FindMesh(const Mesh* mesh) const
+{
+	for (size_t i = 0; i < m_meshes.size(); i++)
+	{
+		if (m_meshes[i].mesh == mesh)
+			return (int)i;
+	}
+	return -1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// one big vertex buffer and index buffer shared by many meshes, so they can all be drawn from a single VAO
+// with base vertex / first index offsets (and so from a single indirect draw).
+// vertices are stored as full float MeshVertex since there's no per-mesh dequantization in a shared draw
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+class Mesh;
+
+struct ArenaLod
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
+
+struct ArenaMesh
+{
+	const Mesh* mesh;
+	int baseVertex;
+	std::vector<ArenaLod> lods;
+};
+
+class MeshArena
+{
+public:
+	MeshArena() = default;
+	~MeshArena() {}
+
+	void Init(size_t maxVertices = 4 * 1024 * 1024, size_t maxIndices = 16 * 1024 * 1024);
+	void Dispose();
+
+	// copies the mesh (every lod) in, the mesh must have been loaded with keepGeometry.
+	// returns the arena id, or -1 when it doesn't fit
+	int AddMesh(const Mesh* mesh);
+	int FindMesh(const Mesh* mesh) const;
+
+	const ArenaMesh& GetMesh(int id) const { return m_meshes[id]; }
+	GLuint GetVertexArray() const { return m_vertexArrayId; }
+
+	size_t GetUsedVertices() const { return m_usedVertices; }
+	size_t GetUsedIndices() const { return m_usedIndices; }
+
+private:
+	GLuint m_vertexArrayId = 0;
+	GLuint m_vertexBufferId = 0;
+	GLuint m_indexBufferId = 0;
+
+	size_t m_maxVertices = 0;
+	size_t m_maxIndices = 0;
+	size_t m_usedVertices = 0;
+	size_t m_usedIndices = 0;
+
+	std::vector<ArenaMesh> m_meshes;
+
+};
@@ -0,0 +1,242 @@
+#include "MeshBenchmark.h"
+
+#include "IndirectRenderer.h"
+#include "LightClusters.h"
+#include "Mesh.h"
+#include "MeshArena.h"
+#include "MeshRenderer.h"
+#include "Renderable.h"
+#include "StaticBatch.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+enum class BenchmarkMode
+{
+	Naive,
+	Instanced,
+	Indirect,
+	Static
+};
+
+struct BenchmarkResult
+{
+	unsigned int drawCalls;
+	double submitMs;
+	double frameMs;
+	uint64_t triangles; // per frame, instanced draws of a big mesh pass 32 bits
+};
+
+static BenchmarkResult RunPass(SDL_Window* window, MeshRenderer& renderer, IndirectRenderer& indirectRenderer, std::vector<iRenderable>& objects, StaticBatch& staticBatch, int frames, BenchmarkMode mode)
+{
+	BenchmarkResult result = { 0, 0.0, 0.0, 0 };
+
+	// the first few frames include driver warm up, leave them out
+	const int warmupFrames = 10;
+	for (int frame = 0; frame < warmupFrames + frames; frame++)
+	{
+		if (frame == warmupFrames)
+			Mesh::ResetDrawStats();
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (mode == BenchmarkMode::Static)
+		{
+			auto submitStart = std::chrono::steady_clock::now();
+			renderer.RenderStatic(staticBatch);
+			auto submitEnd = std::chrono::steady_clock::now();
+
+			if (frame >= warmupFrames)
+			{
+				result.drawCalls = staticBatch.GetStats().drawCalls;
+				result.triangles += staticBatch.GetStats().visibleTriangles;
+				result.submitMs += std::chrono::duration<double, std::milli>(submitEnd - submitStart).count();
+			}
+		}
+		else if (mode == BenchmarkMode::Indirect)
+		{
+			auto submitStart = std::chrono::steady_clock::now();
+			for (iRenderable& object : objects)
+			{
+				indirectRenderer.Submit(&object);
+			}
+			indirectRenderer.Render();
+			auto submitEnd = std::chrono::steady_clock::now();
+
+			if (frame >= warmupFrames)
+			{
+				result.drawCalls = indirectRenderer.GetStats().drawCalls;
+				result.triangles = indirectRenderer.GetStats().triangles;
+				result.submitMs += std::chrono::duration<double, std::milli>(submitEnd - submitStart).count();
+			}
+		}
+		else
+		{
+			for (iRenderable& object : objects)
+			{
+				renderer.Submit(&object);
+			}
+
+			if (mode == BenchmarkMode::Instanced)
+				renderer.Render();
+			else
+				renderer.RenderNaive();
+
+			if (frame >= warmupFrames)
+			{
+				result.drawCalls = renderer.GetStats().drawCalls;
+				result.submitMs += renderer.GetStats().submitMs;
+			}
+		}
+
+		SDL_GL_SwapWindow(window);
+		glFinish();
+
+		auto endTime = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames)
+		{
+			result.frameMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+		}
+
+		SDL_PumpEvents();
+	}
+
+	result.submitMs /= frames;
+	result.frameMs /= frames;
+	if (mode == BenchmarkMode::Static)
+		result.triangles /= frames;
+	else if (mode != BenchmarkMode::Indirect)
+		result.triangles = Mesh::GetDrawStats().trianglesSubmitted / frames;
+	return result;
+}
+
+void RunMeshBenchmark(SDL_Window* window, const char* meshPath, int instanceCount, int lightCount, int frames)
+{
+	Mesh mesh;
+	if (!mesh.LoadFromFile(meshPath, GetCompactVertexFormat(), true))
+		return;
+
+	int width, height;
+	SDL_GL_GetDrawableSize(window, &width, &height);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glClearColor(0.4f, 0.5f, 0.6f, 1.0f);
+
+	// square grid of copies, spaced a bit over one mesh apart, with random yaw and size so it isn't a perfect lattice
+	float spacing = mesh.GetBoundingRadius() * 2.5f;
+	int side = (int)ceilf(sqrtf((float)instanceCount));
+	srand(1234);
+
+	std::vector<iRenderable> objects(instanceCount);
+	for (int i = 0; i < instanceCount; i++)
+	{
+		glm::vec3 position((i % side - side * 0.5f) * spacing, 0.0f, (i / side - side * 0.5f) * spacing);
+		float scale = 0.75f + 0.5f * (rand() / (float)RAND_MAX);
+
+		objects[i].SetMesh(&mesh);
+		objects[i].SetPosition(position - mesh.GetBoundsCenter() * scale);
+		objects[i].SetRotation(glm::vec3(0.0f, 6.2831853f * (rand() / (float)RAND_MAX), 0.0f));
+		objects[i].SetScale(glm::vec3(scale));
+		objects[i].UpdateTransform();
+	}
+
+	// looking down across the field from one corner
+	float fieldSize = side * spacing;
+	float fovY = glm::radians(60.0f);
+	glm::vec3 cameraPosition(-fieldSize * 0.6f, fieldSize * 0.25f, -fieldSize * 0.6f);
+	glm::mat4 view = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	float nearPlane = spacing * 0.1f;
+	float farPlane = fieldSize * 3.0f;
+	glm::mat4 projection = glm::perspective(fovY, (float)width / height, nearPlane, farPlane);
+
+	MeshRenderer renderer;
+	renderer.Init();
+	renderer.SetCamera(view, projection, cameraPosition, fovY, (float)height);
+
+	// static batch chunks about 8x8 objects across
+	StaticBatch staticBatch;
+	std::vector<const iRenderable*> staticObjects;
+	for (const iRenderable& object : objects)
+	{
+		staticObjects.push_back(&object);
+	}
+	staticBatch.Build(staticObjects, spacing * 8.0f);
+
+	// the arena holds its own float copy of the mesh
+	MeshArena arena;
+	arena.Init(mesh.GetVertices().size(), mesh.GetIndices().size());
+	arena.AddMesh(&mesh);
+
+	IndirectRenderer indirectRenderer;
+	indirectRenderer.Init(&arena);
+	indirectRenderer.SetCamera(view, projection, cameraPosition, fovY, (float)height);
+
+	BenchmarkResult naive = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Naive);
+	BenchmarkResult instanced = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Instanced);
+	BenchmarkResult indirect = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Indirect);
+	BenchmarkResult merged = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Static);
+
+	// the lights and camera don't move, so the clusters are binned and uploaded once
+	LightClusters clusters;
+	BenchmarkResult litInstanced = {};
+	BenchmarkResult litIndirect = {};
+	if (lightCount > 0)
+	{
+		std::vector<PointLight> lights(lightCount);
+		for (PointLight& light : lights)
+		{
+			light.position = glm::vec3((rand() / (float)RAND_MAX - 0.5f) * fieldSize, (rand() / (float)RAND_MAX) * spacing,
+				(rand() / (float)RAND_MAX - 0.5f) * fieldSize);
+			light.radius = spacing * (0.5f + 1.5f * (rand() / (float)RAND_MAX));
+			light.color = glm::vec3(0.2f + 0.8f * (rand() / (float)RAND_MAX), 0.2f + 0.8f * (rand() / (float)RAND_MAX), 0.2f + 0.8f * (rand() / (float)RAND_MAX));
+			light.intensity = 1.0f;
+		}
+
+		clusters.Init();
+		clusters.SetProjection(fovY, nearPlane, farPlane, width, height);
+		clusters.Build(lights.data(), lights.size(), view);
+		clusters.Upload();
+
+		renderer.SetLightClusters(&clusters);
+		indirectRenderer.SetLightClusters(&clusters);
+		litInstanced = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Instanced);
+		litIndirect = RunPass(window, renderer, indirectRenderer, objects, staticBatch, frames, BenchmarkMode::Indirect);
+		renderer.SetLightClusters(nullptr);
+		indirectRenderer.SetLightClusters(nullptr);
+	}
+
+	renderer.Dispose();
+	indirectRenderer.Dispose();
+	arena.Dispose();
+
+	printf("\n%d x %s, %d frames\n", instanceCount, meshPath, frames);
+	printf("            draw calls   submit (ms)   frame (ms)   triangles\n");
+	printf("naive       %10u   %11.3f   %10.3f   %9" PRIu64 "\n", naive.drawCalls, naive.submitMs, naive.frameMs, naive.triangles);
+	printf("instanced   %10u   %11.3f   %10.3f   %9" PRIu64 "\n", instanced.drawCalls, instanced.submitMs, instanced.frameMs, instanced.triangles);
+	printf("indirect    %10u   %11.3f   %10.3f   %9" PRIu64 " (%u commands, %s)\n", indirect.drawCalls, indirect.submitMs, indirect.frameMs, indirect.triangles,
+		indirectRenderer.GetStats().commands, indirectRenderer.GetStats().indirect ? "multi-draw" : "fallback");
+	printf("static      %10u   %11.3f   %10.3f   %9" PRIu64 " (%u/%u chunks visible, %.1f MB)\n", merged.drawCalls, merged.submitMs, merged.frameMs, merged.triangles,
+		staticBatch.GetStats().visibleChunks, staticBatch.GetStats().chunks, staticBatch.GetStats().memoryBytes / (1024.0f * 1024.0f));
+
+	if (lightCount > 0)
+	{
+		const LightClusterStats& lightStats = clusters.GetStats();
+		printf("\n%d point lights, %u visible, %u cluster assignments, %u max per cluster, %u dropped\n", lightCount,
+			lightStats.visibleLights, lightStats.assignments, lightStats.maxLightsPerCluster, lightStats.droppedAssignments);
+		printf("            draw calls   submit (ms)   frame (ms)   triangles\n");
+		printf("instanced   %10u   %11.3f   %10.3f   %9" PRIu64 "\n", litInstanced.drawCalls, litInstanced.submitMs, litInstanced.frameMs, litInstanced.triangles);
+		printf("indirect    %10u   %11.3f   %10.3f   %9" PRIu64 "\n", litIndirect.drawCalls, litIndirect.submitMs, litIndirect.frameMs, litIndirect.triangles);
+		clusters.Dispose();
+	}
+}
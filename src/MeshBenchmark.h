@@ -0,0 +1,8 @@
+#pragma once
+
+#include <SDL.h>
+
+// draws instanceCount copies of one mesh with MeshRenderer::RenderNaive, MeshRenderer::Render and as a
+// StaticBatch, and prints draw calls, CPU submission time and frame time for each. with lightCount point lights
+// scattered over the field, instanced and indirect are drawn again with clustered lighting. needs a current GL context
+void RunMeshBenchmark(SDL_Window* window, const char* meshPath, int instanceCount, int lightCount, int frames = 120);
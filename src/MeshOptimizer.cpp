@@ -0,0 +1,380 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Forsyth scoring constants, from "Linear-Speed Vertex Cache Optimisation"
+static const int kForsythCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+// maps the indices of a range onto 0..n-1 so the per-vertex arrays only cover what the range uses.
+// returns the number of unique vertices, outUnique[local] is the original index
+static size_t CompactIndices(const unsigned int* indices, size_t indexCount, std::vector<unsigned int>& outLocal, std::vector<unsigned int>& outUnique)
+{
+    outUnique.assign(indices, indices + indexCount);
+    std::sort(outUnique.begin(), outUnique.end());
+    outUnique.erase(std::unique(outUnique.begin(), outUnique.end()), outUnique.end());
+
+    outLocal.resize(indexCount);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        outLocal[i] = static_cast<unsigned int>(std::lower_bound(outUnique.begin(), outUnique.end(), indices[i]) - outUnique.begin());
+    }
+
+    return outUnique.size();
+}
+
+// fifo cache simulation. a vertex is resident if it was inserted within the last 'size' insertions,
+// hits don't move it. Reset() just moves time far enough on that nothing is resident
+class FifoCache
+{
+public:
+    FifoCache(size_t vertexCount, unsigned int size)
+        : m_timestamps(vertexCount, 0), m_time(size + 1), m_size(size) {}
+
+    unsigned int Misses(const unsigned int* triangle)
+    {
+        unsigned int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            if (m_time - m_timestamps[v] > m_size)
+            {
+                m_timestamps[v] = m_time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void Reset() { m_time += m_size + 1; }
+
+private:
+    std::vector<unsigned int> m_timestamps;
+    unsigned int m_time;
+    unsigned int m_size;
+
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indexCount < 3)
+        return stats;
+
+    std::vector<unsigned int> local, unique;
+    size_t vertexCount = CompactIndices(indices, indexCount, local, unique);
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        misses += cache.Misses(&local[i]);
+    }
+
+    stats.acmr = static_cast<float>(misses) / (indexCount / 3);
+    stats.atvr = static_cast<float>(misses) / vertexCount;
+    return stats;
+}
+
+static float ForsythVertexScore(int cachePosition, unsigned int remainingValence)
+{
+    // nothing left to draw with this vertex
+    if (remainingValence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // used by the last triangle, fixed score so the next triangle doesn't just strip along
+            score = kLastTriangleScore;
+        }
+        else
+        {
+            float scaler = 1.0f / (kForsythCacheSize - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+        }
+    }
+
+    // boost vertices with few triangles left so they get finished off instead of lingering
+    score += kValenceBoostScale * powf(static_cast<float>(remainingValence), -kValenceBoostPower);
+    return score;
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    std::vector<unsigned int> local, unique;
+    size_t vertexCount = CompactIndices(indices, triangleCount * 3, local, unique);
+
+    // vertex -> triangle adjacency. valence doubles as the count of not yet emitted triangles
+    std::vector<unsigned int> valence(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        valence[local[i]]++;
+    }
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + valence[v];
+    }
+
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    {
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                adjacency[fill[local[3 * t + k]]++] = static_cast<unsigned int>(t);
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = ForsythVertexScore(-1, valence[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScore[t] = vertexScore[local[3 * t + 0]] + vertexScore[local[3 * t + 1]] + vertexScore[local[3 * t + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+
+    unsigned int cache[kForsythCacheSize + 3];
+    int cacheCount = 0;
+
+    long long bestTriangle = -1;
+    size_t nextCandidate = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if (bestTriangle < 0)
+        {
+            // nothing in the cache touches a remaining triangle, carry on from the next one in the original order
+            while (emitted[nextCandidate])
+                nextCandidate++;
+            bestTriangle = static_cast<long long>(nextCandidate);
+        }
+
+        size_t t = static_cast<size_t>(bestTriangle);
+        const unsigned int* triangle = &local[3 * t];
+        emitted[t] = true;
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            output.push_back(v);
+
+            // swap-remove this triangle from the vertex's remaining list
+            unsigned int* begin = &adjacency[offsets[v]];
+            unsigned int* end = begin + valence[v];
+            unsigned int* it = std::find(begin, end, static_cast<unsigned int>(t));
+            if (it != end)
+            {
+                *it = *(end - 1);
+                valence[v]--;
+            }
+        }
+
+        // the triangle's vertices go to the front, everything else shuffles back
+        unsigned int newCache[kForsythCacheSize + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            if (std::find(newCache, newCache + newCount, triangle[k]) == newCache + newCount)
+                newCache[newCount++] = triangle[k];
+        }
+        for (int i = 0; i < cacheCount; i++)
+        {
+            if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+                newCache[newCount++] = cache[i];
+        }
+
+        // rescore everything that moved, including vertices that just fell out the end
+        for (int i = 0; i < newCount; i++)
+        {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < kForsythCacheSize ? i : -1;
+
+            float score = ForsythVertexScore(cachePosition[v], valence[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            for (unsigned int a = offsets[v]; a < offsets[v] + valence[v]; a++)
+            {
+                triangleScore[adjacency[a]] += delta;
+            }
+        }
+
+        cacheCount = std::min(newCount, kForsythCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        // best candidate is always adjacent to something in the cache
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (int i = 0; i < cacheCount; i++)
+        {
+            unsigned int v = cache[i];
+            for (unsigned int a = offsets[v]; a < offsets[v] + valence[v]; a++)
+            {
+                unsigned int candidate = adjacency[a];
+                if (triangleScore[candidate] > bestScore)
+                {
+                    bestScore = triangleScore[candidate];
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        indices[i] = unique[output[i]];
+    }
+}
+
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const std::vector<MeshVertex>& vertices, float threshold)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    std::vector<unsigned int> local, unique;
+    size_t vertexCount = CompactIndices(indices, triangleCount * 3, local, unique);
+    FifoCache cache(vertexCount, kVertexCacheSize);
+
+    // hard boundaries are where every vertex of a triangle missed, the cache was effectively empty there anyway
+    std::vector<size_t> hardClusters;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (cache.Misses(&local[3 * t]) == 3)
+            hardClusters.push_back(t);
+    }
+    hardClusters.push_back(triangleCount);
+
+    // split each hard cluster further wherever the run so far is already within threshold of the cluster's acmr
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+    {
+        size_t start = hardClusters[c];
+        size_t end = hardClusters[c + 1];
+
+        cache.Reset();
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            clusterMisses += cache.Misses(&local[3 * t]);
+        }
+        float clusterAcmr = static_cast<float>(clusterMisses) / (end - start);
+
+        cache.Reset();
+        clusters.push_back(start);
+        size_t runStart = start;
+        size_t runMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            runMisses += cache.Misses(&local[3 * t]);
+            if (t + 1 < end && static_cast<float>(runMisses) / (t + 1 - runStart) <= clusterAcmr * threshold)
+            {
+                cache.Reset();
+                clusters.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // area weighted centroid and normal per cluster
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[3 * t + 0]].position;
+            const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+            const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+            float area = glm::length(normal);
+
+            clusterNormal[c] += normal;
+            clusterCentroid[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterArea += area;
+        }
+
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea;
+        clusterCentroid[c] = clusterArea > 0.0f ? clusterCentroid[c] / clusterArea : glm::vec3(0.0f);
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+    // clusters facing away from the middle of the mesh are the likely occluders, draw them first
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float length = glm::length(clusterNormal[c]);
+        sortKey[c] = length > 0.0f ? glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c] / length) : 0.0f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (size_t c : order)
+    {
+        output.insert(output.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexFetch(std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    const unsigned int kUnused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), kUnused);
+
+    std::vector<MeshVertex> output;
+    output.reserve(vertices.size());
+
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == kUnused)
+        {
+            remap[index] = static_cast<unsigned int>(output.size());
+            output.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(output);
+}
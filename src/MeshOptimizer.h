@@ -0,0 +1,32 @@
+#pragma once
+
+// post-load index/vertex reordering for indexed triangle lists.
+// the usual order is OptimizeVertexCache per draw range, then OptimizeOverdraw on the same range,
+// then OptimizeVertexFetch once over the whole buffer
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+// fifo size used for reporting, roughly what current hardware behaves like
+static const unsigned int kVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+    float acmr; // average cache miss ratio: transformed vertices per triangle, 0.5 is the best case, 3 the worst
+    float atvr; // average transformed vertex ratio: transformed vertices per unique vertex, 1 is optimal
+};
+
+// simulates a fifo post-transform cache over the index list
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, unsigned int cacheSize = kVertexCacheSize);
+
+// reorders triangles for vertex cache hits (Forsyth's linear-speed algorithm)
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount);
+
+// splits the cache optimized order into clusters and sorts them so outward facing ones are drawn first.
+// threshold is how much worse than the original acmr the result is allowed to get (1.05 = 5%)
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const std::vector<MeshVertex>& vertices, float threshold = 1.05f);
+
+// reorders vertices into first-use order and rewrites indices to match. unreferenced vertices are dropped
+void OptimizeVertexFetch(std::vector<MeshVertex>& vertices, std::vector<unsigned int>& indices);
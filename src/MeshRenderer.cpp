@@ -0,0 +1,456 @@
+#include "MeshRenderer.h"
+
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "Renderable.h"
+#include "Shader.h"
+#include "StaticBatch.h"
+#include "Texture.h"
+#include "VertexFormat.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// locations 3-5 hold the top three rows of the world matrix, the last row is always 0,0,0,1
+static const GLuint kInstanceAttribute = 3;
+static const size_t kRowsPerInstance = 3;
+static const size_t kInitialInstanceCapacity = 1024;
+// renderables per job for lod selection and instance data
+static const size_t kItemsPerJob = 256;
+// alpha tested texels below this are discarded
+static const float kAlphaTestCutoff = 0.5f;
+
+static const char* kMeshVertexSource = R"(
+	layout (location = 0) in vec3 a_position;
+	layout (location = 1) in vec3 a_normal;
+	layout (location = 2) in vec2 a_texcoord;
+	layout (location = 3) in vec4 a_modelRow0;
+	layout (location = 4) in vec4 a_modelRow1;
+	layout (location = 5) in vec4 a_modelRow2;
+
+	out vec3 v_normal;
+	out vec2 v_texcoord;
+	out vec3 v_worldPosition;
+
+	uniform mat4 u_viewProjection;
+
+	void main()
+	{
+		mat4 model = transpose(mat4(a_modelRow0, a_modelRow1, a_modelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+
+		vec4 worldPosition = model * vec4(DecodePosition(a_position), 1.0);
+		gl_Position = u_viewProjection * worldPosition;
+		v_worldPosition = worldPosition.xyz;
+		v_normal = mat3(model) * DecodeNormal(a_normal);
+		v_texcoord = a_texcoord;
+	}
+)";
+
+// after kClusteredLightingGLSL
+static const char* kMeshFragmentSource = R"(
+	out vec4 out_color;
+
+	in vec3 v_normal;
+	in vec2 v_texcoord;
+	in vec3 v_worldPosition;
+
+	uniform sampler2D u_sampler;
+	uniform int u_useTexture;
+	uniform float u_alphaCutoff; // 0 unless the texture is alpha tested
+
+	const vec3 kLightDirection = normalize(vec3(-0.3, -1.0, -0.5));
+
+	void main()
+	{
+		vec4 albedo = u_useTexture != 0 ? texture(u_sampler, v_texcoord) : vec4(1.0);
+		if (albedo.a < u_alphaCutoff)
+			discard;
+		vec3 normal = normalize(v_normal);
+		float diffuse = max(dot(normal, -kLightDirection), 0.0) * 0.8 + 0.2;
+		out_color = vec4(albedo.rgb * (diffuse + ClusteredLighting(v_worldPosition, normal)), albedo.a);
+	}
+)";
+
+void MeshRenderer::Init()
+{
+	CreateShaderPrograms();
+
+	m_instanceCapacity = kInitialInstanceCapacity;
+	glGenBuffers(1, &m_instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity * kRowsPerInstance * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshRenderer::Dispose()
+{
+	glDeleteBuffers(1, &m_instanceBuffer);
+	glDeleteProgram(m_programs[0]);
+	glDeleteProgram(m_programs[1]);
+}
+
+void MeshRenderer::SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float fovY, float viewportHeight)
+{
+	m_viewProjection = projection * view;
+	m_cameraPosition = cameraPosition;
+	m_fovY = fovY;
+	m_viewportHeight = viewportHeight;
+}
+
+void MeshRenderer::Submit(iRenderable* renderable)
+{
+	if (renderable->GetMesh() == nullptr)
+		return;
+
+	Texture* texture = renderable->GetTexture();
+	AlphaMode alphaMode = texture != nullptr ? texture->GetAlphaMode() : AlphaMode::Opaque;
+	m_items.push_back({ renderable->GetMesh(), texture, 0, renderable, alphaMode, 0.0f });
+}
+
+void MeshRenderer::CullOccluded()
+{
+	m_stats.occluded = 0;
+	if (m_occlusionCuller == nullptr)
+		return;
+
+	m_itemVisible.resize(m_items.size());
+	auto testRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const DrawItem& item = m_items[i];
+			m_itemVisible[i] = m_occlusionCuller->IsVisible(item.mesh->GetBoundsMin(), item.mesh->GetBoundsMax(), item.renderable->GetTransform()) ? 1 : 0;
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_items.size(), kItemsPerJob, testRange);
+	else
+		testRange(0, m_items.size());
+
+	// compacted in place, submission order is kept for RenderNaive
+	size_t numVisible = 0;
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		if (m_itemVisible[i])
+			m_items[numVisible++] = m_items[i];
+	}
+	m_stats.occluded = (unsigned int)(m_items.size() - numVisible);
+	m_items.resize(numVisible);
+}
+
+void MeshRenderer::UpdateLods()
+{
+	auto updateRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			m_items[i].renderable->UpdateLod(m_cameraPosition, m_fovY, m_viewportHeight);
+			m_items[i].lod = m_items[i].renderable->GetLod();
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_items.size(), kItemsPerJob, updateRange);
+	else
+		updateRange(0, m_items.size());
+}
+
+void MeshRenderer::Render()
+{
+	auto startTime = std::chrono::steady_clock::now();
+	m_stats.drawCalls = 0;
+	m_stats.instances = (unsigned int)m_items.size();
+	m_stats.translucent = 0;
+
+	CullOccluded();
+	if (m_items.empty())
+	{
+		m_stats.submitMs = 0.0;
+		return;
+	}
+
+	UpdateLods();
+
+	for (DrawItem& item : m_items)
+	{
+		if (item.alphaMode != AlphaMode::Translucent)
+			continue;
+
+		glm::vec3 offset = glm::vec3(item.renderable->GetTransform()[3]) - m_cameraPosition;
+		item.distance = glm::dot(offset, offset);
+		m_stats.translucent++;
+	}
+
+	// opaque, then alpha tested, grouped for instancing. translucent ones far to near, which only keeps
+	// instancing where neighbours happen to share a mesh
+	std::sort(m_items.begin(), m_items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.alphaMode != b.alphaMode) return a.alphaMode < b.alphaMode;
+		if (a.alphaMode == AlphaMode::Translucent && a.distance != b.distance) return a.distance > b.distance;
+		if (a.mesh != b.mesh) return a.mesh < b.mesh;
+		if (a.texture != b.texture) return a.texture < b.texture;
+		return a.lod < b.lod;
+	});
+
+	// world matrices in draw order, so each group is a contiguous run of instances
+	m_instanceData.resize(m_items.size() * kRowsPerInstance);
+	auto fillRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::mat4 rows = glm::transpose(m_items[i].renderable->GetTransform());
+			m_instanceData[i * kRowsPerInstance + 0] = rows[0];
+			m_instanceData[i * kRowsPerInstance + 1] = rows[1];
+			m_instanceData[i * kRowsPerInstance + 2] = rows[2];
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_items.size(), kItemsPerJob, fillRange);
+	else
+		fillRange(0, m_items.size());
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	if (m_items.size() > m_instanceCapacity)
+	{
+		while (m_instanceCapacity < m_items.size())
+			m_instanceCapacity *= 2;
+	}
+	// orphan last frame's data instead of waiting for the GPU to finish with it
+	glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity * kRowsPerInstance * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_instanceData.size() * sizeof(glm::vec4), m_instanceData.data());
+
+	GLboolean blendWasEnabled = glIsEnabled(GL_BLEND);
+	GLuint currentProgram = 0;
+	const Mesh* currentMesh = nullptr;
+	Texture* currentTexture = nullptr;
+
+	for (size_t first = 0; first < m_items.size();)
+	{
+		const DrawItem& item = m_items[first];
+
+		size_t last = first + 1;
+		while (last < m_items.size() && m_items[last].mesh == item.mesh && m_items[last].texture == item.texture && m_items[last].lod == item.lod)
+			last++;
+
+		GLuint program = GetProgram(item.mesh);
+		bool alphaModeChanged = first == 0 || m_items[first - 1].alphaMode != item.alphaMode;
+		if (program != currentProgram)
+		{
+			SetupProgram(program);
+			currentProgram = program;
+			currentMesh = nullptr;
+			currentTexture = nullptr;
+			BindTexture(program, nullptr);
+			alphaModeChanged = true;
+		}
+
+		if (alphaModeChanged)
+			SetAlphaMode(program, item.alphaMode);
+
+		if (item.mesh != currentMesh)
+		{
+			item.mesh->SetDequantizationUniforms(program);
+			item.mesh->BindVertexArray();
+			currentMesh = item.mesh;
+		}
+
+		if (item.texture != currentTexture)
+		{
+			BindTexture(program, item.texture);
+			currentTexture = item.texture;
+		}
+
+		// the instance attributes live on the mesh's VAO, point them at this group's run
+		SetInstanceAttributes(first);
+		item.mesh->DrawInstanced((GLsizei)(last - first), item.lod);
+		m_stats.drawCalls++;
+
+		first = last;
+	}
+
+	glDepthMask(GL_TRUE);
+	if (blendWasEnabled)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_items.clear();
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.submitMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void MeshRenderer::RenderNaive()
+{
+	auto startTime = std::chrono::steady_clock::now();
+	m_stats.drawCalls = 0;
+	m_stats.instances = (unsigned int)m_items.size();
+
+	CullOccluded();
+	UpdateLods();
+
+	GLuint currentProgram = 0;
+	for (const DrawItem& item : m_items)
+	{
+		GLuint program = GetProgram(item.mesh);
+		if (program != currentProgram)
+		{
+			SetupProgram(program);
+			currentProgram = program;
+		}
+
+		item.mesh->SetDequantizationUniforms(program);
+		BindTexture(program, item.texture);
+
+		// instance arrays off, the matrix goes in as constant attribute values instead
+		item.mesh->BindVertexArray();
+		for (GLuint i = 0; i < kRowsPerInstance; i++)
+		{
+			glDisableVertexAttribArray(kInstanceAttribute + i);
+		}
+
+		glm::mat4 rows = glm::transpose(item.renderable->GetTransform());
+		for (GLuint i = 0; i < kRowsPerInstance; i++)
+		{
+			glVertexAttrib4fv(kInstanceAttribute + i, glm::value_ptr(rows[i]));
+		}
+
+		item.mesh->Draw(item.lod);
+		m_stats.drawCalls++;
+	}
+
+	glBindVertexArray(0);
+	m_items.clear();
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.submitMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void MeshRenderer::RenderStatic(StaticBatch& batch)
+{
+	// static batches are float vertices already in world space
+	GLuint program = m_programs[0];
+	SetupProgram(program);
+	glUniform3f(glGetUniformLocation(program, "u_positionOffset"), 0.0f, 0.0f, 0.0f);
+	glUniform3f(glGetUniformLocation(program, "u_positionScale"), 1.0f, 1.0f, 1.0f);
+
+	// the batch's VAO has no instance arrays, so the model rows come from these constant values
+	glVertexAttrib4f(kInstanceAttribute + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib4f(kInstanceAttribute + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+	glVertexAttrib4f(kInstanceAttribute + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+
+	Frustum frustum(m_viewProjection);
+	batch.Draw(frustum, [this, program](Texture* texture) {
+		BindTexture(program, texture);
+	});
+}
+
+GLuint CreateMeshShaderProgram(const VertexFormat& format, const char* vertexSource)
+{
+	// the decode functions depend on the vertex format, so each variant gets its own #defines
+	std::string fullVertexSource = "#version 330 core\n" + GetVertexFormatDefines(format) + kVertexDecodeGLSL + vertexSource;
+	std::string fullFragmentSource = std::string("#version 330 core\n") + kClusteredLightingGLSL + kMeshFragmentSource;
+
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, fullVertexSource.c_str());
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fullFragmentSource.c_str());
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+
+	int success;
+	char info_log[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(program, 512, NULL, info_log);
+		printf("Failed to link shader:\n%s\n", info_log);
+	}
+
+	// No longer need these
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glUseProgram(program);
+	GLint textureUniformLocation = glGetUniformLocation(program, "u_sampler");
+	assert(textureUniformLocation >= 0 && "Sampler does not exist");
+	glUniform1i(textureUniformLocation, 0);
+
+	// the light buffers' samplers need units of their own even with clustering off, samplers of different
+	// types on one unit fail the draw
+	glUniform1i(glGetUniformLocation(program, "u_lightData"), LightClusters::kLightDataTextureUnit);
+	glUniform1i(glGetUniformLocation(program, "u_clusterGrid"), LightClusters::kClusterGridTextureUnit);
+	glUniform1i(glGetUniformLocation(program, "u_lightIndices"), LightClusters::kLightIndexTextureUnit);
+	glUniform1i(glGetUniformLocation(program, "u_useClusters"), 0);
+	glUniform1f(glGetUniformLocation(program, "u_alphaCutoff"), 0.0f);
+
+	return program;
+}
+
+void MeshRenderer::CreateShaderPrograms()
+{
+	m_programs[0] = CreateMeshShaderProgram(GetFullVertexFormat(), kMeshVertexSource);
+	m_programs[1] = CreateMeshShaderProgram(GetCompactVertexFormat(), kMeshVertexSource);
+}
+
+GLuint MeshRenderer::GetProgram(const Mesh* mesh) const
+{
+	return mesh->GetVertexFormat().normal == NormalEncoding::Float32 ? m_programs[0] : m_programs[1];
+}
+
+void MeshRenderer::SetupProgram(GLuint program)
+{
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "u_viewProjection"), 1, false, glm::value_ptr(m_viewProjection));
+
+	if (m_lightClusters != nullptr)
+		m_lightClusters->Bind(program);
+	else
+		glUniform1i(glGetUniformLocation(program, "u_useClusters"), 0);
+}
+
+void MeshRenderer::SetInstanceAttributes(size_t firstInstance)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+
+	GLsizei stride = kRowsPerInstance * sizeof(glm::vec4);
+	size_t offset = firstInstance * stride;
+	for (GLuint i = 0; i < kRowsPerInstance; i++)
+	{
+		glEnableVertexAttribArray(kInstanceAttribute + i);
+		glVertexAttribPointer(kInstanceAttribute + i, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(offset + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(kInstanceAttribute + i, 1);
+	}
+}
+
+void MeshRenderer::BindTexture(GLuint program, Texture* texture)
+{
+	glUniform1i(glGetUniformLocation(program, "u_useTexture"), texture != nullptr);
+	if (texture != nullptr)
+		texture->Bind();
+}
+
+void MeshRenderer::SetAlphaMode(GLuint program, AlphaMode alphaMode)
+{
+	glUniform1f(glGetUniformLocation(program, "u_alphaCutoff"), alphaMode == AlphaMode::AlphaTest ? kAlphaTestCutoff : 0.0f);
+
+	if (alphaMode == AlphaMode::Translucent)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+	}
+	else
+	{
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+	}
+}
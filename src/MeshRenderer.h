@@ -0,0 +1,110 @@
+#pragma once
+
+// draws 3D renderables. everything submitted in a frame is grouped by mesh/texture/lod and each group
+// is one glDrawElementsInstanced, with the world matrices streamed through a per-instance buffer.
+// opaque and alpha tested textures go first without blending, translucent ones after them back to front
+// without depth writes. RenderNaive draws the same list one object at a time, for comparison
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Texture.h"
+
+#include <cstdint>
+#include <vector>
+
+class iRenderable;
+class JobSystem;
+class LightClusters;
+class Mesh;
+class OcclusionCuller;
+class StaticBatch;
+struct VertexFormat;
+
+struct MeshRenderStats
+{
+	unsigned int drawCalls;
+	unsigned int instances;
+	unsigned int occluded; // of instances, skipped by the occlusion culler
+	unsigned int translucent; // of instances, blended back to front
+	double submitMs; // CPU time spent issuing the frame, not GPU time
+};
+
+// links vertexSource (prefixed with #version, the format's #defines and kVertexDecodeGLSL) against the lit
+// mesh fragment shader. the fragment shader wants v_normal, v_texcoord, v_worldPosition, u_sampler on unit 0,
+// u_useTexture and u_alphaCutoff, plus LightClusters::Bind's uniforms when clustered lighting is on
+GLuint CreateMeshShaderProgram(const VertexFormat& format, const char* vertexSource);
+
+class MeshRenderer
+{
+public:
+	MeshRenderer() = default;
+	~MeshRenderer() {}
+
+	void Init();
+	void Dispose();
+
+	// lod selection and instance data are split across the job system's threads when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	// renderables hidden behind the culler's occluders are dropped before drawing. the culler has to be
+	// rasterized for the same camera first
+	void SetOcclusionCuller(const OcclusionCuller* culler) { m_occlusionCuller = culler; }
+	// point lights binned for the same camera are added on top of the directional light. the clusters
+	// have to be built and uploaded before rendering
+	void SetLightClusters(const LightClusters* clusters) { m_lightClusters = clusters; }
+
+	void SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float fovY, float viewportHeight);
+
+	// queues the renderable for this frame, its lod is picked when rendering
+	void Submit(iRenderable* renderable);
+
+	void Render();
+	void RenderNaive();
+
+	// merged scenery, culled against the current camera
+	void RenderStatic(StaticBatch& batch);
+
+	const MeshRenderStats& GetStats() const { return m_stats; }
+
+private:
+	struct DrawItem
+	{
+		Mesh* mesh;
+		Texture* texture;
+		int lod;
+		iRenderable* renderable;
+		AlphaMode alphaMode;
+		float distance; // squared, from the camera, translucent items only
+	};
+
+	void CullOccluded();
+	void UpdateLods();
+	void CreateShaderPrograms();
+	GLuint GetProgram(const Mesh* mesh) const;
+	void SetupProgram(GLuint program);
+	void SetAlphaMode(GLuint program, AlphaMode alphaMode);
+	void SetInstanceAttributes(size_t firstInstance);
+	void BindTexture(GLuint program, Texture* texture);
+
+	// [0] float normals, [1] octahedral normals
+	GLuint m_programs[2] = { 0, 0 };
+
+	JobSystem* m_jobSystem = nullptr;
+	const OcclusionCuller* m_occlusionCuller = nullptr;
+	const LightClusters* m_lightClusters = nullptr;
+
+	GLuint m_instanceBuffer = 0;
+	size_t m_instanceCapacity = 0; // in instances
+
+	std::vector<DrawItem> m_items;
+	std::vector<uint8_t> m_itemVisible; // CullOccluded scratch
+	std::vector<glm::vec4> m_instanceData; // 3 rows of the world matrix per instance
+
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+	float m_fovY = 1.0f;
+	float m_viewportHeight = 1.0f;
+
+	MeshRenderStats m_stats = { 0, 0, 0, 0, 0.0 };
+
+};
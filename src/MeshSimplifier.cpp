@@ -0,0 +1,321 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+// symmetric 4x4 error quadric, plus the total weight so errors come out as an average squared distance
+struct Quadric
+{
+    float a00, a01, a02, a11, a12, a22;
+    float b0, b1, b2;
+    float c;
+    float w;
+};
+
+static void AddQuadric(Quadric& q, const Quadric& r)
+{
+    q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02;
+    q.a11 += r.a11; q.a12 += r.a12; q.a22 += r.a22;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.w += r.w;
+}
+
+// plane n.p + d = 0, weighted
+static Quadric PlaneQuadric(const glm::vec3& n, float d, float w)
+{
+    Quadric q;
+    q.a00 = w * n.x * n.x; q.a01 = w * n.x * n.y; q.a02 = w * n.x * n.z;
+    q.a11 = w * n.y * n.y; q.a12 = w * n.y * n.z; q.a22 = w * n.z * n.z;
+    q.b0 = w * n.x * d; q.b1 = w * n.y * d; q.b2 = w * n.z * d;
+    q.c = w * d * d;
+    q.w = w;
+    return q;
+}
+
+// distance from p to the planes the quadric was built from, root mean square
+static float QuadricError(const Quadric& q, const glm::vec3& p)
+{
+    float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+    float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+    float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+    float r = p.x * rx + p.y * ry + p.z * rz + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+
+    return q.w > 0.0f ? sqrtf(fabsf(r) / q.w) : 0.0f;
+}
+
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    float error;
+};
+
+float SimplifyMesh(const std::vector<MeshVertex>& vertices, const unsigned int* indices, size_t indexCount,
+    size_t targetIndexCount, float maxError, float boundsDiagonal, std::vector<unsigned int>& outIndices)
+{
+    outIndices.assign(indices, indices + indexCount - indexCount % 3);
+    if (outIndices.size() <= targetIndexCount)
+        return 0.0f;
+
+    // work on 0..n-1 over just the vertices this range uses
+    std::vector<unsigned int> unique(outIndices);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    size_t vertexCount = unique.size();
+
+    std::vector<unsigned int> current(outIndices.size());
+    for (size_t i = 0; i < outIndices.size(); i++)
+    {
+        current[i] = static_cast<unsigned int>(std::lower_bound(unique.begin(), unique.end(), outIndices[i]) - unique.begin());
+    }
+
+    // positions scaled so the mesh has a unit diagonal, errors are relative to its size
+    glm::vec3 minBounds(FLT_MAX);
+    glm::vec3 maxBounds(-FLT_MAX);
+    for (unsigned int v : unique)
+    {
+        minBounds = glm::min(minBounds, vertices[v].position);
+        maxBounds = glm::max(maxBounds, vertices[v].position);
+    }
+    float diagonal = boundsDiagonal > 0.0f ? boundsDiagonal : glm::length(maxBounds - minBounds);
+    float invScale = diagonal > 0.0f ? 1.0f / diagonal : 1.0f;
+
+    std::vector<glm::vec3> positions(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        positions[v] = (vertices[unique[v]].position - minBounds) * invScale;
+    }
+
+    // weld vertices that share a position. several vertices at one position means a uv/normal seam
+    std::vector<unsigned int> welded(vertexCount);
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::vector<unsigned int> order(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            order[v] = static_cast<unsigned int>(v);
+        }
+        std::sort(order.begin(), order.end(), [&positions](unsigned int a, unsigned int b) {
+            const glm::vec3& pa = positions[a];
+            const glm::vec3& pb = positions[b];
+            if (pa.x != pb.x) return pa.x < pb.x;
+            if (pa.y != pb.y) return pa.y < pb.y;
+            return pa.z < pb.z;
+        });
+
+        for (size_t i = 0; i < vertexCount;)
+        {
+            size_t j = i + 1;
+            while (j < vertexCount && positions[order[j]] == positions[order[i]])
+                j++;
+
+            for (size_t k = i; k < j; k++)
+            {
+                welded[order[k]] = order[i];
+                locked[order[k]] = j - i > 1;
+            }
+            i = j;
+        }
+    }
+
+    // open borders: edges with a single triangle. lock both ends (and any vertex welded to them)
+    {
+        std::unordered_map<uint64_t, int> edgeCount;
+        edgeCount.reserve(current.size());
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint64_t a = welded[current[i + k]];
+                uint64_t b = welded[current[i + (k + 1) % 3]];
+                edgeCount[a < b ? (a << 32) | b : (b << 32) | a]++;
+            }
+        }
+
+        std::vector<bool> borderPosition(vertexCount, false);
+        for (const auto& edge : edgeCount)
+        {
+            if (edge.second == 1)
+            {
+                borderPosition[edge.first >> 32] = true;
+                borderPosition[edge.first & 0xFFFFFFFFu] = true;
+            }
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (borderPosition[welded[v]])
+                locked[v] = true;
+        }
+    }
+
+    // area weighted plane quadrics, accumulated per welded position
+    Quadric zero = {};
+    std::vector<Quadric> quadrics(vertexCount, zero);
+    for (size_t i = 0; i < current.size(); i += 3)
+    {
+        const glm::vec3& p0 = positions[current[i + 0]];
+        const glm::vec3& p1 = positions[current[i + 1]];
+        const glm::vec3& p2 = positions[current[i + 2]];
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+
+        normal /= length;
+        Quadric q = PlaneQuadric(normal, -glm::dot(normal, p0), length * 0.5f);
+        for (int k = 0; k < 3; k++)
+        {
+            AddQuadric(quadrics[welded[current[i + k]]], q);
+        }
+    }
+
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<Collapse> collapses;
+    float reachedError = 0.0f;
+
+    // each pass collapses the cheapest edges that don't touch each other's neighbourhoods, then compacts
+    while (current.size() > targetIndexCount)
+    {
+        size_t triangleCount = current.size() / 3;
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int v : current)
+        {
+            adjacencyOffsets[v + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        adjacency.resize(current.size());
+        {
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < current.size(); i++)
+            {
+                adjacency[fill[current[i]]++] = static_cast<unsigned int>(i / 3);
+            }
+        }
+
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = current[3 * t + k];
+                unsigned int b = current[3 * t + (k + 1) % 3];
+                if (welded[a] == welded[b])
+                    continue;
+
+                Quadric q = quadrics[welded[a]];
+                AddQuadric(q, quadrics[welded[b]]);
+
+                if (!locked[a])
+                    collapses.push_back({ a, b, QuadricError(q, positions[b]) });
+                if (!locked[b])
+                    collapses.push_back({ b, a, QuadricError(q, positions[a]) });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            remap[v] = static_cast<unsigned int>(v);
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t trianglesToRemove = (current.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        size_t applied = 0;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.error > maxError || removed >= trianglesToRemove)
+                break;
+
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // reject collapses that would flip a remaining triangle over
+            bool valid = true;
+            size_t kills = 0;
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && valid; a++)
+            {
+                const unsigned int* triangle = &current[3 * adjacency[a]];
+                if (welded[triangle[0]] == welded[collapse.to] || welded[triangle[1]] == welded[collapse.to] || welded[triangle[2]] == welded[collapse.to])
+                {
+                    kills++;
+                    continue;
+                }
+
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    before[k] = positions[triangle[k]];
+                    after[k] = triangle[k] == collapse.from ? positions[collapse.to] : before[k];
+                }
+
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+                    valid = false;
+            }
+
+            if (!valid)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            AddQuadric(quadrics[welded[collapse.to]], quadrics[welded[collapse.from]]);
+
+            // everything around the collapse is off limits for the rest of the pass so the flip checks stay valid
+            touched[collapse.to] = true;
+            for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+            {
+                const unsigned int* triangle = &current[3 * adjacency[a]];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+
+            reachedError = std::max(reachedError, collapse.error);
+            removed += kills;
+            applied++;
+        }
+
+        if (applied == 0)
+            break;
+
+        // apply and drop triangles that collapsed to a line
+        size_t write = 0;
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            unsigned int a = remap[current[i + 0]];
+            unsigned int b = remap[current[i + 1]];
+            unsigned int c = remap[current[i + 2]];
+            if (welded[a] == welded[b] || welded[b] == welded[c] || welded[c] == welded[a])
+                continue;
+
+            current[write++] = a;
+            current[write++] = b;
+            current[write++] = c;
+        }
+        current.resize(write);
+    }
+
+    outIndices.resize(current.size());
+    for (size_t i = 0; i < current.size(); i++)
+    {
+        outIndices[i] = unique[current[i]];
+    }
+
+    return reachedError;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// edge collapse simplification with quadric error metrics (Garland & Heckbert).
+// vertices are only ever collapsed onto other existing vertices, so the result is a new index list over the
+// same vertex buffer and LODs can live next to the full mesh as extra index ranges.
+// uv/normal seams (several vertices at one position) and open borders are locked so they don't tear
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+// simplifies one triangle list towards targetIndexCount, stopping early once a collapse's quadric error (the weighted
+// RMS distance to the planes of the faces merged into it) would pass maxError. errors are relative to boundsDiagonal,
+// the whole mesh's when the list is one submesh of it, or the list's own bounds if 0. returns the error reached, same units
+float SimplifyMesh(const std::vector<MeshVertex>& vertices, const unsigned int* indices, size_t indexCount,
+    size_t targetIndexCount, float maxError, float boundsDiagonal, std::vector<unsigned int>& outIndices);
@@ -0,0 +1,259 @@
+#include "ObjBenchmark.h"
+
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// each object is a band of rows of about this many triangles, every kRelativeEvery'th uses negative indices
+static const int kTrianglesPerObject = 64 * 1024;
+static const int kRelativeEvery = 4;
+// both parsers read the same decimal text, they may still round the last bit differently
+static const float kMaxAttributeDifference = 1e-6f;
+
+static const char* kMaterialNames[2] = { "stone", "grass" };
+
+struct ObjData
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+};
+
+// the mtl goes next to the obj. a cols x rows grid of quads over a rolling height field, one position/texcoord/normal per grid vertex
+static bool WriteObj(const std::string& objPath, const std::string& mtlName, int cols, int rows)
+{
+	FILE* mtl = fopen(mtlName.c_str(), "w");
+	if (mtl == nullptr)
+		return false;
+	for (int i = 0; i < 2; i++)
+		fprintf(mtl, "newmtl %s\nKd %.1f %.1f %.1f\n\n", kMaterialNames[i], 0.5f, 0.5f + 0.3f * i, 0.5f);
+	fclose(mtl);
+
+	FILE* file = fopen(objPath.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	std::vector<char> buffer(1024 * 1024);
+	setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+	fprintf(file, "# generated by -objbench\nmtllib %s\n", mtlName.c_str());
+
+	int vertsPerRow = cols + 1;
+	int numVertices = vertsPerRow * (rows + 1);
+	for (int z = 0; z <= rows; z++)
+		for (int x = 0; x <= cols; x++)
+			fprintf(file, "v %.4f %.4f %.4f\n", x * 0.1f, 0.5f * sinf(x * 0.05f) * cosf(z * 0.07f), z * 0.1f);
+	for (int z = 0; z <= rows; z++)
+		for (int x = 0; x <= cols; x++)
+			fprintf(file, "vt %.5f %.5f\n", (float)x / cols, (float)z / rows);
+	for (int z = 0; z <= rows; z++)
+	{
+		for (int x = 0; x <= cols; x++)
+		{
+			float dx = -0.025f * cosf(x * 0.05f) * cosf(z * 0.07f);
+			float dz = 0.035f * sinf(x * 0.05f) * sinf(z * 0.07f);
+			float length = sqrtf(dx * dx + 1.0f + dz * dz);
+			fprintf(file, "vn %.4f %.4f %.4f\n", dx / length, 1.0f / length, dz / length);
+		}
+	}
+
+	int rowsPerObject = std::max(1, kTrianglesPerObject / (2 * cols));
+	for (int z = 0; z < rows; z++)
+	{
+		int object = z / rowsPerObject;
+		if (z % rowsPerObject == 0)
+			fprintf(file, "o part%d\nusemtl %s\n", object, kMaterialNames[object % 2]);
+
+		bool relative = object % kRelativeEvery == kRelativeEvery - 1;
+		for (int x = 0; x < cols; x++)
+		{
+			int corners[4] = { z * vertsPerRow + x, (z + 1) * vertsPerRow + x, (z + 1) * vertsPerRow + x + 1, z * vertsPerRow + x + 1 };
+			fputc('f', file);
+			for (int corner : corners)
+			{
+				int index = relative ? corner - numVertices : corner + 1;
+				fprintf(file, " %d/%d/%d", index, index, index);
+			}
+			fputc('\n', file);
+		}
+	}
+
+	bool ok = ferror(file) == 0;
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+static bool IsSameIndex(const tinyobj::index_t& a, const tinyobj::index_t& b)
+{
+	return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+}
+
+static bool CompareFloats(const char* name, const std::vector<float>& a, const std::vector<float>& b, float& maxDifference, std::string& mismatch)
+{
+	if (a.size() != b.size())
+	{
+		mismatch = std::string(name) + " count differs";
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++)
+		maxDifference = std::max(maxDifference, fabsf(a[i] - b[i]));
+	if (maxDifference > kMaxAttributeDifference)
+	{
+		mismatch = std::string(name) + " values differ";
+		return false;
+	}
+	return true;
+}
+
+// ParseObj against tinyobj's output
+static bool CompareObjData(const ObjData& expected, const ObjData& actual, float& maxDifference, std::string& mismatch)
+{
+	maxDifference = 0.0f;
+	if (!CompareFloats("positions", expected.attrib.vertices, actual.attrib.vertices, maxDifference, mismatch) ||
+		!CompareFloats("normals", expected.attrib.normals, actual.attrib.normals, maxDifference, mismatch) ||
+		!CompareFloats("texcoords", expected.attrib.texcoords, actual.attrib.texcoords, maxDifference, mismatch))
+		return false;
+
+	if (expected.shapes.size() != actual.shapes.size())
+	{
+		mismatch = "shape count differs";
+		return false;
+	}
+	for (size_t s = 0; s < expected.shapes.size(); s++)
+	{
+		const tinyobj::shape_t& a = expected.shapes[s];
+		const tinyobj::shape_t& b = actual.shapes[s];
+		if (a.name != b.name)
+			mismatch = "shape " + std::to_string(s) + " name differs";
+		else if (a.mesh.indices.size() != b.mesh.indices.size() || !std::equal(a.mesh.indices.begin(), a.mesh.indices.end(), b.mesh.indices.begin(), IsSameIndex))
+			mismatch = "shape " + std::to_string(s) + " indices differ";
+		else if (a.mesh.num_face_vertices != b.mesh.num_face_vertices)
+			mismatch = "shape " + std::to_string(s) + " face sizes differ";
+		else if (a.mesh.material_ids != b.mesh.material_ids)
+			mismatch = "shape " + std::to_string(s) + " material ids differ";
+		if (!mismatch.empty())
+			return false;
+	}
+
+	if (expected.materials.size() != actual.materials.size())
+	{
+		mismatch = "material count differs";
+		return false;
+	}
+	for (size_t m = 0; m < expected.materials.size(); m++)
+	{
+		if (expected.materials[m].name != actual.materials[m].name)
+		{
+			mismatch = "material " + std::to_string(m) + " name differs";
+			return false;
+		}
+	}
+	return true;
+}
+
+// best of runs, the last run's output is kept
+template <typename Parse>
+static double TimeParse(int runs, ObjData& data, Parse parse)
+{
+	double bestMs = 0.0;
+	for (int run = 0; run < runs; run++)
+	{
+		data = ObjData();
+		auto startTime = std::chrono::steady_clock::now();
+		bool ok = parse(data);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		if (!ok)
+			return -1.0;
+		if (run == 0 || ms < bestMs)
+			bestMs = ms;
+	}
+	return bestMs;
+}
+
+static void PrintTiming(const char* name, double ms, double megabytes, double baselineMs)
+{
+	printf("%-24s %10.1f   %8.1f   %6.2fx\n", name, ms, megabytes * 1000.0 / ms, baselineMs / ms);
+}
+
+bool RunObjBenchmark(int triangleCount, int runs)
+{
+	int quads = std::max(1, triangleCount / 2);
+	int cols = std::max(1, (int)sqrtf((float)quads));
+	int rows = std::max(1, quads / cols);
+
+	std::string name = "objbench_" + std::to_string(triangleCount);
+	std::string objPath = name + ".obj";
+	std::string mtlName = name + ".mtl";
+
+	auto writeStart = std::chrono::steady_clock::now();
+	if (!WriteObj(objPath, mtlName, cols, rows))
+	{
+		printf("couldn't write %s\n", objPath.c_str());
+		remove(objPath.c_str());
+		remove(mtlName.c_str());
+		return false;
+	}
+	double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart).count();
+
+	// past 2 GB for long on windows
+	double megabytes = (double)std::ifstream(objPath, std::ios::binary | std::ios::ate).tellg() / (1024.0 * 1024.0);
+
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	printf("\n%d triangles, %.1f MB obj written in %.0f ms, best of %d runs\n", 2 * cols * rows, megabytes, writeMs, runs);
+	printf("parser                      time (ms)       MB/s   speedup\n");
+
+	// tinyobj's output is the reference, the others are compared against it
+	std::string err;
+	ObjData expected;
+	double tinyobjMs = TimeParse(runs, expected, [&](ObjData& data) {
+		return tinyobj::LoadObj(&data.attrib, &data.shapes, &data.materials, &err, objPath.c_str(), "");
+	});
+
+	bool ok = tinyobjMs >= 0.0;
+	if (ok)
+	{
+		PrintTiming("tinyobj::LoadObj", tinyobjMs, megabytes, tinyobjMs);
+
+		std::vector<unsigned int> threadCounts = { 1 };
+		if (maxThreads > 1)
+			threadCounts.push_back(maxThreads);
+		for (unsigned int numThreads : threadCounts)
+		{
+			ObjData actual;
+			double ms = TimeParse(runs, actual, [&](ObjData& data) {
+				return ParseObj(objPath.c_str(), &data.attrib, &data.shapes, &data.materials, &err, (int)numThreads);
+			});
+			if (ms < 0.0)
+			{
+				ok = false;
+				break;
+			}
+
+			char label[64];
+			snprintf(label, sizeof(label), "ParseObj, %u thread%s", numThreads, numThreads > 1 ? "s" : "");
+			PrintTiming(label, ms, megabytes, tinyobjMs);
+
+			float maxDifference;
+			std::string mismatch;
+			if (!CompareObjData(expected, actual, maxDifference, mismatch))
+			{
+				printf("  output differs from tinyobj: %s (max attribute difference %g)\n", mismatch.c_str(), maxDifference);
+				ok = false;
+			}
+		}
+	}
+
+	if (tinyobjMs < 0.0 || !err.empty())
+		printf("%s", err.c_str());
+	printf("outputs match: %s\n", ok ? "yes" : "NO");
+
+	remove(objPath.c_str());
+	remove(mtlName.c_str());
+	return ok;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// writes a generated obj of about triangleCount triangles (quads in several objects, two materials, some faces
+// with relative indices) and an mtl to the working directory, times tinyobj::LoadObj and ParseObj on one and on
+// every hardware thread reading it, checks ParseObj's attrib/shapes/materials match tinyobj's and deletes the
+// files. returns false on a mismatch or if the files can't be written. no GL needed
+bool RunObjBenchmark(int triangleCount, int runs = 3);
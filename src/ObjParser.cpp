@@ -0,0 +1,620 @@
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OBJ_PARSER_SSE2
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// don't bother spinning up threads for less than this much text per chunk
+static const size_t kMinChunkSize = 1024 * 1024;
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    bool Open(const char* path);
+
+    const char* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+
+};
+
+#ifdef _WIN32
+bool MappedFile::Open(const char* path)
+{
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size))
+        return false;
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0)
+        return true;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return false;
+
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    return m_data != nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+}
+#else
+bool MappedFile::Open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(data);
+    return true;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+#endif
+
+// --------------------------------------------------------
+// scanning helpers
+// --------------------------------------------------------
+
+static const char* FindLineEnd(const char* p, const char* end)
+{
+#ifdef OBJ_PARSER_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16)
+    {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, newline));
+        if (mask != 0)
+        {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, static_cast<unsigned long>(mask));
+            return p + bit;
+#else
+            return p + __builtin_ctz(static_cast<unsigned int>(mask));
+#endif
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n')
+        p++;
+    return p;
+}
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline const char* SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && IsSpace(*p))
+        p++;
+    return p;
+}
+
+static inline bool IsDigit(char c)
+{
+    return static_cast<unsigned>(c - '0') < 10;
+}
+
+// strtod is locale aware and slow, obj files only ever contain plain decimal floats
+static const char* ParseFloat(const char* p, const char* end, float& out)
+{
+    static const double s_powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = SkipSpaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    while (p < end && IsDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+        p++;
+    }
+
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && IsDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        int e = 0;
+        while (p < end && IsDigit(*p))
+        {
+            if (e < 10000)
+                e = e * 10 + (*p - '0');
+            p++;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0)
+        value = -exponent <= 22 ? value / s_powersOf10[-exponent] : value * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        value = exponent <= 22 ? value * s_powersOf10[exponent] : value * std::pow(10.0, exponent);
+
+    out = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+static const char* ParseInt(const char* p, const char* end, int& out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    int value = 0;
+    while (p < end && IsDigit(*p))
+    {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+
+    out = negative ? -value : value;
+    return p;
+}
+
+static std::string ParseName(const char* p, const char* end)
+{
+    p = SkipSpaces(p, end);
+    const char* nameEnd = p;
+    while (nameEnd < end && !IsSpace(*nameEnd) && *nameEnd != '\r')
+        nameEnd++;
+    return std::string(p, nameEnd);
+}
+
+// --------------------------------------------------------
+// chunk parsing
+// --------------------------------------------------------
+
+struct ObjEvent
+{
+    enum Type { kGroup, kObject, kUseMtl, kMtlLib };
+
+    Type type;
+    size_t triangleOffset; // triangles in the chunk before this line
+    std::string name;      // rest of the line for mtllib
+};
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<tinyobj::index_t> indices; // 3 per triangle
+
+    // negative (relative) indices are resolved against the chunk's local counts and need
+    // the chunk's base added once the counts of the previous chunks are known. (corner * 3 + attribute)
+    std::vector<size_t> relativeFixups;
+
+    std::vector<ObjEvent> events;
+};
+
+// obj indices are 1 based, negative ones count back from the last element
+static inline int FixIndex(int idx, int localCount, size_t slot, std::vector<size_t>& fixups)
+{
+    if (idx > 0)
+        return idx - 1;
+    if (idx == 0)
+        return 0;
+
+    fixups.push_back(slot);
+    return localCount + idx;
+}
+
+static void ParseChunk(ObjChunk& chunk)
+{
+    std::vector<tinyobj::index_t> face;
+    face.reserve(8);
+
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char* lineEnd = FindLineEnd(p, chunk.end);
+        const char* line = SkipSpaces(p, lineEnd);
+        p = lineEnd + 1;
+
+        if (line >= lineEnd)
+            continue;
+
+        size_t lineLength = lineEnd - line;
+        char c0 = line[0];
+        char c1 = lineLength > 1 ? line[1] : '\0';
+
+        if (c0 == 'v' && IsSpace(c1))
+        {
+            float x, y, z;
+            const char* token = ParseFloat(line + 2, lineEnd, x);
+            token = ParseFloat(token, lineEnd, y);
+            ParseFloat(token, lineEnd, z);
+            chunk.vertices.push_back(x);
+            chunk.vertices.push_back(y);
+            chunk.vertices.push_back(z);
+        }
+        else if (c0 == 'v' && c1 == 'n' && lineLength > 2 && IsSpace(line[2]))
+        {
+            float x, y, z;
+            const char* token = ParseFloat(line + 3, lineEnd, x);
+            token = ParseFloat(token, lineEnd, y);
+            ParseFloat(token, lineEnd, z);
+            chunk.normals.push_back(x);
+            chunk.normals.push_back(y);
+            chunk.normals.push_back(z);
+        }
+        else if (c0 == 'v' && c1 == 't' && lineLength > 2 && IsSpace(line[2]))
+        {
+            float u, v = 0.0f;
+            const char* token = ParseFloat(line + 3, lineEnd, u);
+            token = SkipSpaces(token, lineEnd);
+            if (token < lineEnd && *token != '\r')
+                ParseFloat(token, lineEnd, v);
+            chunk.texcoords.push_back(u);
+            chunk.texcoords.push_back(v);
+        }
+        else if (c0 == 'f' && IsSpace(c1))
+        {
+            int numVertices = static_cast<int>(chunk.vertices.size() / 3);
+            int numNormals = static_cast<int>(chunk.normals.size() / 3);
+            int numTexcoords = static_cast<int>(chunk.texcoords.size() / 2);
+
+            // collect the raw values first, corners are fixed up against their final slot once triangulated
+            face.clear();
+            const char* token = SkipSpaces(line + 2, lineEnd);
+            while (token < lineEnd && *token != '\r')
+            {
+                tinyobj::index_t idx;
+                idx.vertex_index = 0;
+                idx.texcoord_index = 0;
+                idx.normal_index = 0;
+
+                token = ParseInt(token, lineEnd, idx.vertex_index);
+                if (token < lineEnd && *token == '/')
+                {
+                    token++;
+                    if (token < lineEnd && *token != '/')
+                        token = ParseInt(token, lineEnd, idx.texcoord_index);
+                    if (token < lineEnd && *token == '/')
+                        token = ParseInt(token + 1, lineEnd, idx.normal_index);
+                }
+                face.push_back(idx);
+
+                while (token < lineEnd && !IsSpace(*token) && *token != '\r')
+                    token++; // skip anything we didn't understand
+                token = SkipSpaces(token, lineEnd);
+            }
+
+            if (face.size() < 3)
+                continue;
+
+            // fan triangulation, same as tinyobj
+            for (size_t k = 2; k < face.size(); k++)
+            {
+                const tinyobj::index_t* corners[3] = { &face[0], &face[k - 1], &face[k] };
+                for (int i = 0; i < 3; i++)
+                {
+                    size_t slot = chunk.indices.size();
+                    tinyobj::index_t idx;
+                    idx.vertex_index = FixIndex(corners[i]->vertex_index, numVertices, slot * 3 + 0, chunk.relativeFixups);
+                    idx.normal_index = corners[i]->normal_index != 0 ? FixIndex(corners[i]->normal_index, numNormals, slot * 3 + 1, chunk.relativeFixups) : -1;
+                    idx.texcoord_index = corners[i]->texcoord_index != 0 ? FixIndex(corners[i]->texcoord_index, numTexcoords, slot * 3 + 2, chunk.relativeFixups) : -1;
+                    chunk.indices.push_back(idx);
+                }
+            }
+        }
+        else if ((c0 == 'g' || c0 == 'o') && (IsSpace(c1) || lineLength == 1))
+        {
+            ObjEvent ev;
+            ev.type = c0 == 'g' ? ObjEvent::kGroup : ObjEvent::kObject;
+            ev.triangleOffset = chunk.indices.size() / 3;
+            ev.name = ParseName(line + 1, lineEnd);
+            chunk.events.push_back(std::move(ev));
+        }
+        else if (lineLength > 6 && strncmp(line, "usemtl", 6) == 0 && IsSpace(line[6]))
+        {
+            ObjEvent ev;
+            ev.type = ObjEvent::kUseMtl;
+            ev.triangleOffset = chunk.indices.size() / 3;
+            ev.name = ParseName(line + 6, lineEnd);
+            chunk.events.push_back(std::move(ev));
+        }
+        else if (lineLength > 6 && strncmp(line, "mtllib", 6) == 0 && IsSpace(line[6]))
+        {
+            ObjEvent ev;
+            ev.type = ObjEvent::kMtlLib;
+            ev.triangleOffset = chunk.indices.size() / 3;
+            const char* nameEnd = lineEnd;
+            while (nameEnd > line && (nameEnd[-1] == '\r' || IsSpace(nameEnd[-1])))
+                nameEnd--;
+            const char* name = SkipSpaces(line + 6, nameEnd);
+            ev.name = std::string(name, nameEnd);
+            chunk.events.push_back(std::move(ev));
+        }
+        // comments and anything else are ignored
+    }
+}
+
+// --------------------------------------------------------
+// merging
+// --------------------------------------------------------
+
+static void AppendTriangles(tinyobj::shape_t& shape, const ObjChunk& chunk, size_t first, size_t last, int materialId)
+{
+    if (first >= last)
+        return;
+
+    shape.mesh.indices.insert(shape.mesh.indices.end(), chunk.indices.begin() + first * 3, chunk.indices.begin() + last * 3);
+    shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), last - first, static_cast<unsigned char>(3));
+    shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), last - first, materialId);
+}
+
+static void LoadMaterialLibraries(const std::string& names, const std::string& baseDir, std::vector<tinyobj::material_t>* materials,
+    std::map<std::string, int>& materialMap, std::string* err)
+{
+    if (!materials)
+        return;
+
+    tinyobj::MaterialFileReader reader(baseDir);
+
+    // like tinyobj, use the first library in the list that loads
+    size_t start = 0;
+    while (start < names.size())
+    {
+        size_t end = names.find(' ', start);
+        if (end == std::string::npos)
+            end = names.size();
+
+        std::string name = names.substr(start, end - start);
+        if (!name.empty())
+        {
+            std::string mtlErr;
+            bool ok = reader(name, materials, &materialMap, &mtlErr);
+            if (err)
+                *err += mtlErr;
+            if (ok)
+                return;
+        }
+        start = end + 1;
+    }
+
+    if (err)
+        *err += "WARN: Failed to load material file(s). Use default material.\n";
+}
+
+bool ParseObj(const char* filepath, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+    std::vector<tinyobj::material_t>* materials, std::string* err, int numThreads)
+{
+    MappedFile file;
+    if (!file.Open(filepath))
+    {
+        if (err)
+            *err += "Cannot open file [" + std::string(filepath) + "]\n";
+        return false;
+    }
+
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    shapes->clear();
+
+    const char* data = file.GetData();
+    size_t size = file.GetSize();
+
+    if (numThreads <= 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t numChunks = std::max<size_t>(1, std::min<size_t>(numThreads, size / kMinChunkSize));
+
+    // split at line boundaries
+    std::vector<ObjChunk> chunks(numChunks);
+    const char* chunkBegin = data;
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        const char* chunkEnd = data + size;
+        if (i + 1 < numChunks)
+        {
+            chunkEnd = std::max(chunkBegin, data + size * (i + 1) / numChunks);
+            chunkEnd = FindLineEnd(chunkEnd, data + size);
+            if (chunkEnd < data + size)
+                chunkEnd++; // include the newline
+        }
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numChunks; i++)
+        threads.emplace_back(ParseChunk, std::ref(chunks[i]));
+    if (numChunks > 0)
+        ParseChunk(chunks[0]);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // work out where each chunk's attributes land, then resolve the relative indices
+    size_t numVertices = 0, numNormals = 0, numTexcoords = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        int bases[3] = { static_cast<int>(numVertices / 3), static_cast<int>(numNormals / 3), static_cast<int>(numTexcoords / 2) };
+        for (size_t fixup : chunk.relativeFixups)
+        {
+            tinyobj::index_t& idx = chunk.indices[fixup / 3];
+            switch (fixup % 3)
+            {
+            case 0: idx.vertex_index += bases[0]; break;
+            case 1: idx.normal_index += bases[1]; break;
+            case 2: idx.texcoord_index += bases[2]; break;
+            }
+        }
+
+        numVertices += chunk.vertices.size();
+        numNormals += chunk.normals.size();
+        numTexcoords += chunk.texcoords.size();
+    }
+
+    attrib->vertices.reserve(numVertices);
+    attrib->normals.reserve(numNormals);
+    attrib->texcoords.reserve(numTexcoords);
+    for (ObjChunk& chunk : chunks)
+    {
+        attrib->vertices.insert(attrib->vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        attrib->normals.insert(attrib->normals.end(), chunk.normals.begin(), chunk.normals.end());
+        attrib->texcoords.insert(attrib->texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+        std::vector<float>().swap(chunk.vertices);
+        std::vector<float>().swap(chunk.normals);
+        std::vector<float>().swap(chunk.texcoords);
+    }
+
+    // replay groups/objects/materials in file order to build the shapes
+    std::string baseDir(filepath);
+    size_t slash = baseDir.find_last_of("/\\");
+    baseDir = slash != std::string::npos ? baseDir.substr(0, slash + 1) : std::string();
+
+    std::map<std::string, int> materialMap;
+    int materialId = -1;
+    tinyobj::shape_t shape;
+
+    for (const ObjChunk& chunk : chunks)
+    {
+        size_t cursor = 0;
+        for (const ObjEvent& ev : chunk.events)
+        {
+            AppendTriangles(shape, chunk, cursor, ev.triangleOffset, materialId);
+            cursor = ev.triangleOffset;
+
+            switch (ev.type)
+            {
+            case ObjEvent::kGroup:
+            case ObjEvent::kObject:
+                if (!shape.mesh.indices.empty())
+                    shapes->push_back(std::move(shape));
+                shape = tinyobj::shape_t();
+                shape.name = ev.name;
+                break;
+            case ObjEvent::kUseMtl:
+            {
+                auto it = materialMap.find(ev.name);
+                materialId = it != materialMap.end() ? it->second : -1;
+                break;
+            }
+            case ObjEvent::kMtlLib:
+                LoadMaterialLibraries(ev.name, baseDir, materials, materialMap, err);
+                break;
+            }
+        }
+        AppendTriangles(shape, chunk, cursor, chunk.indices.size() / 3, materialId);
+    }
+
+    if (!shape.mesh.indices.empty())
+        shapes->push_back(std::move(shape));
+
+    return true;
+}
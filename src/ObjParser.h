@@ -0,0 +1,14 @@
+#pragma once
+
+// drop-in replacement for tinyobj::LoadObj for big files.
+// the file is memory mapped, split into chunks at line boundaries and each chunk is parsed on its own thread,
+// then the chunks are stitched back together into the same attrib/shape layout tinyobj produces (always triangulated).
+// materials are read with tinyobj's mtl parser, relative to the obj's directory
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+bool ParseObj(const char* filepath, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+    std::vector<tinyobj::material_t>* materials, std::string* err, int numThreads = 0);
@@ -0,0 +1,161 @@
+#include "OcclusionBenchmark.h"
+
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+struct OcclusionBenchmarkBox
+{
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+struct OcclusionBenchmarkResult
+{
+	double rasterMs; // setup + binning + tiles
+	double testMs;
+	unsigned int frustumVisible;
+	unsigned int visible;
+	unsigned int triangles;
+};
+
+static OcclusionBenchmarkResult RunPass(OcclusionCuller& culler, const glm::mat4& viewProjection, const std::vector<OcclusionBenchmarkBox>& buildings,
+	const std::vector<OcclusionBenchmarkBox>& props, int frames)
+{
+	OcclusionBenchmarkResult result = { 0.0, 0.0, 0, 0, 0 };
+	Frustum frustum(viewProjection);
+	const glm::mat4 identity(1.0f);
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		culler.BeginFrame(viewProjection);
+		for (const OcclusionBenchmarkBox& building : buildings)
+		{
+			if (frustum.IntersectsAabb(building.boundsMin, building.boundsMax))
+				culler.AddOccluderBox(building.boundsMin, building.boundsMax, identity);
+		}
+		culler.Rasterize();
+
+		auto rasterEnd = std::chrono::steady_clock::now();
+
+		unsigned int frustumVisible = 0;
+		unsigned int visible = 0;
+		for (const OcclusionBenchmarkBox& prop : props)
+		{
+			if (!frustum.IntersectsAabb(prop.boundsMin, prop.boundsMax))
+				continue;
+
+			frustumVisible++;
+			if (culler.IsVisible(prop.boundsMin, prop.boundsMax, identity))
+				visible++;
+		}
+
+		auto endTime = std::chrono::steady_clock::now();
+
+		result.rasterMs += std::chrono::duration<double, std::milli>(rasterEnd - startTime).count();
+		result.testMs += std::chrono::duration<double, std::milli>(endTime - rasterEnd).count();
+		result.frustumVisible = frustumVisible;
+		result.visible = visible;
+		result.triangles = culler.GetStats().triangles;
+	}
+
+	result.rasterMs /= frames;
+	result.testMs /= frames;
+	return result;
+}
+
+void RunOcclusionBenchmark(int objectCount, int frames)
+{
+	auto random = [](float range) { return rand() / (float)RAND_MAX * range; };
+	srand(1234);
+
+	// 40x40 blocks of 30 units with 10 unit streets, buildings 10 to 70 high
+	const int blocks = 40;
+	const float blockSize = 30.0f;
+	const float streetWidth = 10.0f;
+	const float pitch = blockSize + streetWidth;
+	const float citySize = blocks * pitch;
+
+	std::vector<OcclusionBenchmarkBox> buildings;
+	for (int z = 0; z < blocks; z++)
+	{
+		for (int x = 0; x < blocks; x++)
+		{
+			glm::vec3 corner(x * pitch, 0.0f, z * pitch);
+			buildings.push_back({ corner, corner + glm::vec3(blockSize, 10.0f + random(60.0f), blockSize) });
+		}
+	}
+
+	// props anywhere, they end up in the streets, in front of walls and behind them
+	std::vector<OcclusionBenchmarkBox> props(objectCount);
+	for (OcclusionBenchmarkBox& prop : props)
+	{
+		glm::vec3 position(random(citySize), random(2.0f), random(citySize));
+		prop.boundsMin = position;
+		prop.boundsMax = position + glm::vec3(1.0f + random(2.0f));
+	}
+
+	// standing in a street near one corner, looking diagonally across the city
+	glm::vec3 eye(blockSize + streetWidth * 0.5f, 2.0f, blockSize + streetWidth * 0.5f);
+	glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.05f, 0.8f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.5f, citySize * 1.5f);
+	glm::mat4 viewProjection = projection * view;
+
+	OcclusionCuller culler;
+	culler.Init();
+
+	printf("\n%d buildings, %d props, %dx%d depth buffer, %d frames\n", (int)buildings.size(), objectCount, culler.GetWidth(), culler.GetHeight(), frames);
+	printf("kernel             raster (ms)   test (ms)   triangles   in frustum   visible   max diff\n");
+
+	std::vector<float> scalarDepth;
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		culler.SetSimdLevel(level);
+		OcclusionBenchmarkResult result = RunPass(culler, viewProjection, buildings, props, frames);
+
+		// every kernel should produce the same depth buffer
+		const float* depth = culler.GetDepth();
+		size_t numPixels = (size_t)culler.GetWidth() * culler.GetHeight();
+		if (level == SimdLevel::Scalar)
+			scalarDepth.assign(depth, depth + numPixels);
+
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < numPixels; i++)
+		{
+			maxDifference = std::max(maxDifference, std::abs(depth[i] - scalarDepth[i]));
+		}
+
+		printf("%-16s   %11.3f   %9.3f   %9u   %10u   %7u   %8g\n", GetSimdLevelName(level), result.rasterMs, result.testMs,
+			result.triangles, result.frustumVisible, result.visible, maxDifference);
+	}
+
+	unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+	JobSystem jobSystem;
+	jobSystem.Init(numThreads);
+	culler.SetJobSystem(&jobSystem);
+	culler.SetSimdLevel(GetBestSimdLevel());
+
+	OcclusionBenchmarkResult threaded = RunPass(culler, viewProjection, buildings, props, frames);
+	char label[32];
+	snprintf(label, sizeof(label), "%s, %u threads", GetSimdLevelName(GetBestSimdLevel()), numThreads);
+	printf("%-16s   %11.3f   %9.3f   %9u   %10u   %7u\n", label, threaded.rasterMs, threaded.testMs,
+		threaded.triangles, threaded.frustumVisible, threaded.visible);
+
+	jobSystem.Dispose();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// a street level view into a city block grid: every building is a box occluder and objectCount small props
+// are scattered over the streets and roofs. rasterizes the occluders with each SIMD level on one thread, then
+// with the job system on every hardware thread, checks the SIMD depth buffers against the scalar one and
+// prints raster time, test time and how many props were culled. no GL needed
+void RunOcclusionBenchmark(int objectCount, int frames = 100);
@@ -0,0 +1,483 @@
+#include "OcclusionCuller.h"
+
+#include "JobSystem.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// unit cube for AddOccluderBox, counter clockwise from outside
+static const glm::vec3 kBoxVertices[8] = {
+	glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0),
+	glm::vec3(0, 0, 1), glm::vec3(1, 0, 1), glm::vec3(0, 1, 1), glm::vec3(1, 1, 1)
+};
+static const unsigned int kBoxIndices[36] = {
+	0, 2, 3, 0, 3, 1, // -z
+	4, 5, 7, 4, 7, 6, // +z
+	0, 4, 6, 0, 6, 2, // -x
+	1, 3, 7, 1, 7, 5, // +x
+	0, 1, 5, 0, 5, 4, // -y
+	2, 6, 7, 2, 7, 3  // +y
+};
+
+// rasterizes the part of the triangle inside [x0, x1] x [y0, y1] (inclusive), keeping the nearest depth.
+// e is ScreenTriangle::coefficients. the SIMD versions expect x0 to be aligned to their width and the row to have room up to the aligned x1
+
+static void RasterizeScalar(const float* e, float* depth, int width, int x0, int y0, int x1, int y1)
+{
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		float row0 = e[3] * py + e[6];
+		float row1 = e[4] * py + e[7];
+		float row2 = e[5] * py + e[8];
+		float rowDepth = e[10] * py + e[11];
+		float* out = depth + y * width;
+
+		for (int x = x0; x <= x1; x++)
+		{
+			float px = x + 0.5f;
+			if (e[0] * px + row0 >= 0.0f && e[1] * px + row1 >= 0.0f && e[2] * px + row2 >= 0.0f)
+			{
+				float z = e[9] * px + rowDepth;
+				out[x] = std::max(out[x], z);
+			}
+		}
+	}
+}
+
+#if defined(CPU_X86)
+
+static void RasterizeSse(const float* e, float* depth, int width, int x0, int y0, int x1, int y1)
+{
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 a0 = _mm_set1_ps(e[0]);
+	const __m128 a1 = _mm_set1_ps(e[1]);
+	const __m128 a2 = _mm_set1_ps(e[2]);
+	const __m128 depthA = _mm_set1_ps(e[9]);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		__m128 row0 = _mm_set1_ps(e[3] * py + e[6]);
+		__m128 row1 = _mm_set1_ps(e[4] * py + e[7]);
+		__m128 row2 = _mm_set1_ps(e[5] * py + e[8]);
+		__m128 rowDepth = _mm_set1_ps(e[10] * py + e[11]);
+		float* out = depth + y * width;
+
+		for (int x = x0; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+			__m128 previous = _mm_loadu_ps(out + x);
+			__m128 nearest = _mm_max_ps(previous, z);
+			_mm_storeu_ps(out + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+		}
+	}
+}
+
+// plain multiply and add rather than FMA, so it rounds like the other kernels
+CPU_TARGET_AVX2 static void RasterizeAvx2(const float* e, float* depth, int width, int x0, int y0, int x1, int y1)
+{
+	const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 a0 = _mm256_set1_ps(e[0]);
+	const __m256 a1 = _mm256_set1_ps(e[1]);
+	const __m256 a2 = _mm256_set1_ps(e[2]);
+	const __m256 depthA = _mm256_set1_ps(e[9]);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float py = y + 0.5f;
+		__m256 row0 = _mm256_set1_ps(e[3] * py + e[6]);
+		__m256 row1 = _mm256_set1_ps(e[4] * py + e[7]);
+		__m256 row2 = _mm256_set1_ps(e[5] * py + e[8]);
+		__m256 rowDepth = _mm256_set1_ps(e[10] * py + e[11]);
+		float* out = depth + y * width;
+
+		for (int x = x0; x <= x1; x += 8)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+			__m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, px), row0), zero, _CMP_GE_OQ);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, px), row1), zero, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, px), row2), zero, _CMP_GE_OQ));
+			if (_mm256_movemask_ps(inside) == 0)
+				continue;
+
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(depthA, px), rowDepth);
+			__m256 previous = _mm256_loadu_ps(out + x);
+			_mm256_storeu_ps(out + x, _mm256_blendv_ps(previous, _mm256_max_ps(previous, z), inside));
+		}
+	}
+}
+
+#endif
+
+static void RasterizeTriangle(SimdLevel level, const float* e, float* depth, int width, int x0, int y0, int x1, int y1)
+{
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2: RasterizeAvx2(e, depth, width, x0 & ~7, y0, x1, y1); break;
+	case SimdLevel::Sse: RasterizeSse(e, depth, width, x0 & ~3, y0, x1, y1); break;
+#endif
+	default: RasterizeScalar(e, depth, width, x0, y0, x1, y1); break;
+	}
+}
+
+void OcclusionCuller::Init(int width, int height)
+{
+	assert(width % kTileSize == 0 && height % kTileSize == 0);
+
+	m_width = width;
+	m_height = height;
+	m_tilesX = width / kTileSize;
+	m_tilesY = height / kTileSize;
+	m_blocksX = width / kBlockSize;
+	m_blocksY = height / kBlockSize;
+
+	m_depth.assign((size_t)width * height, 0.0f);
+	m_blockDepth.assign((size_t)m_blocksX * m_blocksY, 0.0f);
+	m_bins.resize((size_t)m_tilesX * m_tilesY);
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+	m_viewProjection = viewProjection;
+	m_occluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(const void* positions, size_t stride, const unsigned int* indices, size_t triangleCount, const glm::mat4& world)
+{
+	Occluder occluder;
+	occluder.positions = static_cast<const uint8_t*>(positions);
+	occluder.stride = stride;
+	occluder.indices = indices;
+	occluder.triangleCount = triangleCount;
+	occluder.worldViewProjection = m_viewProjection * world;
+	occluder.firstTriangle = 0;
+	occluder.numTriangles = 0;
+	m_occluders.push_back(occluder);
+}
+
+void OcclusionCuller::AddOccluder(const Mesh& mesh, const glm::mat4& world)
+{
+	assert(!mesh.GetVertices().empty() && "occluder meshes need keepGeometry");
+
+	// the coarsest lod is the cheapest stand-in. its submeshes are consecutive in the index buffer
+	const MeshLod& lod = mesh.GetLod(mesh.GetNumLods() - 1);
+	if (lod.submeshes.empty())
+		return;
+
+	unsigned int firstIndex = lod.submeshes.front().indexOffset;
+	unsigned int lastIndex = lod.submeshes.back().indexOffset + lod.submeshes.back().indexCount;
+	AddOccluder(&mesh.GetVertices()[0].position, sizeof(MeshVertex), &mesh.GetIndices()[firstIndex], (lastIndex - firstIndex) / 3, world);
+}
+
+void OcclusionCuller::AddOccluderBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world)
+{
+	glm::mat4 box = world;
+	box[3] = world * glm::vec4(boundsMin, 1.0f);
+	box[0] *= boundsMax.x - boundsMin.x;
+	box[1] *= boundsMax.y - boundsMin.y;
+	box[2] *= boundsMax.z - boundsMin.z;
+	AddOccluder(kBoxVertices, sizeof(glm::vec3), kBoxIndices, 12, box);
+}
+
+void OcclusionCuller::Rasterize()
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	// every occluder gets its own output range, so they can be set up in any order
+	size_t triangleCapacity = 0;
+	for (Occluder& occluder : m_occluders)
+	{
+		occluder.firstTriangle = triangleCapacity;
+		triangleCapacity += occluder.triangleCount * 2;
+	}
+	if (m_triangles.size() < triangleCapacity)
+		m_triangles.resize(triangleCapacity);
+
+	auto setupRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			SetupOccluder(m_occluders[i]);
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_occluders.size(), 1, setupRange);
+	else
+		setupRange(0, m_occluders.size());
+
+	// binning is a couple of integer ops per triangle and tile, not worth splitting up
+	for (std::vector<uint32_t>& bin : m_bins)
+	{
+		bin.clear();
+	}
+
+	m_stats.occluders = (unsigned int)m_occluders.size();
+	m_stats.triangles = 0;
+	m_stats.binnedTriangles = 0;
+	for (const Occluder& occluder : m_occluders)
+	{
+		for (size_t i = occluder.firstTriangle; i < occluder.firstTriangle + occluder.numTriangles; i++)
+		{
+			const ScreenTriangle& triangle = m_triangles[i];
+			for (int tileY = triangle.minY / kTileSize; tileY <= triangle.maxY / kTileSize; tileY++)
+			{
+				for (int tileX = triangle.minX / kTileSize; tileX <= triangle.maxX / kTileSize; tileX++)
+				{
+					m_bins[tileY * m_tilesX + tileX].push_back((uint32_t)i);
+					m_stats.binnedTriangles++;
+				}
+			}
+		}
+		m_stats.triangles += (unsigned int)occluder.numTriangles;
+	}
+
+	auto setupEnd = std::chrono::steady_clock::now();
+
+	// tiles don't share pixels or blocks, one job each
+	auto rasterRange = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			RasterizeTile((int)i);
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_bins.size(), 1, rasterRange);
+	else
+		rasterRange(0, m_bins.size());
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.setupMs = std::chrono::duration<double, std::milli>(setupEnd - startTime).count();
+	m_stats.rasterMs = std::chrono::duration<double, std::milli>(endTime - setupEnd).count();
+}
+
+void OcclusionCuller::SetupOccluder(Occluder& occluder)
+{
+	occluder.numTriangles = 0;
+	ScreenTriangle* out = &m_triangles[occluder.firstTriangle];
+
+	for (size_t t = 0; t < occluder.triangleCount; t++)
+	{
+		glm::vec4 clip[3];
+		for (int v = 0; v < 3; v++)
+		{
+			const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(occluder.positions + occluder.indices[t * 3 + v] * occluder.stride);
+			clip[v] = occluder.worldViewProjection * glm::vec4(position, 1.0f);
+		}
+
+		// completely outside one side of the frustum
+		bool outside = false;
+		for (int axis = 0; axis < 3 && !outside; axis++)
+		{
+			outside = (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) ||
+				(clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w);
+		}
+		if (outside)
+			continue;
+
+		// clip against the near plane (z = -w), which leaves a triangle or a quad
+		float distance[3];
+		int numInside = 0;
+		for (int v = 0; v < 3; v++)
+		{
+			distance[v] = clip[v].z + clip[v].w;
+			numInside += distance[v] >= 0.0f ? 1 : 0;
+		}
+
+		if (numInside == 3)
+		{
+			if (SetupTriangle(clip, out[occluder.numTriangles]))
+				occluder.numTriangles++;
+			continue;
+		}
+
+		glm::vec4 polygon[4];
+		int numVertices = 0;
+		for (int v = 0; v < 3; v++)
+		{
+			int next = (v + 1) % 3;
+			if (distance[v] >= 0.0f)
+				polygon[numVertices++] = clip[v];
+			if ((distance[v] >= 0.0f) != (distance[next] >= 0.0f))
+			{
+				float t = distance[v] / (distance[v] - distance[next]);
+				polygon[numVertices++] = clip[v] + (clip[next] - clip[v]) * t;
+			}
+		}
+
+		for (int v = 1; v + 1 < numVertices; v++)
+		{
+			glm::vec4 fan[3] = { polygon[0], polygon[v], polygon[v + 1] };
+			if (SetupTriangle(fan, out[occluder.numTriangles]))
+				occluder.numTriangles++;
+		}
+	}
+}
+
+bool OcclusionCuller::SetupTriangle(const glm::vec4* clip, ScreenTriangle& out) const
+{
+	// pixel coordinates with y down, depth 1/w
+	glm::vec3 screen[3];
+	for (int v = 0; v < 3; v++)
+	{
+		float invW = 1.0f / std::max(clip[v].w, 1e-6f);
+		screen[v].x = (clip[v].x * invW * 0.5f + 0.5f) * m_width;
+		screen[v].y = (0.5f - clip[v].y * invW * 0.5f) * m_height;
+		screen[v].z = invW;
+	}
+
+	// flipping y turns counter clockwise front faces clockwise, so they have negative area here
+	float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+	if (area >= 0.0f)
+		return false;
+
+	// swap to positive area, then inside is every edge function >= 0
+	std::swap(screen[1], screen[2]);
+	area = -area;
+
+	float minX = std::min(std::min(screen[0].x, screen[1].x), screen[2].x);
+	float maxX = std::max(std::max(screen[0].x, screen[1].x), screen[2].x);
+	float minY = std::min(std::min(screen[0].y, screen[1].y), screen[2].y);
+	float maxY = std::max(std::max(screen[0].y, screen[1].y), screen[2].y);
+
+	// pixels whose centres could be covered
+	out.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+	out.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+	out.maxX = std::min(m_width - 1, (int)std::floor(maxX - 0.5f));
+	out.maxY = std::min(m_height - 1, (int)std::floor(maxY - 0.5f));
+	if (out.minX > out.maxX || out.minY > out.maxY)
+		return false;
+
+	float* e = out.coefficients;
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& a = screen[i];
+		const glm::vec3& b = screen[(i + 1) % 3];
+		e[i] = a.y - b.y;
+		e[3 + i] = b.x - a.x;
+		e[6 + i] = -(e[i] * a.x + e[3 + i] * a.y);
+	}
+
+	float dz1 = screen[1].z - screen[0].z;
+	float dz2 = screen[2].z - screen[0].z;
+	e[9] = (dz1 * (screen[2].y - screen[0].y) - dz2 * (screen[1].y - screen[0].y)) / area;
+	e[10] = (dz2 * (screen[1].x - screen[0].x) - dz1 * (screen[2].x - screen[0].x)) / area;
+	e[11] = screen[0].z - e[9] * screen[0].x - e[10] * screen[0].y;
+	return true;
+}
+
+void OcclusionCuller::RasterizeTile(int tile)
+{
+	int tileX = (tile % m_tilesX) * kTileSize;
+	int tileY = (tile / m_tilesX) * kTileSize;
+
+	for (int y = tileY; y < tileY + kTileSize; y++)
+	{
+		std::fill_n(&m_depth[y * m_width + tileX], kTileSize, 0.0f);
+	}
+
+	for (uint32_t index : m_bins[tile])
+	{
+		const ScreenTriangle& triangle = m_triangles[index];
+		int x0 = std::max(triangle.minX, tileX);
+		int y0 = std::max(triangle.minY, tileY);
+		int x1 = std::min(triangle.maxX, tileX + kTileSize - 1);
+		int y1 = std::min(triangle.maxY, tileY + kTileSize - 1);
+		RasterizeTriangle(m_simdLevel, triangle.coefficients, m_depth.data(), m_width, x0, y0, x1, y1);
+	}
+
+	// farthest depth of each block in the tile
+	for (int blockY = tileY / kBlockSize; blockY < (tileY + kTileSize) / kBlockSize; blockY++)
+	{
+		for (int blockX = tileX / kBlockSize; blockX < (tileX + kTileSize) / kBlockSize; blockX++)
+		{
+			float farthest = m_depth[blockY * kBlockSize * m_width + blockX * kBlockSize];
+			for (int y = 0; y < kBlockSize; y++)
+			{
+				const float* row = &m_depth[(blockY * kBlockSize + y) * m_width + blockX * kBlockSize];
+				for (int x = 0; x < kBlockSize; x++)
+				{
+					farthest = std::min(farthest, row[x]);
+				}
+			}
+			m_blockDepth[blockY * m_blocksX + blockX] = farthest;
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const
+{
+	glm::mat4 worldViewProjection = m_viewProjection * world;
+
+	glm::vec2 screenMin(FLT_MAX);
+	glm::vec2 screenMax(-FLT_MAX);
+	float nearest = 0.0f;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = worldViewProjection * glm::vec4(corner, 1.0f);
+
+		// crossing the near plane, the rectangle would be meaningless
+		if (clip.z < -clip.w || clip.w <= 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		glm::vec2 screen((clip.x * invW * 0.5f + 0.5f) * m_width, (0.5f - clip.y * invW * 0.5f) * m_height);
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+		nearest = std::max(nearest, invW);
+	}
+
+	// every pixel the rectangle touches, rounded outwards
+	int minX = std::max(0, (int)std::floor(screenMin.x));
+	int minY = std::max(0, (int)std::floor(screenMin.y));
+	int maxX = std::min(m_width - 1, (int)std::floor(screenMax.x));
+	int maxY = std::min(m_height - 1, (int)std::floor(screenMax.y));
+	if (minX > maxX || minY > maxY)
+		return false;
+
+	for (int blockY = minY / kBlockSize; blockY <= maxY / kBlockSize; blockY++)
+	{
+		for (int blockX = minX / kBlockSize; blockX <= maxX / kBlockSize; blockX++)
+		{
+			// the whole block is in front of the object
+			if (m_blockDepth[blockY * m_blocksX + blockX] >= nearest)
+				continue;
+
+			int x0 = std::max(minX, blockX * kBlockSize);
+			int y0 = std::max(minY, blockY * kBlockSize);
+			int x1 = std::min(maxX, blockX * kBlockSize + kBlockSize - 1);
+			int y1 = std::min(maxY, blockY * kBlockSize + kBlockSize - 1);
+			for (int y = y0; y <= y1; y++)
+			{
+				const float* row = &m_depth[y * m_width];
+				for (int x = x0; x <= x1; x++)
+				{
+					if (row[x] < nearest)
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// software occlusion culling. a few big occluders are rasterized on the CPU into a small depth buffer
+// (256x128 by default), then objects are tested against it by their screen space bounding rectangle before
+// they're drawn.
+// depth is stored as 1/w, so bigger is nearer, the buffer clears to 0 and interpolating across a triangle in
+// screen space is exact. the screen is split into 32x32 tiles: triangles are set up per occluder in parallel,
+// binned into the tiles they touch, then each tile is rasterized by one job with SSE/AVX2 (scalar elsewhere)
+// and reduced to 8x8 blocks holding their minimum, i.e. farthest, depth. a test only looks at single pixels
+// in blocks where that farthest depth isn't already in front of the object.
+// occluders should be closed and a little smaller than what they stand for, back faces are skipped
+
+#include "CpuFeatures.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+class Mesh;
+
+struct OcclusionStats
+{
+	unsigned int occluders;
+	unsigned int triangles;    // front facing and on screen, after near plane clipping
+	unsigned int binnedTriangles; // triangle/tile pairs
+	double setupMs;
+	double rasterMs;
+};
+
+class OcclusionCuller
+{
+public:
+	static const int kTileSize = 32;
+	static const int kBlockSize = 8;
+
+	OcclusionCuller() = default;
+	~OcclusionCuller() {}
+
+	// multiples of kTileSize
+	void Init(int width = 256, int height = 128);
+
+	// setup and tiles are split across the job system's threads when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	// defaults to GetBestSimdLevel, settable for benchmarking
+	void SetSimdLevel(SimdLevel level) { m_simdLevel = level; }
+
+	// clears the occluders, GL style clip space
+	void BeginFrame(const glm::mat4& viewProjection);
+
+	// the geometry isn't copied, it has to stay alive until Rasterize. stride is in bytes
+	void AddOccluder(const void* positions, size_t stride, const unsigned int* indices, size_t triangleCount, const glm::mat4& world);
+	// the mesh's coarsest lod, needs a mesh loaded with keepGeometry
+	void AddOccluder(const Mesh& mesh, const glm::mat4& world);
+	void AddOccluderBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world);
+
+	void Rasterize();
+
+	// false if the box is completely hidden behind the occluders or off screen. safe to call from several threads
+	bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const;
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	const float* GetDepth() const { return m_depth.data(); } // rows top to bottom
+	const OcclusionStats& GetStats() const { return m_stats; }
+
+private:
+	struct Occluder
+	{
+		const uint8_t* positions;
+		size_t stride;
+		const unsigned int* indices;
+		size_t triangleCount;
+		glm::mat4 worldViewProjection;
+		size_t firstTriangle; // into m_triangles, room for 2 per source triangle (near clipping)
+		size_t numTriangles;  // written by setup
+	};
+
+	// three edge functions and the depth plane, each a * x + b * y + c in pixel coordinates sampled at
+	// pixel centres: a0 a1 a2, b0 b1 b2, c0 c1 c2, then depth a b c
+	struct ScreenTriangle
+	{
+		float coefficients[12];
+		int minX, minY, maxX, maxY; // inclusive pixel bounds, clamped to the screen
+	};
+
+	void SetupOccluder(Occluder& occluder);
+	bool SetupTriangle(const glm::vec4* clip, ScreenTriangle& out) const;
+	void RasterizeTile(int tile);
+
+	int m_width = 0;
+	int m_height = 0;
+	int m_tilesX = 0;
+	int m_tilesY = 0;
+	int m_blocksX = 0;
+	int m_blocksY = 0;
+
+	JobSystem* m_jobSystem = nullptr;
+	SimdLevel m_simdLevel = GetBestSimdLevel();
+
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	std::vector<Occluder> m_occluders;
+	std::vector<ScreenTriangle> m_triangles;
+	std::vector<std::vector<uint32_t>> m_bins; // per tile
+	std::vector<float> m_depth;
+	std::vector<float> m_blockDepth; // min over each kBlockSize square
+
+	OcclusionStats m_stats = { 0, 0, 0, 0.0, 0.0 };
+
+};
@@ -0,0 +1,88 @@
+#include "ParticleBenchmark.h"
+
+#include "JobSystem.h"
+#include "ParticleSystem.h"
+#include "RenderPacket.h"
+
+#include <cstdio>
+
+struct ParticleTiming
+{
+	double updateMs;
+	double recordMs;
+	unsigned int liveParticles;
+};
+
+static ParticleTiming RunPass(ParticleSystem& particles, RenderPacket& packet, int frames)
+{
+	const float dt = 1.0f / 60.0f;
+	ParticleTiming timing = { 0.0, 0.0, 0 };
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		particles.Update(dt);
+		particles.Record(packet);
+		timing.updateMs += particles.GetStats().updateMs;
+		timing.recordMs += particles.GetStats().recordMs;
+	}
+
+	timing.updateMs /= frames;
+	timing.recordMs /= frames;
+	timing.liveParticles = particles.GetStats().liveParticles;
+	return timing;
+}
+
+static void PrintTiming(const char* name, const ParticleTiming& timing)
+{
+	double total = timing.updateMs + timing.recordMs;
+	printf("%-20s %9u   %10.3f   %10.3f   %9.3f   %s\n", name, timing.liveParticles, timing.updateMs, timing.recordMs, total,
+		total < 1000.0 / 60.0 ? "yes" : "no");
+}
+
+void RunParticleBenchmark(int count, int frames)
+{
+	// lifetimes of 1.5-2.5s, spawned at the rate that keeps about count alive
+	ParticleEmitterDesc desc;
+	desc.position = glm::vec2(480.0f, 270.0f);
+	desc.positionJitter = glm::vec2(400.0f, 200.0f);
+	desc.minLifetime = 1.5f;
+	desc.maxLifetime = 2.5f;
+	desc.rate = count / 2.0f;
+	desc.gravity = glm::vec2(0.0f, 98.0f);
+	desc.drag = 0.5f;
+	desc.startColor = glm::vec4(1.0f, 0.8f, 0.2f, 1.0f);
+	desc.endColor = glm::vec4(1.0f, 0.1f, 0.0f, 0.0f);
+	desc.maxParticles = count + count / 4;
+
+	ParticleSystem particles;
+	particles.AddEmitter(desc);
+	RenderPacket packet;
+
+	// fill up to the steady state first
+	RunPass(particles, packet, 180);
+
+	printf("\n%d particles, %d frames\n", count, frames);
+	printf("kernel                    live   update (ms)  record (ms)  total (ms)  60 Hz\n");
+
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		particles.SetSimdLevel(level);
+		PrintTiming(GetSimdLevelName(level), RunPass(particles, packet, frames));
+	}
+
+	JobSystem jobSystem;
+	jobSystem.Init();
+	particles.SetSimdLevel(GetBestSimdLevel());
+	particles.SetJobSystem(&jobSystem);
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s, %u threads", GetSimdLevelName(GetBestSimdLevel()), jobSystem.GetNumThreads());
+	PrintTiming(name, RunPass(particles, packet, frames));
+
+	particles.SetJobSystem(nullptr);
+	jobSystem.Dispose();
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// keeps count particles alive in one emitter and times ParticleSystem::Update + Record per 60 Hz frame for each
+// SIMD level on one thread, then with the job system on every hardware thread. no GL needed
+void RunParticleBenchmark(int count, int frames = 120);
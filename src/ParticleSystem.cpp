@@ -0,0 +1,406 @@
+#include "ParticleSystem.h"
+
+#include "JobSystem.h"
+#include "RenderPacket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// particles per job. a multiple of 8 so every range but an emitter's last starts on a full SIMD group
+static const unsigned int kParticlesPerJob = 16 * 1024;
+
+struct IntegrateParams
+{
+	float dt;
+	float damping;   // velocity scale for this step
+	float gravityDtX; // velocity added this step
+	float gravityDtY;
+};
+
+static IntegrateParams MakeIntegrateParams(const ParticleEmitterDesc& desc, float dt)
+{
+	IntegrateParams params;
+	params.dt = dt;
+	params.damping = std::max(0.0f, 1.0f - desc.drag * dt);
+	params.gravityDtX = desc.gravity.x * dt;
+	params.gravityDtY = desc.gravity.y * dt;
+	return params;
+}
+
+static uint32_t PackColor(float r, float g, float b, float a)
+{
+	auto toByte = [](float value) { return (uint32_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f); };
+	return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | (toByte(a) << 24);
+}
+
+// integration: velocity gets drag and gravity, then everything else moves along its rate
+
+static void IntegrateScalar(std::vector<float>* s, unsigned int begin, unsigned int end, const IntegrateParams& p)
+{
+	for (unsigned int i = begin; i < end; i++)
+	{
+		float vx = s[ParticlePool::VelocityX][i] * p.damping + p.gravityDtX;
+		float vy = s[ParticlePool::VelocityY][i] * p.damping + p.gravityDtY;
+		s[ParticlePool::VelocityX][i] = vx;
+		s[ParticlePool::VelocityY][i] = vy;
+		s[ParticlePool::PositionX][i] += vx * p.dt;
+		s[ParticlePool::PositionY][i] += vy * p.dt;
+		s[ParticlePool::Size][i] += s[ParticlePool::SizeRate][i] * p.dt;
+		s[ParticlePool::Red][i] += s[ParticlePool::RedRate][i] * p.dt;
+		s[ParticlePool::Green][i] += s[ParticlePool::GreenRate][i] * p.dt;
+		s[ParticlePool::Blue][i] += s[ParticlePool::BlueRate][i] * p.dt;
+		s[ParticlePool::Alpha][i] += s[ParticlePool::AlphaRate][i] * p.dt;
+		s[ParticlePool::Life][i] -= p.dt;
+	}
+}
+
+static void PackScalar(const std::vector<float>* s, unsigned int begin, unsigned int end, ParticleInstance* out)
+{
+	for (unsigned int i = begin; i < end; i++)
+	{
+		ParticleInstance& instance = *out++;
+		instance.x = s[ParticlePool::PositionX][i];
+		instance.y = s[ParticlePool::PositionY][i];
+		instance.size = std::max(s[ParticlePool::Size][i], 0.0f);
+		instance.color = PackColor(s[ParticlePool::Red][i], s[ParticlePool::Green][i], s[ParticlePool::Blue][i], s[ParticlePool::Alpha][i]);
+	}
+}
+
+#if defined(CPU_X86)
+
+// end may run up to 3 past the live count, the pool is padded for it
+static void IntegrateSse(std::vector<float>* s, unsigned int begin, unsigned int end, const IntegrateParams& p)
+{
+	const __m128 dt = _mm_set1_ps(p.dt);
+	const __m128 damping = _mm_set1_ps(p.damping);
+	const __m128 gravityX = _mm_set1_ps(p.gravityDtX);
+	const __m128 gravityY = _mm_set1_ps(p.gravityDtY);
+
+	// value += rate * dt
+	auto step = [&s, dt](int value, int rate, unsigned int i) {
+		float* v = &s[value][i];
+		_mm_storeu_ps(v, _mm_add_ps(_mm_loadu_ps(v), _mm_mul_ps(_mm_loadu_ps(&s[rate][i]), dt)));
+	};
+
+	for (unsigned int i = begin; i < end; i += 4)
+	{
+		__m128 vx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&s[ParticlePool::VelocityX][i]), damping), gravityX);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&s[ParticlePool::VelocityY][i]), damping), gravityY);
+		_mm_storeu_ps(&s[ParticlePool::VelocityX][i], vx);
+		_mm_storeu_ps(&s[ParticlePool::VelocityY][i], vy);
+		step(ParticlePool::PositionX, ParticlePool::VelocityX, i);
+		step(ParticlePool::PositionY, ParticlePool::VelocityY, i);
+		step(ParticlePool::Size, ParticlePool::SizeRate, i);
+		step(ParticlePool::Red, ParticlePool::RedRate, i);
+		step(ParticlePool::Green, ParticlePool::GreenRate, i);
+		step(ParticlePool::Blue, ParticlePool::BlueRate, i);
+		step(ParticlePool::Alpha, ParticlePool::AlphaRate, i);
+
+		float* life = &s[ParticlePool::Life][i];
+		_mm_storeu_ps(life, _mm_sub_ps(_mm_loadu_ps(life), dt));
+	}
+}
+
+CPU_TARGET_AVX2 static void IntegrateAvx2(std::vector<float>* s, unsigned int begin, unsigned int end, const IntegrateParams& p)
+{
+	const __m256 dt = _mm256_set1_ps(p.dt);
+	const __m256 damping = _mm256_set1_ps(p.damping);
+	const __m256 gravityX = _mm256_set1_ps(p.gravityDtX);
+	const __m256 gravityY = _mm256_set1_ps(p.gravityDtY);
+
+	for (unsigned int i = begin; i < end; i += 8)
+	{
+		__m256 vx = _mm256_fmadd_ps(_mm256_loadu_ps(&s[ParticlePool::VelocityX][i]), damping, gravityX);
+		__m256 vy = _mm256_fmadd_ps(_mm256_loadu_ps(&s[ParticlePool::VelocityY][i]), damping, gravityY);
+		_mm256_storeu_ps(&s[ParticlePool::VelocityX][i], vx);
+		_mm256_storeu_ps(&s[ParticlePool::VelocityY][i], vy);
+
+		// value += rate * dt
+		const int pairs[][2] = {
+			{ ParticlePool::PositionX, ParticlePool::VelocityX }, { ParticlePool::PositionY, ParticlePool::VelocityY },
+			{ ParticlePool::Size, ParticlePool::SizeRate },
+			{ ParticlePool::Red, ParticlePool::RedRate }, { ParticlePool::Green, ParticlePool::GreenRate },
+			{ ParticlePool::Blue, ParticlePool::BlueRate }, { ParticlePool::Alpha, ParticlePool::AlphaRate }
+		};
+		for (const auto& pair : pairs)
+		{
+			float* v = &s[pair[0]][i];
+			_mm256_storeu_ps(v, _mm256_fmadd_ps(_mm256_loadu_ps(&s[pair[1]][i]), dt, _mm256_loadu_ps(v)));
+		}
+
+		float* life = &s[ParticlePool::Life][i];
+		_mm256_storeu_ps(life, _mm256_sub_ps(_mm256_loadu_ps(life), dt));
+	}
+}
+
+// 4 particles at a time, the colour is packed to bytes and the four x, y, size, colour registers transposed
+// into four instances. the output isn't padded, so the last few go through the scalar version
+static void PackSse(const std::vector<float>* s, unsigned int begin, unsigned int end, ParticleInstance* out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	auto toBytes = [&](const float* value) {
+		return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(value), zero), one), scale));
+	};
+
+	unsigned int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&s[ParticlePool::PositionX][i]);
+		__m128 y = _mm_loadu_ps(&s[ParticlePool::PositionY][i]);
+		__m128 size = _mm_max_ps(_mm_loadu_ps(&s[ParticlePool::Size][i]), zero);
+
+		__m128i r = toBytes(&s[ParticlePool::Red][i]);
+		__m128i g = _mm_slli_epi32(toBytes(&s[ParticlePool::Green][i]), 8);
+		__m128i b = _mm_slli_epi32(toBytes(&s[ParticlePool::Blue][i]), 16);
+		__m128i a = _mm_slli_epi32(toBytes(&s[ParticlePool::Alpha][i]), 24);
+		__m128 color = _mm_castsi128_ps(_mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a)));
+
+		_MM_TRANSPOSE4_PS(x, y, size, color);
+		float* output = &out->x;
+		_mm_storeu_ps(output + 0, x);
+		_mm_storeu_ps(output + 4, y);
+		_mm_storeu_ps(output + 8, size);
+		_mm_storeu_ps(output + 12, color);
+		out += 4;
+	}
+
+	PackScalar(s, i, end, out);
+}
+
+#endif
+
+static void Integrate(SimdLevel level, std::vector<float>* streams, unsigned int begin, unsigned int end, const IntegrateParams& params)
+{
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Avx2: IntegrateAvx2(streams, begin, (end + 7) & ~7u, params); break;
+	case SimdLevel::Sse: IntegrateSse(streams, begin, (end + 3) & ~3u, params); break;
+#endif
+	default: IntegrateScalar(streams, begin, end, params); break;
+	}
+}
+
+static void Pack(SimdLevel level, const std::vector<float>* streams, unsigned int begin, unsigned int end, ParticleInstance* out)
+{
+#if defined(CPU_X86)
+	if (level != SimdLevel::Scalar)
+	{
+		PackSse(streams, begin, end, out);
+		return;
+	}
+#endif
+	PackScalar(streams, begin, end, out);
+}
+
+void ParticlePool::Reserve(unsigned int maxParticles)
+{
+	capacity = maxParticles;
+	unsigned int padded = (maxParticles + 7) & ~7u;
+	for (std::vector<float>& stream : streams)
+	{
+		stream.resize(padded, 0.0f);
+	}
+	count = std::min(count, capacity);
+}
+
+void ParticlePool::Remove(unsigned int index)
+{
+	unsigned int last = count - 1;
+	for (std::vector<float>& stream : streams)
+	{
+		stream[index] = stream[last];
+	}
+	count--;
+}
+
+ParticleEmitter::ParticleEmitter(const ParticleEmitterDesc& desc)
+	: m_desc(desc)
+{
+	m_pool.Reserve(desc.maxParticles);
+
+	// different emitters shouldn't produce the same pattern
+	static uint32_t s_seed = 0x9E3779B9u;
+	s_seed = s_seed * 1664525u + 1013904223u;
+	m_randomState = s_seed | 1u;
+}
+
+float ParticleEmitter::Random()
+{
+	// xorshift32
+	m_randomState ^= m_randomState << 13;
+	m_randomState ^= m_randomState >> 17;
+	m_randomState ^= m_randomState << 5;
+	return (m_randomState >> 8) * (1.0f / 16777216.0f);
+}
+
+void ParticleEmitter::RemoveDead()
+{
+	std::vector<float>& life = m_pool.streams[ParticlePool::Life];
+	for (unsigned int i = 0; i < m_pool.count;)
+	{
+		if (life[i] <= 0.0f)
+			m_pool.Remove(i); // the moved in particle gets checked next
+		else
+			i++;
+	}
+}
+
+void ParticleEmitter::Spawn(float dt)
+{
+	m_spawnAccumulator += m_desc.rate * dt;
+	unsigned int toSpawn = (unsigned int)m_spawnAccumulator;
+	m_spawnAccumulator -= (float)toSpawn;
+
+	// a full pool drops the excess rather than saving it up
+	toSpawn = std::min(toSpawn, m_pool.capacity - m_pool.count);
+
+	std::vector<float>* s = m_pool.streams;
+	for (unsigned int n = 0; n < toSpawn; n++)
+	{
+		unsigned int i = m_pool.count++;
+
+		float lifetime = m_desc.minLifetime + (m_desc.maxLifetime - m_desc.minLifetime) * Random();
+		lifetime = std::max(lifetime, 1e-3f);
+		float angle = m_desc.direction + (Random() * 2.0f - 1.0f) * m_desc.spread;
+		float speed = m_desc.minSpeed + (m_desc.maxSpeed - m_desc.minSpeed) * Random();
+		float invLifetime = 1.0f / lifetime;
+
+		s[ParticlePool::PositionX][i] = m_desc.position.x + (Random() * 2.0f - 1.0f) * m_desc.positionJitter.x;
+		s[ParticlePool::PositionY][i] = m_desc.position.y + (Random() * 2.0f - 1.0f) * m_desc.positionJitter.y;
+		s[ParticlePool::VelocityX][i] = cosf(angle) * speed;
+		s[ParticlePool::VelocityY][i] = sinf(angle) * speed;
+		s[ParticlePool::Size][i] = m_desc.startSize;
+		s[ParticlePool::SizeRate][i] = (m_desc.endSize - m_desc.startSize) * invLifetime;
+		for (int c = 0; c < 4; c++)
+		{
+			s[ParticlePool::Red + c][i] = m_desc.startColor[c];
+			s[ParticlePool::RedRate + c][i] = (m_desc.endColor[c] - m_desc.startColor[c]) * invLifetime;
+		}
+		s[ParticlePool::Life][i] = lifetime;
+	}
+}
+
+ParticleEmitter* ParticleSystem::AddEmitter(const ParticleEmitterDesc& desc)
+{
+	m_emitters.emplace_back(new ParticleEmitter(desc));
+	return m_emitters.back().get();
+}
+
+void ParticleSystem::RemoveEmitter(ParticleEmitter* emitter)
+{
+	for (size_t i = 0; i < m_emitters.size(); i++)
+	{
+		if (m_emitters[i].get() == emitter)
+		{
+			m_emitters.erase(m_emitters.begin() + i);
+			return;
+		}
+	}
+}
+
+void ParticleSystem::Clear()
+{
+	m_emitters.clear();
+}
+
+void ParticleSystem::BuildWorkRanges()
+{
+	m_workRanges.clear();
+	unsigned int firstInstance = 0;
+	for (const std::unique_ptr<ParticleEmitter>& emitter : m_emitters)
+	{
+		unsigned int count = emitter->m_pool.count;
+		for (unsigned int begin = 0; begin < count; begin += kParticlesPerJob)
+		{
+			unsigned int end = std::min(begin + kParticlesPerJob, count);
+			m_workRanges.push_back({ emitter.get(), begin, end, firstInstance + begin });
+		}
+		firstInstance += count;
+	}
+}
+
+void ParticleSystem::Update(float dt)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	BuildWorkRanges();
+	SimdLevel level = m_simdLevel;
+	auto integrateRange = [this, level, dt](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const WorkRange& range = m_workRanges[i];
+			IntegrateParams params = MakeIntegrateParams(range.emitter->m_desc, dt);
+			Integrate(level, range.emitter->m_pool.streams, range.begin, range.end, params);
+		}
+	};
+
+	// removal and spawning reshuffle the whole pool, so those are one job per emitter
+	auto respawnRange = [this, dt](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			m_emitters[i]->RemoveDead();
+			m_emitters[i]->Spawn(dt);
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+	{
+		m_jobSystem->ParallelFor(m_workRanges.size(), 1, integrateRange);
+		m_jobSystem->ParallelFor(m_emitters.size(), 1, respawnRange);
+	}
+	else
+	{
+		integrateRange(0, m_workRanges.size());
+		respawnRange(0, m_emitters.size());
+	}
+
+	m_stats.liveParticles = 0;
+	for (const std::unique_ptr<ParticleEmitter>& emitter : m_emitters)
+	{
+		m_stats.liveParticles += emitter->m_pool.count;
+	}
+	m_stats.emitters = (unsigned int)m_emitters.size();
+	m_stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void ParticleSystem::Record(RenderPacket& packet)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	BuildWorkRanges();
+
+	packet.particleDraws.clear();
+	unsigned int total = 0;
+	for (const std::unique_ptr<ParticleEmitter>& emitter : m_emitters)
+	{
+		unsigned int count = emitter->m_pool.count;
+		if (count > 0)
+			packet.particleDraws.push_back({ emitter->m_desc.texture, total, count });
+		total += count;
+	}
+	packet.particles.resize(total);
+
+	SimdLevel level = m_simdLevel;
+	auto packRange = [this, level, &packet](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const WorkRange& range = m_workRanges[i];
+			Pack(level, range.emitter->m_pool.streams, range.begin, range.end, &packet.particles[range.firstInstance]);
+		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_workRanges.size(), 1, packRange);
+	else
+		packRange(0, m_workRanges.size());
+
+	m_stats.recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// 2D particles. each emitter owns a structure-of-arrays pool that is integrated with SSE/AVX2 kernels (scalar
+// elsewhere) and packed into 16 byte instances for Renderer's instanced particle pass. dead particles are
+// swap-removed, so a pool is always the first count entries of its arrays with no holes.
+// colour and size change linearly from the start to the end value over each particle's lifetime
+
+#include "CpuFeatures.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+class Texture;
+struct RenderPacket;
+
+struct ParticleEmitterDesc
+{
+	glm::vec2 position = glm::vec2(0.0f);
+	glm::vec2 positionJitter = glm::vec2(0.0f); // particles start anywhere within +-jitter of the position
+	float rate = 100.0f;                         // particles per second
+	float minLifetime = 1.0f;
+	float maxLifetime = 2.0f;
+	float direction = 0.0f;                      // radians
+	float spread = 3.14159265f;                  // +- radians around direction
+	float minSpeed = 50.0f;
+	float maxSpeed = 100.0f;
+	glm::vec2 gravity = glm::vec2(0.0f);
+	float drag = 0.0f;                           // fraction of the velocity lost per second
+	float startSize = 8.0f;
+	float endSize = 0.0f;
+	glm::vec4 startColor = glm::vec4(1.0f);
+	glm::vec4 endColor = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	Texture* texture = nullptr;
+	unsigned int maxParticles = 10000;
+};
+
+// one array per attribute, padded to a multiple of 8 so the kernels never need a scalar tail
+struct ParticlePool
+{
+	enum Stream
+	{
+		PositionX, PositionY,
+		VelocityX, VelocityY,
+		Size, SizeRate,
+		Red, Green, Blue, Alpha,
+		RedRate, GreenRate, BlueRate, AlphaRate,
+		Life, // seconds left
+		NumStreams
+	};
+
+	unsigned int count = 0;
+	unsigned int capacity = 0;
+	std::vector<float> streams[NumStreams];
+
+	void Reserve(unsigned int maxParticles);
+	void Remove(unsigned int index); // moves the last particle into index
+};
+
+class ParticleEmitter
+{
+public:
+	explicit ParticleEmitter(const ParticleEmitterDesc& desc);
+
+	void SetPosition(const glm::vec2& position) { m_desc.position = position; }
+	void SetRate(float rate) { m_desc.rate = rate; }
+
+	const ParticleEmitterDesc& GetDesc() const { return m_desc; }
+	const ParticlePool& GetPool() const { return m_pool; }
+
+private:
+	friend class ParticleSystem;
+
+	void RemoveDead();
+	void Spawn(float dt);
+	float Random(); // 0..1
+
+	ParticleEmitterDesc m_desc;
+	ParticlePool m_pool;
+	float m_spawnAccumulator = 0.0f;
+	uint32_t m_randomState;
+
+};
+
+struct ParticleStats
+{
+	unsigned int liveParticles;
+	unsigned int emitters;
+	double updateMs;
+	double recordMs;
+};
+
+class ParticleSystem
+{
+public:
+	ParticleSystem() = default;
+	~ParticleSystem() {}
+
+	// integration and packing are split across the job system's threads when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+	// defaults to GetBestSimdLevel, settable for benchmarking
+	void SetSimdLevel(SimdLevel level) { m_simdLevel = level; }
+
+	ParticleEmitter* AddEmitter(const ParticleEmitterDesc& desc);
+	void RemoveEmitter(ParticleEmitter* emitter);
+	void Clear();
+
+	// integrates, removes dead particles, then spawns new ones
+	void Update(float dt);
+
+	// replaces the packet's particle instances and draws with this frame's
+	void Record(RenderPacket& packet);
+
+	const ParticleStats& GetStats() const { return m_stats; }
+
+private:
+	struct WorkRange
+	{
+		ParticleEmitter* emitter;
+		unsigned int begin;
+		unsigned int end;
+		unsigned int firstInstance; // Record only
+	};
+
+	void BuildWorkRanges();
+
+	std::vector<std::unique_ptr<ParticleEmitter>> m_emitters;
+	std::vector<WorkRange> m_workRanges;
+
+	JobSystem* m_jobSystem = nullptr;
+	SimdLevel m_simdLevel = GetBestSimdLevel();
+
+	ParticleStats m_stats = { 0, 0, 0.0, 0.0 };
+
+};
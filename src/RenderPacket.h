@@ -0,0 +1,108 @@
+#pragma once
+
+// everything the render side needs to draw one 2D frame, copied out of the game's objects so the simulation
+// can carry on changing them while the frame is being drawn (see FramePipeline)
+
+#include "Vertex.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class SpriteLayer;
+class Texture;
+class Tilemap;
+
+struct SpriteDrawCommand
+{
+	Texture* texture;
+	unsigned int firstVertex;
+	unsigned int vertexCount;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	int layer;
+};
+
+// one instanced quad, 16 bytes
+struct ParticleInstance
+{
+	float x;
+	float y;
+	float size;
+	uint32_t color; // rgba8, r in the low byte
+};
+
+struct ParticleDrawCommand
+{
+	Texture* texture;
+	unsigned int firstInstance;
+	unsigned int instanceCount;
+};
+
+struct TileEdit
+{
+	uint32_t cell; // y * width + x
+	uint16_t tile;
+};
+
+// edits are applied to the map's render side copy before it's drawn
+struct TilemapDraw
+{
+	Tilemap* tilemap;
+	glm::vec2 viewMin; // map units, what ends up at the top left of the screen
+	glm::vec2 viewMax;
+	unsigned int firstEdit;
+	unsigned int editCount;
+};
+
+// slots [firstSlot, firstSlot + slotCount) of a sprite layer, 4 vertices each starting at firstVertex in layerVertices
+struct SpriteLayerPatch
+{
+	unsigned int firstSlot;
+	unsigned int slotCount;
+	unsigned int firstVertex;
+};
+
+struct SpriteLayerDraw
+{
+	SpriteLayer* layer;
+	unsigned int slotCount; // the layer's high water mark, removed slots are degenerate quads
+	unsigned int firstPatch;
+	unsigned int patchCount;
+	glm::vec2 maxSpriteSize; // for texture streaming
+};
+
+struct RenderPacket
+{
+	unsigned int frame = 0;
+
+	std::vector<TilemapDraw> tilemaps; // drawn first, in order
+	std::vector<TileEdit> tileEdits;
+	std::vector<SpriteLayerDraw> spriteLayers; // then these
+	std::vector<SpriteLayerPatch> layerPatches;
+	std::vector<Vertex> layerVertices;
+
+	std::vector<SpriteDrawCommand> sprites; // submission order
+	std::vector<Vertex> vertices;            // positions already offset into place
+	std::vector<unsigned int> indices;       // into vertices, so the arrays can be uploaded as they are
+	std::vector<ParticleInstance> particles; // drawn after the sprites
+	std::vector<ParticleDrawCommand> particleDraws;
+	std::vector<glm::vec2> linePoints;
+
+	// keeps the capacity, packets are reused every frame
+	void Clear()
+	{
+		tilemaps.clear();
+		tileEdits.clear();
+		spriteLayers.clear();
+		layerPatches.clear();
+		layerVertices.clear();
+		sprites.clear();
+		vertices.clear();
+		indices.clear();
+		particles.clear();
+		particleDraws.clear();
+		linePoints.clear();
+	}
+};
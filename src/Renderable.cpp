@@ -0,0 +1,23 @@
+#include "Renderable.h"
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+void iRenderable::UpdateLod(const glm::vec3& cameraPosition, float fovY, float viewportHeight)
+{
+    if (m_mesh == nullptr)
+        return;
+
+    float scale = std::max(m_scale.x, std::max(m_scale.y, m_scale.z));
+    float radius = m_mesh->GetBoundingRadius() * scale;
+    float distance = glm::length(m_worldPosition + m_mesh->GetBoundsCenter() * scale - cameraPosition);
+
+    // projected diameter of the bounding sphere in pixels, from inside it the object fills the screen
+    float screenSize = viewportHeight;
+    if (distance > radius)
+        screenSize = radius * viewportHeight / (distance * tanf(fovY * 0.5f));
+
+    m_lod = m_mesh->SelectLod(screenSize, m_lod);
+}
@@ -18,9 +18,18 @@ public:
     iRenderable() = default;
     ~iRenderable() {}
 
+    void SetMesh(Mesh* mesh) { m_mesh = mesh; }
+    void SetTexture(Texture* texture) { m_texture = texture; }
+    Mesh* GetMesh() const { return m_mesh; }
+    Texture* GetTexture() const { return m_texture; }
+
+    // picks the mesh LOD from the object's projected size, once per frame before drawing
+    void UpdateLod(const glm::vec3& cameraPosition, float fovY, float viewportHeight);
+    int GetLod() const { return m_lod; }
+
 protected:
-    glm::mat4 m_transform;
-    Mesh* m_mesh;
-    Texture* m_texture;
+    Mesh* m_mesh = nullptr;
+    Texture* m_texture = nullptr;
+    int m_lod = 0;
 
 };
@@ -1,39 +1,83 @@
 #include "Renderer.h"
 
+#include "JobSystem.h"
+#include "Shader.h"
+#include "SpriteLayer.h"
+#include "Tilemap.h"
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
 #include <cassert>
 #include <algorithm>
+#include <cfloat>
+#include <cstring>
 
-static const unsigned int kMaxSprites = 2000;
+static const unsigned int kMaxSprites = 2000; // initial capacity, the sprite buffers grow as needed
 static const unsigned int kMaxLines = 100;
+// render objects per job when building sprite batches
+static const size_t kSpritesPerJob = 1024;
+// where the sprite shader reads its depth from, an array on the sprite VAO and a constant for the others
+static const GLuint kDepthAttribute = 2;
+// alpha tested texels below this are discarded
+static const float kAlphaTestCutoff = 0.5f;
+
+static bool IsInPass(AlphaMode alphaMode, bool translucentPass)
+{
+	return (alphaMode == AlphaMode::Translucent) == translucentPass;
+}
 
 void Renderer::Init()
 {
 	CreateShaderProgram();
 	CreateRenderData();
+	CreateParticleRenderData();
+	CreateOverdrawRenderData();
+
+	// -spritebench checks the kernels against the scalar one
+	printf("Sprite kernel: %s\n", GetSimdLevelName(GetBestSimdLevel()));
 }
 
 void Renderer::SetProjection(unsigned int screenWidth, unsigned int screenHeight)
 {
 	glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(screenWidth), static_cast<float>(screenHeight), 0.0f, -1.0f, 1.0f);
-	
+	m_projection = projection;
+
 	glUseProgram(m_shaderProgram);
 	glUniformMatrix4fv(glGetUniformLocation(m_shaderProgram, "u_projection"), 1, false, glm::value_ptr(projection));
 
 	glUseProgram(m_debugShaderProgram);
 	glUniformMatrix4fv(glGetUniformLocation(m_debugShaderProgram, "u_projection"), 1, false, glm::value_ptr(projection));
+
+	glUseProgram(m_particleShaderProgram);
+	glUniformMatrix4fv(glGetUniformLocation(m_particleShaderProgram, "u_projection"), 1, false, glm::value_ptr(projection));
+}
+
+void Renderer::SetPixelsPerUnit(float pixelsPerUnit)
+{
+	m_pixelsPerUnit = pixelsPerUnit;
 }
 
 void Renderer::Dispose()
 {
 	glDeleteBuffers(1, &m_ebo);
+	glDeleteBuffers(1, &m_depthVbo);
 	glDeleteBuffers(1, &m_vbo);
 	glDeleteVertexArrays(1, &m_vao);
 	glDeleteBuffers(1, &m_lineVbo);
 	glDeleteVertexArrays(1, &m_lineVao);
+	glDeleteBuffers(1, &m_particleQuadVbo);
+	glDeleteBuffers(1, &m_particleInstanceVbo);
+	glDeleteVertexArrays(1, &m_particleVao);
+	glDeleteProgram(m_particleShaderProgram);
+
+	glDeleteQueries(kFillQueryFrames * 2, &m_fillQueries[0][0]);
+	glDeleteFramebuffers(1, &m_overdrawFramebuffer);
+	glDeleteTextures(1, &m_overdrawTexture);
+	glDeleteRenderbuffers(1, &m_overdrawDepth);
+	glDeleteVertexArrays(1, &m_overdrawVao);
+	glDeleteProgram(m_overdrawProgram);
 
 	glDeleteProgram(m_shaderProgram);
 	glDeleteProgram(m_debugShaderProgram);
@@ -44,98 +88,551 @@ void Renderer::AddRenderObject(const RenderObject& renderObject)
 	m_renderObjects.push_back(renderObject);
 }
 
+void Renderer::AddSprite(const SpriteInstance& sprite, Texture* texture, int layer)
+{
+	m_sprites.push_back(sprite);
+	m_spriteTextures.push_back(texture);
+	m_spriteLayers.push_back(layer);
+}
+
+void Renderer::AddSprites(const SpriteInstance* sprites, size_t count, Texture* texture, const glm::vec2& offset, int layer)
+{
+	size_t first = m_sprites.size();
+	m_sprites.insert(m_sprites.end(), sprites, sprites + count);
+	m_spriteTextures.resize(first + count, texture);
+	m_spriteLayers.resize(first + count, layer);
+
+	for (size_t i = first; i < m_sprites.size(); i++)
+	{
+		m_sprites[i].position += offset;
+	}
+}
+
 void Renderer::RenderObjects()
 {
-	//std::sort(m_renderObjects.begin(), m_renderObjects.end(), RenderObjectCompare());
+	// the packet only ever has sprites in it, so this is just the sprite passes
+	RecordSprites(m_immediatePacket);
+	DrawFrame(m_immediatePacket);
+}
 
-	glUseProgram(m_shaderProgram);
-	glBindVertexArray(m_vao);
+void Renderer::AddDebugLine(const glm::vec2& p1, const glm::vec2& p2)
+{
+	m_linePoints.push_back(p1);
+	m_linePoints.push_back(p2);
+}
+
+void Renderer::RenderDebugLines()
+{
+	DrawLines(m_linePoints);
+	m_linePoints.clear();
+}
 
-	Texture* currentTexture = nullptr;
+void Renderer::RecordFrame(RenderPacket& packet)
+{
+	RecordSprites(packet);
+
+	packet.linePoints.swap(m_linePoints);
+	m_linePoints.clear();
+}
+
+void Renderer::DrawFrame(const RenderPacket& packet)
+{
+	m_stats = {};
+
+	bool overdrawView = GetOverdrawView();
+	if (overdrawView)
+		BeginOverdraw();
+
+	ReadFillQueries();
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	m_fillQueryPixels[m_fillQueryFrame] = static_cast<uint64_t>(viewport[2]) * static_cast<uint64_t>(viewport[3]);
+	m_fillQueryIssued[m_fillQueryFrame] = true;
+
+	AssignDepths(packet);
+	UploadSprites(packet);
+
+	// every quad of a sprite has the same depth, so the later ones need LEQUAL to still draw over the earlier
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+
+	// the overdraw view counts fragments with additive blending in both passes
+	if (overdrawView)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+	}
+
+	// opaque and alpha tested, front to back with depth writes, so everything they cover fails the depth
+	// test before it's shaded. the tilemaps are usually the whole screen and go last
+	if (!overdrawView)
+		glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glBeginQuery(GL_SAMPLES_PASSED, m_fillQueries[m_fillQueryFrame][0]);
+	DrawSprites(DrawPass::Opaque);
+	DrawSpriteLayers(packet, DrawPass::Opaque);
+	DrawTilemaps(packet, DrawPass::Opaque);
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	// translucent, blended back to front over the opaque ones and tested against their depth
+	if (!overdrawView)
+		glEnable(GL_BLEND);
+	glDepthMask(GL_FALSE);
+	glBeginQuery(GL_SAMPLES_PASSED, m_fillQueries[m_fillQueryFrame][1]);
+	DrawTilemaps(packet, DrawPass::Translucent);
+	DrawSpriteLayers(packet, DrawPass::Translucent);
+	DrawSprites(DrawPass::Translucent);
+	DrawParticles(packet);
+	glEndQuery(GL_SAMPLES_PASSED);
+
+	// back to what Game::SetupGL left for everything else
+	glDepthMask(GL_TRUE);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	m_fillQueryFrame = (m_fillQueryFrame + 1) % kFillQueryFrames;
+
+	if (overdrawView)
+		ResolveOverdraw();
+
+	DrawLines(packet.linePoints);
+}
+
+void Renderer::AssignDepths(const RenderPacket& packet)
+{
+	// painter's order: tilemaps, sprite layers, then sprite commands by layer and submission order.
+	// each gets its own depth, nearer the later it is, so the depth test gives the same picture as painting
+	size_t numCommands = packet.sprites.size();
+	m_paintOrder.resize(numCommands);
+	for (size_t i = 0; i < numCommands; i++)
+	{
+		m_paintOrder[i] = (unsigned int)i;
+	}
+	std::stable_sort(m_paintOrder.begin(), m_paintOrder.end(), [&packet](unsigned int a, unsigned int b) {
+		return packet.sprites[a].layer < packet.sprites[b].layer;
+	});
+
+	size_t firstSpriteRank = packet.tilemaps.size() + packet.spriteLayers.size();
+	m_commandRanks.resize(numCommands);
+	for (size_t i = 0; i < numCommands; i++)
+	{
+		m_commandRanks[m_paintOrder[i]] = (unsigned int)(firstSpriteRank + i);
+	}
+	m_numRanks = firstSpriteRank + numCommands;
+}
+
+float Renderer::GetDepth(size_t rank) const
+{
+	// 0 is the near plane, the last rank stays just short of it so particles can still go in front
+	return 1.0f - (rank + 1.0f) / (m_numRanks + 1.0f);
+}
+
+void Renderer::SetAlphaCutoff(AlphaMode alphaMode)
+{
+	glUniform1f(glGetUniformLocation(m_shaderProgram, "u_alphaCutoff"), alphaMode == AlphaMode::AlphaTest ? kAlphaTestCutoff : 0.0f);
+}
+
+void Renderer::RecordSprites(RenderPacket& packet)
+{
+	packet.sprites.resize(m_renderObjects.size());
+	size_t numObjectCommands = packet.sprites.size();
 
-	for (const RenderObject& obj : m_renderObjects)
+	// where each object's vertices and indices land, a prefix sum over the counts
+	unsigned int vertexCount = 0;
+	unsigned int indexCount = 0;
+	for (size_t i = 0; i < m_renderObjects.size(); i++)
 	{
-		if (obj.GetTexture() != currentTexture)
+		const RenderObject& obj = m_renderObjects[i];
+		SpriteDrawCommand& command = packet.sprites[i];
+		command.texture = obj.GetTexture();
+		command.firstVertex = vertexCount;
+		command.vertexCount = (unsigned int)obj.GetVertexVec()->size();
+		command.firstIndex = indexCount;
+		command.indexCount = (unsigned int)obj.GetIndexVec()->size();
+		command.layer = obj.GetLayer();
+
+		vertexCount += command.vertexCount;
+		indexCount += command.indexCount;
+	}
+
+	// then runs of kernel sprites sharing a texture, split up so the jobs stay a reasonable size
+	m_spriteRuns.clear();
+	for (size_t i = 0; i < m_sprites.size();)
+	{
+		size_t end = i + 1;
+		while (end < m_sprites.size() && end - i < kSpritesPerJob && m_spriteTextures[end] == m_spriteTextures[i] && m_spriteLayers[end] == m_spriteLayers[i])
+			end++;
+
+		unsigned int count = (unsigned int)(end - i);
+		packet.sprites.push_back({ m_spriteTextures[i], vertexCount, count * 4, indexCount, count * 6, m_spriteLayers[i] });
+		m_spriteRuns.push_back((unsigned int)i);
+		vertexCount += count * 4;
+		indexCount += count * 6;
+		i = end;
+	}
+
+	packet.vertices.resize(vertexCount);
+	packet.indices.resize(indexCount);
+
+	// every object has its own output range, so they can be filled in any order
+	auto recordRange = [this, &packet](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
 		{
-			// If a different texture is encountered, start a new batch
-			if (!m_vertexBuffer.empty())
+			const RenderObject& obj = m_renderObjects[i];
+			const SpriteDrawCommand& command = packet.sprites[i];
+
+			glm::vec2 offset = obj.GetPosition() != nullptr ? *(obj.GetPosition()) : glm::vec2(0.0f);
+			Vertex* vertices = &packet.vertices[command.firstVertex];
+			for (const Vertex& vertex : *(obj.GetVertexVec())) {
+				vertices->position = vertex.position + offset;
+				vertices->texCoord = vertex.texCoord;
+				vertices++;
+			}
+
+			unsigned int* indices = &packet.indices[command.firstIndex];
+			for (unsigned int index : *(obj.GetIndexVec()))
 			{
-				currentTexture->Bind();
-				FlushBatch();
-				ClearBatch();
+				*indices++ = index + command.firstVertex;
 			}
-			currentTexture = obj.GetTexture();
 		}
+	};
 
-		for (Vertex vertex : *(obj.GetVertexVec())) {
-			if (obj.GetPosition() != nullptr)
-				vertex.position += *(obj.GetPosition());
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_renderObjects.size(), kSpritesPerJob, recordRange);
+	else
+		recordRange(0, m_renderObjects.size());
 
-			m_vertexBuffer.push_back(vertex);
+	// one job per run, straight into the packet
+	auto generateRange = [this, &packet, numObjectCommands](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			const SpriteDrawCommand& command = packet.sprites[numObjectCommands + i];
+			size_t count = command.vertexCount / 4;
+			GenerateSpriteVertices(&m_sprites[m_spriteRuns[i]], count, &packet.vertices[command.firstVertex]);
+			GenerateSpriteIndices(count, command.firstVertex, &packet.indices[command.firstIndex]);
 		}
+	};
+
+	if (m_jobSystem != nullptr)
+		m_jobSystem->ParallelFor(m_spriteRuns.size(), 1, generateRange);
+	else
+		generateRange(0, m_spriteRuns.size());
+
+	m_renderObjects.clear();
+	m_sprites.clear();
+	m_spriteTextures.clear();
+	m_spriteLayers.clear();
+}
+
+void Renderer::DrawTilemaps(const RenderPacket& packet, DrawPass pass)
+{
+	if (packet.tilemaps.empty())
+		return;
 
-		// Append the indices from the current RenderObject to the current index batch
-		unsigned int vertexOffset = m_vertexBuffer.size() - obj.GetVertexVec()->size();
-		for (unsigned int index : *(obj.GetIndexVec()))
+	glUseProgram(m_shaderProgram);
+	GLint projectionLocation = glGetUniformLocation(m_shaderProgram, "u_projection");
+	bool translucentPass = pass == DrawPass::Translucent;
+
+	// front to back in the opaque pass
+	size_t count = packet.tilemaps.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = translucentPass ? i : count - 1 - i;
+		const TilemapDraw& draw = packet.tilemaps[index];
+		Tilemap* tilemap = draw.tilemap;
+		Texture* tileset = tilemap->GetTileset();
+		if (!IsInPass(tileset->GetAlphaMode(), translucentPass))
+			continue;
+
+		if (draw.editCount > 0)
+			tilemap->ApplyEdits(&packet.tileEdits[draw.firstEdit], draw.editCount);
+
+		// chunk vertices are in map space, the camera is just an offset on the projection
+		glm::mat4 projection = glm::translate(m_projection, glm::vec3(-draw.viewMin, 0.0f));
+		glUniformMatrix4fv(projectionLocation, 1, false, glm::value_ptr(projection));
+
+		float tilesetScale = tilemap->GetTileSize() * m_pixelsPerUnit;
+		tileset->ReportScreenSize(tilesetScale * tilemap->GetTilesetColumns(), tilesetScale * tilemap->GetTilesetRows());
+
+		// the chunk VAOs have no depth array, the constant attribute value is used instead
+		glVertexAttrib1f(kDepthAttribute, GetDepth(index));
+		SetAlphaCutoff(tileset->GetAlphaMode());
+		tilemap->Draw(draw.viewMin, draw.viewMax);
+	}
+
+	glUniformMatrix4fv(projectionLocation, 1, false, glm::value_ptr(m_projection));
+}
+
+void Renderer::DrawSpriteLayers(const RenderPacket& packet, DrawPass pass)
+{
+	if (packet.spriteLayers.empty())
+		return;
+
+	glUseProgram(m_shaderProgram);
+	bool translucentPass = pass == DrawPass::Translucent;
+
+	size_t count = packet.spriteLayers.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = translucentPass ? i : count - 1 - i;
+		const SpriteLayerDraw& draw = packet.spriteLayers[index];
+		SpriteLayer* layer = draw.layer;
+		if (!IsInPass(layer->GetTexture()->GetAlphaMode(), translucentPass))
+			continue;
+
+		layer->ApplyPatches(&packet.layerPatches[draw.firstPatch], draw.patchCount, packet.layerVertices.data());
+		m_stats.retainedBytes += layer->GetUploadBytes();
+
+		if (draw.slotCount == 0)
+			continue;
+
+		layer->GetTexture()->ReportScreenSize(draw.maxSpriteSize.x * m_pixelsPerUnit, draw.maxSpriteSize.y * m_pixelsPerUnit);
+		glVertexAttrib1f(kDepthAttribute, GetDepth(packet.tilemaps.size() + index));
+		SetAlphaCutoff(layer->GetTexture()->GetAlphaMode());
+		layer->Draw(draw.slotCount);
+		m_stats.spriteDraws++;
+		if (!translucentPass)
+			m_stats.opaqueDraws++;
+	}
+}
+
+void Renderer::UploadSprites(const RenderPacket& packet)
+{
+	m_batches.clear();
+	m_firstTranslucentBatch = 0;
+	if (packet.sprites.empty())
+		return;
+
+	// opaque and alpha tested commands front to back, alpha tested after the rest since discarding can turn
+	// off early depth testing. then the translucent ones back to front
+	m_drawOrder.clear();
+	for (unsigned int command : m_paintOrder)
+	{
+		if (packet.sprites[command].texture->GetAlphaMode() != AlphaMode::Translucent)
+			m_drawOrder.push_back(command);
+	}
+	size_t numOpaque = m_drawOrder.size();
+	std::stable_sort(m_drawOrder.begin(), m_drawOrder.end(), [this, &packet](unsigned int a, unsigned int b) {
+		AlphaMode modeA = packet.sprites[a].texture->GetAlphaMode();
+		AlphaMode modeB = packet.sprites[b].texture->GetAlphaMode();
+		if (modeA != modeB) return modeA < modeB;
+		return m_commandRanks[a] > m_commandRanks[b];
+	});
+	for (unsigned int command : m_paintOrder)
+	{
+		if (packet.sprites[command].texture->GetAlphaMode() == AlphaMode::Translucent)
+			m_drawOrder.push_back(command);
+	}
+
+	// the indices are laid out in draw order, so consecutive commands with the same texture are one draw
+	m_drawFirstIndex.resize(packet.sprites.size());
+	unsigned int indexCount = 0;
+	for (size_t i = 0; i < m_drawOrder.size(); i++)
+	{
+		const SpriteDrawCommand& command = packet.sprites[m_drawOrder[i]];
+		m_drawFirstIndex[m_drawOrder[i]] = indexCount;
+
+		if (i == numOpaque)
+			m_firstTranslucentBatch = m_batches.size();
+		AlphaMode alphaMode = command.texture->GetAlphaMode();
+		if (i == numOpaque || m_batches.empty() || m_batches.back().texture != command.texture || m_batches.back().alphaMode != alphaMode)
+			m_batches.push_back({ command.texture, alphaMode, (unsigned int)i, 0, indexCount, 0 });
+
+		m_batches.back().commandCount++;
+		m_batches.back().indexCount += command.indexCount;
+		indexCount += command.indexCount;
+	}
+	if (numOpaque == m_drawOrder.size())
+		m_firstTranslucentBatch = m_batches.size();
+
+	glBindVertexArray(m_vao);
+	ReserveSpriteBuffers(packet.vertices.size(), packet.indices.size());
+
+	// the whole buffer is rewritten, invalidating lets the driver hand over fresh memory instead of syncing
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	Vertex* mappedVertices = static_cast<Vertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, packet.vertices.size() * sizeof(Vertex),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	glBindBuffer(GL_ARRAY_BUFFER, m_depthVbo);
+	float* mappedDepths = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, packet.vertices.size() * sizeof(float),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	unsigned int* mappedIndices = static_cast<unsigned int*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, packet.indices.size() * sizeof(unsigned int),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	bool mapped = mappedVertices != nullptr && mappedDepths != nullptr && mappedIndices != nullptr;
+
+	// copy each sprite into place and measure it for texture streaming on the way. only the GL calls stay on this thread
+	m_screenSizes.resize(packet.sprites.size());
+	auto copyRange = [this, &packet](size_t begin, size_t end, Vertex* outVertices, float* outDepths, unsigned int* outIndices) {
+		for (size_t i = begin; i < end; i++)
 		{
-			m_indexBuffer.push_back(index + vertexOffset);
+			const SpriteDrawCommand& command = packet.sprites[i];
+			const Vertex* vertices = &packet.vertices[command.firstVertex];
+
+			glm::vec2 minExtent(FLT_MAX);
+			glm::vec2 maxExtent(-FLT_MAX);
+			for (unsigned int v = 0; v < command.vertexCount; v++)
+			{
+				minExtent = glm::min(minExtent, vertices[v].position);
+				maxExtent = glm::max(maxExtent, vertices[v].position);
+			}
+			m_screenSizes[i] = command.vertexCount > 0 ? (maxExtent - minExtent) * m_pixelsPerUnit : glm::vec2(0.0f);
+
+			if (outVertices != nullptr)
+				memcpy(outVertices + command.firstVertex, vertices, command.vertexCount * sizeof(Vertex));
+			std::fill(outDepths + command.firstVertex, outDepths + command.firstVertex + command.vertexCount, GetDepth(m_commandRanks[i]));
+			memcpy(outIndices + m_drawFirstIndex[i], &packet.indices[command.firstIndex], command.indexCount * sizeof(unsigned int));
 		}
-	}
+	};
+
+	auto copy = [this, &packet, &copyRange](Vertex* outVertices, float* outDepths, unsigned int* outIndices) {
+		auto copyJob = [&copyRange, outVertices, outDepths, outIndices](size_t begin, size_t end) {
+			copyRange(begin, end, outVertices, outDepths, outIndices);
+		};
+
+		if (m_jobSystem != nullptr)
+			m_jobSystem->ParallelFor(packet.sprites.size(), kSpritesPerJob, copyJob);
+		else
+			copyJob(0, packet.sprites.size());
+	};
 
-	// Add the last batch (if any) to the result
-	if (!m_vertexBuffer.empty())
+	if (mapped)
+		copy(mappedVertices, mappedDepths, mappedIndices);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	if (mappedVertices != nullptr)
+		mapped = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE && mapped;
+	glBindBuffer(GL_ARRAY_BUFFER, m_depthVbo);
+	if (mappedDepths != nullptr)
+		mapped = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE && mapped;
+	if (mappedIndices != nullptr)
+		mapped = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE && mapped;
+
+	m_stats.streamedBytes += packet.vertices.size() * (sizeof(Vertex) + sizeof(float)) + packet.indices.size() * sizeof(unsigned int);
+
+	// mapping can fail or the contents get lost (e.g. a mode switch), fall back to a plain upload
+	if (!mapped)
 	{
-		currentTexture->Bind();
-		FlushBatch();
-		ClearBatch();
+		m_vertexDepths.resize(packet.vertices.size());
+		m_drawIndices.resize(packet.indices.size());
+		copy(nullptr, m_vertexDepths.data(), m_drawIndices.data());
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, packet.vertices.size() * sizeof(Vertex), packet.vertices.data());
+		glBindBuffer(GL_ARRAY_BUFFER, m_depthVbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, m_vertexDepths.size() * sizeof(float), m_vertexDepths.data());
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_drawIndices.size() * sizeof(unsigned int), m_drawIndices.data());
 	}
 
 	glBindVertexArray(0);
-	m_renderObjects.clear();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void Renderer::AddDebugLine(const glm::vec2& p1, const glm::vec2& p2)
+void Renderer::DrawSprites(DrawPass pass)
 {
-	m_linePoints.push_back(p1);
-	m_linePoints.push_back(p2);
+	bool translucentPass = pass == DrawPass::Translucent;
+	size_t firstBatch = translucentPass ? m_firstTranslucentBatch : 0;
+	size_t endBatch = translucentPass ? m_batches.size() : m_firstTranslucentBatch;
+	if (firstBatch == endBatch)
+		return;
+
+	glUseProgram(m_shaderProgram);
+	glBindVertexArray(m_vao);
+
+	for (size_t b = firstBatch; b < endBatch; b++)
+	{
+		const SpriteBatch& batch = m_batches[b];
+
+		// let streamed textures know how big they ended up on screen, once per batch with the biggest sprite
+		glm::vec2 screenSize(0.0f);
+		for (unsigned int i = 0; i < batch.commandCount; i++)
+		{
+			screenSize = glm::max(screenSize, m_screenSizes[m_drawOrder[batch.firstCommand + i]]);
+		}
+		batch.texture->ReportScreenSize(screenSize.x, screenSize.y);
+
+		batch.texture->Bind();
+		SetAlphaCutoff(batch.alphaMode);
+		glDrawElements(GL_TRIANGLES, batch.indexCount, GL_UNSIGNED_INT, (const void*)(batch.firstIndex * sizeof(unsigned int)));
+		m_stats.spriteDraws++;
+		if (!translucentPass)
+			m_stats.opaqueDraws++;
+	}
+
+	glBindVertexArray(0);
 }
 
-void Renderer::RenderDebugLines()
+void Renderer::ReserveSpriteBuffers(size_t vertexCount, size_t indexCount)
 {
-	glUseProgram(m_debugShaderProgram);
-	glBindVertexArray(m_lineVao);
+	// expects the sprite VAO to be bound, the element buffer binding is part of it
+	if (vertexCount > m_vertexCapacity)
+	{
+		while (m_vertexCapacity < vertexCount)
+			m_vertexCapacity *= 2;
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_linePoints.size() * sizeof(glm::vec2), m_linePoints.data());
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, m_depthVbo);
+		glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	}
 
-	glDrawArrays(GL_LINES, 0, m_linePoints.size());
+	if (indexCount > m_indexCapacity)
+	{
+		while (m_indexCapacity < indexCount)
+			m_indexCapacity *= 2;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+	}
+}
 
-	m_linePoints.clear();
+void Renderer::DrawParticles(const RenderPacket& packet)
+{
+	if (packet.particles.empty())
+		return;
 
+	glUseProgram(m_particleShaderProgram);
+	glBindVertexArray(m_particleVao);
+
+	// orphaned every frame, the GPU may still be reading last frame's instances
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleInstanceVbo);
+	while (m_particleCapacity < packet.particles.size())
+		m_particleCapacity *= 2;
+	glBufferData(GL_ARRAY_BUFFER, m_particleCapacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, packet.particles.size() * sizeof(ParticleInstance), packet.particles.data());
+
+	GLint useTextureLocation = glGetUniformLocation(m_particleShaderProgram, "u_useTexture");
+	for (const ParticleDrawCommand& draw : packet.particleDraws)
+	{
+		glUniform1i(useTextureLocation, draw.texture != nullptr);
+		if (draw.texture != nullptr)
+			draw.texture->Bind();
+
+		// no base instance in 3.3, so the instance attributes are pointed at this emitter's run
+		size_t offset = draw.firstInstance * sizeof(ParticleInstance);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)(offset + offsetof(ParticleInstance, x)));
+		glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), (void*)(offset + offsetof(ParticleInstance, color)));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, draw.instanceCount);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
-void Renderer::FlushBatch()
+void Renderer::DrawLines(const std::vector<glm::vec2>& linePoints)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_vertexBuffer.size() * sizeof(Vertex), m_vertexBuffer.data());
-	
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_indexBuffer.size() * sizeof(unsigned int), m_indexBuffer.data());
-	
-	glDrawElements(GL_TRIANGLES, m_indexBuffer.size(), GL_UNSIGNED_INT, 0);
-	
+	glUseProgram(m_debugShaderProgram);
+	glBindVertexArray(m_lineVao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_lineVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, linePoints.size() * sizeof(glm::vec2), linePoints.data());
+
+	glDrawArrays(GL_LINES, 0, linePoints.size());
+
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
 
-void Renderer::ClearBatch()
-{
-	m_vertexBuffer.clear();
-	m_indexBuffer.clear();
+	glBindVertexArray(0);
 }
 
 void Renderer::CreateShaderProgram()
@@ -148,6 +645,7 @@ void Renderer::CreateShaderProgram()
 
 			layout (location = 0) in vec2 a_position;
 			layout (location = 1) in vec2 a_texcoord;
+			layout (location = 2) in float a_depth; // 0 near .. 1 far, the painter's order
 
 			varying vec2 v_texcoord;
 
@@ -156,6 +654,7 @@ void Renderer::CreateShaderProgram()
 			void main()
 			{
 				gl_Position = u_projection * vec4(a_position, 0.0, 1.0);
+				gl_Position.z = a_depth * 2.0 - 1.0;
 				v_texcoord = a_texcoord;
 			}
 		)";
@@ -183,10 +682,15 @@ void Renderer::CreateShaderProgram()
 
 			uniform vec4 u_color;
 			uniform sampler2D u_sampler;
+			uniform float u_alphaCutoff; // 0 unless the texture is alpha tested
+			uniform int u_overdraw;
 
 			void main()
 			{
-				out_color = texture(u_sampler, v_texcoord);
+				vec4 color = texture(u_sampler, v_texcoord);
+				if (color.a < u_alphaCutoff)
+					discard;
+				out_color = u_overdraw != 0 ? vec4(1.0) : color;
 				//out_color = vec4(1, 0, 1, 1);
 			}
 		)";
@@ -226,6 +730,8 @@ void Renderer::CreateShaderProgram()
 	GLint textureUniformLocation = glGetUniformLocation(m_shaderProgram, "u_sampler");
 	assert(textureUniformLocation >= 0 && "Sampler does not exist");
 	glUniform1i(textureUniformLocation, 0);
+	glUniform1f(glGetUniformLocation(m_shaderProgram, "u_alphaCutoff"), 0.0f);
+	glUniform1i(glGetUniformLocation(m_shaderProgram, "u_overdraw"), 0);
 
 
 	// DEBUG SHADER -- MOVE THIS
@@ -314,12 +820,14 @@ void Renderer::CreateRenderData()
 	// VBO
 	glGenBuffers(1, &m_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferData(GL_ARRAY_BUFFER, kMaxSprites * 4 * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+	m_vertexCapacity = kMaxSprites * 4;
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
 
 	// EBO
 	glGenBuffers(1, &m_ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, kMaxSprites * 6 * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+	m_indexCapacity = kMaxSprites * 6;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
 
 	// Enable the vertex attribute arrays for position and texcoords
 	glEnableVertexAttribArray(0);
@@ -327,11 +835,20 @@ void Renderer::CreateRenderData()
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
 
+	// depths in a buffer of their own, so Vertex stays the same for the kernels, tilemaps and sprite layers
+	glGenBuffers(1, &m_depthVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_depthVbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCapacity * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(kDepthAttribute);
+	glVertexAttribPointer(kDepthAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+
 	// Unbind
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+	glGenQueries(kFillQueryFrames * 2, &m_fillQueries[0][0]);
+
 	// FOR DEBUG LINES
 	// VAO
 	glGenVertexArrays(1, &m_lineVao);
@@ -351,6 +868,259 @@ void Renderer::CreateRenderData()
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void Renderer::CreateParticleRenderData()
+{
+	// same sampling as the sprite shader, tinted by the particle's colour
+	const GLchar* vertexSource = R"(
+		#version 330 core
+
+		layout (location = 0) in vec2 a_corner;
+		layout (location = 1) in vec2 a_texcoord;
+		layout (location = 2) in vec3 a_particle; // x, y, size
+		layout (location = 3) in vec4 a_color;
+
+		out vec2 v_texcoord;
+		out vec4 v_color;
+
+		uniform mat4 u_projection;
+
+		void main()
+		{
+			gl_Position = u_projection * vec4(a_particle.xy + a_corner * a_particle.z, 0.0, 1.0);
+			gl_Position.z = -1.0; // in front of every sprite
+			v_texcoord = a_texcoord;
+			v_color = a_color;
+		}
+	)";
+
+	const GLchar* fragmentSource = R"(
+		#version 330 core
+		out vec4 out_color;
+
+		in vec2 v_texcoord;
+		in vec4 v_color;
+
+		uniform sampler2D u_sampler;
+		uniform int u_useTexture;
+		uniform int u_overdraw;
+
+		void main()
+		{
+			vec4 texel = u_useTexture != 0 ? texture(u_sampler, v_texcoord) : vec4(1.0);
+			out_color = u_overdraw != 0 ? vec4(1.0) : texel * v_color;
+		}
+	)";
+
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+	m_particleShaderProgram = glCreateProgram();
+	glAttachShader(m_particleShaderProgram, vertexShader);
+	glAttachShader(m_particleShaderProgram, fragmentShader);
+	glLinkProgram(m_particleShaderProgram);
+
+	int success;
+	char info_log[512];
+	glGetProgramiv(m_particleShaderProgram, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(m_particleShaderProgram, 512, NULL, info_log);
+		printf("Failed to link shader:\n%s\n", info_log);
+	}
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glUseProgram(m_particleShaderProgram);
+	glUniform1i(glGetUniformLocation(m_particleShaderProgram, "u_sampler"), 0);
+	glUniform1i(glGetUniformLocation(m_particleShaderProgram, "u_overdraw"), 0);
+
+	// corner, texcoord as a strip
+	const float quad[] = {
+		-0.5f, -0.5f, 0.0f, 0.0f,
+		 0.5f, -0.5f, 1.0f, 0.0f,
+		-0.5f,  0.5f, 0.0f, 1.0f,
+		 0.5f,  0.5f, 1.0f, 1.0f
+	};
+
+	glGenVertexArrays(1, &m_particleVao);
+	glBindVertexArray(m_particleVao);
+
+	glGenBuffers(1, &m_particleQuadVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleQuadVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+
+	m_particleCapacity = kMaxSprites * 4;
+	glGenBuffers(1, &m_particleInstanceVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_particleInstanceVbo);
+	glBufferData(GL_ARRAY_BUFFER, m_particleCapacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, x));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, color));
+	glVertexAttribDivisor(3, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Renderer::CreateOverdrawRenderData()
+{
+	// one triangle over the whole screen, counts to a ramp
+	const GLchar* vertexSource = R"(
+		#version 330 core
+
+		out vec2 v_texcoord;
+
+		void main()
+		{
+			vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+			gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+			v_texcoord = corner;
+		}
+	)";
+
+	const GLchar* fragmentSource = R"(
+		#version 330 core
+		out vec4 out_color;
+
+		in vec2 v_texcoord;
+
+		uniform sampler2D u_counts;
+
+		const vec3 kRamp[5] = vec3[5](
+			vec3(0.0, 0.0, 0.0),
+			vec3(0.0, 0.2, 1.0),
+			vec3(0.0, 0.9, 0.2),
+			vec3(1.0, 0.9, 0.0),
+			vec3(1.0, 0.0, 0.0));
+
+		void main()
+		{
+			float count = texture(u_counts, v_texcoord).r;
+			out_color = vec4(kRamp[int(min(count, 4.0))], 1.0);
+		}
+	)";
+
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+	m_overdrawProgram = glCreateProgram();
+	glAttachShader(m_overdrawProgram, vertexShader);
+	glAttachShader(m_overdrawProgram, fragmentShader);
+	glLinkProgram(m_overdrawProgram);
+
+	int success;
+	char info_log[512];
+	glGetProgramiv(m_overdrawProgram, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(m_overdrawProgram, 512, NULL, info_log);
+		printf("Failed to link shader:\n%s\n", info_log);
+	}
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glUseProgram(m_overdrawProgram);
+	glUniform1i(glGetUniformLocation(m_overdrawProgram, "u_counts"), 0);
+
+	glGenVertexArrays(1, &m_overdrawVao);
+}
+
+void Renderer::BeginOverdraw()
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_overdrawTarget);
+
+	// the count target follows the viewport, with a depth buffer of its own for the opaque pass to test against
+	if (viewport[2] != m_overdrawWidth || viewport[3] != m_overdrawHeight)
+	{
+		m_overdrawWidth = viewport[2];
+		m_overdrawHeight = viewport[3];
+
+		if (m_overdrawFramebuffer == 0)
+		{
+			glGenFramebuffers(1, &m_overdrawFramebuffer);
+			glGenTextures(1, &m_overdrawTexture);
+			glGenRenderbuffers(1, &m_overdrawDepth);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, m_overdrawTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, m_overdrawWidth, m_overdrawHeight, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, m_overdrawDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_overdrawWidth, m_overdrawHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, m_overdrawFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_overdrawTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_overdrawDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			printf("Overdraw framebuffer is incomplete\n");
+	}
+
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_overdrawFramebuffer);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	glUseProgram(m_shaderProgram);
+	glUniform1i(glGetUniformLocation(m_shaderProgram, "u_overdraw"), 1);
+	glUseProgram(m_particleShaderProgram);
+	glUniform1i(glGetUniformLocation(m_particleShaderProgram, "u_overdraw"), 1);
+}
+
+void Renderer::ResolveOverdraw()
+{
+	glUseProgram(m_shaderProgram);
+	glUniform1i(glGetUniformLocation(m_shaderProgram, "u_overdraw"), 0);
+	glUseProgram(m_particleShaderProgram);
+	glUniform1i(glGetUniformLocation(m_particleShaderProgram, "u_overdraw"), 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_overdrawTarget);
+	glDisable(GL_BLEND);
+	glUseProgram(m_overdrawProgram);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_overdrawTexture);
+	glBindVertexArray(m_overdrawVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_BLEND);
+}
+
+void Renderer::ReadFillQueries()
+{
+	// this frame's pair is about to be reused, take its result if the GPU has got that far. it's a few
+	// frames old by now, so it normally has
+	int frame = m_fillQueryFrame;
+	if (!m_fillQueryIssued[frame])
+		return;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(m_fillQueries[frame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	GLuint64 opaqueSamples = 0;
+	GLuint64 translucentSamples = 0;
+	glGetQueryObjectui64v(m_fillQueries[frame][0], GL_QUERY_RESULT, &opaqueSamples);
+	glGetQueryObjectui64v(m_fillQueries[frame][1], GL_QUERY_RESULT, &translucentSamples);
+	m_fillStats.opaqueSamples = opaqueSamples;
+	m_fillStats.translucentSamples = translucentSamples;
+	m_fillStats.screenPixels = m_fillQueryPixels[frame];
+}
+
 void Renderer::CheckError()
 {
 	GLenum error = glGetError();
@@ -3,11 +3,16 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "RenderPacket.h"
+#include "SpriteKernels.h"
 #include "Vertex.h"
 #include "Texture.h"
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
+class JobSystem;
 class SpriteEntity;
 
 typedef std::vector<Vertex> tVertexVec;
@@ -16,19 +21,21 @@ typedef std::vector<unsigned int> tIndexVec;
 class RenderObject
 {
 public:
-	RenderObject(tVertexVec* vertexVec, tIndexVec* indexVec, glm::vec2* position, Texture* texture)
-		: m_vertexVec(vertexVec), m_indexVec(indexVec), m_position(position), m_texture(texture) {}
+	RenderObject(tVertexVec* vertexVec, tIndexVec* indexVec, glm::vec2* position, Texture* texture, int layer = 0)
+		: m_vertexVec(vertexVec), m_indexVec(indexVec), m_texture(texture), m_position(position), m_layer(layer) {}
 
 	tVertexVec* GetVertexVec() const { return m_vertexVec; }
 	tIndexVec* GetIndexVec() const { return m_indexVec; }
 	Texture* GetTexture() const { return m_texture; }
 	glm::vec2* GetPosition() const { return m_position; }
+	int GetLayer() const { return m_layer; }
 
 private:
 	tVertexVec* m_vertexVec;
 	tIndexVec* m_indexVec;
 	Texture* m_texture;
 	glm::vec2* m_position;
+	int m_layer;
 
 };
 
@@ -41,6 +48,24 @@ public:
 	}
 };
 
+// sprite work done by the last DrawFrame
+struct RendererStats
+{
+	unsigned int spriteDraws;  // retained layers and streamed batches
+	unsigned int opaqueDraws;  // of spriteDraws, opaque or alpha tested and drawn front to back without blending
+	size_t streamedBytes;      // vertices and indices of the sprites recorded this frame
+	size_t retainedBytes;      // sprite layer patches
+};
+
+// samples written by each pass, from occlusion queries read back a few frames late so they never stall.
+// divided by screenPixels it's the average overdraw
+struct FillStats
+{
+	uint64_t opaqueSamples;
+	uint64_t translucentSamples; // particles included
+	uint64_t screenPixels;
+};
+
 class Renderer
 {
 public:
@@ -49,34 +74,137 @@ public:
 
 	void Init();
 	void SetProjection(unsigned int screenWidth, unsigned int screenHeight);
+	void SetPixelsPerUnit(float pixelsPerUnit); // window pixels per projection unit, for texture streaming
 	void Dispose();
 
+	// sprite batches are built across the job system's threads when set
+	void SetJobSystem(JobSystem* jobSystem) { m_jobSystem = jobSystem; }
+
 	void AddRenderObject(const RenderObject& renderObject);
+
+	// quads built by the SIMD sprite kernels. higher layers are in front, within a layer render objects come
+	// first and then sprites in the order they were added. tilemaps and sprite layers are behind all of them.
+	// the texture's AlphaMode decides whether it's drawn in the opaque or the translucent pass
+	void AddSprite(const SpriteInstance& sprite, Texture* texture, int layer = 0);
+	// a prebuilt run of sprites sharing a texture (e.g. a text label), moved by offset on the way in
+	void AddSprites(const SpriteInstance* sprites, size_t count, Texture* texture, const glm::vec2& offset, int layer = 0);
 	
 	void RenderObjects();
 
 	void AddDebugLine(const glm::vec2& p1, const glm::vec2& p2);
 	void RenderDebugLines();
 
-	void FlushBatch();
-	void ClearBatch();
+	// split version of RenderObjects + RenderDebugLines for the pipelined loop. RecordFrame is CPU only and
+	// copies out everything added since the last frame, DrawFrame needs the GL context
+	void RecordFrame(RenderPacket& packet);
+	void DrawFrame(const RenderPacket& packet);
+
+	const RendererStats& GetStats() const { return m_stats; }
+	const FillStats& GetFillStats() const { return m_fillStats; }
+
+	// draws how many times each pixel was written instead of the frame: black for none, then blue, green,
+	// yellow and red for four or more. can be toggled from any thread, takes effect on the next DrawFrame
+	void SetOverdrawView(bool enabled) { m_overdrawView.store(enabled, std::memory_order_relaxed); }
+	bool GetOverdrawView() const { return m_overdrawView.load(std::memory_order_relaxed); }
 
 private:
 	void CreateShaderProgram();
 	void CreateRenderData();
+	void CreateParticleRenderData();
+	void CreateOverdrawRenderData();
+
+	// opaque and alpha tested things go in the first, everything blended in the second
+	enum class DrawPass
+	{
+		Opaque,
+		Translucent
+	};
+
+	void RecordSprites(RenderPacket& packet);
+	void AssignDepths(const RenderPacket& packet);
+	void UploadSprites(const RenderPacket& packet);
+	void DrawTilemaps(const RenderPacket& packet, DrawPass pass);
+	void DrawSpriteLayers(const RenderPacket& packet, DrawPass pass);
+	void DrawSprites(DrawPass pass);
+	void DrawParticles(const RenderPacket& packet);
+	void DrawLines(const std::vector<glm::vec2>& linePoints);
+	void ReserveSpriteBuffers(size_t vertexCount, size_t indexCount);
+	void SetAlphaCutoff(AlphaMode alphaMode);
+	float GetDepth(size_t rank) const;
+
+	void BeginOverdraw();
+	void ResolveOverdraw();
+	void ReadFillQueries();
 
 	void CheckError();
 
 	GLuint m_shaderProgram;
-
-	tVertexVec m_vertexBuffer;
-	tIndexVec m_indexBuffer;
+	glm::mat4 m_projection = glm::mat4(1.0f);
 
 	GLuint m_vao;
 	GLuint m_vbo;
 	GLuint m_ebo;
+	GLuint m_depthVbo; // one float per vertex, parallel to m_vbo
+	size_t m_vertexCapacity = 0;
+	size_t m_indexCapacity = 0;
+
+	JobSystem* m_jobSystem = nullptr;
+
+	// DrawSprites scratch
+	struct SpriteBatch
+	{
+		Texture* texture;
+		AlphaMode alphaMode;
+		unsigned int firstCommand; // into m_drawOrder
+		unsigned int commandCount;
+		unsigned int firstIndex;
+		unsigned int indexCount;
+	};
+	std::vector<SpriteBatch> m_batches; // opaque pass, then from m_firstTranslucentBatch the translucent one
+	size_t m_firstTranslucentBatch = 0;
+	std::vector<glm::vec2> m_screenSizes; // per command
+	std::vector<unsigned int> m_paintOrder;   // commands back to front, stable sorted by layer
+	std::vector<unsigned int> m_drawOrder;    // commands in the order they're drawn
+	std::vector<unsigned int> m_commandRanks; // per command, its position in m_paintOrder
+	std::vector<unsigned int> m_drawFirstIndex; // per command, where its indices go in the index buffer
+	std::vector<unsigned int> m_drawIndices;  // upload fallback when mapping fails
+	std::vector<float> m_vertexDepths;        // same
+	size_t m_numRanks = 0; // tilemaps, sprite layers and sprite commands this frame
 
 	std::vector<RenderObject> m_renderObjects;
+	std::vector<SpriteInstance> m_sprites;
+	std::vector<Texture*> m_spriteTextures; // parallel to m_sprites
+	std::vector<int> m_spriteLayers;        // same
+	std::vector<unsigned int> m_spriteRuns;  // first sprite of each kernel sprite command, RecordSprites scratch
+	RenderPacket m_immediatePacket; // for RenderObjects
+	float m_pixelsPerUnit = 1.0f;
+	RendererStats m_stats = { 0, 0, 0, 0 };
+
+	// fill queries, one pair per frame in flight
+	static const int kFillQueryFrames = 3;
+	GLuint m_fillQueries[kFillQueryFrames][2];
+	uint64_t m_fillQueryPixels[kFillQueryFrames] = {};
+	bool m_fillQueryIssued[kFillQueryFrames] = {};
+	int m_fillQueryFrame = 0;
+	FillStats m_fillStats = { 0, 0, 0 };
+
+	// overdraw view: fragment counts go into a float target that is resolved to a colour ramp
+	std::atomic<bool> m_overdrawView{ false };
+	GLuint m_overdrawProgram = 0;
+	GLuint m_overdrawVao = 0; // empty, the resolve triangle comes from gl_VertexID
+	GLuint m_overdrawFramebuffer = 0;
+	GLuint m_overdrawTexture = 0;
+	GLuint m_overdrawDepth = 0;
+	int m_overdrawWidth = 0;
+	int m_overdrawHeight = 0;
+	GLint m_overdrawTarget = 0; // the framebuffer that was bound before BeginOverdraw
+
+	// Particles: a unit quad plus one ParticleInstance per particle
+	GLuint m_particleShaderProgram;
+	GLuint m_particleVao;
+	GLuint m_particleQuadVbo;
+	GLuint m_particleInstanceVbo;
+	size_t m_particleCapacity = 0;
 
 	// Debug lines
 	GLuint m_debugShaderProgram;
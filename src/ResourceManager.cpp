@@ -1,9 +1,11 @@
 #include "ResourceManager.h"
 
 #include <iostream>
+#include <fstream>
 
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
 
 const std::string ResourceManager::s_meshDirectoryPath = "../data/models/";
 const std::string ResourceManager::s_textureDirectoryPath = "../data/images/";
@@ -22,24 +24,41 @@ void ResourceManager::UnloadResources()
         delete it.second;
         std::cout << "Unloaded texture: " << it.first << "\n";
     }
+    for (auto& it : m_streamedTextureMap)
+    {
+        m_textureStreamer->UnloadTexture(it.second);
+        std::cout << "Unloaded streamed texture: " << it.first << "\n";
+    }
     std::cout << "--------------------------------------------------------\n\n";
 }
 
-bool ResourceManager::LoadMesh(std::string name)
+bool ResourceManager::LoadMesh(std::string name, bool compact, bool keepGeometry)
 {
     std::string path = s_meshDirectoryPath + name + ".obj";
 
     Mesh *mesh = new Mesh();
-    bool ret = mesh->LoadFromFile(path.c_str());
+    bool ret = mesh->LoadFromFile(path.c_str(), compact ? GetCompactVertexFormat() : GetFullVertexFormat(), keepGeometry);
 
     m_meshMap[name] = mesh;
 
     return ret;
 }
 
-bool ResourceManager::LoadTexture(std::string name)
+bool ResourceManager::LoadTexture(std::string name, bool streamed)
 {
-    std::string path = s_textureDirectoryPath + name + ".png";
+    // prefer the baked version if there is one
+    std::string path = s_textureDirectoryPath + name + ".ktx";
+    if (!std::ifstream(path).good())
+    {
+        path = s_textureDirectoryPath + name + ".png";
+    }
+
+    if (m_textureStreamer)
+    {
+        Texture* texture = m_textureStreamer->LoadTexture(path.c_str(), !streamed);
+        m_streamedTextureMap[name] = texture;
+        return texture != nullptr;
+    }
 
     Texture *texture = new Texture();
     bool ret = texture->LoadFromFile(path.c_str());
@@ -64,7 +83,8 @@ Mesh *ResourceManager::GetMesh(std::string name)
 
 Texture *ResourceManager::GetTexture(std::string name)
 {
-    Texture* temp = m_textureMap[name];
+    auto streamed = m_streamedTextureMap.find(name);
+    Texture* temp = streamed != m_streamedTextureMap.end() ? streamed->second : m_textureMap[name];
     if (!temp)
     {
         std::cerr << "ERROR: missing texture: " << name << "\n";
@@ -5,6 +5,7 @@
 
 class Mesh;
 class Texture;
+class TextureStreamer;
 
 typedef std::map<std::string, Mesh*> tMeshMap;
 typedef std::map<std::string, Texture*> tTextureMap;
@@ -17,15 +18,25 @@ public:
 
     void UnloadResources();
 
-    bool LoadMesh(std::string name);
-    bool LoadTexture(std::string name);
+    bool LoadMesh(std::string name, bool compact = false, bool keepGeometry = false); // compact = quantized 16 byte vertices, keepGeometry for static batching
+    // with a texture streamer set every texture is read on its worker and uploaded through its PBO queue, a
+    // streamed one only as far as it's drawn and the rest in full over the next frames. without, it loads here
+    bool LoadTexture(std::string name, bool streamed = false);
 
     Mesh* GetMesh(std::string name);
     Texture* GetTexture(std::string name);
 
+    void SetTextureStreamer(TextureStreamer* textureStreamer) { m_textureStreamer = textureStreamer; }
+
+    // where LoadMesh/LoadTexture look, relative to the working directory. with a trailing slash
+    static const std::string& GetMeshDirectory() { return s_meshDirectoryPath; }
+    static const std::string& GetTextureDirectory() { return s_textureDirectoryPath; }
+
 private:
     tMeshMap m_meshMap;
     tTextureMap m_textureMap;
+    tTextureMap m_streamedTextureMap; // owned by the streamer, streamed or not
+    TextureStreamer* m_textureStreamer = nullptr;
     static const std::string s_meshDirectoryPath;
     static const std::string s_textureDirectoryPath;
 
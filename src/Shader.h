@@ -23,3 +23,6 @@ private:
     GLuint m_programId = 0;
 
 };
+
+// compiles one stage from source, printing the info log if it fails. the shader is returned either way
+GLuint CompileShader(GLenum type, const char* source);
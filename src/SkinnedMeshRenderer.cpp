@@ -0,0 +1,261 @@
+#include "SkinnedMeshRenderer.h"
+
+#include "Animation.h"
+#include "LightClusters.h"
+#include "Mesh.h"
+#include "MeshRenderer.h"
+#include "Texture.h"
+#include "VertexFormat.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static const size_t kRowsPerJoint = 3;
+static const size_t kInitialPaletteCapacity = 64 * 1024;
+// alpha tested texels below this are discarded
+static const float kAlphaTestCutoff = 0.5f;
+
+// joints at location 6 and weights at 7, see VertexFormat. 3-5 are the instance matrices MeshRenderer
+// uses, these meshes don't have them
+static const char* kSkinnedVertexSource = R"(
+	layout (location = 0) in vec3 a_position;
+	layout (location = 1) in vec3 a_normal;
+	layout (location = 2) in vec2 a_texcoord;
+	layout (location = 6) in uvec4 a_joints;
+	layout (location = 7) in vec4 a_weights;
+
+	out vec3 v_normal;
+	out vec2 v_texcoord;
+	out vec3 v_worldPosition;
+
+	uniform mat4 u_viewProjection;
+	uniform samplerBuffer u_palette;
+	uniform int u_firstJoint;
+	uniform int u_jointCount;
+
+	void main()
+	{
+		// the weighted sum of the joints' rows, still a 3x4 matrix
+		int base = u_firstJoint + gl_InstanceID * u_jointCount;
+		vec4 row0 = vec4(0.0);
+		vec4 row1 = vec4(0.0);
+		vec4 row2 = vec4(0.0);
+		for (int i = 0; i < 4; i++)
+		{
+			int texel = (base + int(a_joints[i])) * 3;
+			row0 += a_weights[i] * texelFetch(u_palette, texel + 0);
+			row1 += a_weights[i] * texelFetch(u_palette, texel + 1);
+			row2 += a_weights[i] * texelFetch(u_palette, texel + 2);
+		}
+
+		vec4 position = vec4(DecodePosition(a_position), 1.0);
+		vec3 worldPosition = vec3(dot(row0, position), dot(row1, position), dot(row2, position));
+		vec3 normal = DecodeNormal(a_normal);
+
+		gl_Position = u_viewProjection * vec4(worldPosition, 1.0);
+		v_worldPosition = worldPosition;
+		v_normal = vec3(dot(row0.xyz, normal), dot(row1.xyz, normal), dot(row2.xyz, normal));
+		v_texcoord = a_texcoord;
+	}
+)";
+
+void SkinnedMeshRenderer::Init()
+{
+	VertexFormat formats[2] = {
+		MakeVertexFormat(PositionEncoding::Float32, NormalEncoding::Float32, TexCoordEncoding::Float32, true),
+		MakeVertexFormat(PositionEncoding::Unorm16, NormalEncoding::Oct8, TexCoordEncoding::Half16, true)
+	};
+	for (int i = 0; i < 2; i++)
+	{
+		m_programs[i] = CreateMeshShaderProgram(formats[i], kSkinnedVertexSource);
+		glUseProgram(m_programs[i]);
+		glUniform1i(glGetUniformLocation(m_programs[i], "u_palette"), kPaletteTextureUnit);
+	}
+
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	m_maxPaletteJoints = std::max<size_t>(maxTexels / kRowsPerJoint, kMaxJoints);
+
+	m_paletteCapacity = std::min(kInitialPaletteCapacity, m_maxPaletteJoints);
+	glGenBuffers(1, &m_paletteBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_paletteCapacity * kRowsPerJoint * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &m_paletteTexture);
+	glActiveTexture(GL_TEXTURE0 + kPaletteTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_paletteBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void SkinnedMeshRenderer::Dispose()
+{
+	glDeleteTextures(1, &m_paletteTexture);
+	glDeleteBuffers(1, &m_paletteBuffer);
+	glDeleteProgram(m_programs[0]);
+	glDeleteProgram(m_programs[1]);
+	m_paletteCapacity = 0;
+}
+
+void SkinnedMeshRenderer::SetCamera(const glm::mat4& view, const glm::mat4& projection)
+{
+	m_viewProjection = projection * view;
+}
+
+void SkinnedMeshRenderer::Submit(const Mesh* mesh, Texture* texture, const JointMatrix* palette, int jointCount)
+{
+	if (mesh == nullptr || palette == nullptr || jointCount <= 0)
+		return;
+
+	m_items.push_back({ mesh, texture, palette, jointCount });
+}
+
+void SkinnedMeshRenderer::Render()
+{
+	auto startTime = std::chrono::steady_clock::now();
+	m_stats.drawCalls = 0;
+	m_stats.instances = (unsigned int)m_items.size();
+	m_stats.joints = 0;
+	m_stats.uploads = 0;
+
+	// grouped for instancing. a group has to share the joint count too, it's the palette stride
+	std::sort(m_items.begin(), m_items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.mesh != b.mesh) return a.mesh < b.mesh;
+		if (a.texture != b.texture) return a.texture < b.texture;
+		return a.jointCount < b.jointCount;
+	});
+
+	GLboolean blendWasEnabled = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+
+	// as many items as the texture buffer can address per upload, normally all of them
+	for (size_t first = 0; first < m_items.size();)
+	{
+		size_t joints = 0;
+		size_t last = first;
+		while (last < m_items.size() && joints + m_items[last].jointCount <= m_maxPaletteJoints)
+		{
+			joints += m_items[last].jointCount;
+			last++;
+		}
+
+		UploadPalettes(first, last);
+		DrawItems(first, last);
+		first = last;
+	}
+
+	if (blendWasEnabled)
+		glEnable(GL_BLEND);
+
+	glActiveTexture(GL_TEXTURE0 + kPaletteTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(0);
+	m_items.clear();
+
+	auto endTime = std::chrono::steady_clock::now();
+	m_stats.submitMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+}
+
+void SkinnedMeshRenderer::UploadPalettes(size_t first, size_t last)
+{
+	size_t joints = 0;
+	for (size_t i = first; i < last; i++)
+	{
+		joints += m_items[i].jointCount;
+	}
+
+	m_paletteData.resize(joints * kRowsPerJoint);
+	glm::vec4* out = m_paletteData.data();
+	for (size_t i = first; i < last; i++)
+	{
+		memcpy(out, m_items[i].palette, m_items[i].jointCount * sizeof(JointMatrix));
+		out += m_items[i].jointCount * kRowsPerJoint;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+	if (joints > m_paletteCapacity)
+	{
+		while (m_paletteCapacity < joints)
+			m_paletteCapacity *= 2;
+		m_paletteCapacity = std::min(m_paletteCapacity, m_maxPaletteJoints);
+	}
+	// orphan the previous contents instead of waiting for the GPU to finish with them
+	glBufferData(GL_TEXTURE_BUFFER, m_paletteCapacity * kRowsPerJoint * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, m_paletteData.size() * sizeof(glm::vec4), m_paletteData.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	m_stats.joints += (unsigned int)joints;
+	m_stats.uploads++;
+}
+
+void SkinnedMeshRenderer::DrawItems(size_t first, size_t last)
+{
+	glActiveTexture(GL_TEXTURE0 + kPaletteTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	GLuint currentProgram = 0;
+	const Mesh* currentMesh = nullptr;
+	size_t firstJoint = 0;
+
+	for (size_t begin = first; begin < last;)
+	{
+		const DrawItem& item = m_items[begin];
+
+		size_t end = begin + 1;
+		while (end < last && m_items[end].mesh == item.mesh && m_items[end].texture == item.texture && m_items[end].jointCount == item.jointCount)
+			end++;
+
+		GLuint program = GetProgram(item.mesh);
+		if (program != currentProgram)
+		{
+			SetupProgram(program);
+			currentProgram = program;
+			currentMesh = nullptr;
+		}
+
+		if (item.mesh != currentMesh)
+		{
+			item.mesh->SetDequantizationUniforms(program);
+			item.mesh->BindVertexArray();
+			currentMesh = item.mesh;
+		}
+
+		bool alphaTested = item.texture != nullptr && item.texture->GetAlphaMode() != AlphaMode::Opaque;
+		glUniform1f(glGetUniformLocation(program, "u_alphaCutoff"), alphaTested ? kAlphaTestCutoff : 0.0f);
+		glUniform1i(glGetUniformLocation(program, "u_useTexture"), item.texture != nullptr);
+		if (item.texture != nullptr)
+			item.texture->Bind();
+
+		glUniform1i(glGetUniformLocation(program, "u_firstJoint"), (GLint)firstJoint);
+		glUniform1i(glGetUniformLocation(program, "u_jointCount"), item.jointCount);
+		item.mesh->DrawInstanced((GLsizei)(end - begin));
+		m_stats.drawCalls++;
+
+		firstJoint += (end - begin) * item.jointCount;
+		begin = end;
+	}
+}
+
+GLuint SkinnedMeshRenderer::GetProgram(const Mesh* mesh) const
+{
+	return mesh->GetVertexFormat().normal == NormalEncoding::Float32 ? m_programs[0] : m_programs[1];
+}
+
+void SkinnedMeshRenderer::SetupProgram(GLuint program)
+{
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "u_viewProjection"), 1, false, glm::value_ptr(m_viewProjection));
+
+	if (m_lightClusters != nullptr)
+		m_lightClusters->Bind(program);
+	else
+		glUniform1i(glGetUniformLocation(program, "u_useClusters"), 0);
+}
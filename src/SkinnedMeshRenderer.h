@@ -0,0 +1,85 @@
+#pragma once
+
+// draws skinned meshes. the skinning happens in the vertex shader: every instance's palette (AnimationSystem's
+// world * model * inverse bind per joint) is copied into one texture buffer, 3 RGBA32F texels per joint, and
+// each vertex blends the matrices of its 4 joints. submissions are grouped by mesh/texture and each group is
+// one glDrawElementsInstanced, an instance finding its palette at u_firstJoint + gl_InstanceID * u_jointCount.
+// a frame with more joints than the driver's texture buffer limit is drawn in several uploads
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class LightClusters;
+class Mesh;
+class Texture;
+struct JointMatrix;
+
+struct SkinnedRenderStats
+{
+	unsigned int drawCalls;
+	unsigned int instances;
+	unsigned int joints;     // palette matrices uploaded
+	unsigned int uploads;    // times the palette buffer was refilled, 1 unless over the limit
+	double submitMs;         // CPU time spent issuing the frame, not GPU time
+};
+
+class SkinnedMeshRenderer
+{
+public:
+	SkinnedMeshRenderer() = default;
+	~SkinnedMeshRenderer() {}
+
+	// the palettes use texture unit kPaletteTextureUnit, after LightClusters' units
+	static const int kPaletteTextureUnit = 5;
+
+	void Init();
+	void Dispose();
+
+	// point lights binned for the same camera are added on top of the directional light
+	void SetLightClusters(const LightClusters* clusters) { m_lightClusters = clusters; }
+
+	void SetCamera(const glm::mat4& view, const glm::mat4& projection);
+
+	// the mesh needs a skinned vertex format with joint indices below jointCount. palette is jointCount
+	// matrices and is read in Render, so it has to stay valid until then. translucent textures are drawn
+	// alpha tested, without sorting
+	void Submit(const Mesh* mesh, Texture* texture, const JointMatrix* palette, int jointCount);
+
+	void Render();
+
+	const SkinnedRenderStats& GetStats() const { return m_stats; }
+
+private:
+	struct DrawItem
+	{
+		const Mesh* mesh;
+		Texture* texture;
+		const JointMatrix* palette;
+		int jointCount;
+	};
+
+	GLuint GetProgram(const Mesh* mesh) const;
+	void SetupProgram(GLuint program);
+	void UploadPalettes(size_t first, size_t last);
+	void DrawItems(size_t first, size_t last);
+
+	// [0] float normals, [1] octahedral normals
+	GLuint m_programs[2] = { 0, 0 };
+
+	const LightClusters* m_lightClusters = nullptr;
+
+	GLuint m_paletteBuffer = 0;
+	GLuint m_paletteTexture = 0;
+	size_t m_paletteCapacity = 0; // in joints
+	size_t m_maxPaletteJoints = 0; // GL_MAX_TEXTURE_BUFFER_SIZE / 3
+
+	std::vector<DrawItem> m_items;
+	std::vector<glm::vec4> m_paletteData; // 3 rows per joint, in draw order
+
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+
+	SkinnedRenderStats m_stats = { 0, 0, 0, 0, 0.0 };
+
+};
@@ -0,0 +1,81 @@
+#include "SpriteBenchmark.h"
+
+#include "SpriteKernels.h"
+#include "Vertex.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// in pixels, for positions up to ~1000. fma rounds differently from a multiply and an add, a few ulps at most
+static const float kMaxKernelError = 1e-3f;
+
+bool RunSpriteBenchmark(int count, int iterations)
+{
+	auto random = [](float range) { return rand() / (float)RAND_MAX * range; };
+	srand(1234);
+
+	// the same quads two ways: local vertices + a position, like a RenderObject, and as SpriteInstances
+	std::vector<SpriteInstance> sprites(count);
+	std::vector<std::vector<Vertex>> objectVertices(count);
+	std::vector<glm::vec2> objectPositions(count);
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec2 position(random(960.0f), random(540.0f));
+		glm::vec2 size(8.0f + random(24.0f), 8.0f + random(24.0f));
+		sprites[i] = MakeSpriteInstance(position, size, 0.0f, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+
+		glm::vec2 half = size * 0.5f;
+		objectVertices[i] = {
+			{ glm::vec2(-half.x, -half.y), glm::vec2(0.0f, 0.0f) },
+			{ glm::vec2(half.x, -half.y), glm::vec2(1.0f, 0.0f) },
+			{ glm::vec2(half.x, half.y), glm::vec2(1.0f, 1.0f) },
+			{ glm::vec2(-half.x, half.y), glm::vec2(0.0f, 1.0f) }
+		};
+		objectPositions[i] = position;
+	}
+
+	float kernelError = ValidateSpriteKernels();
+	bool kernelsMatch = kernelError <= kMaxKernelError;
+	printf("\n%d sprites, %d iterations\n", count, iterations);
+	printf("kernels vs scalar: max error %g, %s (tolerance %g)\n", kernelError, kernelsMatch ? "pass" : "FAIL", kMaxKernelError);
+	printf("path              ms/frame   ns/sprite\n");
+
+	// what Renderer::RenderObjects used to do per vertex
+	{
+		std::vector<Vertex> output;
+		auto startTime = std::chrono::steady_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			output.clear();
+			for (int i = 0; i < count; i++)
+			{
+				for (Vertex vertex : objectVertices[i]) {
+					vertex.position += objectPositions[i];
+					output.push_back(vertex);
+				}
+			}
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+		printf("push_back loop    %8.3f   %9.2f\n", ms, ms * 1e6 / count);
+	}
+
+	std::vector<Vertex> output(count * 4);
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		auto startTime = std::chrono::steady_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			GenerateSpriteVertices(level, sprites.data(), sprites.size(), output.data());
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+		printf("%-16s  %8.3f   %9.2f%s\n", GetSimdLevelName(level), ms, ms * 1e6 / count, level == GetBestSimdLevel() ? " (selected)" : "");
+	}
+
+	return kernelsMatch;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// times quad generation for count sprites on one thread: the old per-vertex copy and push_back loop over render
+// objects, then each sprite kernel the CPU supports. first checks the kernels against the scalar one and returns
+// false if they're further apart than float rounding explains. no GL needed
+bool RunSpriteBenchmark(int count, int iterations = 50);
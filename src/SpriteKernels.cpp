@@ -0,0 +1,202 @@
+#include "SpriteKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+SpriteInstance MakeSpriteInstance(const glm::vec2& position, const glm::vec2& size, float rotation, const glm::vec4& uvRect)
+{
+	SpriteInstance sprite;
+	sprite.position = position;
+	sprite.halfSize = size * 0.5f;
+	sprite.rotation = glm::vec2(cosf(rotation), sinf(rotation));
+	sprite.uvRect = uvRect;
+	return sprite;
+}
+
+static void GenerateScalar(const SpriteInstance* sprites, size_t count, Vertex* out)
+{
+	static const float kCornerX[4] = { -1.0f, 1.0f, 1.0f, -1.0f };
+	static const float kCornerY[4] = { -1.0f, -1.0f, 1.0f, 1.0f };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const SpriteInstance& sprite = sprites[i];
+		float c = sprite.rotation.x;
+		float s = sprite.rotation.y;
+
+		for (int k = 0; k < 4; k++)
+		{
+			float lx = kCornerX[k] * sprite.halfSize.x;
+			float ly = kCornerY[k] * sprite.halfSize.y;
+
+			Vertex& vertex = out[i * 4 + k];
+			vertex.position.x = sprite.position.x + c * lx - s * ly;
+			vertex.position.y = sprite.position.y + s * lx + c * ly;
+			vertex.texCoord.x = kCornerX[k] < 0.0f ? sprite.uvRect.x : sprite.uvRect.z;
+			vertex.texCoord.y = kCornerY[k] < 0.0f ? sprite.uvRect.y : sprite.uvRect.w;
+		}
+	}
+}
+
+#if defined(CPU_X86)
+
+// one sprite per iteration: x, y, u, v for the 4 corners in a register each, then transposed into 4 vertices
+static void GenerateSse(const SpriteInstance* sprites, size_t count, Vertex* out)
+{
+	const __m128 cornerX = _mm_setr_ps(-1.0f, 1.0f, 1.0f, -1.0f);
+	const __m128 cornerY = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+	float* output = &out[0].position.x;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const SpriteInstance& sprite = sprites[i];
+
+		__m128 lx = _mm_mul_ps(cornerX, _mm_set1_ps(sprite.halfSize.x));
+		__m128 ly = _mm_mul_ps(cornerY, _mm_set1_ps(sprite.halfSize.y));
+		__m128 c = _mm_set1_ps(sprite.rotation.x);
+		__m128 s = _mm_set1_ps(sprite.rotation.y);
+
+		__m128 x = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(sprite.position.x), _mm_mul_ps(c, lx)), _mm_mul_ps(s, ly));
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_set1_ps(sprite.position.y), _mm_mul_ps(s, lx)), _mm_mul_ps(c, ly));
+
+		__m128 uv = _mm_loadu_ps(&sprite.uvRect.x);
+		__m128 u = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(0, 2, 2, 0));
+		__m128 v = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(3, 3, 1, 1));
+
+		_MM_TRANSPOSE4_PS(x, y, u, v);
+		_mm_storeu_ps(output + 0, x);
+		_mm_storeu_ps(output + 4, y);
+		_mm_storeu_ps(output + 8, u);
+		_mm_storeu_ps(output + 12, v);
+		output += 16;
+	}
+}
+
+// two sprites per iteration, one in each 128 bit lane, otherwise the same as the SSE kernel
+CPU_TARGET_AVX2 static void GenerateAvx2(const SpriteInstance* sprites, size_t count, Vertex* out)
+{
+	const __m256 cornerX = _mm256_setr_ps(-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f);
+	const __m256 cornerY = _mm256_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f);
+	float* output = &out[0].position.x;
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		const SpriteInstance& a = sprites[i];
+		const SpriteInstance& b = sprites[i + 1];
+
+		__m256 lx = _mm256_mul_ps(cornerX, _mm256_setr_ps(a.halfSize.x, a.halfSize.x, a.halfSize.x, a.halfSize.x, b.halfSize.x, b.halfSize.x, b.halfSize.x, b.halfSize.x));
+		__m256 ly = _mm256_mul_ps(cornerY, _mm256_setr_ps(a.halfSize.y, a.halfSize.y, a.halfSize.y, a.halfSize.y, b.halfSize.y, b.halfSize.y, b.halfSize.y, b.halfSize.y));
+		__m256 c = _mm256_setr_ps(a.rotation.x, a.rotation.x, a.rotation.x, a.rotation.x, b.rotation.x, b.rotation.x, b.rotation.x, b.rotation.x);
+		__m256 s = _mm256_setr_ps(a.rotation.y, a.rotation.y, a.rotation.y, a.rotation.y, b.rotation.y, b.rotation.y, b.rotation.y, b.rotation.y);
+		__m256 px = _mm256_setr_ps(a.position.x, a.position.x, a.position.x, a.position.x, b.position.x, b.position.x, b.position.x, b.position.x);
+		__m256 py = _mm256_setr_ps(a.position.y, a.position.y, a.position.y, a.position.y, b.position.y, b.position.y, b.position.y, b.position.y);
+
+		__m256 x = _mm256_fmadd_ps(c, lx, _mm256_fnmadd_ps(s, ly, px));
+		__m256 y = _mm256_fmadd_ps(s, lx, _mm256_fmadd_ps(c, ly, py));
+
+		__m256 uv = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&a.uvRect.x)), _mm_loadu_ps(&b.uvRect.x), 1);
+		__m256 u = _mm256_permute_ps(uv, _MM_SHUFFLE(0, 2, 2, 0));
+		__m256 v = _mm256_permute_ps(uv, _MM_SHUFFLE(3, 3, 1, 1));
+
+		// 4x4 transpose within each lane
+		__m256 xy01 = _mm256_unpacklo_ps(x, y);
+		__m256 xy23 = _mm256_unpackhi_ps(x, y);
+		__m256 uv01 = _mm256_unpacklo_ps(u, v);
+		__m256 uv23 = _mm256_unpackhi_ps(u, v);
+		__m256 v0 = _mm256_shuffle_ps(xy01, uv01, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 v1 = _mm256_shuffle_ps(xy01, uv01, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 v2 = _mm256_shuffle_ps(xy23, uv23, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 v3 = _mm256_shuffle_ps(xy23, uv23, _MM_SHUFFLE(3, 2, 3, 2));
+
+		// low lanes are sprite a's vertices, high lanes sprite b's
+		_mm256_storeu_ps(output + 0, _mm256_permute2f128_ps(v0, v1, 0x20));
+		_mm256_storeu_ps(output + 8, _mm256_permute2f128_ps(v2, v3, 0x20));
+		_mm256_storeu_ps(output + 16, _mm256_permute2f128_ps(v0, v1, 0x31));
+		_mm256_storeu_ps(output + 24, _mm256_permute2f128_ps(v2, v3, 0x31));
+		output += 32;
+	}
+
+	if (i < count)
+		GenerateSse(sprites + i, count - i, out + i * 4);
+}
+
+#endif
+
+void GenerateSpriteVertices(const SpriteInstance* sprites, size_t count, Vertex* out)
+{
+	GenerateSpriteVertices(GetBestSimdLevel(), sprites, count, out);
+}
+
+void GenerateSpriteVertices(SimdLevel level, const SpriteInstance* sprites, size_t count, Vertex* out)
+{
+	if (count == 0)
+		return;
+
+	switch (level)
+	{
+#if defined(CPU_X86)
+	case SimdLevel::Sse: GenerateSse(sprites, count, out); break;
+	case SimdLevel::Avx2: GenerateAvx2(sprites, count, out); break;
+#endif
+	default: GenerateScalar(sprites, count, out); break;
+	}
+}
+
+void GenerateSpriteIndices(size_t count, unsigned int firstVertex, unsigned int* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int base = firstVertex + (unsigned int)i * 4;
+		out[0] = base + 0;
+		out[1] = base + 1;
+		out[2] = base + 2;
+		out[3] = base + 2;
+		out[4] = base + 3;
+		out[5] = base + 0;
+		out += 6;
+	}
+}
+
+float ValidateSpriteKernels(size_t count, unsigned int seed)
+{
+	// mt19937's sequence is fixed by the standard, unlike rand's
+	std::mt19937 generator(seed);
+	auto random = [&generator](float range) { return ((float)generator() / (float)std::mt19937::max() * 2.0f - 1.0f) * range; };
+
+	std::vector<SpriteInstance> sprites(count);
+	for (SpriteInstance& sprite : sprites)
+	{
+		sprite = MakeSpriteInstance(glm::vec2(random(1000.0f), random(1000.0f)), glm::vec2(1.0f + fabsf(random(64.0f)), 1.0f + fabsf(random(64.0f))),
+			random(3.14159265f), glm::vec4(fabsf(random(0.5f)), fabsf(random(0.5f)), 0.5f + fabsf(random(0.5f)), 0.5f + fabsf(random(0.5f))));
+	}
+
+	std::vector<Vertex> reference(count * 4);
+	std::vector<Vertex> result(count * 4);
+	GenerateSpriteVertices(SimdLevel::Scalar, sprites.data(), count, reference.data());
+
+	// fma rounds differently from a separate multiply and add, so an exact match isn't expected
+	float maxError = 0.0f;
+	const SimdLevel levels[] = { SimdLevel::Sse, SimdLevel::Avx2 };
+	for (SimdLevel level : levels)
+	{
+		if (!IsSimdLevelSupported(level))
+			continue;
+
+		GenerateSpriteVertices(level, sprites.data(), count, result.data());
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			maxError = std::max(maxError, glm::length(result[i].position - reference[i].position));
+			maxError = std::max(maxError, glm::length(result[i].texCoord - reference[i].texCoord));
+		}
+	}
+
+	return maxError;
+}
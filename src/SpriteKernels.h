@@ -0,0 +1,34 @@
+#pragma once
+
+// builds sprite quads (4 vertices, 6 indices each) from compact sprite descriptions straight into a preallocated
+// output, with SSE and AVX2 versions picked at runtime from the CPU's features and a scalar one for reference
+// and for anything that isn't x86
+
+#include "CpuFeatures.h"
+#include "Vertex.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+struct SpriteInstance
+{
+	glm::vec2 position; // centre
+	glm::vec2 halfSize;
+	glm::vec2 rotation; // cos and sin of the angle, so the kernels don't need trig
+	glm::vec4 uvRect;   // u0, v0, u1, v1
+};
+
+// size is the full width/height, rotation in radians around the centre
+SpriteInstance MakeSpriteInstance(const glm::vec2& position, const glm::vec2& size, float rotation, const glm::vec4& uvRect);
+
+// GetBestSimdLevel's kernel unless one is given. corners go top left, top right, bottom right, bottom left (before rotation). out needs room for 4 * count
+void GenerateSpriteVertices(const SpriteInstance* sprites, size_t count, Vertex* out);
+void GenerateSpriteVertices(SimdLevel level, const SpriteInstance* sprites, size_t count, Vertex* out);
+
+// 0 1 2, 2 3 0 per quad, offset by firstVertex. out needs room for 6 * count
+void GenerateSpriteIndices(size_t count, unsigned int firstVertex, unsigned int* out);
+
+// runs every supported kernel over count random sprites, the same ones for a given seed on every platform, and
+// returns the largest difference from the scalar kernel in pixels/uv units
+float ValidateSpriteKernels(size_t count = 1024, unsigned int seed = 1234);
@@ -0,0 +1,194 @@
+#include "SpriteLayer.h"
+
+#include "Texture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+static const unsigned int kInitialSlots = 256;
+// dirty slots closer together than this go up as one range, a few unchanged quads are cheaper than another call
+static const unsigned int kMaxPatchGap = 16;
+
+void SpriteLayer::Dispose()
+{
+	if (m_vertexArrayId == 0)
+		return;
+
+	glDeleteBuffers(1, &m_vertexBufferId);
+	glDeleteBuffers(1, &m_indexBufferId);
+	glDeleteVertexArrays(1, &m_vertexArrayId);
+	m_vertexArrayId = 0;
+	m_vertexBufferId = 0;
+	m_indexBufferId = 0;
+	m_capacity = 0;
+}
+
+SpriteHandle SpriteLayer::Add(const SpriteInstance& sprite)
+{
+	SpriteHandle handle;
+	if (!m_freeSlots.empty())
+	{
+		handle = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		m_sprites[handle] = sprite;
+	}
+	else
+	{
+		handle = (SpriteHandle)m_sprites.size();
+		m_sprites.push_back(sprite);
+		m_live.push_back(0);
+		m_dirty.push_back(0);
+	}
+
+	m_live[handle] = 1;
+	m_maxSpriteSize = glm::max(m_maxSpriteSize, sprite.halfSize * 2.0f);
+	MarkDirty(handle);
+	return handle;
+}
+
+void SpriteLayer::Update(SpriteHandle handle, const SpriteInstance& sprite)
+{
+	assert(handle < m_sprites.size() && m_live[handle]);
+
+	m_sprites[handle] = sprite;
+	m_maxSpriteSize = glm::max(m_maxSpriteSize, sprite.halfSize * 2.0f);
+	MarkDirty(handle);
+}
+
+void SpriteLayer::Remove(SpriteHandle handle)
+{
+	assert(handle < m_sprites.size() && m_live[handle]);
+
+	// the slot stays in the buffer as a zero sized quad until it's reused
+	m_sprites[handle] = MakeSpriteInstance(glm::vec2(0.0f), glm::vec2(0.0f), 0.0f, glm::vec4(0.0f));
+	m_live[handle] = 0;
+	m_freeSlots.push_back(handle);
+	MarkDirty(handle);
+}
+
+void SpriteLayer::MarkDirty(SpriteHandle handle)
+{
+	if (m_dirty[handle])
+		return;
+
+	m_dirty[handle] = 1;
+	m_dirtySlots.push_back(handle);
+}
+
+void SpriteLayer::Record(RenderPacket& packet)
+{
+	SpriteLayerDraw draw;
+	draw.layer = this;
+	draw.slotCount = (unsigned int)m_sprites.size();
+	draw.firstPatch = (unsigned int)packet.layerPatches.size();
+	draw.patchCount = 0;
+	draw.maxSpriteSize = m_maxSpriteSize;
+
+	// coalesce the dirty slots into ranges and generate each range's quads straight into the packet
+	std::sort(m_dirtySlots.begin(), m_dirtySlots.end());
+	for (size_t i = 0; i < m_dirtySlots.size();)
+	{
+		SpriteHandle first = m_dirtySlots[i];
+		SpriteHandle last = first;
+		while (++i < m_dirtySlots.size() && m_dirtySlots[i] - last <= kMaxPatchGap)
+			last = m_dirtySlots[i];
+
+		unsigned int slotCount = last - first + 1;
+		unsigned int firstVertex = (unsigned int)packet.layerVertices.size();
+		packet.layerVertices.resize(firstVertex + slotCount * 4);
+		GenerateSpriteVertices(&m_sprites[first], slotCount, &packet.layerVertices[firstVertex]);
+
+		packet.layerPatches.push_back({ first, slotCount, firstVertex });
+		draw.patchCount++;
+	}
+
+	for (SpriteHandle handle : m_dirtySlots)
+	{
+		m_dirty[handle] = 0;
+	}
+	m_dirtySlots.clear();
+
+	packet.spriteLayers.push_back(draw);
+}
+
+void SpriteLayer::ApplyPatches(const SpriteLayerPatch* patches, size_t count, const Vertex* vertices)
+{
+	m_uploadBytes = 0;
+	if (count == 0)
+		return;
+
+	unsigned int slotCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		slotCount = std::max(slotCount, patches[i].firstSlot + patches[i].slotCount);
+	}
+	Reserve(slotCount);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+	for (size_t i = 0; i < count; i++)
+	{
+		const SpriteLayerPatch& patch = patches[i];
+		size_t bytes = patch.slotCount * 4 * sizeof(Vertex);
+		glBufferSubData(GL_ARRAY_BUFFER, patch.firstSlot * 4 * sizeof(Vertex), bytes, &vertices[patch.firstVertex]);
+		m_uploadBytes += bytes;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SpriteLayer::Reserve(unsigned int slotCount)
+{
+	if (slotCount <= m_capacity)
+		return;
+
+	unsigned int capacity = std::max(m_capacity, kInitialSlots);
+	while (capacity < slotCount)
+		capacity *= 2;
+
+	if (m_vertexArrayId == 0)
+	{
+		glGenVertexArrays(1, &m_vertexArrayId);
+		glGenBuffers(1, &m_indexBufferId);
+	}
+	glBindVertexArray(m_vertexArrayId);
+
+	// a new vertex buffer with the old quads copied over on the GPU, nothing is uploaded again
+	GLuint vertexBufferId;
+	glGenBuffers(1, &vertexBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+	glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+	if (m_vertexBufferId != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, m_vertexBufferId);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, 0, m_capacity * 4 * sizeof(Vertex));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &m_vertexBufferId);
+	}
+	m_vertexBufferId = vertexBufferId;
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+
+	// the indices only depend on the slot count
+	std::vector<unsigned int> indices(capacity * 6);
+	GenerateSpriteIndices(capacity, 0, indices.data());
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_capacity = capacity;
+}
+
+void SpriteLayer::Draw(unsigned int slotCount)
+{
+	if (slotCount == 0 || m_vertexArrayId == 0)
+		return;
+
+	m_texture->Bind();
+	glBindVertexArray(m_vertexArrayId);
+	glDrawElements(GL_TRIANGLES, std::min(slotCount, m_capacity) * 6, GL_UNSIGNED_INT, (void*)0);
+	glBindVertexArray(0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// retained sprites for things that rarely change (backgrounds, scenery). sprites are added once and get a
+// handle back, and their quads stay in a GPU buffer owned by the layer. only the slots touched since the
+// last frame are regenerated and uploaded, merged into a few ranges, so a static layer costs one draw and no
+// uploads per frame. one texture per layer, layers draw in the order they were recorded, before the
+// streamed sprites.
+// like Tilemap the layer is split in two: Add/Update/Remove and Record run on the simulation thread and
+// the patches reach the GL side (ApplyPatches/Draw) through the RenderPacket
+
+#include "RenderPacket.h"
+#include "SpriteKernels.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Texture;
+
+// slot index, reused once the sprite is removed
+typedef uint32_t SpriteHandle;
+static const SpriteHandle kInvalidSpriteHandle = 0xffffffff;
+
+class SpriteLayer
+{
+public:
+	explicit SpriteLayer(Texture* texture) : m_texture(texture) {}
+	~SpriteLayer() {}
+
+	void Dispose(); // needs the GL context
+
+	// simulation side
+	SpriteHandle Add(const SpriteInstance& sprite);
+	void Update(SpriteHandle handle, const SpriteInstance& sprite);
+	void Remove(SpriteHandle handle);
+	const SpriteInstance& Get(SpriteHandle handle) const { return m_sprites[handle]; }
+
+	// generates the vertices of every slot changed since the last Record into the packet and queues a draw
+	void Record(RenderPacket& packet);
+
+	// render side
+	void ApplyPatches(const SpriteLayerPatch* patches, size_t count, const Vertex* vertices);
+	void Draw(unsigned int slotCount);
+
+	Texture* GetTexture() const { return m_texture; }
+	unsigned int GetCount() const { return (unsigned int)(m_sprites.size() - m_freeSlots.size()); }
+	size_t GetUploadBytes() const { return m_uploadBytes; } // by the last ApplyPatches
+
+private:
+	void Reserve(unsigned int slotCount); // render side
+	void MarkDirty(SpriteHandle handle);
+
+	Texture* m_texture;
+
+	// simulation side
+	std::vector<SpriteInstance> m_sprites;
+	std::vector<uint8_t> m_live;
+	std::vector<uint8_t> m_dirty;
+	std::vector<SpriteHandle> m_freeSlots;
+	std::vector<SpriteHandle> m_dirtySlots;
+	glm::vec2 m_maxSpriteSize = glm::vec2(0.0f);
+
+	// render side
+	GLuint m_vertexArrayId = 0;
+	GLuint m_vertexBufferId = 0;
+	GLuint m_indexBufferId = 0;
+	unsigned int m_capacity = 0; // in slots
+	size_t m_uploadBytes = 0;
+
+};
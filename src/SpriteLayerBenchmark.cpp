@@ -0,0 +1,168 @@
+#include "SpriteLayerBenchmark.h"
+
+#include "RenderPacket.h"
+#include "Renderer.h"
+#include "ResourceManager.h"
+#include "SpriteKernels.h"
+#include "SpriteLayer.h"
+#include "Texture.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+enum class LayerBenchmarkMode
+{
+	Streamed,
+	StaticLayer,
+	AllLayers
+};
+
+struct LayerBenchmarkResult
+{
+	unsigned int spriteDraws;
+	double uploadBytes;
+	double cpuMs;
+	double frameMs;
+};
+
+struct LayerBenchmarkSprite
+{
+	glm::vec2 position;
+	glm::vec2 size;
+	glm::vec2 velocity;
+};
+
+static LayerBenchmarkResult RunPass(SDL_Window* window, Renderer& renderer, const glm::vec2& viewSize, Texture& background, Texture& mover,
+	const std::vector<LayerBenchmarkSprite>& staticSprites, std::vector<LayerBenchmarkSprite> movingSprites, int frames, LayerBenchmarkMode mode)
+{
+	LayerBenchmarkResult result = { 0, 0.0, 0.0, 0.0 };
+	RenderPacket packet;
+	const glm::vec4 fullUv(0.0f, 0.0f, 1.0f, 1.0f);
+
+	SpriteLayer staticLayer(&background);
+	SpriteLayer movingLayer(&mover);
+	std::vector<SpriteHandle> movingHandles;
+	if (mode != LayerBenchmarkMode::Streamed)
+	{
+		for (const LayerBenchmarkSprite& sprite : staticSprites)
+		{
+			staticLayer.Add(MakeSpriteInstance(sprite.position, sprite.size, 0.0f, fullUv));
+		}
+	}
+	if (mode == LayerBenchmarkMode::AllLayers)
+	{
+		for (const LayerBenchmarkSprite& sprite : movingSprites)
+		{
+			movingHandles.push_back(movingLayer.Add(MakeSpriteInstance(sprite.position, sprite.size, 0.0f, fullUv)));
+		}
+	}
+
+	// the layers are uploaded during the warm up frames, the one off cost isn't part of the averages
+	const int warmupFrames = 10;
+	for (int frame = 0; frame < warmupFrames + frames; frame++)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < movingSprites.size(); i++)
+		{
+			LayerBenchmarkSprite& sprite = movingSprites[i];
+			sprite.position += sprite.velocity;
+			sprite.position = glm::mod(sprite.position, viewSize);
+
+			if (mode == LayerBenchmarkMode::AllLayers)
+				movingLayer.Update(movingHandles[i], MakeSpriteInstance(sprite.position, sprite.size, 0.0f, fullUv));
+			else
+				renderer.AddSprite(MakeSpriteInstance(sprite.position, sprite.size, 0.0f, fullUv), &mover);
+		}
+
+		if (mode == LayerBenchmarkMode::Streamed)
+		{
+			for (const LayerBenchmarkSprite& sprite : staticSprites)
+			{
+				renderer.AddSprite(MakeSpriteInstance(sprite.position, sprite.size, 0.0f, fullUv), &background);
+			}
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		packet.Clear();
+		if (mode != LayerBenchmarkMode::Streamed)
+			staticLayer.Record(packet);
+		if (mode == LayerBenchmarkMode::AllLayers)
+			movingLayer.Record(packet);
+		renderer.RecordFrame(packet);
+		renderer.DrawFrame(packet);
+
+		auto cpuEnd = std::chrono::steady_clock::now();
+
+		SDL_GL_SwapWindow(window);
+		glFinish();
+
+		auto endTime = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames)
+		{
+			const RendererStats& stats = renderer.GetStats();
+			result.spriteDraws = stats.spriteDraws;
+			result.uploadBytes += (double)(stats.streamedBytes + stats.retainedBytes);
+			result.cpuMs += std::chrono::duration<double, std::milli>(cpuEnd - startTime).count();
+			result.frameMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+		}
+
+		SDL_PumpEvents();
+	}
+
+	staticLayer.Dispose();
+	movingLayer.Dispose();
+
+	result.uploadBytes /= frames;
+	result.cpuMs /= frames;
+	result.frameMs /= frames;
+	return result;
+}
+
+void RunSpriteLayerBenchmark(SDL_Window* window, Renderer& renderer, const glm::vec2& viewSize, int count, int frames)
+{
+	Texture background;
+	Texture mover;
+	const std::string& directory = ResourceManager::GetTextureDirectory();
+	if (!background.LoadFromFile((directory + "Grass.png").c_str()) || !mover.LoadFromFile((directory + "Wizard.png").c_str()))
+		return;
+
+	auto random = [](float range) { return rand() / (float)RAND_MAX * range; };
+	srand(1234);
+
+	std::vector<LayerBenchmarkSprite> staticSprites(count);
+	for (LayerBenchmarkSprite& sprite : staticSprites)
+	{
+		sprite.position = glm::vec2(random(viewSize.x), random(viewSize.y));
+		sprite.size = glm::vec2(8.0f + random(24.0f));
+		sprite.velocity = glm::vec2(0.0f);
+	}
+
+	std::vector<LayerBenchmarkSprite> movingSprites(std::max(1, count / 100));
+	for (LayerBenchmarkSprite& sprite : movingSprites)
+	{
+		sprite.position = glm::vec2(random(viewSize.x), random(viewSize.y));
+		sprite.size = glm::vec2(16.0f);
+		sprite.velocity = glm::vec2(random(2.0f) - 1.0f, random(2.0f) - 1.0f);
+	}
+
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+	LayerBenchmarkResult streamed = RunPass(window, renderer, viewSize, background, mover, staticSprites, movingSprites, frames, LayerBenchmarkMode::Streamed);
+	LayerBenchmarkResult staticLayer = RunPass(window, renderer, viewSize, background, mover, staticSprites, movingSprites, frames, LayerBenchmarkMode::StaticLayer);
+	LayerBenchmarkResult allLayers = RunPass(window, renderer, viewSize, background, mover, staticSprites, movingSprites, frames, LayerBenchmarkMode::AllLayers);
+
+	printf("\n%d static + %d moving sprites, %d frames\n", count, (int)movingSprites.size(), frames);
+	printf("                   sprite draws   upload (KB/frame)   CPU (ms)   frame (ms)\n");
+	printf("all streamed       %12u   %17.1f   %8.3f   %10.3f\n", streamed.spriteDraws, streamed.uploadBytes / 1024.0, streamed.cpuMs, streamed.frameMs);
+	printf("static layer       %12u   %17.1f   %8.3f   %10.3f\n", staticLayer.spriteDraws, staticLayer.uploadBytes / 1024.0, staticLayer.cpuMs, staticLayer.frameMs);
+	printf("all in layers      %12u   %17.1f   %8.3f   %10.3f\n", allLayers.spriteDraws, allLayers.uploadBytes / 1024.0, allLayers.cpuMs, allLayers.frameMs);
+}
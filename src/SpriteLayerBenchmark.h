@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL.h>
+#include <glm/glm.hpp>
+
+class Renderer;
+
+// a mostly static scene: count background sprites plus a hundredth as many moving ones. drawn with everything
+// streamed through Renderer::AddSprite each frame, then with the background in a SpriteLayer and the movers
+// streamed, then with the movers in a layer too. prints upload bytes, sprite draws and CPU/frame time per frame.
+// viewSize is the area the renderer's projection covers. needs a current GL context
+void RunSpriteLayerBenchmark(SDL_Window* window, Renderer& renderer, const glm::vec2& viewSize, int count, int frames = 300);
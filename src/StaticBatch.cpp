@@ -0,0 +1,184 @@
+#include "StaticBatch.h"
+
+#include "Frustum.h"
+#include "Mesh.h"
+#include "Renderable.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <tuple>
+
+StaticBatch::~StaticBatch()
+{
+	Release();
+}
+
+void StaticBatch::Release()
+{
+	glDeleteVertexArrays(1, &m_vertexArrayId);
+	glDeleteBuffers(1, &m_vertexBufferId);
+	glDeleteBuffers(1, &m_indexBufferId);
+	m_vertexArrayId = 0;
+	m_vertexBufferId = 0;
+	m_indexBufferId = 0;
+
+	m_chunks.clear();
+	m_textures.clear();
+	m_stats = StaticBatchStats();
+}
+
+void StaticBatch::Build(const std::vector<const iRenderable*>& objects, float chunkSize)
+{
+	Release();
+
+	// bucket by the cell the object's centre falls in, then by texture
+	typedef std::tuple<int, int, int> tCell;
+	std::map<tCell, std::map<Texture*, std::vector<const iRenderable*>>> cells;
+
+	for (const iRenderable* object : objects)
+	{
+		const Mesh* mesh = object->GetMesh();
+		if (mesh == nullptr || mesh->GetVertices().empty())
+		{
+			printf("StaticBatch: skipping object without CPU geometry (load the mesh with keepGeometry)\n");
+			continue;
+		}
+
+		glm::vec3 center = glm::vec3(object->GetTransform() * glm::vec4(mesh->GetBoundsCenter(), 1.0f));
+		tCell cell((int)floorf(center.x / chunkSize), (int)floorf(center.y / chunkSize), (int)floorf(center.z / chunkSize));
+		cells[cell][object->GetTexture()].push_back(object);
+		m_stats.objects++;
+	}
+
+	for (const auto& cell : cells)
+	{
+		for (const auto& group : cell.second)
+		{
+			if (std::find(m_textures.begin(), m_textures.end(), group.first) == m_textures.end())
+				m_textures.push_back(group.first);
+		}
+	}
+
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices;
+
+	for (const auto& cell : cells)
+	{
+		Chunk chunk;
+		chunk.boundsMin = glm::vec3(FLT_MAX);
+		chunk.boundsMax = glm::vec3(-FLT_MAX);
+
+		for (const auto& group : cell.second)
+		{
+			ChunkRange range;
+			range.texture = (unsigned int)(std::find(m_textures.begin(), m_textures.end(), group.first) - m_textures.begin());
+			range.indexOffset = (unsigned int)indices.size();
+
+			for (const iRenderable* object : group.second)
+			{
+				const Mesh* mesh = object->GetMesh();
+				const glm::mat4& transform = object->GetTransform();
+				glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+				unsigned int baseVertex = (unsigned int)vertices.size();
+				for (const MeshVertex& source : mesh->GetVertices())
+				{
+					MeshVertex vertex;
+					vertex.position = glm::vec3(transform * glm::vec4(source.position, 1.0f));
+					vertex.normal = glm::normalize(normalTransform * source.normal);
+					vertex.texCoord = source.texCoord;
+					vertices.push_back(vertex);
+
+					chunk.boundsMin = glm::min(chunk.boundsMin, vertex.position);
+					chunk.boundsMax = glm::max(chunk.boundsMax, vertex.position);
+				}
+
+				// full detail only, the lods that follow it in the index list aren't needed
+				const std::vector<unsigned int>& meshIndices = mesh->GetIndices();
+				for (int i = 0; i < 3 * mesh->NumTriangles(); i++)
+				{
+					indices.push_back(baseVertex + meshIndices[i]);
+				}
+			}
+
+			range.indexCount = (unsigned int)indices.size() - range.indexOffset;
+			chunk.ranges.push_back(range);
+		}
+
+		m_chunks.push_back(chunk);
+	}
+
+	glGenVertexArrays(1, &m_vertexArrayId);
+	glBindVertexArray(m_vertexArrayId);
+
+	glGenBuffers(1, &m_vertexBufferId);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_indexBufferId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	SetupVertexAttributes(GetFullVertexFormat());
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	m_drawCounts.assign(m_textures.size(), std::vector<GLsizei>());
+	m_drawOffsets.assign(m_textures.size(), std::vector<const void*>());
+
+	m_stats.chunks = (unsigned int)m_chunks.size();
+	m_stats.triangles = indices.size() / 3;
+	m_stats.memoryBytes = vertices.size() * sizeof(MeshVertex) + indices.size() * sizeof(unsigned int);
+
+	printf("Static batch: %u objects -> %u chunks, %u textures, %" PRIu64 " triangles, %.1f MB\n",
+		m_stats.objects, m_stats.chunks, (unsigned int)m_textures.size(), m_stats.triangles, m_stats.memoryBytes / (1024.0f * 1024.0f));
+}
+
+void StaticBatch::Draw(const Frustum& frustum, const std::function<void(Texture*)>& bindTexture)
+{
+	m_stats.visibleChunks = 0;
+	m_stats.drawCalls = 0;
+	m_stats.visibleTriangles = 0;
+
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		m_drawCounts[i].clear();
+		m_drawOffsets[i].clear();
+	}
+
+	// gather the visible ranges per texture
+	for (const Chunk& chunk : m_chunks)
+	{
+		if (!frustum.IntersectsAabb(chunk.boundsMin, chunk.boundsMax))
+			continue;
+
+		m_stats.visibleChunks++;
+		for (const ChunkRange& range : chunk.ranges)
+		{
+			m_drawCounts[range.texture].push_back(range.indexCount);
+			m_drawOffsets[range.texture].push_back((const void*)(range.indexOffset * sizeof(unsigned int)));
+			m_stats.visibleTriangles += range.indexCount / 3;
+		}
+	}
+
+	glBindVertexArray(m_vertexArrayId);
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_drawCounts[i].empty())
+			continue;
+
+		if (bindTexture)
+			bindTexture(m_textures[i]);
+
+		glMultiDrawElements(GL_TRIANGLES, m_drawCounts[i].data(), GL_UNSIGNED_INT, m_drawOffsets[i].data(), (GLsizei)m_drawCounts[i].size());
+		m_stats.drawCalls++;
+	}
+	glBindVertexArray(0);
+}
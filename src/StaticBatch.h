@@ -0,0 +1,76 @@
+#pragma once
+
+// merges scenery that never moves into big pre-transformed vertex/index buffers at load time.
+// objects are bucketed into a grid of chunkSize cells so the result can still be frustum culled, and within
+// a chunk everything sharing a texture is one contiguous index range. drawing is one glMultiDrawElements
+// per texture over the visible chunks. bigger chunks = fewer draws but coarser culling
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Frustum;
+class iRenderable;
+class Texture;
+
+struct StaticBatchStats
+{
+	unsigned int objects;
+	unsigned int chunks;
+	uint64_t triangles; // the whole batch
+	size_t memoryBytes;
+	// last Draw
+	unsigned int visibleChunks;
+	unsigned int drawCalls;
+	uint64_t visibleTriangles; // in the ranges drawn
+};
+
+class StaticBatch
+{
+public:
+	StaticBatch() = default;
+	~StaticBatch();
+
+	// the objects' meshes must have been loaded with keepGeometry. transforms are baked in, so call
+	// UpdateTransform on them first. can be called again to rebuild
+	void Build(const std::vector<const iRenderable*>& objects, float chunkSize);
+
+	// expects a program using MeshRenderer's vertex layout with identity instance rows bound (see MeshRenderer::RenderStatic)
+	void Draw(const Frustum& frustum, const std::function<void(Texture*)>& bindTexture);
+
+	const StaticBatchStats& GetStats() const { return m_stats; }
+
+private:
+	struct ChunkRange
+	{
+		unsigned int texture; // into m_textures
+		unsigned int indexOffset;
+		unsigned int indexCount;
+	};
+
+	struct Chunk
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		std::vector<ChunkRange> ranges;
+	};
+
+	void Release();
+
+	GLuint m_vertexArrayId = 0;
+	GLuint m_vertexBufferId = 0;
+	GLuint m_indexBufferId = 0;
+
+	std::vector<Chunk> m_chunks;
+	std::vector<Texture*> m_textures; // every texture used, draw order
+
+	// per draw scratch
+	std::vector<std::vector<GLsizei>> m_drawCounts;
+	std::vector<std::vector<const void*>> m_drawOffsets;
+
+	StaticBatchStats m_stats = {};
+
+};
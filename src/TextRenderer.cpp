@@ -0,0 +1,185 @@
+#include "TextRenderer.h"
+
+#include "Font.h"
+#include "Renderer.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+// a label not drawn for this many frames is dropped from the cache
+static const unsigned int kEvictFrames = 120;
+static const unsigned int kEvictInterval = 30;
+static const size_t kInitialTableSize = 256;
+static const size_t kMaxFormattedLength = 256;
+
+static uint64_t HashText(const Font* font, float scale, const char* text)
+{
+	// FNV-1a over the characters, then the style
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* c = text; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+	}
+
+	uint32_t scaleBits;
+	memcpy(&scaleBits, &scale, sizeof(scaleBits));
+	hash = (hash ^ scaleBits) * 1099511628211ull;
+	hash = (hash ^ (uint64_t)(uintptr_t)font) * 1099511628211ull;
+	return hash;
+}
+
+void TextRenderer::DrawText(Font& font, const glm::vec2& position, float scale, const char* text)
+{
+	const CachedText& entry = GetLayout(font, scale, text);
+	if (!entry.glyphs.empty())
+		m_renderer->AddSprites(entry.glyphs.data(), entry.glyphs.size(), font.GetTexture(), position);
+
+	m_stats.labels++;
+	m_stats.glyphs += (unsigned int)entry.glyphs.size();
+}
+
+void TextRenderer::DrawFormat(Font& font, const glm::vec2& position, float scale, const char* format, ...)
+{
+	char buffer[kMaxFormattedLength];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	DrawText(font, position, scale, buffer);
+}
+
+glm::vec2 TextRenderer::MeasureText(Font& font, float scale, const char* text)
+{
+	return GetLayout(font, scale, text).size;
+}
+
+void TextRenderer::EndFrame()
+{
+	m_frame++;
+	m_stats.labels = 0;
+	m_stats.glyphs = 0;
+	m_stats.layouts = 0;
+
+	if (m_frame % kEvictInterval != 0)
+		return;
+
+	// evicted entries keep their buffers for the next new label. the table has no tombstones, it's rebuilt instead
+	bool evicted = false;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		CachedText& entry = m_entries[i];
+		if (entry.live && m_frame - entry.lastUsedFrame > kEvictFrames)
+		{
+			entry.live = false;
+			m_freeEntries.push_back((unsigned int)i);
+			m_liveEntries--;
+			evicted = true;
+		}
+	}
+
+	if (evicted)
+		Rehash(m_table.size());
+
+	m_stats.cachedStrings = m_liveEntries;
+}
+
+const TextRenderer::CachedText& TextRenderer::GetLayout(Font& font, float scale, const char* text)
+{
+	if (m_table.empty())
+		Rehash(kInitialTableSize);
+
+	uint64_t hash = HashText(&font, scale, text);
+	size_t mask = m_table.size() - 1;
+	size_t slot = (size_t)hash & mask;
+	while (m_table[slot] >= 0)
+	{
+		CachedText& entry = m_entries[m_table[slot]];
+		if (entry.hash == hash && entry.font == &font && entry.scale == scale && strcmp(entry.text.c_str(), text) == 0)
+		{
+			entry.lastUsedFrame = m_frame;
+			return entry;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// not cached, lay it out into a free entry
+	unsigned int index;
+	if (!m_freeEntries.empty())
+	{
+		index = m_freeEntries.back();
+		m_freeEntries.pop_back();
+	}
+	else
+	{
+		index = (unsigned int)m_entries.size();
+		m_entries.emplace_back();
+	}
+
+	CachedText& entry = m_entries[index];
+	entry.hash = hash;
+	entry.font = &font;
+	entry.scale = scale;
+	entry.text.assign(text);
+	entry.lastUsedFrame = m_frame;
+	entry.live = true;
+	Layout(font, scale, text, entry);
+
+	m_table[slot] = (int)index;
+	m_liveEntries++;
+	m_stats.layouts++;
+	m_stats.cachedStrings = m_liveEntries;
+
+	// keep the table at most half full so probes stay short
+	if (m_liveEntries * 2 > m_table.size())
+		Rehash(m_table.size() * 2);
+
+	return entry;
+}
+
+void TextRenderer::Layout(Font& font, float scale, const char* text, CachedText& entry)
+{
+	entry.glyphs.clear();
+	entry.size = glm::vec2(0.0f);
+
+	glm::vec2 pen(0.0f);
+	for (const char* c = text; *c != '\0'; c++)
+	{
+		if (*c == '\n')
+		{
+			entry.size.x = glm::max(entry.size.x, pen.x);
+			pen = glm::vec2(0.0f, pen.y + font.GetLineHeight() * scale);
+			continue;
+		}
+
+		const Glyph& glyph = font.GetGlyph((unsigned char)*c);
+		if (glyph.visible)
+		{
+			glm::vec2 size = glyph.size * scale;
+			entry.glyphs.push_back(MakeSpriteInstance(pen + size * 0.5f, size, 0.0f, glyph.uvRect));
+		}
+		pen.x += glyph.advance * scale;
+	}
+
+	entry.size.x = glm::max(entry.size.x, pen.x);
+	entry.size.y = pen.y + font.GetLineHeight() * scale;
+}
+
+void TextRenderer::Rehash(size_t tableSize)
+{
+	m_table.assign(tableSize, -1);
+
+	size_t mask = tableSize - 1;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		if (!m_entries[i].live)
+			continue;
+
+		size_t slot = (size_t)m_entries[i].hash & mask;
+		while (m_table[slot] >= 0)
+			slot = (slot + 1) & mask;
+		m_table[slot] = (int)i;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// draws strings through Renderer's sprite batcher. laying a string out (glyph lookup, advances, line breaks)
+// happens once, the resulting glyph quads are cached keyed by the text, font and scale, and a cached label
+// only costs a copy into the renderer's sprite list per frame. all text with the same font shares its atlas
+// page, so a HUD drawn together is one draw call.
+// the cache is a flat open addressing table over reused entries: once the set of labels settles nothing
+// is allocated per frame, even when numbers change every frame. labels not drawn for a while are evicted
+
+#include "SpriteKernels.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Font;
+class Renderer;
+
+struct TextStats
+{
+	unsigned int labels;   // drawn this frame
+	unsigned int glyphs;
+	unsigned int layouts;  // cache misses this frame
+	unsigned int cachedStrings;
+};
+
+class TextRenderer
+{
+public:
+	TextRenderer() = default;
+	~TextRenderer() {}
+
+	void SetRenderer(Renderer* renderer) { m_renderer = renderer; }
+
+	// position is the top left of the first line. scale multiplies the font's pixel size
+	void DrawText(Font& font, const glm::vec2& position, float scale, const char* text);
+	// printf style, formatted into a fixed buffer (longer output is cut off)
+	void DrawFormat(Font& font, const glm::vec2& position, float scale, const char* format, ...);
+
+	glm::vec2 MeasureText(Font& font, float scale, const char* text);
+
+	// once per frame after the text has been drawn. ages the cache and resets the stats
+	void EndFrame();
+
+	const TextStats& GetStats() const { return m_stats; }
+
+private:
+	struct CachedText
+	{
+		uint64_t hash;
+		const Font* font;
+		float scale;
+		std::string text;
+		std::vector<SpriteInstance> glyphs; // relative to the label's position
+		glm::vec2 size;
+		unsigned int lastUsedFrame;
+		bool live;
+	};
+
+	const CachedText& GetLayout(Font& font, float scale, const char* text);
+	void Layout(Font& font, float scale, const char* text, CachedText& entry);
+	void Rehash(size_t tableSize);
+
+	Renderer* m_renderer = nullptr;
+
+	std::vector<CachedText> m_entries;
+	std::vector<unsigned int> m_freeEntries;
+	std::vector<int> m_table; // entry index or -1, power of two size
+	unsigned int m_liveEntries = 0;
+	unsigned int m_frame = 0;
+
+	TextStats m_stats = { 0, 0, 0, 0 };
+
+};
@@ -1,11 +1,33 @@
 #include "Texture.h"
 
+#include "TextureBaker.h"
+
+#include <SDL.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+AlphaMode ClassifyAlpha(const unsigned char* pixels, size_t pixelCount)
+{
+	AlphaMode alphaMode = AlphaMode::Opaque;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		unsigned char alpha = pixels[i * 4 + 3];
+		if (alpha == 255)
+			continue;
+		if (alpha != 0)
+			return AlphaMode::Translucent;
+		alphaMode = AlphaMode::AlphaTest;
+	}
+	return alphaMode;
+}
+
 Texture::Texture(const char* path, bool useMipMaps)
 	: Texture()
 {
@@ -20,6 +42,13 @@ Texture::~Texture()
 
 bool Texture::LoadFromFile(const char *path, bool useMipMaps)
 {
+	// baked textures carry their own mip chain so useMipMaps doesn't apply
+	size_t pathLength = strlen(path);
+	if (pathLength > 4 && strcmp(path + pathLength - 4, ".ktx") == 0)
+	{
+		return LoadFromKtx(path);
+	}
+
 	int width, height, numChannels;
 	unsigned char *data = stbi_load(path, &width, &height, &numChannels, 0);
 	if (data == nullptr)
@@ -46,8 +75,12 @@ bool Texture::LoadFromFile(const char *path, bool useMipMaps)
 			assert(false);
 	}
 	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	m_alphaMode = numChannels == 4 ? ClassifyAlpha(data, static_cast<size_t>(width) * height) : AlphaMode::Opaque;
 	stbi_image_free(data);
 
+	m_width = width;
+	m_height = height;
+
 	// set params
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -57,6 +90,7 @@ bool Texture::LoadFromFile(const char *path, bool useMipMaps)
 	if (useMipMaps)
 	{
 		glGenerateMipmap(GL_TEXTURE_2D);
+		m_numLevels = static_cast<int>(std::log2(std::max(width, height))) + 1;
 	}
 
 	// unbind
@@ -65,7 +99,112 @@ bool Texture::LoadFromFile(const char *path, bool useMipMaps)
 	return true;
 }
 
+bool Texture::LoadFromPixels(int width, int height, const unsigned char* pixels)
+{
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	m_alphaMode = ClassifyAlpha(pixels, static_cast<size_t>(width) * height);
+
+	m_width = width;
+	m_height = height;
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+bool Texture::LoadFromKtx(const char* path)
+{
+	TextureFileData file;
+	if (!ReadTextureFile(path, file))
+	{
+		return false;
+	}
+
+	// s3tc is near universal on desktop but not core, decode on the cpu if the driver doesn't have it
+	static const bool s_hasS3tc = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc") == SDL_TRUE;
+	if (IsCompressedFormat(file.format) && !s_hasS3tc)
+	{
+		std::cout << "S3TC not supported, decompressing " << path << "\n";
+		for (TextureMipLevel& mip : file.mips)
+		{
+			TextureMipLevel rgba;
+			DecompressMipLevel(mip, file.format, rgba);
+			mip = std::move(rgba);
+		}
+		file.format = TextureFormat::RGBA8;
+	}
+
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+
+	m_width = file.mips[0].width;
+	m_height = file.mips[0].height;
+	m_numLevels = static_cast<int>(file.mips.size());
+
+	// bc1's alpha is one bit, bc3's isn't worth decoding just to find out
+	if (file.format == TextureFormat::RGBA8)
+		m_alphaMode = ClassifyAlpha(file.mips[0].data.data(), static_cast<size_t>(m_width) * m_height);
+	else
+		m_alphaMode = file.format == TextureFormat::BC1 ? AlphaMode::AlphaTest : AlphaMode::Translucent;
+
+	GLenum internalFormat = GetGLInternalFormat(file.format);
+	for (size_t level = 0; level < file.mips.size(); level++)
+	{
+		const TextureMipLevel& mip = file.mips[level];
+		if (IsCompressedFormat(file.format))
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, mip.width, mip.height, 0,
+				static_cast<GLsizei>(mip.data.size()), mip.data.data());
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, mip.width, mip.height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, mip.data.data());
+		}
+	}
+
+	// set params
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(file.mips.size()) - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, file.mips.size() > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// unbind
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
 void Texture::Bind() const
 {
 	glBindTexture(GL_TEXTURE_2D, m_texture);
 }
+
+void Texture::ReportScreenSize(float pixelsWide, float pixelsHigh)
+{
+	// the level whose texels map roughly 1:1 onto the covered pixels
+	float ratio = std::max(m_width / std::max(pixelsWide, 1.0f), m_height / std::max(pixelsHigh, 1.0f));
+	int level = ratio > 1.0f ? static_cast<int>(std::log2(ratio)) : 0;
+	level = std::min(level, m_numLevels - 1);
+
+	if (m_requestedLevel < 0 || level < m_requestedLevel)
+	{
+		m_requestedLevel = level;
+	}
+}
+
+int Texture::TakeRequestedLevel()
+{
+	int level = m_requestedLevel;
+	m_requestedLevel = -1;
+	return level;
+}
@@ -2,6 +2,19 @@
 
 #include <glad/glad.h>
 
+#include <cstddef>
+
+// how a texture's alpha has to be drawn, worked out from its pixels when it's loaded
+enum class AlphaMode
+{
+	Opaque,     // alpha is 255 everywhere, drawn without blending
+	AlphaTest,  // alpha is only 0 or 255, drawn without blending and with the empty texels discarded
+	Translucent // anything in between, blended back to front
+};
+
+// looks at the alpha of every pixel, rgba8
+AlphaMode ClassifyAlpha(const unsigned char* pixels, size_t pixelCount);
+
 class Texture
 {
 public:
@@ -10,9 +23,32 @@ public:
 	~Texture();
 
 	bool LoadFromFile(const char* path, bool useMipMaps = false);
+	// rgba8, rows top to bottom. clamped and unfiltered, for atlases built at runtime
+	bool LoadFromPixels(int width, int height, const unsigned char* pixels);
 	void Bind() const;
 
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+	AlphaMode GetAlphaMode() const { return m_alphaMode; }
+	// e.g. to fade an opaque texture out, which the classification can't know about
+	void SetAlphaMode(AlphaMode alphaMode) { m_alphaMode = alphaMode; }
+
+	// called by the renderer with the on-screen size the texture was drawn at this frame.
+	// streamed textures use the smallest reported size to pick which mips to keep resident
+	void ReportScreenSize(float pixelsWide, float pixelsHigh);
+
 private:
+	friend class TextureStreamer;
+
+	bool LoadFromKtx(const char* path);
+	int TakeRequestedLevel();
+
 	GLuint m_texture;
+	int m_width = 0;
+	int m_height = 0;
+	int m_numLevels = 1;
+	AlphaMode m_alphaMode = AlphaMode::Translucent;
+	int m_requestedLevel = -1; // -1 = not drawn since the last TakeRequestedLevel
 
 };
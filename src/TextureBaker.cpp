@@ -0,0 +1,480 @@
+#include "TextureBaker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "stb_image.h" // implementation lives in Texture.cpp
+
+// --------------------------------------------------------
+// mip generation
+// --------------------------------------------------------
+
+static void DownsampleLevel(const TextureMipLevel& src, TextureMipLevel& dst)
+{
+	dst.width = std::max(1, src.width / 2);
+	dst.height = std::max(1, src.height / 2);
+	dst.data.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+
+	for (int y = 0; y < dst.height; y++)
+	{
+		int y0 = std::min(2 * y, src.height - 1);
+		int y1 = std::min(2 * y + 1, src.height - 1);
+		for (int x = 0; x < dst.width; x++)
+		{
+			int x0 = std::min(2 * x, src.width - 1);
+			int x1 = std::min(2 * x + 1, src.width - 1);
+
+			const uint8_t* p[4] = {
+				&src.data[(y0 * src.width + x0) * 4],
+				&src.data[(y0 * src.width + x1) * 4],
+				&src.data[(y1 * src.width + x0) * 4],
+				&src.data[(y1 * src.width + x1) * 4]
+			};
+
+			// weight colour by alpha so fully transparent texels don't bleed black into sprite edges
+			int alphaSum = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+			uint8_t* out = &dst.data[(y * dst.width + x) * 4];
+			for (int c = 0; c < 3; c++)
+			{
+				if (alphaSum > 0)
+				{
+					int sum = p[0][c] * p[0][3] + p[1][c] * p[1][3] + p[2][c] * p[2][3] + p[3][c] * p[3][3];
+					out[c] = static_cast<uint8_t>((sum + alphaSum / 2) / alphaSum);
+				}
+				else
+				{
+					out[c] = static_cast<uint8_t>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+				}
+			}
+			out[3] = static_cast<uint8_t>((alphaSum + 2) / 4);
+		}
+	}
+}
+
+void GenerateMipChain(const uint8_t* rgba, int width, int height, std::vector<TextureMipLevel>& outMips)
+{
+	outMips.clear();
+
+	TextureMipLevel base;
+	base.width = width;
+	base.height = height;
+	base.data.assign(rgba, rgba + static_cast<size_t>(width) * height * 4);
+	outMips.push_back(std::move(base));
+
+	while (outMips.back().width > 1 || outMips.back().height > 1)
+	{
+		TextureMipLevel next;
+		DownsampleLevel(outMips.back(), next);
+		outMips.push_back(std::move(next));
+	}
+}
+
+// --------------------------------------------------------
+// block compression
+// --------------------------------------------------------
+
+static uint16_t PackRGB565(const float* rgb)
+{
+	int r = static_cast<int>(std::round(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+	int g = static_cast<int>(std::round(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+	int b = static_cast<int>(std::round(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t c, uint8_t* rgb)
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+	rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+	rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+}
+
+// builds the 4 entry palette for a colour block. alpha of entry 3 is 0 in BC1 3-colour mode
+static void BuildColorPalette(uint16_t c0, uint16_t c1, bool allowThreeColor, uint8_t palette[4][4])
+{
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+	palette[0][3] = 255;
+	palette[1][3] = 255;
+
+	if (c0 > c1 || !allowThreeColor)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		palette[2][3] = 255;
+		palette[3][3] = 255;
+	}
+	else
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+		palette[2][3] = 255;
+		palette[3][3] = 0;
+	}
+}
+
+// fits endpoints along the principal axis of the block's colours
+// punchThrough = BC1 with transparent texels, which needs the 3-colour mode (c0 <= c1)
+static void EncodeColorBlock(const uint8_t block[16][4], bool punchThrough, uint8_t* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	int count = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		if (punchThrough && block[i][3] < 128)
+			continue;
+		for (int c = 0; c < 3; c++)
+			mean[c] += block[i][c];
+		count++;
+	}
+
+	uint16_t c0 = 0;
+	uint16_t c1 = 0;
+	if (count > 0)
+	{
+		for (int c = 0; c < 3; c++)
+			mean[c] /= count;
+
+		float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+		for (int i = 0; i < 16; i++)
+		{
+			if (punchThrough && block[i][3] < 128)
+				continue;
+			float r = block[i][0] - mean[0];
+			float g = block[i][1] - mean[1];
+			float b = block[i][2] - mean[2];
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+
+		// power iteration for the dominant eigenvector
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iter = 0; iter < 8; iter++)
+		{
+			float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+			if (len < 1e-6f)
+				break;
+			axis[0] = x / len;
+			axis[1] = y / len;
+			axis[2] = z / len;
+		}
+		float axisLenSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+		float minT = 0.0f;
+		float maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			if (punchThrough && block[i][3] < 128)
+				continue;
+			float t = ((block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2]) / axisLenSq;
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		// inset the endpoints slightly, the extremes are rarely the best choice after quantization
+		float inset = (maxT - minT) / 16.0f;
+		minT += inset;
+		maxT -= inset;
+
+		float e0[3], e1[3];
+		for (int c = 0; c < 3; c++)
+		{
+			e0[c] = mean[c] + axis[c] * maxT;
+			e1[c] = mean[c] + axis[c] * minT;
+		}
+		c0 = PackRGB565(e0);
+		c1 = PackRGB565(e1);
+	}
+
+	// 4-colour mode needs c0 > c1, 3-colour mode needs c0 <= c1
+	if ((punchThrough && c0 > c1) || (!punchThrough && c0 < c1))
+		std::swap(c0, c1);
+
+	uint8_t palette[4][4];
+	BuildColorPalette(c0, c1, punchThrough, palette);
+
+	uint32_t indices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		if (punchThrough && block[i][3] < 128)
+		{
+			best = 3;
+		}
+		else if (c0 != c1)
+		{
+			int bestError = INT32_MAX;
+			int numColors = punchThrough ? 3 : 4;
+			for (int p = 0; p < numColors; p++)
+			{
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+		}
+		indices |= static_cast<uint32_t>(best) << (2 * i);
+	}
+
+	memcpy(out + 0, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &indices, 4);
+}
+
+static void BuildAlphaPalette(uint8_t a0, uint8_t a1, uint8_t palette[8])
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	uint8_t minA = 255;
+	uint8_t maxA = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		minA = std::min(minA, block[i][3]);
+		maxA = std::max(maxA, block[i][3]);
+	}
+
+	// 8 value mode (a0 > a1); a flat block just uses index 0
+	uint8_t a0 = maxA;
+	uint8_t a1 = minA;
+	uint8_t palette[8];
+	BuildAlphaPalette(a0, a1, palette);
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		int bestError = 256;
+		for (int p = 0; p < (a0 > a1 ? 8 : 1); p++)
+		{
+			int error = std::abs(block[i][3] - palette[p]);
+			if (error < bestError)
+			{
+				bestError = error;
+				best = p;
+			}
+		}
+		indices |= static_cast<uint64_t>(best) << (3 * i);
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+void CompressMipLevel(const TextureMipLevel& rgbaLevel, TextureFormat format, TextureMipLevel& outLevel)
+{
+	assert(IsCompressedFormat(format));
+
+	outLevel.width = rgbaLevel.width;
+	outLevel.height = rgbaLevel.height;
+	outLevel.data.resize(GetMipLevelSize(format, rgbaLevel.width, rgbaLevel.height));
+
+	size_t blockSize = format == TextureFormat::BC1 ? 8 : 16;
+	int blocksX = (rgbaLevel.width + 3) / 4;
+	int blocksY = (rgbaLevel.height + 3) / 4;
+
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			// gather the 4x4 block, clamping at the image edge
+			uint8_t block[16][4];
+			bool hasTransparency = false;
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = std::min(by * 4 + y, rgbaLevel.height - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = std::min(bx * 4 + x, rgbaLevel.width - 1);
+					memcpy(block[y * 4 + x], &rgbaLevel.data[(sy * rgbaLevel.width + sx) * 4], 4);
+					hasTransparency |= block[y * 4 + x][3] < 128;
+				}
+			}
+
+			uint8_t* out = &outLevel.data[(by * blocksX + bx) * blockSize];
+			if (format == TextureFormat::BC1)
+			{
+				EncodeColorBlock(block, hasTransparency, out);
+			}
+			else
+			{
+				EncodeAlphaBlock(block, out);
+				EncodeColorBlock(block, false, out + 8);
+			}
+		}
+	}
+}
+
+void DecompressMipLevel(const TextureMipLevel& level, TextureFormat format, TextureMipLevel& outRgbaLevel)
+{
+	assert(IsCompressedFormat(format));
+
+	outRgbaLevel.width = level.width;
+	outRgbaLevel.height = level.height;
+	outRgbaLevel.data.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+	size_t blockSize = format == TextureFormat::BC1 ? 8 : 16;
+	int blocksX = (level.width + 3) / 4;
+	int blocksY = (level.height + 3) / 4;
+
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			const uint8_t* in = &level.data[(by * blocksX + bx) * blockSize];
+
+			uint8_t alphaPalette[8];
+			uint64_t alphaIndices = 0;
+			if (format == TextureFormat::BC3)
+			{
+				BuildAlphaPalette(in[0], in[1], alphaPalette);
+				for (int i = 0; i < 6; i++)
+					alphaIndices |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+				in += 8;
+			}
+
+			uint16_t c0, c1;
+			uint32_t indices;
+			memcpy(&c0, in + 0, 2);
+			memcpy(&c1, in + 2, 2);
+			memcpy(&indices, in + 4, 4);
+
+			uint8_t palette[4][4];
+			BuildColorPalette(c0, c1, format == TextureFormat::BC1, palette);
+
+			for (int y = 0; y < 4; y++)
+			{
+				int dy = by * 4 + y;
+				if (dy >= level.height)
+					break;
+				for (int x = 0; x < 4; x++)
+				{
+					int dx = bx * 4 + x;
+					if (dx >= level.width)
+						break;
+
+					int i = y * 4 + x;
+					uint8_t* out = &outRgbaLevel.data[(dy * level.width + dx) * 4];
+					memcpy(out, palette[(indices >> (2 * i)) & 3], 4);
+					if (format == TextureFormat::BC3)
+						out[3] = alphaPalette[(alphaIndices >> (3 * i)) & 7];
+				}
+			}
+		}
+	}
+}
+
+TextureFormat ChooseCompressedFormat(const uint8_t* rgba, int width, int height)
+{
+	size_t numPixels = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		if (rgba[i * 4 + 3] != 255)
+			return TextureFormat::BC3;
+	}
+	return TextureFormat::BC1;
+}
+
+// --------------------------------------------------------
+// baking
+// --------------------------------------------------------
+
+static bool BakeTextureImpl(const char* srcPath, const char* dstPath, const TextureFormat* format, bool generateMips)
+{
+	int width, height, numChannels;
+	unsigned char* pixels = stbi_load(srcPath, &width, &height, &numChannels, 4); // always expand to rgba
+	if (pixels == nullptr)
+	{
+		std::cerr << "Failed to load " << srcPath << ": " << stbi_failure_reason() << "\n";
+		return false;
+	}
+
+	TextureFileData file;
+	file.format = format ? *format : ChooseCompressedFormat(pixels, width, height);
+
+	std::vector<TextureMipLevel> rgbaMips;
+	if (generateMips)
+	{
+		GenerateMipChain(pixels, width, height, rgbaMips);
+	}
+	else
+	{
+		rgbaMips.resize(1);
+		rgbaMips[0].width = width;
+		rgbaMips[0].height = height;
+		rgbaMips[0].data.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	}
+	stbi_image_free(pixels);
+
+	if (IsCompressedFormat(file.format))
+	{
+		file.mips.resize(rgbaMips.size());
+		for (size_t i = 0; i < rgbaMips.size(); i++)
+			CompressMipLevel(rgbaMips[i], file.format, file.mips[i]);
+	}
+	else
+	{
+		file.mips = std::move(rgbaMips);
+	}
+
+	if (!WriteTextureFile(dstPath, file))
+		return false;
+
+	size_t bakedSize = 0;
+	for (const TextureMipLevel& mip : file.mips)
+		bakedSize += mip.data.size();
+
+	static const char* s_formatNames[] = { "RGBA8", "BC1", "BC3" };
+	printf("Baked %s -> %s (%dx%d, %d mips, %s, %zu bytes vs %zu uncompressed)\n", srcPath, dstPath, width, height,
+		static_cast<int>(file.mips.size()), s_formatNames[static_cast<int>(file.format)], bakedSize,
+		static_cast<size_t>(width) * height * numChannels);
+
+	return true;
+}
+
+bool BakeTexture(const char* srcPath, const char* dstPath, TextureFormat format, bool generateMips)
+{
+	return BakeTextureImpl(srcPath, dstPath, &format, generateMips);
+}
+
+bool BakeTexture(const char* srcPath, const char* dstPath, bool generateMips)
+{
+	return BakeTextureImpl(srcPath, dstPath, nullptr, generateMips);
+}
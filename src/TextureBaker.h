@@ -0,0 +1,24 @@
+#pragma once
+
+// offline texture baking: png -> ktx with a pre-filtered mip chain and optional block compression
+// the runtime only ever has to memcpy the result into glCompressedTexImage2D
+
+#include "TextureFile.h"
+
+#include <cstdint>
+#include <vector>
+
+// build the full mip chain (down to 1x1) for an rgba8 image using a 2x2 box filter
+void GenerateMipChain(const uint8_t* rgba, int width, int height, std::vector<TextureMipLevel>& outMips);
+
+// encode an rgba8 level into BC1/BC3 blocks. dimensions don't have to be multiples of 4
+void CompressMipLevel(const TextureMipLevel& rgbaLevel, TextureFormat format, TextureMipLevel& outLevel);
+
+// decode a BC1/BC3 level back to rgba8, used when the driver doesn't expose s3tc
+void DecompressMipLevel(const TextureMipLevel& level, TextureFormat format, TextureMipLevel& outRgbaLevel);
+
+// chooses BC3 if the image has any non-opaque pixels, BC1 otherwise
+TextureFormat ChooseCompressedFormat(const uint8_t* rgba, int width, int height);
+
+bool BakeTexture(const char* srcPath, const char* dstPath, TextureFormat format, bool generateMips = true);
+bool BakeTexture(const char* srcPath, const char* dstPath, bool generateMips = true); // picks BC1 or BC3
@@ -0,0 +1,244 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const uint8_t kKtxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t kKtxEndianness = 0x04030201;
+
+struct KtxHeader
+{
+	uint8_t identifier[12];
+	uint32_t endianness;
+	uint32_t glType;
+	uint32_t glTypeSize;
+	uint32_t glFormat;
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+};
+
+bool IsCompressedFormat(TextureFormat format)
+{
+	return format != TextureFormat::RGBA8;
+}
+
+GLenum GetGLInternalFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1:
+		return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	case TextureFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default:
+		return GL_RGBA8;
+	}
+}
+
+size_t GetMipLevelSize(TextureFormat format, int width, int height)
+{
+	size_t blocksX = (width + 3) / 4;
+	size_t blocksY = (height + 3) / 4;
+
+	switch (format)
+	{
+	case TextureFormat::BC1:
+		return blocksX * blocksY * 8;
+	case TextureFormat::BC3:
+		return blocksX * blocksY * 16;
+	default:
+		return static_cast<size_t>(width) * height * 4;
+	}
+}
+
+// parses the header and records where each level's data starts
+static bool ReadHeader(std::ifstream& file, const char* path, TextureFileInfo& outInfo)
+{
+	KtxHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(KtxHeader)) ||
+		memcmp(header.identifier, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0 ||
+		header.endianness != kKtxEndianness)
+	{
+		std::cerr << "Not a KTX file: " << path << "\n";
+		return false;
+	}
+
+	if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1)
+	{
+		std::cerr << "Unsupported KTX layout (only single 2D images): " << path << "\n";
+		return false;
+	}
+
+	switch (header.glInternalFormat)
+	{
+	case GL_RGBA8:
+		outInfo.format = TextureFormat::RGBA8;
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		outInfo.format = TextureFormat::BC1;
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		outInfo.format = TextureFormat::BC3;
+		break;
+	default:
+		std::cerr << "Unsupported KTX internal format 0x" << std::hex << header.glInternalFormat << std::dec << ": " << path << "\n";
+		return false;
+	}
+
+	outInfo.width = static_cast<int>(header.pixelWidth);
+	outInfo.height = static_cast<int>(header.pixelHeight);
+
+	// skip the key/value metadata, we don't write any
+	file.seekg(header.bytesOfKeyValueData, std::ios::cur);
+
+	uint32_t numMips = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+	outInfo.levelOffsets.resize(numMips);
+
+	int width = outInfo.width;
+	int height = outInfo.height;
+	for (uint32_t i = 0; i < numMips; i++)
+	{
+		uint32_t imageSize;
+		if (!file.read(reinterpret_cast<char*>(&imageSize), sizeof(uint32_t)) || imageSize != GetMipLevelSize(outInfo.format, width, height))
+		{
+			std::cerr << "Corrupt mip level " << i << " in " << path << "\n";
+			return false;
+		}
+
+		// mip padding to 4 bytes (always 0 for the formats we support)
+		outInfo.levelOffsets[i] = static_cast<uint64_t>(file.tellg());
+		file.seekg(imageSize + (4 - imageSize % 4) % 4, std::ios::cur);
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	if (!file)
+	{
+		std::cerr << "Truncated texture file " << path << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+static bool ReadLevel(std::ifstream& file, const char* path, const TextureFileInfo& info, int level, TextureMipLevel& outMip)
+{
+	outMip.width = std::max(1, info.width >> level);
+	outMip.height = std::max(1, info.height >> level);
+	outMip.data.resize(GetMipLevelSize(info.format, outMip.width, outMip.height));
+
+	file.seekg(info.levelOffsets[level], std::ios::beg);
+	if (!file.read(reinterpret_cast<char*>(outMip.data.data()), outMip.data.size()))
+	{
+		std::cerr << "Failed to read mip level " << level << " from " << path << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool ReadTextureFileInfo(const char* path, TextureFileInfo& outInfo)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open texture file " << path << "\n";
+		return false;
+	}
+
+	return ReadHeader(file, path, outInfo);
+}
+
+bool ReadTextureLevel(const char* path, const TextureFileInfo& info, int level, TextureMipLevel& outMip)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open texture file " << path << "\n";
+		return false;
+	}
+
+	return ReadLevel(file, path, info, level, outMip);
+}
+
+bool ReadTextureFile(const char* path, TextureFileData& outData)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open texture file " << path << "\n";
+		return false;
+	}
+
+	TextureFileInfo info;
+	if (!ReadHeader(file, path, info))
+	{
+		return false;
+	}
+
+	outData.format = info.format;
+	outData.mips.resize(info.levelOffsets.size());
+	for (size_t i = 0; i < outData.mips.size(); i++)
+	{
+		if (!ReadLevel(file, path, info, static_cast<int>(i), outData.mips[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool WriteTextureFile(const char* path, const TextureFileData& data)
+{
+	if (data.mips.empty())
+		return false;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open " << path << " for writing\n";
+		return false;
+	}
+
+	bool compressed = IsCompressedFormat(data.format);
+
+	KtxHeader header;
+	memcpy(header.identifier, kKtxIdentifier, sizeof(kKtxIdentifier));
+	header.endianness = kKtxEndianness;
+	header.glType = compressed ? 0 : GL_UNSIGNED_BYTE;
+	header.glTypeSize = 1;
+	header.glFormat = compressed ? 0 : GL_RGBA;
+	header.glInternalFormat = GetGLInternalFormat(data.format);
+	header.glBaseInternalFormat = GL_RGBA;
+	header.pixelWidth = data.mips[0].width;
+	header.pixelHeight = data.mips[0].height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = static_cast<uint32_t>(data.mips.size());
+	header.bytesOfKeyValueData = 0;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(KtxHeader));
+
+	for (const TextureMipLevel& mip : data.mips)
+	{
+		uint32_t imageSize = static_cast<uint32_t>(mip.data.size());
+		file.write(reinterpret_cast<const char*>(&imageSize), sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(mip.data.data()), imageSize);
+
+		static const char padding[3] = { 0, 0, 0 };
+		file.write(padding, (4 - imageSize % 4) % 4);
+	}
+
+	return file.good();
+}
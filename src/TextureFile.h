@@ -0,0 +1,58 @@
+#pragma once
+
+// KTX (version 1) container for baked textures.
+// only single 2D images are supported, with a full or partial mip chain stored largest first
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// not part of the core 3.3 headers but every desktop driver we care about exposes EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum class TextureFormat
+{
+	RGBA8,
+	BC1, // rgb + 1 bit alpha, 8 bytes per 4x4 block
+	BC3  // rgba, 16 bytes per 4x4 block
+};
+
+struct TextureMipLevel
+{
+	int width;
+	int height;
+	std::vector<uint8_t> data;
+};
+
+struct TextureFileData
+{
+	TextureFormat format = TextureFormat::RGBA8;
+	std::vector<TextureMipLevel> mips; // mips[0] is the full size image
+};
+
+// header only view of a file, for reading individual levels on demand
+struct TextureFileInfo
+{
+	TextureFormat format = TextureFormat::RGBA8;
+	int width = 0;
+	int height = 0;
+	std::vector<uint64_t> levelOffsets;
+
+	int GetNumLevels() const { return static_cast<int>(levelOffsets.size()); }
+};
+
+bool IsCompressedFormat(TextureFormat format);
+GLenum GetGLInternalFormat(TextureFormat format);
+size_t GetMipLevelSize(TextureFormat format, int width, int height);
+
+bool ReadTextureFile(const char* path, TextureFileData& outData);
+bool ReadTextureFileInfo(const char* path, TextureFileInfo& outInfo);
+bool ReadTextureLevel(const char* path, const TextureFileInfo& info, int level, TextureMipLevel& outMip);
+bool WriteTextureFile(const char* path, const TextureFileData& data);
@@ -0,0 +1,466 @@
+#include "TextureStreamer.h"
+
+#include "Texture.h"
+#include "TextureBaker.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "stb_image.h" // implementation lives in Texture.cpp
+
+// levels this size and smaller are loaded up front so a ktx texture is never just a flat colour
+static const int kTailSize = 64;
+
+// frames without a ReportScreenSize before a texture's wanted level falls back to its tail
+static const unsigned int kUnusedFrames = 300;
+
+TextureStreamer::~TextureStreamer()
+{
+	Dispose();
+}
+
+void TextureStreamer::Init(size_t memoryBudget, size_t uploadBudgetPerFrame, double uploadMsPerFrame)
+{
+	m_memoryBudget = memoryBudget;
+	m_uploadQueue.Init(8, 1024 * 1024, uploadBudgetPerFrame, uploadMsPerFrame);
+	m_hasS3tc = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc") == SDL_TRUE;
+
+	m_quit = false;
+	m_worker = std::thread(&TextureStreamer::WorkerThread, this);
+}
+
+void TextureStreamer::Dispose()
+{
+	if (m_worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+			m_requests.clear();
+		}
+		m_condition.notify_all();
+		m_worker.join();
+	}
+
+	m_uploadQueue.Dispose();
+	m_finishedUploads.clear();
+
+	for (StreamedTexture& entry : m_textures)
+	{
+		delete entry.texture;
+	}
+	m_textures.clear();
+	m_readyLevels.clear();
+	m_completed.clear();
+	m_residentBytes = 0;
+}
+
+Texture* TextureStreamer::LoadTexture(const char* path, bool resident)
+{
+	StreamedTexture entry;
+	entry.id = m_nextId++;
+	entry.path = path;
+	entry.requestsInFlight = 0;
+	entry.lastUsedFrame = m_frame;
+	entry.failed = false;
+
+	size_t pathLength = strlen(path);
+	entry.isKtx = pathLength > 4 && strcmp(path + pathLength - 4, ".ktx") == 0;
+	if (entry.isKtx)
+	{
+		if (!ReadTextureFileInfo(path, entry.info))
+		{
+			return nullptr;
+		}
+	}
+	else
+	{
+		int numChannels;
+		if (!stbi_info(path, &entry.info.width, &entry.info.height, &numChannels))
+		{
+			std::cerr << "Failed to load " << path << ": " << stbi_failure_reason() << "\n";
+			return nullptr;
+		}
+		entry.info.format = TextureFormat::RGBA8; // decoded pngs are always expanded to rgba
+	}
+
+	entry.numLevels = entry.isKtx ? entry.info.GetNumLevels() : static_cast<int>(std::log2(std::max(entry.info.width, entry.info.height))) + 1;
+
+	Texture* texture = new Texture();
+	texture->m_width = entry.info.width;
+	texture->m_height = entry.info.height;
+	texture->m_numLevels = entry.numLevels;
+	// the pixels haven't been seen yet, so only the format says anything about the alpha
+	texture->m_alphaMode = entry.info.format == TextureFormat::BC1 ? AlphaMode::AlphaTest : AlphaMode::Translucent;
+	entry.texture = texture;
+
+	glGenTextures(1, &texture->m_texture);
+	glBindTexture(GL_TEXTURE_2D, texture->m_texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.numLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	if (entry.isKtx)
+	{
+		// the tail is tiny, just read it here
+		entry.tailLevel = entry.numLevels - 1;
+		while (entry.tailLevel > 0 && std::max(entry.info.width >> (entry.tailLevel - 1), entry.info.height >> (entry.tailLevel - 1)) <= kTailSize)
+		{
+			entry.tailLevel--;
+		}
+
+		entry.residentLevel = entry.numLevels;
+		entry.uploadingLevel = entry.numLevels;
+		for (int level = entry.numLevels - 1; level >= entry.tailLevel; level--)
+		{
+			TextureMipLevel mip;
+			if (!ReadTextureLevel(path, entry.info, level, mip))
+			{
+				break;
+			}
+			if (IsCompressedFormat(entry.info.format) && !m_hasS3tc)
+			{
+				TextureMipLevel rgba;
+				DecompressMipLevel(mip, entry.info.format, rgba);
+				mip = std::move(rgba);
+			}
+			UploadLevel(entry, level, mip);
+		}
+	}
+	else
+	{
+		// nothing to show until the worker has decoded the png, use a grey 1x1 as the coarsest level
+		static const uint8_t s_placeholder[4] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, entry.numLevels - 1, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, s_placeholder);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.numLevels - 1);
+
+		entry.tailLevel = entry.numLevels - 1;
+		entry.residentLevel = entry.numLevels;
+		entry.uploadingLevel = entry.numLevels;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the whole chain counts as tail, so Update asks for it straight away and eviction leaves it alone
+	if (resident)
+		entry.tailLevel = 0;
+
+	entry.wantedLevel = entry.tailLevel;
+	entry.pendingLevel = entry.numLevels;
+	m_textures.push_back(std::move(entry));
+
+	return texture;
+}
+
+void TextureStreamer::UnloadTexture(Texture* texture)
+{
+	for (auto it = m_textures.begin(); it != m_textures.end(); ++it)
+	{
+		if (it->texture == texture)
+		{
+			m_uploadQueue.Cancel(it->id);
+			for (int level = it->residentLevel; level < it->numLevels; level++)
+			{
+				m_residentBytes -= GetLevelSize(*it, level);
+			}
+			delete texture;
+			m_textures.erase(it);
+			return;
+		}
+	}
+}
+
+void TextureStreamer::Update()
+{
+	m_frame++;
+
+	// gather what the renderer asked for last frame and queue reads for anything missing
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (StreamedTexture& entry : m_textures)
+		{
+			int requested = entry.texture->TakeRequestedLevel();
+			if (requested >= 0)
+			{
+				entry.wantedLevel = std::min(requested, entry.tailLevel);
+				entry.lastUsedFrame = m_frame;
+			}
+			else if (m_frame - entry.lastUsedFrame > kUnusedFrames)
+			{
+				entry.wantedLevel = entry.tailLevel;
+			}
+
+			int firstMissing = std::min(entry.uploadingLevel, entry.pendingLevel);
+			if (entry.wantedLevel < firstMissing && !entry.failed)
+			{
+				LoadRequest request;
+				request.id = entry.id;
+				request.path = entry.path;
+				request.isKtx = entry.isKtx;
+				request.info = entry.info;
+				request.firstLevel = entry.wantedLevel;
+				request.lastLevel = firstMissing - 1;
+				m_requests.push_back(std::move(request));
+
+				entry.pendingLevel = entry.wantedLevel;
+				entry.requestsInFlight++;
+			}
+		}
+
+		for (LoadResult& result : m_completed)
+		{
+			if (StreamedTexture* entry = FindEntry(result.id))
+			{
+				if (result.failed)
+					entry->failed = true;
+				if (result.classified)
+					entry->texture->m_alphaMode = result.alphaMode;
+				if (--entry->requestsInFlight == 0)
+				{
+					entry->pendingLevel = entry->numLevels;
+				}
+			}
+			for (LoadedLevel& level : result.levels)
+			{
+				m_readyLevels.push_back(std::move(level));
+			}
+		}
+		m_completed.clear();
+	}
+	m_condition.notify_one();
+
+	// queue uploads coarsest first, a level can only go in once the one below it is on its way. the queue keeps
+	// them in order and spreads them over frames within its budget
+	std::sort(m_readyLevels.begin(), m_readyLevels.end(), [](const LoadedLevel& a, const LoadedLevel& b) {
+		return a.id != b.id ? a.id < b.id : a.level > b.level;
+	});
+
+	auto readyIt = m_readyLevels.begin();
+	while (readyIt != m_readyLevels.end())
+	{
+		StreamedTexture* entry = FindEntry(readyIt->id);
+		if (!entry || readyIt->level >= entry->uploadingLevel || readyIt->level < entry->wantedLevel)
+		{
+			// unloaded, already queued or no longer wanted
+			readyIt = m_readyLevels.erase(readyIt);
+			continue;
+		}
+
+		if (readyIt->level == entry->uploadingLevel - 1)
+		{
+			TextureFormat format = IsUploadCompressed(*entry) ? entry->info.format : TextureFormat::RGBA8;
+			m_uploadQueue.Submit(entry->id, entry->texture->m_texture, readyIt->level, format, std::move(readyIt->mip));
+			entry->uploadingLevel = readyIt->level;
+			readyIt = m_readyLevels.erase(readyIt);
+			continue;
+		}
+
+		++readyIt;
+	}
+
+	m_finishedUploads.clear();
+	m_uploadQueue.Update(m_finishedUploads);
+	for (const FinishedTextureUpload& finished : m_finishedUploads)
+	{
+		if (StreamedTexture* entry = FindEntry(finished.id))
+			FinishUpload(*entry, finished.level);
+	}
+
+	// over budget: first drop levels finer than what is being drawn, then start on the least recently used
+	if (m_residentBytes > m_memoryBudget)
+	{
+		std::vector<StreamedTexture*> lru;
+		for (StreamedTexture& entry : m_textures)
+		{
+			lru.push_back(&entry);
+		}
+		std::sort(lru.begin(), lru.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+			return a->lastUsedFrame < b->lastUsedFrame;
+		});
+
+		for (StreamedTexture* entry : lru)
+		{
+			if (m_residentBytes <= m_memoryBudget)
+				break;
+			if (entry->residentLevel < entry->wantedLevel)
+				EvictLevels(*entry, entry->wantedLevel);
+		}
+
+		for (StreamedTexture* entry : lru)
+		{
+			if (m_residentBytes <= m_memoryBudget || entry->lastUsedFrame == m_frame)
+				break;
+			if (entry->residentLevel < entry->tailLevel)
+			{
+				EvictLevels(*entry, entry->tailLevel);
+				entry->wantedLevel = entry->tailLevel;
+			}
+		}
+	}
+}
+
+void TextureStreamer::WorkerThread()
+{
+	while (true)
+	{
+		LoadRequest request;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_quit || !m_requests.empty(); });
+			if (m_quit)
+				return;
+
+			request = std::move(m_requests.front());
+			m_requests.pop_front();
+		}
+
+		LoadResult result;
+		ProcessRequest(request, result);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_completed.push_back(std::move(result));
+	}
+}
+
+void TextureStreamer::ProcessRequest(const LoadRequest& request, LoadResult& outResult)
+{
+	outResult.id = request.id;
+
+	if (request.isKtx)
+	{
+		for (int level = request.lastLevel; level >= request.firstLevel; level--)
+		{
+			LoadedLevel loaded;
+			loaded.id = request.id;
+			loaded.level = level;
+			if (!ReadTextureLevel(request.path.c_str(), request.info, level, loaded.mip))
+			{
+				outResult.failed = true;
+				return;
+			}
+
+			if (IsCompressedFormat(request.info.format) && !m_hasS3tc)
+			{
+				TextureMipLevel rgba;
+				DecompressMipLevel(loaded.mip, request.info.format, rgba);
+				loaded.mip = std::move(rgba);
+			}
+
+			outResult.levels.push_back(std::move(loaded));
+		}
+	}
+	else
+	{
+		int width, height, numChannels;
+		unsigned char* pixels = stbi_load(request.path.c_str(), &width, &height, &numChannels, 4);
+		if (pixels == nullptr)
+		{
+			std::cerr << "Failed to load " << request.path << ": " << stbi_failure_reason() << "\n";
+			outResult.failed = true;
+			return;
+		}
+
+		outResult.classified = true;
+		outResult.alphaMode = numChannels == 4 ? ClassifyAlpha(pixels, static_cast<size_t>(width) * height) : AlphaMode::Opaque;
+
+		std::vector<TextureMipLevel> mips;
+		GenerateMipChain(pixels, width, height, mips);
+		stbi_image_free(pixels);
+
+		for (int level = std::min(request.lastLevel, static_cast<int>(mips.size()) - 1); level >= request.firstLevel; level--)
+		{
+			LoadedLevel loaded;
+			loaded.id = request.id;
+			loaded.level = level;
+			loaded.mip = std::move(mips[level]);
+			outResult.levels.push_back(std::move(loaded));
+		}
+	}
+}
+
+TextureStreamer::StreamedTexture* TextureStreamer::FindEntry(unsigned int id)
+{
+	for (StreamedTexture& entry : m_textures)
+	{
+		if (entry.id == id)
+			return &entry;
+	}
+	return nullptr;
+}
+
+bool TextureStreamer::IsUploadCompressed(const StreamedTexture& entry) const
+{
+	return IsCompressedFormat(entry.info.format) && m_hasS3tc;
+}
+
+void TextureStreamer::UploadLevel(StreamedTexture& entry, int level, const TextureMipLevel& mip)
+{
+	glBindTexture(GL_TEXTURE_2D, entry.texture->m_texture);
+
+	if (IsUploadCompressed(entry))
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, GetGLInternalFormat(entry.info.format), mip.width, mip.height, 0,
+			static_cast<GLsizei>(mip.data.size()), mip.data.data());
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip.data.data());
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.uploadingLevel = level;
+	FinishUpload(entry, level);
+}
+
+void TextureStreamer::FinishUpload(StreamedTexture& entry, int level)
+{
+	// evicting cancels the uploads in flight, so anything else arrives in order
+	if (level != entry.residentLevel - 1)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, entry.texture->m_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.residentLevel = level;
+	m_residentBytes += GetLevelSize(entry, level);
+}
+
+void TextureStreamer::EvictLevels(StreamedTexture& entry, int newResidentLevel)
+{
+	glBindTexture(GL_TEXTURE_2D, entry.texture->m_texture);
+
+	// anything still being uploaded is finer than what stays
+	if (entry.uploadingLevel < entry.residentLevel)
+		m_uploadQueue.Cancel(entry.id);
+
+	// clamp first so the texture stays complete, then give the storage back by respecifying the levels as empty.
+	// that includes levels a cancelled upload had already allocated
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, newResidentLevel);
+	for (int level = entry.uploadingLevel; level < newResidentLevel; level++)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		if (level >= entry.residentLevel)
+			m_residentBytes -= GetLevelSize(entry, level);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	entry.residentLevel = newResidentLevel;
+	entry.uploadingLevel = newResidentLevel;
+}
+
+size_t TextureStreamer::GetLevelSize(const StreamedTexture& entry, int level) const
+{
+	int width = std::max(1, entry.info.width >> level);
+	int height = std::max(1, entry.info.height >> level);
+	return GetMipLevelSize(IsUploadCompressed(entry) ? entry.info.format : TextureFormat::RGBA8, width, height);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+// streams texture mip levels in the background.
+// a streamed texture starts with only its smallest mips resident (or a 1x1 placeholder for pngs) and
+// finer levels are read on a worker thread and uploaded coarsest first through a TextureUploadQueue.
+// GL_TEXTURE_BASE_LEVEL is clamped to the finest fully uploaded level so the texture is always complete and
+// safe to sample.
+
+#include "Texture.h"
+#include "TextureFile.h"
+#include "TextureUploadQueue.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TextureStreamer
+{
+public:
+	TextureStreamer() = default;
+	~TextureStreamer();
+
+	// the upload budgets cap how many bytes and how much CPU time a frame spends issuing texture uploads
+	void Init(size_t memoryBudget = 256 * 1024 * 1024, size_t uploadBudgetPerFrame = 4 * 1024 * 1024, double uploadMsPerFrame = 2.0);
+	void Dispose();
+
+	// returns straight away with a texture that is valid to bind. .ktx files stream individual levels,
+	// anything else is decoded (and mipped) on the worker thread. a resident texture wants every level from the
+	// start whether it's drawn or not and is never evicted, the same as a plain load but read and uploaded in
+	// the background
+	Texture* LoadTexture(const char* path, bool resident = false);
+	void UnloadTexture(Texture* texture);
+
+	// main thread, once per frame: collects usage, queues reads, uploads finished levels, evicts
+	void Update();
+
+	size_t GetResidentBytes() const { return m_residentBytes; }
+	const TextureUploadStats& GetUploadStats() const { return m_uploadQueue.GetStats(); }
+
+private:
+	struct StreamedTexture
+	{
+		unsigned int id; // requests refer to the id, the Texture* may be freed and reused while they're in flight
+		Texture* texture;
+		std::string path;
+		bool isKtx;
+		TextureFileInfo info; // levelOffsets is empty for non-ktx sources
+		int numLevels;
+		int tailLevel;     // coarse levels that are always kept resident
+		int residentLevel; // finest level uploaded, everything coarser is resident too. numLevels = placeholder only
+		int uploadingLevel; // finest level handed to the upload queue, residentLevel if none are in it
+		int wantedLevel;
+		int pendingLevel;  // finest level requested from the worker, numLevels if nothing is in flight
+		int requestsInFlight;
+		unsigned int lastUsedFrame;
+		bool failed; // the file couldn't be read, it stays at whatever is resident and is never requested again
+	};
+
+	struct LoadRequest
+	{
+		unsigned int id;
+		std::string path;
+		bool isKtx;
+		TextureFileInfo info;
+		int firstLevel; // finest level to read
+		int lastLevel;  // coarsest level to read
+	};
+
+	struct LoadedLevel
+	{
+		unsigned int id;
+		int level;
+		TextureMipLevel mip;
+	};
+
+	struct LoadResult
+	{
+		unsigned int id;
+		std::vector<LoadedLevel> levels;
+		bool failed = false;
+		bool classified = false; // a decoded png's alpha, the format alone doesn't say
+		AlphaMode alphaMode = AlphaMode::Translucent;
+	};
+
+	void WorkerThread();
+	void ProcessRequest(const LoadRequest& request, LoadResult& outResult);
+
+	StreamedTexture* FindEntry(unsigned int id);
+	bool IsUploadCompressed(const StreamedTexture& entry) const;
+	void UploadLevel(StreamedTexture& entry, int level, const TextureMipLevel& mip);
+	void FinishUpload(StreamedTexture& entry, int level);
+	void EvictLevels(StreamedTexture& entry, int newResidentLevel);
+	size_t GetLevelSize(const StreamedTexture& entry, int level) const;
+
+	std::vector<StreamedTexture> m_textures;
+	std::vector<LoadedLevel> m_readyLevels; // main thread only, waiting for the next coarser level to be queued
+
+	TextureUploadQueue m_uploadQueue;
+	std::vector<FinishedTextureUpload> m_finishedUploads;
+
+	size_t m_memoryBudget = 0;
+	size_t m_residentBytes = 0;
+	unsigned int m_frame = 0;
+	unsigned int m_nextId = 1;
+	bool m_hasS3tc = false;
+
+	// worker
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<LoadRequest> m_requests;
+	std::vector<LoadResult> m_completed;
+	bool m_quit = false;
+
+};
@@ -0,0 +1,317 @@
+#include "TextureUploadQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+TextureUploadQueue::~TextureUploadQueue()
+{
+	Dispose();
+}
+
+void TextureUploadQueue::Init(int numSlots, size_t slotSize, size_t byteBudgetPerFrame, double msBudgetPerFrame)
+{
+	m_numSlots = numSlots;
+	m_slotSize = slotSize;
+	m_byteBudgetPerFrame = byteBudgetPerFrame;
+	m_msBudgetPerFrame = msBudgetPerFrame;
+
+	m_slots.reset(new Slot[m_numSlots]);
+	for (int i = 0; i < m_numSlots; i++)
+	{
+		glGenBuffers(1, &m_slots[i].buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_slots[i].buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_slotSize, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_quit = false;
+	m_copyThread = std::thread(&TextureUploadQueue::CopyThread, this);
+}
+
+void TextureUploadQueue::Dispose()
+{
+	if (m_copyThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+			m_fillTasks.clear();
+		}
+		m_condition.notify_all();
+		m_copyThread.join();
+	}
+
+	// never initialised or already disposed, the destructor calls this again after an explicit Dispose and
+	// the GL context may be gone by then
+	if (!m_slots)
+		return;
+
+	for (int i = 0; i < m_numSlots; i++)
+	{
+		Slot& slot = m_slots[i];
+		if (slot.state == SlotState::Filling)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		if (slot.fence != 0)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_slots.reset();
+	m_numSlots = 0;
+	m_uploads.clear();
+	m_fillOrder.clear();
+}
+
+void TextureUploadQueue::Submit(unsigned int id, GLuint texture, int level, TextureFormat format, TextureMipLevel&& mip)
+{
+	std::unique_ptr<Upload> upload(new Upload());
+	upload->id = id;
+	upload->texture = texture;
+	upload->level = level;
+	upload->format = format;
+	upload->mip = std::move(mip);
+	upload->nextRow = 0;
+	upload->issuedRows = 0;
+	upload->chunksFilling = 0;
+	upload->cancelled = false;
+
+	// compressed levels can only be split on block rows
+	int rowUnit = IsCompressedFormat(format) ? 4 : 1;
+	size_t unitBytes = GetMipLevelSize(format, upload->mip.width, rowUnit);
+	upload->rowsPerChunk = static_cast<int>(m_slotSize / unitBytes) * rowUnit;
+
+	m_uploads.push_back(std::move(upload));
+}
+
+void TextureUploadQueue::Cancel(unsigned int id)
+{
+	for (std::unique_ptr<Upload>& upload : m_uploads)
+	{
+		if (upload->id == id)
+			upload->cancelled = true;
+	}
+}
+
+void TextureUploadQueue::Update(std::vector<FinishedTextureUpload>& outFinished)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	auto elapsedMs = [startTime]() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	};
+
+	m_stats.uploadedBytes = 0;
+	m_stats.chunks = 0;
+
+	// slots the GPU has finished copying out of can be mapped again
+	for (int i = 0; i < m_numSlots; i++)
+	{
+		Slot& slot = m_slots[i];
+		if (slot.state != SlotState::InFlight)
+			continue;
+
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			slot.state = SlotState::Free;
+		}
+	}
+
+	// issue filled slots in order, at least one per frame so a level can't be starved by the budget
+	while (!m_fillOrder.empty() && m_fillOrder.front()->filled.load(std::memory_order_acquire))
+	{
+		Slot* slot = m_fillOrder.front();
+		if (m_stats.chunks > 0 && (m_stats.uploadedBytes + slot->bytes > m_byteBudgetPerFrame || elapsedMs() > m_msBudgetPerFrame))
+			break;
+
+		m_fillOrder.pop_front();
+		IssueSlot(*slot, outFinished);
+	}
+
+	// hand the next chunks to free slots
+	int nextSlot = 0;
+	for (std::unique_ptr<Upload>& uploadPointer : m_uploads)
+	{
+		Upload& upload = *uploadPointer;
+		if (upload.cancelled)
+			continue;
+
+		// rows too wide for a slot go from client memory, once everything before them has been issued
+		if (upload.rowsPerChunk == 0)
+		{
+			if (!m_fillOrder.empty())
+				break;
+			if (m_stats.chunks > 0 && (m_stats.uploadedBytes + upload.mip.data.size() > m_byteBudgetPerFrame || elapsedMs() > m_msBudgetPerFrame))
+				break;
+			IssueDirect(upload, outFinished);
+			continue;
+		}
+
+		while (upload.nextRow < upload.mip.height)
+		{
+			while (nextSlot < m_numSlots && m_slots[nextSlot].state != SlotState::Free)
+				nextSlot++;
+			if (nextSlot == m_numSlots)
+				break;
+
+			Slot& slot = m_slots[nextSlot];
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+			// the fence has already said the GPU is done with it, so there's nothing to synchronize
+			void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_slotSize,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (destination == nullptr)
+			{
+				nextSlot = m_numSlots;
+				break;
+			}
+
+			slot.state = SlotState::Filling;
+			slot.filled.store(false, std::memory_order_relaxed);
+			slot.upload = &upload;
+			slot.firstRow = upload.nextRow;
+			slot.rowCount = std::min(upload.rowsPerChunk, upload.mip.height - upload.nextRow);
+			slot.bytes = GetMipLevelSize(upload.format, upload.mip.width, slot.rowCount);
+
+			size_t sourceOffset = GetMipLevelSize(upload.format, upload.mip.width, slot.firstRow);
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_fillTasks.push_back({ &slot, destination, upload.mip.data.data() + sourceOffset, slot.bytes });
+			}
+
+			m_fillOrder.push_back(&slot);
+			upload.nextRow += slot.rowCount;
+			upload.chunksFilling++;
+		}
+
+		if (nextSlot == m_numSlots)
+			break;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_condition.notify_one();
+
+	RemoveDoneUploads();
+
+	m_stats.pendingBytes = 0;
+	for (const std::unique_ptr<Upload>& upload : m_uploads)
+	{
+		if (!upload->cancelled)
+			m_stats.pendingBytes += upload->mip.data.size() - GetMipLevelSize(upload->format, upload->mip.width, upload->issuedRows);
+	}
+	m_stats.slotsInFlight = 0;
+	for (int i = 0; i < m_numSlots; i++)
+	{
+		if (m_slots[i].state != SlotState::Free)
+			m_stats.slotsInFlight++;
+	}
+	m_stats.uploadMs = elapsedMs();
+}
+
+void TextureUploadQueue::CopyThread()
+{
+	while (true)
+	{
+		FillTask task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_quit || !m_fillTasks.empty(); });
+			if (m_quit)
+				return;
+
+			task = m_fillTasks.front();
+			m_fillTasks.pop_front();
+		}
+
+		memcpy(task.destination, task.source, task.bytes);
+		task.slot->filled.store(true, std::memory_order_release);
+	}
+}
+
+void TextureUploadQueue::IssueSlot(Slot& slot, std::vector<FinishedTextureUpload>& outFinished)
+{
+	Upload& upload = *slot.upload;
+	upload.chunksFilling--;
+	slot.upload = nullptr;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (upload.cancelled)
+	{
+		slot.state = SlotState::Free;
+		return;
+	}
+
+	IssueRows(upload, slot.firstRow, slot.rowCount, slot.buffer, nullptr, slot.bytes);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = SlotState::InFlight;
+
+	m_stats.uploadedBytes += slot.bytes;
+	m_stats.chunks++;
+
+	if (upload.issuedRows == upload.mip.height)
+		outFinished.push_back({ upload.id, upload.level });
+}
+
+void TextureUploadQueue::IssueDirect(Upload& upload, std::vector<FinishedTextureUpload>& outFinished)
+{
+	IssueRows(upload, 0, upload.mip.height, 0, upload.mip.data.data(), upload.mip.data.size());
+	upload.nextRow = upload.mip.height;
+
+	m_stats.uploadedBytes += upload.mip.data.size();
+	m_stats.chunks++;
+	outFinished.push_back({ upload.id, upload.level });
+}
+
+void TextureUploadQueue::IssueRows(Upload& upload, int firstRow, int rowCount, GLuint unpackBuffer, const void* pixels, size_t bytes)
+{
+	const TextureMipLevel& mip = upload.mip;
+	bool compressed = IsCompressedFormat(upload.format);
+
+	glBindTexture(GL_TEXTURE_2D, upload.texture);
+
+	// the level's storage is allocated with its first chunk, before the slot is bound, since a NULL pointer
+	// would otherwise be read as an offset into it
+	if (upload.issuedRows == 0)
+	{
+		if (compressed)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, upload.level, GetGLInternalFormat(upload.format), mip.width, mip.height, 0,
+				static_cast<GLsizei>(mip.data.size()), NULL);
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, upload.level, GL_RGBA8, mip.width, mip.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+	}
+
+	// pixels is an offset into unpackBuffer when there is one
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+	if (compressed)
+	{
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, firstRow, mip.width, rowCount, GetGLInternalFormat(upload.format),
+			static_cast<GLsizei>(bytes), pixels);
+	}
+	else
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, firstRow, mip.width, rowCount, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	upload.issuedRows += rowCount;
+}
+
+void TextureUploadQueue::RemoveDoneUploads()
+{
+	m_uploads.erase(std::remove_if(m_uploads.begin(), m_uploads.end(), [](const std::unique_ptr<Upload>& upload) {
+		return upload->chunksFilling == 0 && (upload->cancelled || upload->issuedRows == upload->mip.height);
+	}), m_uploads.end());
+}
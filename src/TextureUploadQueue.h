@@ -0,0 +1,127 @@
+#pragma once
+
+// uploads texture levels through a ring of pixel buffer objects instead of straight from client memory.
+// each level is split into row chunks no bigger than one ring slot. the main thread maps free slots, a copy
+// thread fills them, and Update unmaps filled slots and issues glTexSubImage2D from them, fencing each slot
+// until the GPU has read it. chunks are issued in submission order and only up to the per frame byte and
+// time budgets, so a large level arrives over several frames instead of stalling one
+
+#include "TextureFile.h"
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TextureUploadStats
+{
+	size_t uploadedBytes;  // issued this frame
+	unsigned int chunks;   // issued this frame
+	double uploadMs;       // CPU time spent issuing this frame
+	size_t pendingBytes;   // submitted but not issued yet
+	unsigned int slotsInFlight;
+};
+
+// a level whose last chunk has been issued, it's safe to sample from now on
+struct FinishedTextureUpload
+{
+	unsigned int id;
+	int level;
+};
+
+class TextureUploadQueue
+{
+public:
+	TextureUploadQueue() = default;
+	~TextureUploadQueue();
+
+	// slotSize is the largest chunk, a level with rows bigger than that goes straight from client memory
+	void Init(int numSlots = 8, size_t slotSize = 1024 * 1024, size_t byteBudgetPerFrame = 4 * 1024 * 1024, double msBudgetPerFrame = 2.0);
+	void Dispose();
+
+	// queues a full level of texture. format is what the level is uploaded as, RGBA8 or a compressed format
+	// the driver supports. id is the caller's and only comes back through Update and Cancel
+	void Submit(unsigned int id, GLuint texture, int level, TextureFormat format, TextureMipLevel&& mip);
+	// drops everything submitted with id that hasn't been issued yet
+	void Cancel(unsigned int id);
+
+	// main thread, once per frame: recycles slots the GPU is done with, issues filled ones within the budget
+	// and maps free ones for the next chunks. levels completed this frame are appended to outFinished
+	void Update(std::vector<FinishedTextureUpload>& outFinished);
+
+	bool IsIdle() const { return m_uploads.empty(); }
+	const TextureUploadStats& GetStats() const { return m_stats; }
+
+private:
+	struct Upload
+	{
+		unsigned int id;
+		GLuint texture;
+		int level;
+		TextureFormat format;
+		TextureMipLevel mip;
+		int rowsPerChunk; // pixel rows, a multiple of 4 for compressed formats
+		int nextRow;      // first row not yet handed to a slot
+		int issuedRows;
+		int chunksFilling;
+		bool cancelled;
+	};
+
+	enum class SlotState
+	{
+		Free,
+		Filling, // mapped, waiting on the copy thread
+		InFlight // issued, waiting on the fence
+	};
+
+	struct Slot
+	{
+		GLuint buffer = 0;
+		SlotState state = SlotState::Free;
+		std::atomic<bool> filled{ false };
+		GLsync fence = 0;
+		Upload* upload = nullptr;
+		int firstRow = 0;
+		int rowCount = 0;
+		size_t bytes = 0;
+	};
+
+	struct FillTask
+	{
+		Slot* slot;
+		void* destination;
+		const uint8_t* source;
+		size_t bytes;
+	};
+
+	void CopyThread();
+	void IssueSlot(Slot& slot, std::vector<FinishedTextureUpload>& outFinished);
+	void IssueDirect(Upload& upload, std::vector<FinishedTextureUpload>& outFinished);
+	void IssueRows(Upload& upload, int firstRow, int rowCount, GLuint unpackBuffer, const void* pixels, size_t bytes);
+	void RemoveDoneUploads();
+
+	std::unique_ptr<Slot[]> m_slots;
+	int m_numSlots = 0;
+	size_t m_slotSize = 0;
+	size_t m_byteBudgetPerFrame = 0;
+	double m_msBudgetPerFrame = 0.0;
+
+	std::vector<std::unique_ptr<Upload>> m_uploads; // submission order
+	std::deque<Slot*> m_fillOrder;                  // slots in Filling, in the order they have to be issued
+
+	TextureUploadStats m_stats = { 0, 0, 0.0, 0, 0 };
+
+	// copy thread
+	std::thread m_copyThread;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<FillTask> m_fillTasks;
+	bool m_quit = false;
+
+};
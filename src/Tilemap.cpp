@@ -0,0 +1,242 @@
+#include "Tilemap.h"
+
+#include "Texture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+static const int kTilesPerChunk = Tilemap::kChunkSize * Tilemap::kChunkSize;
+
+void Tilemap::Init(int width, int height, float tileSize, Texture* tileset, int tilesetColumns, int tilesetRows, const std::vector<uint16_t>& tiles)
+{
+	assert(tiles.empty() || tiles.size() == (size_t)width * height);
+
+	m_width = width;
+	m_height = height;
+	m_tileSize = tileSize;
+	m_tileset = tileset;
+	m_tilesetColumns = std::max(1, tilesetColumns);
+	m_tilesetRows = std::max(1, tilesetRows);
+
+	if (tiles.empty())
+		m_tiles.assign((size_t)width * height, kEmptyTile);
+	else
+		m_tiles = tiles;
+	m_renderTiles = m_tiles;
+	m_edits.clear();
+
+	m_chunksWide = (width + kChunkSize - 1) / kChunkSize;
+	m_chunksHigh = (height + kChunkSize - 1) / kChunkSize;
+	m_chunks.assign((size_t)m_chunksWide * m_chunksHigh, Chunk());
+
+	// every chunk has the same quad layout, so one index buffer covers all of them. 4 vertices per tile
+	// keeps a full chunk under 65536, short indices are enough
+	std::vector<uint16_t> indices(kTilesPerChunk * 6);
+	for (int i = 0; i < kTilesPerChunk; i++)
+	{
+		uint16_t base = (uint16_t)(i * 4);
+		uint16_t* quad = &indices[i * 6];
+		quad[0] = base + 0;
+		quad[1] = base + 1;
+		quad[2] = base + 2;
+		quad[3] = base + 2;
+		quad[4] = base + 3;
+		quad[5] = base + 0;
+	}
+
+	// the element binding is VAO state, don't attach this to whatever happens to be bound
+	glBindVertexArray(0);
+	glGenBuffers(1, &m_indexBufferId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	m_stats = {};
+}
+
+void Tilemap::Dispose()
+{
+	for (Chunk& chunk : m_chunks)
+	{
+		if (chunk.vertexArrayId != 0)
+		{
+			glDeleteBuffers(1, &chunk.vertexBufferId);
+			glDeleteVertexArrays(1, &chunk.vertexArrayId);
+		}
+	}
+	m_chunks.clear();
+
+	glDeleteBuffers(1, &m_indexBufferId);
+	m_indexBufferId = 0;
+}
+
+void Tilemap::SetTile(int x, int y, uint16_t tile)
+{
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+		return;
+
+	uint32_t cell = (uint32_t)(y * m_width + x);
+	if (m_tiles[cell] == tile)
+		return;
+
+	m_tiles[cell] = tile;
+	m_edits.push_back({ cell, tile });
+}
+
+uint16_t Tilemap::GetTile(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+		return kEmptyTile;
+
+	return m_tiles[y * m_width + x];
+}
+
+void Tilemap::Record(RenderPacket& packet, const glm::vec2& viewMin, const glm::vec2& viewMax)
+{
+	TilemapDraw draw;
+	draw.tilemap = this;
+	draw.viewMin = viewMin;
+	draw.viewMax = viewMax;
+	draw.firstEdit = (unsigned int)packet.tileEdits.size();
+	draw.editCount = (unsigned int)m_edits.size();
+	packet.tilemaps.push_back(draw);
+
+	packet.tileEdits.insert(packet.tileEdits.end(), m_edits.begin(), m_edits.end());
+	m_edits.clear();
+}
+
+void Tilemap::ApplyEdits(const TileEdit* edits, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const TileEdit& edit = edits[i];
+		m_renderTiles[edit.cell] = edit.tile;
+
+		int x = (int)(edit.cell % (uint32_t)m_width);
+		int y = (int)(edit.cell / (uint32_t)m_width);
+		GetChunk(x / kChunkSize, y / kChunkSize).dirty = true;
+	}
+}
+
+void Tilemap::Draw(const glm::vec2& viewMin, const glm::vec2& viewMax)
+{
+	m_stats.visibleChunks = 0;
+	m_stats.rebuiltChunks = 0;
+	m_stats.drawCalls = 0;
+	m_stats.tiles = 0;
+
+	if (m_chunks.empty())
+		return;
+
+	// the chunks are a grid, so the visible ones are a rectangle of it and there's nothing to test per chunk
+	float chunkWorldSize = kChunkSize * m_tileSize;
+	int minX = std::max(0, (int)std::floor(viewMin.x / chunkWorldSize));
+	int minY = std::max(0, (int)std::floor(viewMin.y / chunkWorldSize));
+	int maxX = std::min(m_chunksWide - 1, (int)std::floor(viewMax.x / chunkWorldSize));
+	int maxY = std::min(m_chunksHigh - 1, (int)std::floor(viewMax.y / chunkWorldSize));
+	if (minX > maxX || minY > maxY)
+		return;
+
+	m_tileset->Bind();
+
+	for (int chunkY = minY; chunkY <= maxY; chunkY++)
+	{
+		for (int chunkX = minX; chunkX <= maxX; chunkX++)
+		{
+			m_stats.visibleChunks++;
+
+			// edits to chunks out of view wait until they come into view
+			Chunk& chunk = GetChunk(chunkX, chunkY);
+			if (chunk.dirty)
+			{
+				BuildChunk(chunkX, chunkY);
+				m_stats.rebuiltChunks++;
+			}
+
+			if (chunk.numTiles == 0)
+				continue;
+
+			glBindVertexArray(chunk.vertexArrayId);
+			glDrawElements(GL_TRIANGLES, chunk.numTiles * 6, GL_UNSIGNED_SHORT, (void*)0);
+			m_stats.drawCalls++;
+			m_stats.tiles += chunk.numTiles;
+		}
+	}
+
+	glBindVertexArray(0);
+}
+
+void Tilemap::BuildChunk(int chunkX, int chunkY)
+{
+	Chunk& chunk = GetChunk(chunkX, chunkY);
+	chunk.dirty = false;
+
+	int startX = chunkX * kChunkSize;
+	int startY = chunkY * kChunkSize;
+	int endX = std::min(startX + kChunkSize, m_width);
+	int endY = std::min(startY + kChunkSize, m_height);
+
+	// inset the uvs by half a texel so filtering never picks up the neighbouring tile
+	glm::vec2 cellSize(1.0f / m_tilesetColumns, 1.0f / m_tilesetRows);
+	glm::vec2 inset(0.0f);
+	if (m_tileset->GetWidth() > 0 && m_tileset->GetHeight() > 0)
+		inset = glm::vec2(0.5f / m_tileset->GetWidth(), 0.5f / m_tileset->GetHeight());
+
+	// empty tiles are skipped, so the quads are packed and the draw only covers the ones that exist
+	m_scratch.clear();
+	for (int y = startY; y < endY; y++)
+	{
+		for (int x = startX; x < endX; x++)
+		{
+			uint16_t tile = m_renderTiles[y * m_width + x];
+			if (tile == kEmptyTile)
+				continue;
+
+			int cell = tile - 1;
+			glm::vec2 uvMin = glm::vec2((float)(cell % m_tilesetColumns), (float)(cell / m_tilesetColumns % m_tilesetRows)) * cellSize + inset;
+			glm::vec2 uvMax = uvMin + cellSize - inset * 2.0f;
+
+			glm::vec2 topLeft(x * m_tileSize, y * m_tileSize);
+			glm::vec2 bottomRight = topLeft + glm::vec2(m_tileSize);
+
+			m_scratch.push_back({ topLeft, uvMin });
+			m_scratch.push_back({ glm::vec2(bottomRight.x, topLeft.y), glm::vec2(uvMax.x, uvMin.y) });
+			m_scratch.push_back({ bottomRight, uvMax });
+			m_scratch.push_back({ glm::vec2(topLeft.x, bottomRight.y), glm::vec2(uvMin.x, uvMax.y) });
+		}
+	}
+
+	chunk.numTiles = (unsigned int)(m_scratch.size() / 4);
+
+	if (chunk.vertexArrayId == 0)
+	{
+		if (chunk.numTiles == 0)
+			return;
+
+		glGenVertexArrays(1, &chunk.vertexArrayId);
+		glBindVertexArray(chunk.vertexArrayId);
+
+		// sized for a full chunk up front, so later edits are a sub data update and never reallocate
+		glGenBuffers(1, &chunk.vertexBufferId);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBufferId);
+		glBufferData(GL_ARRAY_BUFFER, kTilesPerChunk * 4 * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+		m_stats.gpuBytes += kTilesPerChunk * 4 * sizeof(Vertex);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBufferId);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+		glBindVertexArray(0);
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBufferId);
+	}
+
+	if (!m_scratch.empty())
+		glBufferSubData(GL_ARRAY_BUFFER, 0, m_scratch.size() * sizeof(Vertex), m_scratch.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// 2D tile layer split into kChunkSize x kChunkSize chunks. each chunk's quads live in their own static vertex
+// buffer that is only rebuilt when one of its tiles changes, and drawing walks just the chunks overlapping
+// the view rect, one glDrawElements each.
+// the tile grid is kept twice: the simulation edits its copy with SetTile, the edits travel to the render
+// thread in the frame's RenderPacket (see Record) and are applied to the render copy before drawing
+
+#include "RenderPacket.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Texture;
+
+struct TilemapStats
+{
+	unsigned int visibleChunks;
+	unsigned int rebuiltChunks;
+	unsigned int drawCalls;
+	unsigned int tiles;
+	size_t gpuBytes; // vertex data of every built chunk
+};
+
+class Tilemap
+{
+public:
+	static const int kChunkSize = 32;
+	static const uint16_t kEmptyTile = 0; // tile n > 0 is cell n - 1 of the tileset, row major from the top left
+
+	Tilemap() = default;
+	~Tilemap() {}
+
+	// tiles is width * height row major, or empty for a blank map. tileset is split into columns x rows cells
+	void Init(int width, int height, float tileSize, Texture* tileset, int tilesetColumns, int tilesetRows,
+		const std::vector<uint16_t>& tiles = std::vector<uint16_t>());
+	void Dispose(); // needs the GL context
+
+	// simulation side
+	void SetTile(int x, int y, uint16_t tile);
+	uint16_t GetTile(int x, int y) const;
+
+	// hands this frame's edits to the render side and queues a draw of everything inside the view rect,
+	// in map units with the origin at the map's top left
+	void Record(RenderPacket& packet, const glm::vec2& viewMin, const glm::vec2& viewMax);
+
+	// render side, expects the sprite program bound with the projection already offset by the camera
+	void ApplyEdits(const TileEdit* edits, size_t count);
+	void Draw(const glm::vec2& viewMin, const glm::vec2& viewMax);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	float GetTileSize() const { return m_tileSize; }
+	Texture* GetTileset() const { return m_tileset; }
+	int GetTilesetColumns() const { return m_tilesetColumns; }
+	int GetTilesetRows() const { return m_tilesetRows; }
+	const TilemapStats& GetStats() const { return m_stats; }
+
+private:
+	struct Chunk
+	{
+		GLuint vertexArrayId = 0;
+		GLuint vertexBufferId = 0;
+		unsigned int numTiles = 0;
+		bool dirty = true;
+	};
+
+	void BuildChunk(int chunkX, int chunkY);
+	Chunk& GetChunk(int chunkX, int chunkY) { return m_chunks[chunkY * m_chunksWide + chunkX]; }
+
+	int m_width = 0;
+	int m_height = 0;
+	float m_tileSize = 1.0f;
+	Texture* m_tileset = nullptr;
+	int m_tilesetColumns = 1;
+	int m_tilesetRows = 1;
+
+	// simulation side
+	std::vector<uint16_t> m_tiles;
+	std::vector<TileEdit> m_edits; // since the last Record
+
+	// render side
+	std::vector<uint16_t> m_renderTiles;
+	std::vector<Chunk> m_chunks;
+	int m_chunksWide = 0;
+	int m_chunksHigh = 0;
+	GLuint m_indexBufferId = 0; // the same quad indices for every chunk
+	std::vector<Vertex> m_scratch; // BuildChunk
+
+	TilemapStats m_stats = {};
+
+};
@@ -0,0 +1,156 @@
+#include "TilemapBenchmark.h"
+
+#include "RenderPacket.h"
+#include "Renderer.h"
+#include "SpriteKernels.h"
+#include "Texture.h"
+#include "Tilemap.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const float kTileSize = 16.0f;
+static const int kEditsPerFrame = 4;
+
+struct TilemapBenchmarkResult
+{
+	unsigned int drawCalls;
+	unsigned int tiles;
+	double cpuMs;
+	double frameMs;
+	unsigned int rebuiltChunks; // total over the measured frames
+};
+
+static TilemapBenchmarkResult RunPass(SDL_Window* window, Renderer& renderer, Tilemap& tilemap, const glm::vec2& viewSize, int frames, bool useSprites)
+{
+	TilemapBenchmarkResult result = { 0, 0, 0.0, 0.0, 0 };
+	RenderPacket packet;
+	srand(1234);
+
+	float mapSize = tilemap.GetWidth() * kTileSize;
+	glm::vec2 uvCell(1.0f / tilemap.GetTilesetColumns(), 1.0f / tilemap.GetTilesetRows());
+
+	const int warmupFrames = 10;
+	for (int frame = 0; frame < warmupFrames + frames; frame++)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		// diagonally across the map and back, so chunks keep coming into and going out of view
+		float t = (float)frame / (warmupFrames + frames);
+		float travel = (mapSize - std::max(viewSize.x, viewSize.y)) * (t < 0.5f ? t * 2.0f : 2.0f - t * 2.0f);
+		glm::vec2 viewMin(travel);
+		glm::vec2 viewMax = viewMin + viewSize;
+
+		int minX = (int)(viewMin.x / kTileSize);
+		int minY = (int)(viewMin.y / kTileSize);
+		int maxX = std::min(tilemap.GetWidth() - 1, (int)(viewMax.x / kTileSize));
+		int maxY = std::min(tilemap.GetHeight() - 1, (int)(viewMax.y / kTileSize));
+
+		for (int i = 0; i < kEditsPerFrame; i++)
+		{
+			int x = minX + rand() % (maxX - minX + 1);
+			int y = minY + rand() % (maxY - minY + 1);
+			tilemap.SetTile(x, y, tilemap.GetTile(x, y) == Tilemap::kEmptyTile ? 1 : Tilemap::kEmptyTile);
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		packet.Clear();
+		if (useSprites)
+		{
+			// what a map without chunks would do, every visible tile rebuilt every frame
+			Texture* tileset = tilemap.GetTileset();
+			unsigned int numTiles = 0;
+			for (int y = minY; y <= maxY; y++)
+			{
+				for (int x = minX; x <= maxX; x++)
+				{
+					uint16_t tile = tilemap.GetTile(x, y);
+					if (tile == Tilemap::kEmptyTile)
+						continue;
+
+					int cell = tile - 1;
+					glm::vec2 uvMin = glm::vec2((float)(cell % tilemap.GetTilesetColumns()), (float)(cell / tilemap.GetTilesetColumns())) * uvCell;
+					glm::vec2 centre = glm::vec2(x + 0.5f, y + 0.5f) * kTileSize - viewMin;
+					renderer.AddSprite(MakeSpriteInstance(centre, glm::vec2(kTileSize), 0.0f, glm::vec4(uvMin, uvMin + uvCell)), tileset);
+					numTiles++;
+				}
+			}
+			renderer.RecordFrame(packet);
+
+			if (frame >= warmupFrames)
+				result.tiles = numTiles;
+		}
+		else
+		{
+			tilemap.Record(packet, viewMin, viewMax);
+		}
+		renderer.DrawFrame(packet);
+
+		auto cpuEnd = std::chrono::steady_clock::now();
+
+		SDL_GL_SwapWindow(window);
+		glFinish();
+
+		auto endTime = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames)
+		{
+			if (useSprites)
+			{
+				// one texture, the renderer should merge every tile into one batch
+				result.drawCalls = renderer.GetStats().spriteDraws;
+			}
+			else
+			{
+				result.drawCalls = tilemap.GetStats().drawCalls;
+				result.tiles = tilemap.GetStats().tiles;
+				result.rebuiltChunks += tilemap.GetStats().rebuiltChunks;
+			}
+			result.cpuMs += std::chrono::duration<double, std::milli>(cpuEnd - startTime).count();
+			result.frameMs += std::chrono::duration<double, std::milli>(endTime - startTime).count();
+		}
+
+		SDL_PumpEvents();
+	}
+
+	result.cpuMs /= frames;
+	result.frameMs /= frames;
+	return result;
+}
+
+void RunTilemapBenchmark(SDL_Window* window, Renderer& renderer, const glm::vec2& viewSize, const char* tilesetPath, int mapSize, int frames)
+{
+	Texture tileset;
+	if (!tileset.LoadFromFile(tilesetPath))
+		return;
+
+	// one tile per tileset, so it works with any image. a tenth of the map is holes
+	srand(42);
+	std::vector<uint16_t> tiles((size_t)mapSize * mapSize);
+	for (uint16_t& tile : tiles)
+	{
+		tile = rand() % 10 == 0 ? Tilemap::kEmptyTile : 1;
+	}
+
+	Tilemap tilemap;
+	tilemap.Init(mapSize, mapSize, kTileSize, &tileset, 1, 1, tiles);
+
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+	TilemapBenchmarkResult chunked = RunPass(window, renderer, tilemap, viewSize, frames, false);
+	TilemapBenchmarkResult sprites = RunPass(window, renderer, tilemap, viewSize, frames, true);
+
+	printf("\n%d x %d tilemap, %d frames, %d edits/frame\n", mapSize, mapSize, frames, kEditsPerFrame);
+	printf("            draw calls   tiles   CPU (ms)   frame (ms)\n");
+	printf("chunked     %10u   %5u   %8.3f   %10.3f (%.2f chunks rebuilt/frame, %.1f MB)\n", chunked.drawCalls, chunked.tiles, chunked.cpuMs, chunked.frameMs,
+		(double)chunked.rebuiltChunks / frames, tilemap.GetStats().gpuBytes / (1024.0f * 1024.0f));
+	printf("sprites     %10u   %5u   %8.3f   %10.3f\n", sprites.drawCalls, sprites.tiles, sprites.cpuMs, sprites.frameMs);
+
+	tilemap.Dispose();
+}
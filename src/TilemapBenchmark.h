@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL.h>
+#include <glm/glm.hpp>
+
+class Renderer;
+
+// pans across a mapSize x mapSize tilemap for frames frames, changing a few tiles in view each frame, once with
+// Tilemap's cached chunks and once submitting the visible tiles as sprites every frame. prints draw calls,
+// CPU time (record + draw, before the swap) and frame time for both. viewSize is the area the renderer's projection
+// covers. needs a current GL context
+void RunTilemapBenchmark(SDL_Window* window, Renderer& renderer, const glm::vec2& viewSize, const char* tilesetPath, int mapSize, int frames = 300);
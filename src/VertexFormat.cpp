@@ -0,0 +1,429 @@
+#include "VertexFormat.h"
+
+#include "Mesh.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+const char* kVertexDecodeGLSL = R"(
+	uniform vec3 u_positionOffset;
+	uniform vec3 u_positionScale;
+
+	vec3 DecodePosition(vec3 p)
+	{
+		return u_positionOffset + p * u_positionScale;
+	}
+
+	// a_normal is declared as vec3, octahedral formats only fill in xy
+	vec3 DecodeNormal(vec3 n)
+	{
+	#ifdef VERTEX_OCT_NORMALS
+		vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+		if (v.z < 0.0)
+			v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+		return normalize(v);
+	#else
+		return n;
+	#endif
+	}
+)";
+
+static unsigned int Align4(unsigned int size)
+{
+    return (size + 3) & ~3u;
+}
+
+VertexFormat MakeVertexFormat(PositionEncoding position, NormalEncoding normal, TexCoordEncoding texCoord, bool skinned)
+{
+    VertexFormat format;
+    format.position = position;
+    format.normal = normal;
+    format.texCoord = texCoord;
+    format.skinned = skinned;
+
+    unsigned int offset = 0;
+
+    VertexAttribute& pos = format.attributes[0];
+    pos.size = 3;
+    pos.offset = offset;
+    switch (position)
+    {
+    case PositionEncoding::Unorm16:
+        pos.type = GL_UNSIGNED_SHORT;
+        pos.normalized = GL_TRUE;
+        offset += Align4(3 * sizeof(uint16_t));
+        break;
+    case PositionEncoding::Half16:
+        pos.type = GL_HALF_FLOAT;
+        pos.normalized = GL_FALSE;
+        offset += Align4(3 * sizeof(uint16_t));
+        break;
+    default:
+        pos.type = GL_FLOAT;
+        pos.normalized = GL_FALSE;
+        offset += 3 * sizeof(float);
+        break;
+    }
+
+    VertexAttribute& nrm = format.attributes[1];
+    nrm.offset = offset;
+    switch (normal)
+    {
+    case NormalEncoding::Oct8:
+        nrm.size = 2;
+        nrm.type = GL_BYTE;
+        nrm.normalized = GL_TRUE;
+        offset += Align4(2 * sizeof(int8_t));
+        break;
+    case NormalEncoding::Oct16:
+        nrm.size = 2;
+        nrm.type = GL_SHORT;
+        nrm.normalized = GL_TRUE;
+        offset += 2 * sizeof(int16_t);
+        break;
+    default:
+        nrm.size = 3;
+        nrm.type = GL_FLOAT;
+        nrm.normalized = GL_FALSE;
+        offset += 3 * sizeof(float);
+        break;
+    }
+
+    VertexAttribute& uv = format.attributes[2];
+    uv.size = 2;
+    uv.offset = offset;
+    switch (texCoord)
+    {
+    case TexCoordEncoding::Half16:
+        uv.type = GL_HALF_FLOAT;
+        uv.normalized = GL_FALSE;
+        offset += 2 * sizeof(uint16_t);
+        break;
+    default:
+        uv.type = GL_FLOAT;
+        uv.normalized = GL_FALSE;
+        offset += 2 * sizeof(float);
+        break;
+    }
+
+    format.skinOffset = offset;
+    if (skinned)
+        offset += 8;
+
+    format.stride = offset;
+    return format;
+}
+
+VertexFormat GetFullVertexFormat()
+{
+    return MakeVertexFormat(PositionEncoding::Float32, NormalEncoding::Float32, TexCoordEncoding::Float32);
+}
+
+VertexFormat GetCompactVertexFormat()
+{
+    return MakeVertexFormat(PositionEncoding::Unorm16, NormalEncoding::Oct8, TexCoordEncoding::Half16);
+}
+
+void SetupVertexAttributes(const VertexFormat& format)
+{
+    for (GLuint i = 0; i < 3; i++)
+    {
+        const VertexAttribute& attribute = format.attributes[i];
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, attribute.size, attribute.type, attribute.normalized, format.stride, (const void *)(size_t)attribute.offset);
+    }
+
+    if (format.skinned)
+    {
+        glEnableVertexAttribArray(6);
+        glVertexAttribIPointer(6, 4, GL_UNSIGNED_BYTE, format.stride, (const void *)(size_t)format.skinOffset);
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, GL_TRUE, format.stride, (const void *)(size_t)(format.skinOffset + 4));
+    }
+}
+
+// octahedral mapping of a unit vector onto -1..1 squared
+static glm::vec2 OctEncode(const glm::vec3& n)
+{
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (sum <= 0.0f)
+        return glm::vec2(0.0f);
+
+    glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+    if (n.z < 0.0f)
+    {
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+static glm::vec3 OctDecode(const glm::vec2& e)
+{
+    glm::vec3 v(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+    if (v.z < 0.0f)
+    {
+        glm::vec2 p = (1.0f - glm::abs(glm::vec2(v.y, v.x))) * glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+        v.x = p.x;
+        v.y = p.y;
+    }
+    return glm::normalize(v);
+}
+
+static uint16_t QuantizeUnorm16(float v)
+{
+    return static_cast<uint16_t>(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static int8_t QuantizeSnorm8(float v)
+{
+    return static_cast<int8_t>(roundf(glm::clamp(v, -1.0f, 1.0f) * 127.0f));
+}
+
+static int16_t QuantizeSnorm16(float v)
+{
+    return static_cast<int16_t>(roundf(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+// weights rounded so they still add up to exactly 255, the remainder goes to the largest
+static void QuantizeSkinWeights(const float weights[4], uint8_t out[4])
+{
+    float sum = weights[0] + weights[1] + weights[2] + weights[3];
+    float scale = sum > 0.0f ? 255.0f / sum : 0.0f;
+
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = static_cast<uint8_t>(glm::clamp(roundf(weights[i] * scale), 0.0f, 255.0f));
+        total += out[i];
+        if (weights[i] > weights[largest])
+            largest = i;
+    }
+    out[largest] = static_cast<uint8_t>(glm::clamp(out[largest] + 255 - total, 0, 255));
+}
+
+std::vector<uint8_t> EncodeVertices(const VertexFormat& format, const std::vector<MeshVertex>& vertices, VertexDequantization& outDequantization,
+    const std::vector<VertexSkin>* skins)
+{
+    glm::vec3 minBounds(FLT_MAX);
+    glm::vec3 maxBounds(-FLT_MAX);
+    for (const MeshVertex& vertex : vertices)
+    {
+        minBounds = glm::min(minBounds, vertex.position);
+        maxBounds = glm::max(maxBounds, vertex.position);
+    }
+
+    // flat axes still need a non zero scale to divide by
+    glm::vec3 extent = vertices.empty() ? glm::vec3(1.0f) : glm::max(maxBounds - minBounds, glm::vec3(1e-6f));
+
+    switch (format.position)
+    {
+    case PositionEncoding::Unorm16:
+        outDequantization.positionOffset = minBounds;
+        outDequantization.positionScale = extent;
+        break;
+    case PositionEncoding::Half16:
+        outDequantization.positionOffset = (minBounds + maxBounds) * 0.5f;
+        outDequantization.positionScale = extent * 0.5f;
+        break;
+    default:
+        outDequantization = VertexDequantization();
+        break;
+    }
+
+    std::vector<uint8_t> encoded(vertices.size() * format.stride, 0);
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const MeshVertex& vertex = vertices[i];
+        uint8_t* out = &encoded[i * format.stride];
+
+        uint8_t* pos = out + format.attributes[0].offset;
+        glm::vec3 p = (vertex.position - outDequantization.positionOffset) / outDequantization.positionScale;
+        switch (format.position)
+        {
+        case PositionEncoding::Unorm16:
+        {
+            uint16_t q[3] = { QuantizeUnorm16(p.x), QuantizeUnorm16(p.y), QuantizeUnorm16(p.z) };
+            memcpy(pos, q, sizeof(q));
+            break;
+        }
+        case PositionEncoding::Half16:
+        {
+            uint16_t q[3] = { glm::packHalf1x16(p.x), glm::packHalf1x16(p.y), glm::packHalf1x16(p.z) };
+            memcpy(pos, q, sizeof(q));
+            break;
+        }
+        default:
+            memcpy(pos, &vertex.position, sizeof(glm::vec3));
+            break;
+        }
+
+        uint8_t* nrm = out + format.attributes[1].offset;
+        glm::vec2 oct = OctEncode(vertex.normal);
+        switch (format.normal)
+        {
+        case NormalEncoding::Oct8:
+        {
+            int8_t q[2] = { QuantizeSnorm8(oct.x), QuantizeSnorm8(oct.y) };
+            memcpy(nrm, q, sizeof(q));
+            break;
+        }
+        case NormalEncoding::Oct16:
+        {
+            int16_t q[2] = { QuantizeSnorm16(oct.x), QuantizeSnorm16(oct.y) };
+            memcpy(nrm, q, sizeof(q));
+            break;
+        }
+        default:
+            memcpy(nrm, &vertex.normal, sizeof(glm::vec3));
+            break;
+        }
+
+        uint8_t* uv = out + format.attributes[2].offset;
+        switch (format.texCoord)
+        {
+        case TexCoordEncoding::Half16:
+        {
+            uint16_t q[2] = { glm::packHalf1x16(vertex.texCoord.x), glm::packHalf1x16(vertex.texCoord.y) };
+            memcpy(uv, q, sizeof(q));
+            break;
+        }
+        default:
+            memcpy(uv, &vertex.texCoord, sizeof(glm::vec2));
+            break;
+        }
+
+        // without skin data everything follows joint 0
+        if (format.skinned)
+        {
+            uint8_t* skin = out + format.skinOffset;
+            if (skins != nullptr)
+            {
+                memcpy(skin, (*skins)[i].joints, 4);
+                QuantizeSkinWeights((*skins)[i].weights, skin + 4);
+            }
+            else
+            {
+                skin[4] = 255;
+            }
+        }
+    }
+
+    return encoded;
+}
+
+// same maths the vertex shader does, for measuring
+static MeshVertex DecodeVertex(const VertexFormat& format, const uint8_t* in, const VertexDequantization& dequantization)
+{
+    MeshVertex vertex;
+
+    const uint8_t* pos = in + format.attributes[0].offset;
+    switch (format.position)
+    {
+    case PositionEncoding::Unorm16:
+    {
+        uint16_t q[3];
+        memcpy(q, pos, sizeof(q));
+        vertex.position = glm::vec3(q[0], q[1], q[2]) / 65535.0f;
+        break;
+    }
+    case PositionEncoding::Half16:
+    {
+        uint16_t q[3];
+        memcpy(q, pos, sizeof(q));
+        vertex.position = glm::vec3(glm::unpackHalf1x16(q[0]), glm::unpackHalf1x16(q[1]), glm::unpackHalf1x16(q[2]));
+        break;
+    }
+    default:
+        memcpy(&vertex.position, pos, sizeof(glm::vec3));
+        break;
+    }
+    vertex.position = dequantization.positionOffset + vertex.position * dequantization.positionScale;
+
+    const uint8_t* nrm = in + format.attributes[1].offset;
+    switch (format.normal)
+    {
+    case NormalEncoding::Oct8:
+    {
+        int8_t q[2];
+        memcpy(q, nrm, sizeof(q));
+        vertex.normal = OctDecode(glm::max(glm::vec2(q[0], q[1]) / 127.0f, glm::vec2(-1.0f)));
+        break;
+    }
+    case NormalEncoding::Oct16:
+    {
+        int16_t q[2];
+        memcpy(q, nrm, sizeof(q));
+        vertex.normal = OctDecode(glm::max(glm::vec2(q[0], q[1]) / 32767.0f, glm::vec2(-1.0f)));
+        break;
+    }
+    default:
+        memcpy(&vertex.normal, nrm, sizeof(glm::vec3));
+        break;
+    }
+
+    const uint8_t* uv = in + format.attributes[2].offset;
+    switch (format.texCoord)
+    {
+    case TexCoordEncoding::Half16:
+    {
+        uint16_t q[2];
+        memcpy(q, uv, sizeof(q));
+        vertex.texCoord = glm::vec2(glm::unpackHalf1x16(q[0]), glm::unpackHalf1x16(q[1]));
+        break;
+    }
+    default:
+        memcpy(&vertex.texCoord, uv, sizeof(glm::vec2));
+        break;
+    }
+
+    return vertex;
+}
+
+VertexPrecisionError MeasurePrecisionError(const VertexFormat& format, const std::vector<MeshVertex>& vertices,
+    const std::vector<uint8_t>& encoded, const VertexDequantization& dequantization)
+{
+    VertexPrecisionError error = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    glm::vec3 minBounds(FLT_MAX);
+    glm::vec3 maxBounds(-FLT_MAX);
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const MeshVertex& source = vertices[i];
+        MeshVertex decoded = DecodeVertex(format, &encoded[i * format.stride], dequantization);
+
+        minBounds = glm::min(minBounds, source.position);
+        maxBounds = glm::max(maxBounds, source.position);
+
+        error.maxPositionError = std::max(error.maxPositionError, glm::length(decoded.position - source.position));
+
+        // skip degenerate normals, they have no direction to lose
+        float sourceLength = glm::length(source.normal);
+        if (sourceLength > 0.0f)
+        {
+            float cosAngle = glm::clamp(glm::dot(decoded.normal, source.normal / sourceLength), -1.0f, 1.0f);
+            error.maxNormalError = std::max(error.maxNormalError, glm::degrees(acosf(cosAngle)));
+        }
+
+        glm::vec2 uvError = glm::abs(decoded.texCoord - source.texCoord);
+        error.maxTexCoordError = std::max(error.maxTexCoordError, std::max(uvError.x, uvError.y));
+    }
+
+    float diagonal = vertices.empty() ? 0.0f : glm::length(maxBounds - minBounds);
+    error.relativePositionError = diagonal > 0.0f ? error.maxPositionError / diagonal : 0.0f;
+
+    return error;
+}
+
+std::string GetVertexFormatDefines(const VertexFormat& format)
+{
+    std::string defines;
+    if (format.normal != NormalEncoding::Float32)
+        defines += "#define VERTEX_OCT_NORMALS\n";
+    return defines;
+}
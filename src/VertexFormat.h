@@ -0,0 +1,100 @@
+#pragma once
+
+// describes how a MeshVertex is packed into the vertex buffer, so the attribute setup and the shader
+// decode follow from the descriptor instead of assuming 8 floats.
+// quantized positions are stored relative to the mesh bounds and decoded in the vertex shader as
+// u_positionOffset + a_position * u_positionScale (see kVertexDecodeGLSL)
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshVertex;
+struct VertexSkin;
+
+enum class PositionEncoding
+{
+    Float32,
+    Unorm16, // 3x16 bit normalized over the bounds
+    Half16   // 3x half float, -1..1 around the bounds centre
+};
+
+enum class NormalEncoding
+{
+    Float32,
+    Oct8,  // octahedral, 2x8 bit snorm
+    Oct16  // octahedral, 2x16 bit snorm
+};
+
+enum class TexCoordEncoding
+{
+    Float32,
+    Half16
+};
+
+struct VertexAttribute
+{
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    unsigned int offset;
+};
+
+struct VertexFormat
+{
+    PositionEncoding position;
+    NormalEncoding normal;
+    TexCoordEncoding texCoord;
+
+    // skinned formats append 4 joint indices (u8, location 6, read as uvec4) and 4 weights
+    // (unorm8 summing to 255, location 7) after the texcoord. 3-5 are taken by instance matrices
+    bool skinned;
+
+    // filled in by MakeVertexFormat. locations are 0 = position, 1 = normal, 2 = texcoord
+    VertexAttribute attributes[3];
+    unsigned int skinOffset; // joints, the weights follow 4 bytes later
+    unsigned int stride;
+};
+
+// bounds transform for quantized positions
+struct VertexDequantization
+{
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
+struct VertexPrecisionError
+{
+    float maxPositionError;      // world units
+    float relativePositionError; // maxPositionError over the bounds diagonal
+    float maxNormalError;        // degrees
+    float maxTexCoordError;
+};
+
+VertexFormat MakeVertexFormat(PositionEncoding position, NormalEncoding normal, TexCoordEncoding texCoord, bool skinned = false);
+
+// 32 bytes, what meshes have always used
+VertexFormat GetFullVertexFormat();
+
+// 16 bytes: unorm16 positions, 8 bit octahedral normals, half uvs
+VertexFormat GetCompactVertexFormat();
+
+// enables and points attributes 0-2, and 6-7 for skinned formats, at the currently bound GL_ARRAY_BUFFER
+void SetupVertexAttributes(const VertexFormat& format);
+
+// packs vertices into format.stride sized records. skinned formats take one VertexSkin per vertex
+std::vector<uint8_t> EncodeVertices(const VertexFormat& format, const std::vector<MeshVertex>& vertices, VertexDequantization& outDequantization,
+    const std::vector<VertexSkin>* skins = nullptr);
+
+// decodes the packed data again and compares it against the source vertices
+VertexPrecisionError MeasurePrecisionError(const VertexFormat& format, const std::vector<MeshVertex>& vertices,
+    const std::vector<uint8_t>& encoded, const VertexDequantization& dequantization);
+
+// #defines that select the decode path in kVertexDecodeGLSL, goes after the #version line
+std::string GetVertexFormatDefines(const VertexFormat& format);
+
+// declares u_positionOffset/u_positionScale and DecodePosition(vec3)/DecodeNormal(vec3)
+extern const char* kVertexDecodeGLSL;
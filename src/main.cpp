@@ -1,13 +1,221 @@
 #include "Game.h"
+#include "InputLog.h"
+#include "JobBenchmark.h"
+#include "LightClusterBenchmark.h"
+#include "ObjBenchmark.h"
+#include "OcclusionBenchmark.h"
+#include "ParticleBenchmark.h"
+#include "ResourceManager.h"
+#include "SpriteBenchmark.h"
+#include "TextureBaker.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 constexpr int kScreenWidth = 960;
 constexpr int kScreenHeight = 540;
 
+// 3Dgame -bake <in.png> <out.ktx> [auto|rgba|bc1|bc3] [-nomips]
+static int RunBakeTool(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		printf("usage: %s -bake <in.png> <out.ktx> [auto|rgba|bc1|bc3] [-nomips]\n", argv[0]);
+		return 1;
+	}
+
+	// the optional arguments can come in either order
+	const char* format = "auto";
+	bool generateMips = true;
+	for (int i = 4; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-nomips") == 0)
+			generateMips = false;
+		else
+			format = argv[i];
+	}
+
+	bool ok;
+	if (strcmp(format, "rgba") == 0)
+		ok = BakeTexture(argv[2], argv[3], TextureFormat::RGBA8, generateMips);
+	else if (strcmp(format, "bc1") == 0)
+		ok = BakeTexture(argv[2], argv[3], TextureFormat::BC1, generateMips);
+	else if (strcmp(format, "bc3") == 0)
+		ok = BakeTexture(argv[2], argv[3], TextureFormat::BC3, generateMips);
+	else
+		ok = BakeTexture(argv[2], argv[3], generateMips);
+
+	return ok ? 0 : 1;
+}
+
 int main(int argc, char* argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "-bake") == 0)
+		return RunBakeTool(argc, argv);
+
+	// 3Dgame -jobbench [entities]
+	if (argc > 1 && strcmp(argv[1], "-jobbench") == 0)
+	{
+		RunJobBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+		return 0;
+	}
+
+	// 3Dgame -spritebench [sprites]
+	if (argc > 1 && strcmp(argv[1], "-spritebench") == 0)
+	{
+		return RunSpriteBenchmark(argc > 2 ? atoi(argv[2]) : 100000) ? 0 : 1;
+	}
+
+	// 3Dgame -particlebench [particles]
+	if (argc > 1 && strcmp(argv[1], "-particlebench") == 0)
+	{
+		RunParticleBenchmark(argc > 2 ? atoi(argv[2]) : 500000);
+		return 0;
+	}
+
+	// 3Dgame -animbench [characters]
+	if (argc > 1 && strcmp(argv[1], "-animbench") == 0)
+	{
+		Game game;
+		if (!game.Init(kScreenWidth, kScreenHeight, false, "animation benchmark"))
+			return 1;
+
+		return game.RunAnimationBenchmark(argc > 2 ? atoi(argv[2]) : 1000) ? 0 : 1;
+	}
+
+	// 3Dgame -objbench [triangles], 1M and 10M if not given
+	if (argc > 1 && strcmp(argv[1], "-objbench") == 0)
+	{
+		if (argc > 2)
+			return RunObjBenchmark(atoi(argv[2])) ? 0 : 1;
+
+		bool ok = RunObjBenchmark(1000000);
+		ok = RunObjBenchmark(10000000) && ok;
+		return ok ? 0 : 1;
+	}
+
+	// 3Dgame -occlusionbench [objects]
+	if (argc > 1 && strcmp(argv[1], "-occlusionbench") == 0)
+	{
+		RunOcclusionBenchmark(argc > 2 ? atoi(argv[2]) : 20000);
+		return 0;
+	}
+
+	// 3Dgame -lightbench [lights]
+	if (argc > 1 && strcmp(argv[1], "-lightbench") == 0)
+	{
+		RunLightClusterBenchmark(argc > 2 ? atoi(argv[2]) : 4000);
+		return 0;
+	}
+
+	// 3Dgame -meshbench <model.obj> [count] [lights], lights 0 skips the lit passes
+	if (argc > 2 && strcmp(argv[1], "-meshbench") == 0)
+	{
+		Game game;
+		if (!game.Init(kScreenWidth, kScreenHeight, false, "mesh benchmark"))
+			return 1;
+
+		game.RunMeshBenchmark(argv[2], argc > 3 ? atoi(argv[3]) : 10000, argc > 4 ? atoi(argv[4]) : 1000);
+		return 0;
+	}
+
+	// 3Dgame -tilebench [tileset.png] [size]
+	if (argc > 1 && strcmp(argv[1], "-tilebench") == 0)
+	{
+		Game game;
+		if (!game.Init(kScreenWidth, kScreenHeight, false, "tilemap benchmark"))
+			return 1;
+
+		std::string tileset = argc > 2 ? argv[2] : ResourceManager::GetTextureDirectory() + "Grass.png";
+		game.RunTilemapBenchmark(tileset.c_str(), argc > 3 ? atoi(argv[3]) : 1000);
+		return 0;
+	}
+
+	// 3Dgame -layerbench [sprites]
+	if (argc > 1 && strcmp(argv[1], "-layerbench") == 0)
+	{
+		Game game;
+		if (!game.Init(kScreenWidth, kScreenHeight, false, "sprite layer benchmark"))
+			return 1;
+
+		game.RunSpriteLayerBenchmark(argc > 2 ? atoi(argv[2]) : 20000);
+		return 0;
+	}
+
+	// 3Dgame -replay <log> [runs] [-headless] [-minscale <scale>] [-maxscale <scale>] [-targetms <ms>]
+	if (argc > 2 && strcmp(argv[1], "-replay") == 0)
+	{
+		InputLog log;
+		if (!log.Load(argv[2]))
+			return 1;
+
+		// the optional arguments can come in either order. the render scale is pinned at 1 unless given,
+		// so a run's timings don't depend on where dynamic resolution happened to settle
+		int runs = 5;
+		bool headless = false;
+		float minScale = 1.0f;
+		float maxScale = 1.0f;
+		float targetMs = 15.0f;
+		for (int i = 3; i < argc; i++)
+		{
+			if (strcmp(argv[i], "-headless") == 0)
+				headless = true;
+			else if (strcmp(argv[i], "-minscale") == 0 && i + 1 < argc)
+				minScale = (float)atof(argv[++i]);
+			else if (strcmp(argv[i], "-maxscale") == 0 && i + 1 < argc)
+				maxScale = (float)atof(argv[++i]);
+			else if (strcmp(argv[i], "-targetms") == 0 && i + 1 < argc)
+				targetMs = (float)atof(argv[++i]);
+			else
+			{
+				// anything else has to be the run count, a mistyped option shouldn't quietly become one
+				char* end = nullptr;
+				long value = strtol(argv[i], &end, 10);
+				if (end == argv[i] || *end != '\0' || value < 1 || value > INT_MAX)
+				{
+					printf("usage: %s -replay <log> [runs] [-headless] [-minscale <scale>] [-maxscale <scale>] [-targetms <ms>]\n", argv[0]);
+					return 1;
+				}
+				runs = (int)value;
+			}
+		}
+
+		Game game;
+		game.SetDynamicResolution(minScale, maxScale, targetMs);
+		if (headless ? !game.InitHeadless() : !game.Init(kScreenWidth, kScreenHeight, false, "replay"))
+			return 1;
+
+		game.RunReplay(log, runs);
+		return 0;
+	}
+
+	// 3Dgame [-latency <frames>] [-record <log>] [-minscale <scale>] [-maxscale <scale>] [-targetms <ms>],
+	// latency 0 runs update and render in turn on one thread. the scales bound the dynamic render resolution
 	Game game;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float targetMs = 15.0f;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "-latency") == 0)
+			game.SetFrameLatency(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "-record") == 0)
+			game.SetInputRecording(argv[i + 1]);
+		else if (strcmp(argv[i], "-minscale") == 0)
+			minScale = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-maxscale") == 0)
+			maxScale = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-targetms") == 0)
+			targetMs = (float)atof(argv[i + 1]);
+	}
+	game.SetDynamicResolution(minScale, maxScale, targetMs);
+
 	if (game.Init(kScreenWidth, kScreenHeight, false, "test"))
 		game.Run();
 
 	return 0;
-}
\ No newline at end of file
+}